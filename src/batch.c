@@ -0,0 +1,275 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "libsolver.h"
+
+// Batch mode
+// Boards are handed out to a pool of threads, each board is its own
+// libsolver handle while the token table is shared read only.
+//
+// Solver --batch [--threads N] [--out DIR] [--fill] <board|directory|list>...
+// A list is a text file with one board path per line.
+
+#define PATH_MAX_LENGTH 4096
+
+struct Board_Job {
+  char *path;
+  int status;
+  double parse_ms, fill_ms, total_ms;
+  uint32_t nets, footprints, pads, segments, arcs, vias, zones;
+};
+
+struct Batch {
+  struct Board_Job *jobs;
+  int count, capacity;
+  int next;
+  int fill;
+  const char *out;
+};
+
+static double now_ms(){
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec * 1e3 + time.tv_nsec / 1e6;
+}
+
+static int ends_with(const char *string, const char *suffix){
+  size_t length = strlen(string), suffix_length = strlen(suffix);
+  return length >= suffix_length && strcmp(string + length - suffix_length, suffix) == 0;
+}
+
+static void add_job(struct Batch *batch, const char *path){
+  if(batch->count == batch->capacity){
+    batch->capacity = batch->capacity ? batch->capacity * 2 : 64;
+    batch->jobs = realloc(batch->jobs, batch->capacity * sizeof(struct Board_Job));
+  }
+  struct Board_Job *job = &batch->jobs[batch->count++];
+  memset(job, 0, sizeof(struct Board_Job));
+  job->path = malloc(strlen(path) + 1);
+  strcpy(job->path, path);
+}
+
+static int compare_path(const void *_1, const void *_2){
+  return strcmp(*(char *const *)_1, *(char *const *)_2);
+}
+
+static int add_directory(struct Batch *batch, const char *path){
+  DIR *dir = opendir(path);
+  struct dirent *entry;
+  char **names = NULL;
+  int count = 0, capacity = 0;
+  if(dir == NULL){
+    perror("Error opening directory");
+    return -1;
+  }
+  while((entry = readdir(dir))){
+    if(!ends_with(entry->d_name, ".kicad_pcb")){
+      continue;
+    }
+    if(count == capacity){
+      capacity = capacity ? capacity * 2 : 64;
+      names = realloc(names, capacity * sizeof(char *));
+    }
+    names[count] = malloc(strlen(path) + strlen(entry->d_name) + 2);
+    sprintf(names[count++], "%s/%s", path, entry->d_name);
+  }
+  closedir(dir);
+  // Sorted so the summary comes out in the same order every night
+  qsort(names, count, sizeof(char *), compare_path);
+  for(int i = 0; i < count; i++){
+    add_job(batch, names[i]);
+    free(names[i]);
+  }
+  free(names);
+  return 0;
+}
+
+static int add_list(struct Batch *batch, const char *path){
+  char line[PATH_MAX_LENGTH];
+  FILE *file = fopen(path, "r");
+  if(file == NULL){
+    perror("Error opening list");
+    return -1;
+  }
+  while(fgets(line, sizeof(line), file)){
+    line[strcspn(line, "\r\n")] = '\0';
+    if(line[0] != '\0' && line[0] != '#'){
+      add_job(batch, line);
+    }
+  }
+  fclose(file);
+  return 0;
+}
+
+static int add_input(struct Batch *batch, const char *path){
+  struct stat info;
+  if(stat(path, &info) != 0){
+    perror(path);
+    return -1;
+  }
+  if(S_ISDIR(info.st_mode)){
+    return add_directory(batch, path);
+  }
+  if(ends_with(path, ".kicad_pcb")){
+    add_job(batch, path);
+    return 0;
+  }
+  return add_list(batch, path);
+}
+
+static void count_board(struct Board *board, struct Board_Job *job){
+  for(struct Net *net = solver_next_net(board, NULL); net; net = solver_next_net(board, net)){
+    job->nets++;
+  }
+  for(struct Footprint *footprint = solver_next_footprint(board, NULL); footprint; footprint = solver_next_footprint(board, footprint)){
+    job->footprints++;
+    for(struct Pad *pad = solver_next_pad(footprint, NULL); pad; pad = solver_next_pad(footprint, pad)){
+      job->pads++;
+    }
+  }
+  for(struct Track *track = solver_next_track(board, NULL); track; track = solver_next_track(board, track)){
+    job->segments += solver_track_type(track) == SOLVER_TRACK_SEGMENT;
+    job->arcs += solver_track_type(track) == SOLVER_TRACK_ARC;
+    job->vias += solver_track_type(track) == SOLVER_TRACK_VIA;
+  }
+  for(struct Zone *zone = solver_next_zone(board, NULL); zone; zone = solver_next_zone(board, zone)){
+    job->zones++;
+  }
+}
+
+// Per board results go next to the board, or into --out as <name>.stats
+static void write_results(struct Batch *batch, struct Board_Job *job, struct Board *board){
+  char path[PATH_MAX_LENGTH];
+  if(batch->out){
+    const char *name = strrchr(job->path, '/');
+    snprintf(path, sizeof(path), "%s/%s.stats", batch->out, name ? name + 1 : job->path);
+  }else{
+    snprintf(path, sizeof(path), "%s.stats", job->path);
+  }
+  FILE *file = fopen(path, "w");
+  if(file == NULL){
+    perror(path);
+    return;
+  }
+  fprintf(file, "board %s\n", job->path);
+  fprintf(file, "status %s\n", job->status == 0 ? "ok" : "error");
+  fprintf(file, "nets %u\nfootprints %u\npads %u\n", job->nets, job->footprints, job->pads);
+  fprintf(file, "segments %u\narcs %u\nvias %u\nzones %u\n", job->segments, job->arcs, job->vias, job->zones);
+  for(struct Zone *zone = board ? solver_next_zone(board, NULL) : NULL; batch->fill && zone; zone = solver_next_zone(board, zone)){
+    int points;
+    char uuid[SOLVER_UUID_SIZE];
+    int polygons = solver_zone_filled(zone, &points);
+    fprintf(file, "zone %s polygons %d points %d\n", solver_zone_uuid(zone, uuid), polygons, points);
+  }
+  fprintf(file, "parse_ms %.3f\nfill_ms %.3f\ntotal_ms %.3f\n", job->parse_ms, job->fill_ms, job->total_ms);
+  fclose(file);
+}
+
+static void *batch_worker(void *arg){
+  struct Batch *batch = arg;
+  while(1){
+    int i = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED);
+    if(i >= batch->count){
+      break;
+    }
+    struct Board_Job *job = &batch->jobs[i];
+    double start = now_ms();
+    struct Board *board = solver_open(job->path);
+    job->status = board ? 0 : -1;
+    job->parse_ms = now_ms() - start;
+    if(board){
+      count_board(board, job);
+      if(batch->fill){
+        double fill_start = now_ms();
+        // Boards are already spread over the pool, one thread per board
+        solver_fill_zones(board, 0.01, 1);
+        job->fill_ms = now_ms() - fill_start;
+      }
+    }
+    job->total_ms = now_ms() - start;
+    write_results(batch, job, board);
+    solver_close(board);
+  }
+  return NULL;
+}
+
+static void print_summary(FILE *file, struct Batch *batch, double wall_ms, int threads){
+  int failed = 0;
+  double parse_ms = 0, fill_ms = 0;
+  fprintf(file, "board\tstatus\tparse_ms\tfill_ms\ttotal_ms\tfootprints\tpads\ttracks\tvias\tzones\n");
+  for(int i = 0; i < batch->count; i++){
+    struct Board_Job *job = &batch->jobs[i];
+    fprintf(file, "%s\t%s\t%.3f\t%.3f\t%.3f\t%u\t%u\t%u\t%u\t%u\n", job->path, job->status == 0 ? "ok" : "error",
+      job->parse_ms, job->fill_ms, job->total_ms, job->footprints, job->pads, job->segments + job->arcs, job->vias, job->zones);
+    failed += job->status != 0;
+    parse_ms += job->parse_ms;
+    fill_ms += job->fill_ms;
+  }
+  fprintf(file, "# boards %d failed %d threads %d wall_ms %.3f parse_ms %.3f fill_ms %.3f boards_per_s %.2f\n",
+    batch->count, failed, threads, wall_ms, parse_ms, fill_ms, wall_ms > 0 ? batch->count * 1e3 / wall_ms : 0);
+}
+
+// argv holds the options and inputs after --batch, returns 0 when every
+// board was processed
+int run_batch(int argc, char **argv){
+  struct Batch batch;
+  int threads = 0, status = 0;
+  memset(&batch, 0, sizeof(struct Batch));
+  for(int i = 0; i < argc; i++){
+    if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc){
+      threads = atoi(argv[++i]);
+    }else if(strcmp(argv[i], "--out") == 0 && i + 1 < argc){
+      batch.out = argv[++i];
+      mkdir(batch.out, 0755);
+    }else if(strcmp(argv[i], "--fill") == 0){
+      batch.fill = 1;
+    }else if(add_input(&batch, argv[i]) != 0){
+      status = -1;
+    }
+  }
+  if(batch.count == 0){
+    printf("No boards specified\n");
+    free(batch.jobs);
+    return -1;
+  }
+  if(threads <= 0){
+    threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  if(threads > batch.count){
+    threads = batch.count;
+  }
+
+  double start = now_ms();
+  pthread_t *workers = malloc(threads * sizeof(pthread_t));
+  for(int i = 0; i < threads; i++){
+    pthread_create(&workers[i], NULL, batch_worker, &batch);
+  }
+  for(int i = 0; i < threads; i++){
+    pthread_join(workers[i], NULL);
+  }
+  free(workers);
+  double wall_ms = now_ms() - start;
+
+  print_summary(stdout, &batch, wall_ms, threads);
+  if(batch.out){
+    char path[PATH_MAX_LENGTH];
+    snprintf(path, sizeof(path), "%s/summary.tsv", batch.out);
+    FILE *file = fopen(path, "w");
+    if(file){
+      print_summary(file, &batch, wall_ms, threads);
+      fclose(file);
+    }
+  }
+  for(int i = 0; i < batch.count; i++){
+    status = batch.jobs[i].status == 0 ? status : -1;
+    free(batch.jobs[i].path);
+  }
+  free(batch.jobs);
+  return status;
+}
@@ -0,0 +1,220 @@
+#include <stdio.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "solver.h"
+
+// Parser benchmark
+// Generates boards of a few fixed sizes, parses each one several times and
+// keeps the fastest run. Every case is reported as one JSON line so runs
+// from different commits can be compared by a script.
+//
+// Bench [--case small|medium|large|all|route|route_N] [--repeat N] [--dir DIR]
+//       [--out FILE] [--threads N] [--footprints N] [--pads N] [--segments N]
+//       [--vias N] [--nets N] [--zones N] [--fill-points N] [--seed N]
+// Any count option replaces the presets with one "custom" case. The parser
+// still talks on stdout, so the JSON goes to a file, bench.json unless
+// --out says otherwise, and the readable report goes to stderr.
+//
+// The route cases time the router instead, on boards of local two pad nets
+// that get denser as the pads per footprint go up. "route" runs them all.
+
+struct Bench_Case {
+  const char *name;
+  struct Generator generator;
+};
+
+// Sized so the whole suite runs in a minute or two with the current parser
+static const struct Bench_Case presets[] = {
+  {"small", {100, 8, 2000, 200, 100, 2, 500, 1}},
+  {"medium", {400, 12, 6000, 600, 300, 4, 4000, 1}},
+  {"large", {1000, 16, 12000, 1200, 600, 4, 10000, 1}},
+};
+
+// Same footprint grid, more pads and nets to route through it
+static const struct Bench_Case route_presets[] = {
+  {"route_4", {225, 4, 0, 0, 451, 0, 0, 1, TRUE}},
+  {"route_8", {225, 8, 0, 0, 901, 0, 0, 1, TRUE}},
+  {"route_12", {225, 12, 0, 0, 1351, 0, 0, 1, TRUE}},
+  {"route_16", {225, 16, 0, 0, 1801, 0, 0, 1, TRUE}},
+};
+
+struct Bench_Result {
+  double open_seconds, free_seconds;
+  struct Parse_Timing timings[64];
+  int timing_count;
+};
+
+static double seconds(){
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static long peak_rss_kb(){
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+static int run_once(const char *path, struct Bench_Result *result){
+  struct Parse_Timing *timings;
+  pcb = calloc(1, sizeof(struct Board));
+  parse_timings_reset();
+  double start = seconds();
+  int status = open_pcb(path);
+  double parsed = seconds();
+  free_pcb();
+  pcb = NULL;
+  result->open_seconds = parsed - start;
+  result->free_seconds = seconds() - parsed;
+  result->timing_count = parse_timings(&timings);
+  memcpy(result->timings, timings, result->timing_count * sizeof(struct Parse_Timing));
+  return status;
+}
+
+static int run_case(const struct Bench_Case *bench_case, int repeat, const char *dir, FILE *out){
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/bench_%s.kicad_pcb", dir, bench_case->name);
+  FILE *file = fopen(path, "w");
+  if(file == NULL){
+    perror(path);
+    return ERROR;
+  }
+  uint64_t items = generate_board(file, &bench_case->generator);
+  long bytes = ftell(file);
+  fclose(file);
+
+  struct Bench_Result best, result;
+  memset(&best, 0, sizeof(best));
+  for(int i = 0; i < repeat; i++){
+    if(run_once(path, &result) == ERROR){
+      remove(path);
+      return ERROR;
+    }
+    if(i == 0 || result.open_seconds < best.open_seconds){
+      best.open_seconds = result.open_seconds;
+      best.timing_count = result.timing_count;
+      memcpy(best.timings, result.timings, sizeof(result.timings));
+    }
+    if(i == 0 || result.free_seconds < best.free_seconds){
+      best.free_seconds = result.free_seconds;
+    }
+  }
+  remove(path);
+
+  long rss = peak_rss_kb();
+  fprintf(stderr, "%-8s %8.2f MB %10.1f ms open %8.1f ms free %8.1f MB/s %12.0f items/s %8ld KB peak\n", bench_case->name, bytes / 1e6,
+    best.open_seconds * 1e3, best.free_seconds * 1e3, bytes / 1e6 / best.open_seconds, items / best.open_seconds, rss);
+  fprintf(out, "{\"case\":\"%s\",\"bytes\":%ld,\"items\":%llu,\"repeat\":%d,\"open_ms\":%.3f,\"free_ms\":%.3f,\"mb_per_s\":%.3f,\"items_per_s\":%.0f,\"peak_rss_kb\":%ld,\"classes\":{",
+    bench_case->name, bytes, (unsigned long long)items, repeat, best.open_seconds * 1e3, best.free_seconds * 1e3, bytes / 1e6 / best.open_seconds, items / best.open_seconds, rss);
+  for(int i = 0; i < best.timing_count; i++){
+    fprintf(stderr, "    %-20s %10llu %10.3f ms\n", best.timings[i].name, (unsigned long long)best.timings[i].count, best.timings[i].seconds * 1e3);
+    fprintf(out, "%s\"%s\":{\"count\":%llu,\"ms\":%.3f}", i ? "," : "", best.timings[i].name, (unsigned long long)best.timings[i].count, best.timings[i].seconds * 1e3);
+  }
+  fprintf(out, "}}\n");
+  fflush(out);
+  return SUCCESS;
+}
+
+// Routes a fresh parse of the board each repeat and keeps the fastest
+static int run_route_case(const struct Bench_Case *bench_case, int repeat, int threads, const char *dir, FILE *out){
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/bench_%s.kicad_pcb", dir, bench_case->name);
+  FILE *file = fopen(path, "w");
+  if(file == NULL){
+    perror(path);
+    return ERROR;
+  }
+  generate_board(file, &bench_case->generator);
+  fclose(file);
+
+  struct Route_Options options = {0, 0, 0, 0, 0, 0, threads};
+  struct Route_Stats stats;
+  double best = 0;
+  for(int i = 0; i < repeat; i++){
+    pcb = calloc(1, sizeof(struct Board));
+    if(open_pcb(path) == ERROR){
+      free_pcb();
+      pcb = NULL;
+      remove(path);
+      return ERROR;
+    }
+    double start = seconds();
+    route_board(&options, &stats);
+    double elapsed = seconds() - start;
+    free_pcb();
+    pcb = NULL;
+    best = i == 0 || elapsed < best ? elapsed : best;
+  }
+  remove(path);
+
+  const struct Generator *generator = &bench_case->generator;
+  fprintf(stderr, "%-8s %6u pads %6u/%-6u routed %4u shared %6u vias %9.1f mm %3u passes %10.1f ms\n", bench_case->name, generator->footprints * generator->pads,
+    stats.routed, stats.connections, stats.shared, stats.vias, stats.length, stats.iterations, best * 1e3);
+  fprintf(out, "{\"case\":\"%s\",\"footprints\":%u,\"pads\":%u,\"threads\":%d,\"repeat\":%d,\"connections\":%u,\"routed\":%u,\"shared\":%u,\"segments\":%u,\"vias\":%u,\"length_mm\":%.3f,\"passes\":%u,\"route_ms\":%.3f}\n",
+    bench_case->name, generator->footprints, generator->footprints * generator->pads, threads, repeat, stats.connections, stats.routed, stats.shared, stats.segments, stats.vias,
+    stats.length, stats.iterations, best * 1e3);
+  fflush(out);
+  return SUCCESS;
+}
+
+int main(int argc, char **argv){
+  const char *name = "all", *dir = "/tmp", *out_path = "bench.json";
+  int repeat = 3, threads = 0, custom = FALSE, status = SUCCESS;
+  struct Bench_Case custom_case = {"custom", presets[0].generator};
+  for(int i = 1; i + 1 < argc; i += 2){
+    uint32_t value = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+    if(strcmp(argv[i], "--case") == 0){
+      name = argv[i + 1];
+    }else if(strcmp(argv[i], "--repeat") == 0){
+      repeat = value > 0 ? value : 1;
+    }else if(strcmp(argv[i], "--dir") == 0){
+      dir = argv[i + 1];
+    }else if(strcmp(argv[i], "--out") == 0){
+      out_path = argv[i + 1];
+    }else if(strcmp(argv[i], "--threads") == 0){
+      threads = value;
+    }else if(strcmp(argv[i], "--seed") == 0){
+      custom_case.generator.seed = value;
+    }else{
+      uint32_t *count = strcmp(argv[i], "--footprints") == 0 ? &custom_case.generator.footprints :
+        strcmp(argv[i], "--pads") == 0 ? &custom_case.generator.pads :
+        strcmp(argv[i], "--segments") == 0 ? &custom_case.generator.segments :
+        strcmp(argv[i], "--vias") == 0 ? &custom_case.generator.vias :
+        strcmp(argv[i], "--nets") == 0 ? &custom_case.generator.nets :
+        strcmp(argv[i], "--zones") == 0 ? &custom_case.generator.zones :
+        strcmp(argv[i], "--fill-points") == 0 ? &custom_case.generator.fill_points : NULL;
+      if(count == NULL){
+        fprintf(stderr, "Unknown option %s\n", argv[i]);
+        return EXIT_FAILURE;
+      }
+      *count = value;
+      custom = TRUE;
+    }
+  }
+
+  FILE *out = fopen(out_path, "w");
+  if(out == NULL){
+    perror(out_path);
+    return EXIT_FAILURE;
+  }
+  token_table_init();
+  if(custom){
+    status = run_case(&custom_case, repeat, dir, out);
+  }else{
+    for(size_t i = 0; i < sizeof(presets) / sizeof(presets[0]); i++){
+      if(strcmp(name, "all") == 0 || strcmp(name, presets[i].name) == 0){
+        status = run_case(&presets[i], repeat, dir, out) == ERROR ? ERROR : status;
+      }
+    }
+    for(size_t i = 0; i < sizeof(route_presets) / sizeof(route_presets[0]); i++){
+      if(strcmp(name, "route") == 0 || strcmp(name, route_presets[i].name) == 0){
+        status = run_route_case(&route_presets[i], repeat, threads, dir, out) == ERROR ? ERROR : status;
+      }
+    }
+  }
+  token_table_free();
+  fclose(out);
+  return status == SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,253 @@
+#include <math.h>
+
+#include "solver.h"
+
+// Footprint bodies
+// Placements of one library footprint repeat the same pads, lines and model
+// in the footprint's own frame. After parsing, footprints whose local
+// geometry matches share one body: the body owns the line list, the model
+// and the pads' layer lists, every instance points at them. Pads stay per
+// instance since each carries its net, uuid and source offsets for the
+// writer, line uuids move to a per instance array.
+//
+// Geometry is compared at 0.1 um and 0.0001 degrees, pad angles relative to
+// the footprint's, so rotated placements still share.
+
+#define BODY_QUANTUM 1e4
+
+static int64_t quantise(float value){
+  return llround(value * BODY_QUANTUM);
+}
+
+static int64_t quantise_angle(float angle){
+  double relative = fmod(angle, 360.0);
+  relative += relative < 0 ? 360.0 : 0;
+  int64_t quantised = llround(relative * BODY_QUANTUM);
+  return quantised == llround(360.0 * BODY_QUANTUM) ? 0 : quantised;
+}
+
+static uint64_t mix(uint64_t hash, uint64_t value){
+  for(int i = 0; i < 8; i++){
+    hash = (hash ^ ((value >> (i * 8)) & 0xff)) * 0x100000001b3ull;
+  }
+  return hash;
+}
+
+static uint64_t body_hash(struct Footprint *footprint){
+  uint64_t hash = mix(0xcbf29ce484222325ull, (uintptr_t)footprint->library_link.chars);
+  for(struct Pad *pad = footprint->pads; pad; pad = pad->next){
+    hash = mix(hash, (uintptr_t)pad->num.chars);
+    hash = mix(hash, (uint64_t)pad->type << 32 | (uint32_t)pad->shape);
+    hash = mix(hash, quantise(pad->at.x));
+    hash = mix(hash, quantise(pad->at.y));
+    hash = mix(hash, quantise_angle(pad->at.angle - footprint->at.angle));
+    hash = mix(hash, quantise(pad->size.width));
+    hash = mix(hash, quantise(pad->size.height));
+    hash = mix(hash, quantise(pad->drill.diameter));
+    for(int i = 0; i < pad->layer_count; i++){
+      hash = mix(hash, (uintptr_t)pad->layers[i]);
+    }
+  }
+  for(struct Line *line = footprint->fp_lines; line; line = line->next){
+    hash = mix(hash, quantise(line->start.x));
+    hash = mix(hash, quantise(line->start.y));
+    hash = mix(hash, quantise(line->end.x));
+    hash = mix(hash, quantise(line->end.y));
+    hash = mix(hash, (uintptr_t)line->layer);
+  }
+  if(footprint->model){
+    hash = mix(hash, (uintptr_t)footprint->model->model.chars);
+  }
+  return hash;
+}
+
+static int pads_equal(struct Footprint *_1, struct Footprint *_2){
+  struct Pad *pad_1 = _1->pads, *pad_2 = _2->pads;
+  for(; pad_1 && pad_2; pad_1 = pad_1->next, pad_2 = pad_2->next){
+    if(pad_1->num.chars != pad_2->num.chars || pad_1->type != pad_2->type || pad_1->shape != pad_2->shape ||
+       pad_1->function != pad_2->function || pad_1->layer_count != pad_2->layer_count ||
+       quantise(pad_1->at.x) != quantise(pad_2->at.x) || quantise(pad_1->at.y) != quantise(pad_2->at.y) ||
+       quantise_angle(pad_1->at.angle - _1->at.angle) != quantise_angle(pad_2->at.angle - _2->at.angle) ||
+       quantise(pad_1->size.width) != quantise(pad_2->size.width) || quantise(pad_1->size.height) != quantise(pad_2->size.height) ||
+       quantise(pad_1->roundrect_rratio) != quantise(pad_2->roundrect_rratio) ||
+       pad_1->drill.oval != pad_2->drill.oval || quantise(pad_1->drill.diameter) != quantise(pad_2->drill.diameter) ||
+       quantise(pad_1->drill.width) != quantise(pad_2->drill.width) ||
+       quantise(pad_1->drill.offset.x) != quantise(pad_2->drill.offset.x) || quantise(pad_1->drill.offset.y) != quantise(pad_2->drill.offset.y)){
+      return FALSE;
+    }
+    for(int i = 0; i < pad_1->layer_count; i++){
+      if(pad_1->layers[i] != pad_2->layers[i]){
+        return FALSE;
+      }
+    }
+  }
+  return pad_1 == NULL && pad_2 == NULL;
+}
+
+static int lines_equal(struct Line *line_1, struct Line *line_2){
+  for(; line_1 && line_2; line_1 = line_1->next, line_2 = line_2->next){
+    if(quantise(line_1->start.x) != quantise(line_2->start.x) || quantise(line_1->start.y) != quantise(line_2->start.y) ||
+       quantise(line_1->end.x) != quantise(line_2->end.x) || quantise(line_1->end.y) != quantise(line_2->end.y) ||
+       line_1->layer != line_2->layer || quantise(line_1->stroke.width) != quantise(line_2->stroke.width) ||
+       line_1->stroke.type.chars != line_2->stroke.type.chars){
+      return FALSE;
+    }
+  }
+  return line_1 == NULL && line_2 == NULL;
+}
+
+static int models_equal(struct Model *_1, struct Model *_2){
+  if(_1 == NULL || _2 == NULL){
+    return _1 == _2;
+  }
+  struct XYZ xyz_1[3] = {_1->offset.xyz, _1->scale.xyz, _1->rotate.xyz};
+  struct XYZ xyz_2[3] = {_2->offset.xyz, _2->scale.xyz, _2->rotate.xyz};
+  for(int i = 0; i < 3; i++){
+    if(quantise(xyz_1[i].x) != quantise(xyz_2[i].x) || quantise(xyz_1[i].y) != quantise(xyz_2[i].y) || quantise(xyz_1[i].z) != quantise(xyz_2[i].z)){
+      return FALSE;
+    }
+  }
+  return _1->model.chars == _2->model.chars;
+}
+
+static void box_add(struct Box *box, struct Point point, float grow){
+  box->min_x = fminf(box->min_x, point.x - grow);
+  box->min_y = fminf(box->min_y, point.y - grow);
+  box->max_x = fmaxf(box->max_x, point.x + grow);
+  box->max_y = fmaxf(box->max_y, point.y + grow);
+}
+
+// Extent of pads and lines in the footprint's frame
+static struct Box local_box(struct Footprint *footprint){
+  struct Box box = {INFINITY, INFINITY, -INFINITY, -INFINITY};
+  struct Footprint origin = {0};
+  struct Point outline[PAD_OUTLINE_MAX];
+  for(struct Pad *pad = footprint->pads; pad; pad = pad->next){
+    struct Pad local = *pad;
+    local.at.angle -= footprint->at.angle;
+    int count = pad_outline(&origin, &local, 0, outline);
+    for(int i = 0; i < count; i++){
+      box_add(&box, outline[i], 0);
+    }
+  }
+  for(struct Line *line = footprint->fp_lines; line; line = line->next){
+    box_add(&box, line->start, line->stroke.width / 2);
+    box_add(&box, line->end, line->stroke.width / 2);
+  }
+  if(box.min_x > box.max_x){
+    box = (struct Box){0, 0, 0, 0};
+  }
+  return box;
+}
+
+static struct Footprint_Body *body_create(struct Footprint *footprint, uint64_t hash){
+  struct Footprint_Body *body = calloc(1, sizeof(struct Footprint_Body));
+  body->library_link = footprint->library_link;
+  body->hash = hash;
+  body->lines = footprint->fp_lines;
+  body->model = footprint->model;
+  for(struct Pad *pad = footprint->pads; pad; pad = pad->next, body->pad_count++);
+  for(struct Line *line = footprint->fp_lines; line; line = line->next, body->line_count++);
+  body->pad_layers = calloc(body->pad_count + 1, sizeof(struct Layer **));
+  uint32_t i = 0;
+  for(struct Pad *pad = footprint->pads; pad; pad = pad->next){
+    body->pad_layers[i++] = pad->layers;
+  }
+  body->box = local_box(footprint);
+  body->next = pcb->bodies;
+  pcb->bodies = body;
+  return body;
+}
+
+// Moves the line uuids out and points the instance at body's geometry,
+// freeing its own copies unless it is the footprint body was made from
+static void body_attach(struct Footprint *footprint, struct Footprint_Body *body, int first){
+  footprint->line_uuids = calloc(body->line_count + 1, sizeof(struct Uuid));
+  uint32_t i = 0;
+  for(struct Line *line = footprint->fp_lines; line; line = line->next){
+    footprint->line_uuids[i++] = line->uuid;
+  }
+  if(!first){
+    while(footprint->fp_lines){
+      struct Line *line = footprint->fp_lines;
+      footprint->fp_lines = line->next;
+      free(line);
+    }
+    free(footprint->model);
+    i = 0;
+    for(struct Pad *pad = footprint->pads; pad; pad = pad->next){
+      free(pad->layers);
+      pad->layers = body->pad_layers[i++];
+    }
+  }
+  footprint->fp_lines = body->lines;
+  footprint->model = body->model;
+  footprint->body = body;
+  body->instances++;
+}
+
+struct Body_Slot {
+  uint64_t hash;
+  struct Footprint_Body *body;
+  struct Footprint *first;
+};
+
+int footprint_bodies_init(){
+  uint32_t count = 0, capacity = 16;
+  for(struct Footprint *footprint = pcb->footprints; footprint; footprint = footprint->next, count++);
+  while(capacity < count * 2){
+    capacity *= 2;
+  }
+  struct Body_Slot *slots = calloc(capacity, sizeof(struct Body_Slot));
+  for(struct Footprint *footprint = pcb->footprints; footprint; footprint = footprint->next){
+    if(footprint->body){
+      continue;
+    }
+    uint64_t hash = body_hash(footprint);
+    uint32_t slot = (uint32_t)hash & (capacity - 1);
+    for(; slots[slot].body; slot = (slot + 1) & (capacity - 1)){
+      struct Footprint *first = slots[slot].first;
+      if(slots[slot].hash == hash && first->library_link.chars == footprint->library_link.chars &&
+         pads_equal(first, footprint) && lines_equal(first->fp_lines, footprint->fp_lines) && models_equal(first->model, footprint->model)){
+        break;
+      }
+    }
+    if(slots[slot].body == NULL){
+      slots[slot] = (struct Body_Slot){hash, body_create(footprint, hash), footprint};
+    }
+    body_attach(footprint, slots[slot].body, slots[slot].first == footprint);
+  }
+  free(slots);
+  return SUCCESS;
+}
+
+void footprint_bodies_free(struct Footprint_Body *bodies){
+  while(bodies){
+    struct Footprint_Body *body = bodies;
+    bodies = body->next;
+    while(body->lines){
+      struct Line *line = body->lines;
+      body->lines = line->next;
+      free(line);
+    }
+    for(uint32_t i = 0; i < body->pad_count; i++){
+      free(body->pad_layers[i]);
+    }
+    free(body->pad_layers);
+    free(body->model);
+    free(body);
+  }
+}
+
+// Board aligned box around the body as this footprint places it
+struct Box footprint_box(struct Footprint *footprint){
+  struct Box local = footprint->body->box, box = {INFINITY, INFINITY, -INFINITY, -INFINITY};
+  struct Point corners[4] = {{local.min_x, local.min_y}, {local.max_x, local.min_y}, {local.max_x, local.max_y}, {local.min_x, local.max_y}};
+  for(int i = 0; i < 4; i++){
+    struct Point corner = rotate_point(corners[i], footprint->at.angle);
+    corner.x += footprint->at.x;
+    corner.y += footprint->at.y;
+    box_add(&box, corner, 0);
+  }
+  return box;
+}
@@ -0,0 +1,523 @@
+#include <stdio.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "solver.h"
+
+// Courtyards
+// Each footprint's courtyard is what its lines, rects, circles, arcs and
+// polys on F.CrtYd or B.CrtYd chain into as placed. One closed chain is the
+// courtyard itself, several or open ones give their convex hull, and a
+// footprint with none falls back to the hull of its body box. Parts are
+// sorted on the left edge of their boxes and each sweeps right over the
+// parts starting before its right edge, on its own side of the board.
+// Pairs whose boxes meet are tested on the edge normals of both hulls, the
+// largest gap on any axis separates them. Parts closer than the clearance
+// are violations, overlapping ones also get the area of their
+// intersection. Sweeps start from parts taken in chunks by parallel
+// workers.
+//
+// Convex pairs stop there. When either courtyard is concave the hull gap
+// only rules pairs out, the rest are measured edge to edge on the
+// courtyards themselves and overlaps take their area from the signed
+// triangle fans of both, each pair of triangles clipped as convex hulls.
+//
+// With a board outline each courtyard is also measured against the
+// board's edges, parts outside it, crossing it or closer than the edge
+// clearance are reported. Footprints cutting the board themselves are not.
+//
+// The gap on an edge normal never exceeds the true distance, so near
+// corners of convex courtyards a clearance violation may be reported
+// early.
+
+#define COURTYARD_CHUNK 64
+#define COURTYARD_MAX_ERROR 0.01f
+#define COURTYARD_CLIP_LOCAL 16
+
+// first and count are the hull in the check's point pool, outline and
+// outline_count the courtyard, the hull itself unless ring is set for a
+// concave one. side is 1 for the back and cuts set when the footprint has
+// drawings on Edge.Cuts
+struct Courtyard_Part {
+  struct Footprint *footprint;
+  struct Box box;
+  int side, fallback, cuts;
+  int first, count, outline, outline_count;
+  struct Ring *ring;
+};
+
+// part_2 is -1 for the board edge
+struct Courtyard_Clash {
+  int part_1, part_2;
+  float gap;
+  double area;
+};
+
+struct Clash_List {
+  struct Courtyard_Clash *clashes;
+  int count, capacity;
+};
+
+struct Courtyard_Check {
+  struct Board *board;
+  struct Courtyard_Options options;
+  const struct Board_Outline *outline;
+  struct Courtyard_Part *parts;
+  int part_count, next;
+  struct Point *points;
+  int point_count, point_capacity;
+  struct Clash_List *lists;
+  int thread_id;
+  uint64_t candidates;
+};
+
+static void add_clash(struct Clash_List *list, struct Courtyard_Clash clash){
+  if(list->count == list->capacity){
+    list->capacity = list->capacity ? list->capacity * 2 : 256;
+    list->clashes = realloc(list->clashes, list->capacity * sizeof(struct Courtyard_Clash));
+  }
+  list->clashes[list->count++] = clash;
+}
+
+static int compare_points(const void *_1, const void *_2){
+  const struct Point *point_1 = _1, *point_2 = _2;
+  if(point_1->x != point_2->x){
+    return point_1->x < point_2->x ? -1 : 1;
+  }
+  return point_1->y < point_2->y ? -1 : point_1->y > point_2->y;
+}
+
+static double cross(struct Point o, struct Point _1, struct Point _2){
+  return (double)(_1.x - o.x) * (_2.y - o.y) - (double)(_1.y - o.y) * (_2.x - o.x);
+}
+
+// Monotone chain, points sorted in place, hull written to out with the
+// positive turn, returns its point count
+static int convex_hull(struct Point *points, int count, struct Point *out){
+  qsort(points, count, sizeof(struct Point), compare_points);
+  int hull = 0;
+  for(int i = 0; i < count; i++){
+    for(; hull >= 2 && cross(out[hull - 2], out[hull - 1], points[i]) <= 0; hull--);
+    out[hull++] = points[i];
+  }
+  for(int i = count - 2, lower = hull + 1; i >= 0; i--){
+    for(; hull >= lower && cross(out[hull - 2], out[hull - 1], points[i]) <= 0; hull--);
+    out[hull++] = points[i];
+  }
+  return hull > 1 ? hull - 1 : hull;
+}
+
+static void reserve_points(struct Courtyard_Check *check, int count){
+  if(check->point_count + count > check->point_capacity){
+    while(check->point_count + count > check->point_capacity){
+      check->point_capacity = check->point_capacity ? check->point_capacity * 2 : 4096;
+    }
+    check->points = realloc(check->points, check->point_capacity * sizeof(struct Point));
+  }
+}
+
+// Turns all one way, straight runs allowed
+static int is_convex(const struct Point *points, int count){
+  int sign = 0;
+  for(int i = 0; i < count; i++){
+    double turn = cross(points[i], points[(i + 1) % count], points[(i + 2) % count]);
+    int turn_sign = (turn > 0) - (turn < 0);
+    if(turn_sign && sign && turn_sign != sign){
+      return FALSE;
+    }
+    sign = turn_sign ? turn_sign : sign;
+  }
+  return TRUE;
+}
+
+// Hull of the courtyard chains placed on the board, the body box when the
+// footprint has none or they enclose nothing. A single closed chain that
+// is concave is kept after the hull.
+static void build_part(struct Courtyard_Check *check, struct Footprint *footprint, struct Courtyard_Part *part){
+  part->footprint = footprint;
+  part->side = footprint->layer && strcmp(footprint->layer->canonical_name.chars, "B.Cu") == 0;
+  part->ring = NULL;
+  struct Point *points;
+  int *sizes;
+  part->cuts = footprint_chains(footprint, "Edge.Cuts", 0, &points, &sizes) > 0;
+  free(points);
+  free(sizes);
+  int chains = footprint_chains(footprint, "F.CrtYd", COURTYARD_MAX_ERROR, &points, &sizes);
+  if(chains){
+    part->side = 0;
+  }else{
+    free(points);
+    free(sizes);
+    chains = footprint_chains(footprint, "B.CrtYd", COURTYARD_MAX_ERROR, &points, &sizes);
+    part->side = chains ? 1 : part->side;
+  }
+  int count = 0;
+  for(int i = 0; i < chains; i++){
+    count += abs(sizes[i]);
+  }
+  int single = chains == 1 && sizes[0] >= 3;
+  // The hull, up to one point more than it is built from, goes before the
+  // courtyard
+  reserve_points(check, 2 * (count > 4 ? count : 4) + 1);
+  struct Point *pool = check->points + check->point_count, *outline = pool + count + 1;
+  if(single){
+    memcpy(outline, points, count * sizeof(struct Point));
+  }
+  part->first = check->point_count;
+  part->count = count ? convex_hull(points, count, pool) : 0;
+  part->fallback = part->count < 3;
+  if(part->fallback){
+    struct Box local = footprint->body->box;
+    struct Point corners[4] = {{local.min_x, local.min_y}, {local.max_x, local.min_y}, {local.max_x, local.max_y}, {local.min_x, local.max_y}};
+    for(int i = 0; i < 4; i++){
+      corners[i] = rotate_point(corners[i], footprint->at.angle);
+      corners[i].x += footprint->at.x;
+      corners[i].y += footprint->at.y;
+    }
+    part->count = convex_hull(corners, 4, pool);
+    single = FALSE;
+  }
+  free(points);
+  free(sizes);
+  part->outline = part->first;
+  part->outline_count = part->count;
+  if(single && !is_convex(outline, count)){
+    memmove(pool + part->count, outline, count * sizeof(struct Point));
+    part->outline = part->first + part->count;
+    part->outline_count = count;
+    struct Polygon polygon = {0};
+    polygon.points = pool + part->count;
+    polygon.point_count = count;
+    part->ring = ring_create(&polygon);
+  }
+  check->point_count += part->count + (part->ring ? part->outline_count : 0);
+  part->box = (struct Box){INFINITY, INFINITY, -INFINITY, -INFINITY};
+  for(int i = 0; i < part->count; i++){
+    struct Point point = check->points[part->first + i];
+    part->box.min_x = fminf(part->box.min_x, point.x);
+    part->box.min_y = fminf(part->box.min_y, point.y);
+    part->box.max_x = fmaxf(part->box.max_x, point.x);
+    part->box.max_y = fmaxf(part->box.max_y, point.y);
+  }
+}
+
+// Largest gap between the projections of the two hulls on the edge
+// normals of either, negative when they overlap
+static float hull_gap(const struct Point *hull_1, int count_1, const struct Point *hull_2, int count_2){
+  double gap = -INFINITY;
+  for(int pass = 0; pass < 2; pass++){
+    const struct Point *edges = pass ? hull_2 : hull_1;
+    int edge_count = pass ? count_2 : count_1;
+    for(int e = 0; e < edge_count; e++){
+      struct Point start = edges[e], end = edges[(e + 1) % edge_count];
+      double nx = -(double)(end.y - start.y), ny = end.x - start.x, length = hypot(nx, ny);
+      if(length <= 0){
+        continue;
+      }
+      double min_1 = INFINITY, max_1 = -INFINITY, min_2 = INFINITY, max_2 = -INFINITY;
+      for(int i = 0; i < count_1; i++){
+        double projection = hull_1[i].x * nx + hull_1[i].y * ny;
+        min_1 = fmin(min_1, projection);
+        max_1 = fmax(max_1, projection);
+      }
+      for(int i = 0; i < count_2; i++){
+        double projection = hull_2[i].x * nx + hull_2[i].y * ny;
+        min_2 = fmin(min_2, projection);
+        max_2 = fmax(max_2, projection);
+      }
+      gap = fmax(gap, (fmax(min_1, min_2) - fmin(max_1, max_2)) / length);
+    }
+  }
+  return (float)gap;
+}
+
+// Area of the intersection of two convex hulls with the positive turn,
+// clipping the first by each edge of the second
+static double overlap_area(const struct Point *hull_1, int count_1, const struct Point *hull_2, int count_2){
+  int capacity = count_1 + count_2 + 1;
+  struct Point local[2 * COURTYARD_CLIP_LOCAL];
+  struct Point *polygon = capacity <= COURTYARD_CLIP_LOCAL ? local : malloc(2 * capacity * sizeof(struct Point)), *clipped = polygon + capacity;
+  memcpy(polygon, hull_1, count_1 * sizeof(struct Point));
+  int count = count_1;
+  for(int e = 0; e < count_2 && count > 0; e++){
+    struct Point start = hull_2[e], end = hull_2[(e + 1) % count_2];
+    int out = 0;
+    for(int i = 0; i < count; i++){
+      struct Point current = polygon[i], next = polygon[(i + 1) % count];
+      double side_1 = cross(start, end, current), side_2 = cross(start, end, next);
+      if(side_1 >= 0){
+        clipped[out++] = current;
+      }
+      if((side_1 >= 0) != (side_2 >= 0)){
+        double t = side_1 / (side_1 - side_2);
+        clipped[out++] = (struct Point){(float)(current.x + t * (next.x - current.x)), (float)(current.y + t * (next.y - current.y))};
+      }
+    }
+    memcpy(polygon, clipped, out * sizeof(struct Point));
+    count = out;
+  }
+  double area = 0;
+  for(int i = 0; i < count; i++){
+    struct Point current = polygon[i], next = polygon[(i + 1) % count];
+    area += (double)current.x * next.y - (double)next.x * current.y;
+  }
+  if(polygon != local){
+    free(polygon);
+  }
+  return fabs(area) / 2;
+}
+
+// The fan of triangles from the first point, turned positive, sign is
+// their turn before
+static int fan_triangle(const struct Point *points, int i, struct Point *triangle, struct Box *box){
+  triangle[0] = points[0];
+  triangle[1] = points[i];
+  triangle[2] = points[i + 1];
+  double turn = cross(triangle[0], triangle[1], triangle[2]);
+  if(turn < 0){
+    triangle[1] = points[i + 1];
+    triangle[2] = points[i];
+  }
+  *box = (struct Box){INFINITY, INFINITY, -INFINITY, -INFINITY};
+  for(int k = 0; k < 3; k++){
+    box->min_x = fminf(box->min_x, triangle[k].x);
+    box->min_y = fminf(box->min_y, triangle[k].y);
+    box->max_x = fmaxf(box->max_x, triangle[k].x);
+    box->max_y = fmaxf(box->max_y, triangle[k].y);
+  }
+  return (turn > 0) - (turn < 0);
+}
+
+// Area of the intersection of two simple polygons. Each is the signed sum
+// of its fan triangles, so the intersection is the signed sum of the
+// overlaps of every pair of them.
+static double polygon_overlap_area(const struct Point *points_1, int count_1, const struct Point *points_2, int count_2){
+  double area = 0;
+  struct Point triangle_1[3], triangle_2[3];
+  struct Box box_1, box_2;
+  for(int i = 1; i + 1 < count_1; i++){
+    int sign_1 = fan_triangle(points_1, i, triangle_1, &box_1);
+    for(int j = 1; sign_1 && j + 1 < count_2; j++){
+      int sign_2 = fan_triangle(points_2, j, triangle_2, &box_2);
+      if(sign_2 && box_1.min_x < box_2.max_x && box_2.min_x < box_1.max_x && box_1.min_y < box_2.max_y && box_2.min_y < box_1.max_y){
+        area += sign_1 * sign_2 * overlap_area(triangle_1, 3, triangle_2, 3);
+      }
+    }
+  }
+  return fabs(area);
+}
+
+// Edge to edge distance between two courtyards that do not meet. When
+// they do, the deepest any corner of either reaches into the other,
+// negated, and the area they share.
+static float concave_gap(const struct Ring *ring_1, const struct Ring *ring_2, const struct Point *points_1, int count_1, const struct Point *points_2, int count_2, double *area){
+  float distance = INFINITY;
+  *area = 0;
+  for(int i = 0; i < count_2 && distance > 0; i++){
+    distance = fminf(distance, ring_segment_distance(ring_1, points_2[i], points_2[(i + 1) % count_2]));
+  }
+  if(distance > 0 && !ring_contains_point(ring_1, points_2[0]) && !ring_contains_point(ring_2, points_1[0])){
+    return distance;
+  }
+  float depth = 0;
+  for(int i = 0; i < count_1; i++){
+    depth = ring_contains_point(ring_2, points_1[i]) ? fmaxf(depth, ring_point_distance(ring_2, points_1[i])) : depth;
+  }
+  for(int i = 0; i < count_2; i++){
+    depth = ring_contains_point(ring_1, points_2[i]) ? fmaxf(depth, ring_point_distance(ring_1, points_2[i])) : depth;
+  }
+  *area = polygon_overlap_area(points_1, count_1, points_2, count_2);
+  return -depth;
+}
+
+// Distance from the hull to the nearest board edge, negated when the hull
+// is off the board, 0 when it crosses an edge
+static float edge_gap(const struct Board_Outline *outline, const struct Point *hull, int count){
+  float distance = INFINITY;
+  for(int i = 0; i < count && distance > 0; i++){
+    distance = fminf(distance, board_edge_distance(outline, hull[i], hull[(i + 1) % count]));
+  }
+  return board_contains_point(outline, hull[0]) ? distance : -distance;
+}
+
+static void *courtyard_worker(void *arg){
+  struct Courtyard_Check *check = arg;
+  pcb = check->board;
+  int id = __atomic_fetch_add(&check->thread_id, 1, __ATOMIC_RELAXED);
+  struct Clash_List *list = &check->lists[id];
+  float clearance = check->options.clearance;
+  uint64_t candidates = 0;
+  while(TRUE){
+    int first = __atomic_fetch_add(&check->next, COURTYARD_CHUNK, __ATOMIC_RELAXED);
+    if(first >= check->part_count){
+      break;
+    }
+    int last = first + COURTYARD_CHUNK < check->part_count ? first + COURTYARD_CHUNK : check->part_count;
+    for(int i = first; i < last; i++){
+      const struct Courtyard_Part *part_1 = &check->parts[i];
+      if(check->outline && !part_1->cuts){
+        float gap = edge_gap(check->outline, check->points + part_1->outline, part_1->outline_count);
+        if(gap <= 0 || gap < check->options.edge_clearance){
+          add_clash(list, (struct Courtyard_Clash){i, -1, gap, 0});
+        }
+      }
+      for(int j = i + 1; j < check->part_count && check->parts[j].box.min_x < part_1->box.max_x + clearance; j++){
+        const struct Courtyard_Part *part_2 = &check->parts[j];
+        if(part_2->side != part_1->side || part_2->box.min_y >= part_1->box.max_y + clearance || part_1->box.min_y >= part_2->box.max_y + clearance){
+          continue;
+        }
+        candidates++;
+        const struct Point *hull_1 = check->points + part_1->first, *hull_2 = check->points + part_2->first;
+        float gap = hull_gap(hull_1, part_1->count, hull_2, part_2->count);
+        if(gap >= clearance){
+          continue;
+        }
+        double area = 0;
+        if(part_1->ring || part_2->ring){
+          // A convex partner gets a ring of its hull for the test
+          struct Polygon polygon = {0};
+          const struct Courtyard_Part *convex = part_1->ring ? part_2 : part_1;
+          polygon.points = check->points + convex->first;
+          polygon.point_count = convex->count;
+          struct Ring *ring = convex->ring ? NULL : ring_create(&polygon);
+          float hull = gap;
+          gap = concave_gap(part_1->ring ? part_1->ring : ring, part_2->ring ? part_2->ring : ring, check->points + part_1->outline, part_1->outline_count,
+            check->points + part_2->outline, part_2->outline_count, &area);
+          ring_free(ring);
+          // Crossing edges with no corner inside, the hulls give the depth
+          gap = gap == 0 && area > 0 ? hull : gap;
+          if(gap >= clearance){
+            continue;
+          }
+        }else if(gap < 0){
+          area = overlap_area(hull_1, part_1->count, hull_2, part_2->count);
+        }
+        add_clash(list, (struct Courtyard_Clash){i, j, gap, area});
+      }
+    }
+  }
+  __atomic_fetch_add(&check->candidates, candidates, __ATOMIC_RELAXED);
+  return NULL;
+}
+
+// Report
+
+static int compare_left(const void *_1, const void *_2){
+  const struct Courtyard_Part *part_1 = _1, *part_2 = _2;
+  return part_1->box.min_x < part_2->box.min_x ? -1 : part_1->box.min_x > part_2->box.min_x;
+}
+
+static int compare_clash(const void *_1, const void *_2){
+  const struct Courtyard_Clash *clash_1 = _1, *clash_2 = _2;
+  if(clash_1->area != clash_2->area){
+    return clash_1->area > clash_2->area ? -1 : 1;
+  }
+  return clash_1->gap < clash_2->gap ? -1 : clash_1->gap > clash_2->gap;
+}
+
+static const char *footprint_reference(const struct Footprint *footprint){
+  for(struct Footprint_Property *property = footprint->properties; property; property = property->next){
+    if(property->property && property->property->key.chars && strcmp(property->property->key.chars, "Reference") == 0){
+      return property->property->val.chars;
+    }
+  }
+  return NULL;
+}
+
+// Courtyards on the same side of the board closer than options->clearance
+// mm, 0 by default so only overlaps count, and courtyards off the board or
+// within options->edge_clearance of its edge when it has an outline. Runs
+// on every core when threads is 0. Returns the number of violations.
+int check_courtyards(const struct Courtyard_Options *options, FILE *report, struct Courtyard_Stats *stats){
+  struct Courtyard_Stats local_stats;
+  stats = stats ? stats : &local_stats;
+  memset(stats, 0, sizeof(struct Courtyard_Stats));
+  struct Courtyard_Check check;
+  memset(&check, 0, sizeof(check));
+  check.board = pcb;
+  check.options = *options;
+  check.options.clearance = fmaxf(options->clearance, 0);
+  check.options.edge_clearance = fmaxf(options->edge_clearance, 0);
+  if(pcb->outline == NULL){
+    board_outline_init(0);
+  }
+  check.outline = pcb->outline->rings ? pcb->outline : NULL;
+  int threads = options->threads > 0 ? options->threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+  threads = threads < 1 ? 1 : threads;
+
+  for(struct Footprint *footprint = pcb->footprints; footprint; footprint = footprint->next, check.part_count++);
+  check.parts = malloc((check.part_count ? check.part_count : 1) * sizeof(struct Courtyard_Part));
+  check.part_count = 0;
+  for(struct Footprint *footprint = pcb->footprints; footprint; footprint = footprint->next){
+    struct Courtyard_Part *part = &check.parts[check.part_count];
+    build_part(&check, footprint, part);
+    stats->missing += part->fallback;
+    // Nothing to collide without an area
+    check.part_count += part->count >= 3;
+  }
+  stats->footprints = check.part_count;
+  qsort(check.parts, check.part_count, sizeof(struct Courtyard_Part), compare_left);
+
+  check.lists = calloc(threads, sizeof(struct Clash_List));
+  pthread_t *thread = malloc(threads * sizeof(pthread_t));
+  for(int i = 0; i < threads; i++){
+    pthread_create(&thread[i], NULL, courtyard_worker, &check);
+  }
+  for(int i = 0; i < threads; i++){
+    pthread_join(thread[i], NULL);
+  }
+  free(thread);
+
+  int count = 0;
+  for(int t = 0; t < threads; t++){
+    count += check.lists[t].count;
+  }
+  struct Courtyard_Clash *clashes = malloc((count ? count : 1) * sizeof(struct Courtyard_Clash));
+  count = 0;
+  for(int t = 0; t < threads; t++){
+    if(check.lists[t].count > 0){
+      memcpy(clashes + count, check.lists[t].clashes, check.lists[t].count * sizeof(struct Courtyard_Clash));
+    }
+    count += check.lists[t].count;
+    free(check.lists[t].clashes);
+  }
+  free(check.lists);
+  qsort(clashes, count, sizeof(struct Courtyard_Clash), compare_clash);
+  stats->candidates = check.candidates;
+  stats->violations = count;
+  for(int i = 0; i < count; i++){
+    stats->edge += clashes[i].part_2 < 0;
+    stats->overlaps += clashes[i].part_2 >= 0 && clashes[i].gap < 0;
+    stats->area += clashes[i].area;
+  }
+
+  fprintf(report, "%u footprints, %u without courtyard, %llu candidates, %u overlaps, %u under %.4f mm, %.4f mm^2 overlapping, %u at the board edge\n",
+    stats->footprints, stats->missing, (unsigned long long)stats->candidates, stats->overlaps, stats->violations - stats->overlaps - stats->edge,
+    check.options.clearance, stats->area, stats->edge);
+  for(int i = 0; i < count; i++){
+    const struct Courtyard_Part *part_1 = &check.parts[clashes[i].part_1];
+    const char *reference_1 = footprint_reference(part_1->footprint);
+    if(clashes[i].part_2 < 0){
+      const char *state = clashes[i].gap < 0 ? "outside" : (clashes[i].gap == 0 ? "crosses" : "gap    ");
+      fprintf(report, "%-12s %-12s %s %s %8.4f mm\n", reference_1 ? reference_1 : "?", "Edge.Cuts", part_1->side ? "back " : "front", state, fabsf(clashes[i].gap));
+      continue;
+    }
+    const struct Courtyard_Part *part_2 = &check.parts[clashes[i].part_2];
+    const char *reference_2 = footprint_reference(part_2->footprint);
+    if(clashes[i].gap < 0){
+      fprintf(report, "%-12s %-12s %s overlap %8.4f mm area %10.4f mm^2\n", reference_1 ? reference_1 : "?", reference_2 ? reference_2 : "?",
+        part_1->side ? "back " : "front", -clashes[i].gap, clashes[i].area);
+    }else{
+      fprintf(report, "%-12s %-12s %s gap     %8.4f mm\n", reference_1 ? reference_1 : "?", reference_2 ? reference_2 : "?",
+        part_1->side ? "back " : "front", clashes[i].gap);
+    }
+  }
+  free(clashes);
+  for(int i = 0; i < check.part_count; i++){
+    ring_free(check.parts[i].ring);
+  }
+  free(check.points);
+  free(check.parts);
+  return count;
+}
@@ -0,0 +1,361 @@
+#include <stdio.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "solver.h"
+
+// Crosstalk
+// Every segment is a victim. The spatial index finds the segments of other
+// nets near it on its own layer and the copper layers either side, and
+// those within an angle of parallel couple over the length their
+// projections overlap. Each coupled piece gets a coefficient from its
+// centre spacing D and the victim's height H over its reference plane,
+// k = 1 / (1 + (D/H)^2), taken as the inductive ratio Lm/L with the
+// capacitive ratio Cm/C = k eeff/er, so a stripline has no far end
+// crosstalk. Near end crosstalk is (Lm/L + Cm/C) / 4, saturating once the
+// coupled delay reaches half the rise time. Far end crosstalk is
+// (Lm/L - Cm/C) / 2 times the coupled delay over the rise time, summed
+// along the run. Pieces are gathered per victim and aggressor net and
+// ranked. Victims are taken in chunks by parallel workers.
+
+#define CROSSTALK_SPACING 0.5f
+#define CROSSTALK_ANGLE 10.0f
+#define CROSSTALK_RISE_TIME 1.0f
+#define CROSSTALK_MIN_LENGTH 1.0f
+#define CROSSTALK_TOP 5
+#define CROSSTALK_CHUNK 256
+// mm/ns
+#define CROSSTALK_LIGHT 299.792458
+
+// Height over the nearest reference and the permittivity around a layer
+struct Crosstalk_Layer {
+  float height, epsilon_r, z;
+  int microstrip;
+};
+
+// One coupled piece, later one victim and aggressor net
+struct Coupling {
+  int victim, aggressor;
+  float spacing;
+  double length, next, delay, fext;
+};
+
+struct Coupling_List {
+  struct Coupling *couplings;
+  int count, capacity;
+};
+
+struct Crosstalk_Check {
+  struct Board *board;
+  struct Crosstalk_Options options;
+  struct Stack_Layer stack[STACK_MAX_LAYERS];
+  struct Crosstalk_Layer layers[STACK_MAX_LAYERS];
+  int stack_count;
+  // Stack index of each layer by ordinal, -1 off the stack
+  int stack_of[64];
+  struct Track **segments;
+  int segment_count, next;
+  struct Coupling_List *lists;
+  int thread_id;
+  uint64_t candidates;
+};
+
+struct Victim_Query {
+  struct Crosstalk_Check *check;
+  struct Coupling_List *list;
+  struct Segment *segment;
+  int net, layer;
+  uint64_t candidates;
+};
+
+static void add_coupling(struct Coupling_List *list, struct Coupling coupling){
+  if(list->count == list->capacity){
+    list->capacity = list->capacity ? list->capacity * 2 : 1024;
+    list->couplings = realloc(list->couplings, list->capacity * sizeof(struct Coupling));
+  }
+  list->couplings[list->count++] = coupling;
+}
+
+static int stack_index(const struct Crosstalk_Check *check, const struct Layer *layer){
+  return layer ? check->stack_of[layer->ordinal & 63] : -1;
+}
+
+// Heights to the nearest reference above and below, a side without one
+// leaves a microstrip on an outer layer
+static void build_layers(struct Crosstalk_Check *check){
+  float z = 0;
+  for(int i = 0; i < check->stack_count; i++){
+    check->layers[i].z = z;
+    z += check->stack[i].thickness + check->stack[i].below;
+  }
+  for(int i = 0; i < check->stack_count; i++){
+    struct Crosstalk_Layer *layer = &check->layers[i];
+    float up = INFINITY, down = INFINITY;
+    for(int j = i - 1; j >= 0 && up == INFINITY; j--){
+      up = check->stack[j].reference ? layer->z - check->layers[j].z - check->stack[j].thickness : INFINITY;
+    }
+    for(int j = i + 1; j < check->stack_count && down == INFINITY; j++){
+      down = check->stack[j].reference ? check->layers[j].z - layer->z - check->stack[i].thickness : INFINITY;
+    }
+    layer->height = fminf(up, down);
+    if(layer->height == INFINITY){
+      layer->height = z > 0 ? z : STACK_BOARD;
+    }
+    layer->microstrip = i == 0 || i == check->stack_count - 1;
+    float above = i > 0 ? check->stack[i - 1].epsilon_r : 0, below = i + 1 < check->stack_count ? check->stack[i].epsilon_r : 0;
+    layer->epsilon_r = above > 0 && below > 0 ? (above + below) / 2 : (above > 0 ? above : (below > 0 ? below : STACK_EPSILON_R));
+  }
+}
+
+static int couple(struct Item *item, void *context){
+  struct Victim_Query *query = context;
+  struct Crosstalk_Check *check = query->check;
+  if(item->kind != ITEM_TRACK || item->track->type != TRACK_TYPE_SEG || item->net == NULL || item->net->ordinal <= 0 || item->net->ordinal == query->net){
+    return TRUE;
+  }
+  struct Segment *victim = query->segment, *aggressor = &item->track->track.segment;
+  int layer = stack_index(check, aggressor->layer);
+  if(layer < 0 || abs(layer - query->layer) > 1){
+    return TRUE;
+  }
+  query->candidates++;
+  double dx = victim->end.x - victim->start.x, dy = victim->end.y - victim->start.y, length = hypot(dx, dy);
+  double ax = aggressor->end.x - aggressor->start.x, ay = aggressor->end.y - aggressor->start.y, aggressor_length = hypot(ax, ay);
+  if(length <= 0 || aggressor_length <= 0 || fabs(dx * ay - dy * ax) > sin(check->options.angle * M_PI / 180) * length * aggressor_length){
+    return TRUE;
+  }
+  // Overlap of the aggressor's projection onto the victim
+  double ux = dx / length, uy = dy / length;
+  double t0 = (aggressor->start.x - victim->start.x) * ux + (aggressor->start.y - victim->start.y) * uy;
+  double t1 = (aggressor->end.x - victim->start.x) * ux + (aggressor->end.y - victim->start.y) * uy;
+  double low = fmax(0, fmin(t0, t1)), high = fmin(length, fmax(t0, t1));
+  if(high - low <= 0 || t0 == t1){
+    return TRUE;
+  }
+  // Lateral offset of the aggressor from the victim's line at both ends of
+  // the overlap
+  double lateral = 0;
+  for(int end = 0; end < 2; end++){
+    double s = ((end ? high : low) - t0) / (t1 - t0);
+    double x = aggressor->start.x + s * ax - victim->start.x, y = aggressor->start.y + s * ay - victim->start.y;
+    lateral += fabs(x * uy - y * ux) / 2;
+  }
+  float spacing = (float)(lateral - (victim->width + aggressor->width) / 2);
+  if(spacing > check->options.max_spacing){
+    return TRUE;
+  }
+  const struct Crosstalk_Layer *own = &check->layers[query->layer];
+  double vertical = layer == query->layer ? 0 : fabs(check->layers[layer].z - own->z);
+  double distance = hypot(lateral, vertical), ratio = distance / own->height;
+  double k = 1 / (1 + ratio * ratio);
+  double epsilon_effective = own->epsilon_r;
+  if(own->microstrip){
+    epsilon_effective = (own->epsilon_r + 1) / 2 + (own->epsilon_r - 1) / 2 / sqrt(1 + 12 * own->height / fmax(victim->width, 1e-3));
+  }
+  double capacitive = k * epsilon_effective / own->epsilon_r;
+  double delay = (high - low) * sqrt(epsilon_effective) / CROSSTALK_LIGHT;
+  add_coupling(query->list, (struct Coupling){query->net, item->net->ordinal, spacing, high - low, (k + capacitive) / 4 * (high - low), delay,
+    (k - capacitive) / 2 * delay / check->options.rise_time});
+  return TRUE;
+}
+
+static void *crosstalk_worker(void *arg){
+  struct Crosstalk_Check *check = arg;
+  pcb = check->board;
+  int id = __atomic_fetch_add(&check->thread_id, 1, __ATOMIC_RELAXED);
+  struct Victim_Query query = {check, &check->lists[id], NULL, 0, 0, 0};
+  float reach = check->options.max_spacing;
+  while(TRUE){
+    int first = __atomic_fetch_add(&check->next, CROSSTALK_CHUNK, __ATOMIC_RELAXED);
+    if(first >= check->segment_count){
+      break;
+    }
+    int last = first + CROSSTALK_CHUNK < check->segment_count ? first + CROSSTALK_CHUNK : check->segment_count;
+    for(int i = first; i < last; i++){
+      struct Segment *segment = &check->segments[i]->track.segment;
+      query.segment = segment;
+      query.net = segment->net->ordinal;
+      query.layer = stack_index(check, segment->layer);
+      uint64_t layers = 0;
+      for(int l = query.layer - 1; l <= query.layer + 1; l++){
+        layers |= l >= 0 && l < check->stack_count ? layer_mask(check->stack[l].layer) : 0;
+      }
+      float grow = reach + segment->width;
+      struct Box box = {fminf(segment->start.x, segment->end.x) - grow, fminf(segment->start.y, segment->end.y) - grow,
+        fmaxf(segment->start.x, segment->end.x) + grow, fmaxf(segment->start.y, segment->end.y) + grow};
+      spatial_query(pcb->spatial, box, layers, couple, &query);
+    }
+  }
+  __atomic_fetch_add(&check->candidates, query.candidates, __ATOMIC_RELAXED);
+  return NULL;
+}
+
+// Report
+
+static int compare_nets(const void *_1, const void *_2){
+  const struct Coupling *coupling_1 = _1, *coupling_2 = _2;
+  if(coupling_1->victim != coupling_2->victim){
+    return coupling_1->victim - coupling_2->victim;
+  }
+  return coupling_1->aggressor - coupling_2->aggressor;
+}
+
+struct Victim {
+  int first, count;
+  double next, fext;
+};
+
+static int compare_noise(const void *_1, const void *_2){
+  const struct Coupling *coupling_1 = _1, *coupling_2 = _2;
+  double noise_1 = coupling_1->next + coupling_1->fext, noise_2 = coupling_2->next + coupling_2->fext;
+  return noise_1 > noise_2 ? -1 : noise_1 < noise_2;
+}
+
+static int compare_victim(const void *_1, const void *_2){
+  const struct Victim *victim_1 = _1, *victim_2 = _2;
+  double noise_1 = victim_1->next + victim_1->fext, noise_2 = victim_2->next + victim_2->fext;
+  return noise_1 > noise_2 ? -1 : noise_1 < noise_2;
+}
+
+// Ranks the aggressors of every net by near plus far end crosstalk for
+// segments of other nets within options->max_spacing on the same or an
+// adjacent copper layer. Zero options take the defaults: 0.5 mm, 10
+// degrees from parallel, 1 ns rise time, 1 mm of coupling, 5 aggressors
+// listed per victim, every core. Returns the number of victim nets.
+int check_crosstalk(const struct Crosstalk_Options *options, FILE *report, struct Crosstalk_Stats *stats){
+  struct Crosstalk_Stats local_stats;
+  stats = stats ? stats : &local_stats;
+  memset(stats, 0, sizeof(struct Crosstalk_Stats));
+  struct Crosstalk_Check check;
+  memset(&check, 0, sizeof(check));
+  check.board = pcb;
+  check.options = *options;
+  check.options.max_spacing = options->max_spacing > 0 ? options->max_spacing : CROSSTALK_SPACING;
+  check.options.angle = options->angle > 0 ? options->angle : CROSSTALK_ANGLE;
+  check.options.rise_time = options->rise_time > 0 ? options->rise_time : CROSSTALK_RISE_TIME;
+  check.options.min_length = options->min_length > 0 ? options->min_length : CROSSTALK_MIN_LENGTH;
+  int top = options->top > 0 ? options->top : CROSSTALK_TOP;
+  int threads = options->threads > 0 ? options->threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+  threads = threads < 1 ? 1 : threads;
+
+  check.stack_count = copper_stack(check.stack, STACK_MAX_LAYERS);
+  memset(check.stack_of, 0xff, sizeof(check.stack_of));
+  for(int i = 0; i < check.stack_count; i++){
+    check.stack_of[check.stack[i].layer->ordinal & 63] = i;
+  }
+  build_layers(&check);
+  if(pcb->spatial == NULL){
+    spatial_index_init();
+  }
+  for(struct Track *track = pcb->tracks; track; track = track->next){
+    struct Segment *segment = &track->track.segment;
+    if(track->type == TRACK_TYPE_SEG && segment->net && segment->net->ordinal > 0 && stack_index(&check, segment->layer) >= 0){
+      check.segment_count++;
+    }
+  }
+  check.segments = malloc((check.segment_count ? check.segment_count : 1) * sizeof(struct Track *));
+  check.segment_count = 0;
+  for(struct Track *track = pcb->tracks; track; track = track->next){
+    struct Segment *segment = &track->track.segment;
+    if(track->type == TRACK_TYPE_SEG && segment->net && segment->net->ordinal > 0 && stack_index(&check, segment->layer) >= 0){
+      check.segments[check.segment_count++] = track;
+    }
+  }
+
+  check.lists = calloc(threads, sizeof(struct Coupling_List));
+  pthread_t *thread = malloc(threads * sizeof(pthread_t));
+  for(int i = 0; i < threads; i++){
+    pthread_create(&thread[i], NULL, crosstalk_worker, &check);
+  }
+  for(int i = 0; i < threads; i++){
+    pthread_join(thread[i], NULL);
+  }
+  free(thread);
+
+  // One entry per victim and aggressor net
+  int count = 0;
+  for(int t = 0; t < threads; t++){
+    count += check.lists[t].count;
+  }
+  struct Coupling *couplings = malloc((count ? count : 1) * sizeof(struct Coupling));
+  count = 0;
+  for(int t = 0; t < threads; t++){
+    if(check.lists[t].count > 0){
+      memcpy(couplings + count, check.lists[t].couplings, check.lists[t].count * sizeof(struct Coupling));
+    }
+    count += check.lists[t].count;
+    free(check.lists[t].couplings);
+  }
+  free(check.lists);
+  stats->segments = check.segment_count;
+  stats->candidates = check.candidates;
+  stats->pieces = count;
+  qsort(couplings, count, sizeof(struct Coupling), compare_nets);
+  int pairs = 0;
+  for(int i = 0; i < count;){
+    struct Coupling pair = couplings[i];
+    pair.next = pair.delay = pair.fext = pair.length = 0;
+    for(; i < count && couplings[i].victim == pair.victim && couplings[i].aggressor == pair.aggressor; i++){
+      pair.length += couplings[i].length;
+      pair.next += couplings[i].next;
+      pair.delay += couplings[i].delay;
+      pair.fext += couplings[i].fext;
+      pair.spacing = fminf(pair.spacing, couplings[i].spacing);
+    }
+    if(pair.length < check.options.min_length){
+      continue;
+    }
+    // The length weighted coefficient, saturated by the coupled delay
+    pair.next = pair.next / pair.length * fmin(1, 2 * pair.delay / check.options.rise_time);
+    couplings[pairs++] = pair;
+  }
+
+  struct Net **nets = NULL;
+  int max_ordinal = 0;
+  for(struct Net *net = pcb->nets; net; net = net->next){
+    max_ordinal = net->ordinal > max_ordinal ? net->ordinal : max_ordinal;
+  }
+  nets = calloc(max_ordinal + 1, sizeof(struct Net *));
+  for(struct Net *net = pcb->nets; net; net = net->next){
+    if(net->ordinal >= 0){
+      nets[net->ordinal] = net;
+    }
+  }
+  struct Victim *victims = malloc((pairs ? pairs : 1) * sizeof(struct Victim));
+  int victim_count = 0;
+  for(int i = 0; i < pairs;){
+    struct Victim *victim = &victims[victim_count++];
+    *victim = (struct Victim){i, 0, 0, 0};
+    for(; i < pairs && couplings[i].victim == couplings[victim->first].victim; i++){
+      victim->count++;
+      victim->next += couplings[i].next;
+      victim->fext += couplings[i].fext;
+    }
+    stats->worst_next = fmax(stats->worst_next, victim->next);
+    stats->worst_fext = fmax(stats->worst_fext, victim->fext);
+  }
+  qsort(victims, victim_count, sizeof(struct Victim), compare_victim);
+  stats->couplings = pairs;
+  stats->victims = victim_count;
+
+  fprintf(report, "%u segments, %llu candidates, %u coupled pieces, %u net pairs, rise time %.3f ns\n", stats->segments,
+    (unsigned long long)stats->candidates, stats->pieces, pairs, check.options.rise_time);
+  for(int v = 0; v < victim_count; v++){
+    struct Victim *victim = &victims[v];
+    const struct Net *net = nets[couplings[victim->first].victim];
+    fprintf(report, "%-32s next %6.2f%% fext %6.2f%% from %d nets\n", net && net->name.chars ? net->name.chars : "?", victim->next * 100, victim->fext * 100, victim->count);
+    qsort(couplings + victim->first, victim->count, sizeof(struct Coupling), compare_noise);
+    for(int k = 0; k < victim->count && k < top; k++){
+      const struct Coupling *pair = &couplings[victim->first + k];
+      const struct Net *aggressor = nets[pair->aggressor];
+      fprintf(report, "  %-30s %10.4f mm at %7.4f mm next %6.2f%% fext %6.2f%%\n", aggressor && aggressor->name.chars ? aggressor->name.chars : "?",
+        pair->length, pair->spacing, pair->next * 100, pair->fext * 100);
+    }
+  }
+  free(victims);
+  free(nets);
+  free(couplings);
+  free(check.segments);
+  return victim_count;
+}
@@ -1,3 +1,5 @@
+#include <pthread.h>
+
 #include "debug.h"
 
 /*
@@ -23,6 +25,7 @@ struct Mem_Tracker{
 };
 
 static struct Mem_Tracker *tracker_list = NULL;
+static pthread_mutex_t tracker_lock = PTHREAD_MUTEX_INITIALIZER;
 
 void mem_track(void *ptr, size_t size, const int line, const char *function, const char *file){
   struct Mem_Tracker *tracker = malloc(sizeof(struct Mem_Tracker));
@@ -34,8 +37,8 @@ void mem_track(void *ptr, size_t size, const int line, const char *function, con
 
   //tracker->line = malloc(sizeof(char) * strlen(line));
   tracker->line = line;
-  tracker->function = malloc(sizeof(char) * strlen(function));
-  tracker->file = malloc(sizeof(char) * strlen(file));
+  tracker->function = malloc(sizeof(char) * (strlen(function) + 1));
+  tracker->file = malloc(sizeof(char) * (strlen(file) + 1));
   if(!tracker->line || !tracker->function || !tracker->file){
     fprintf(stderr, "Tracker allocation error");
   }
@@ -46,32 +49,39 @@ void mem_track(void *ptr, size_t size, const int line, const char *function, con
 
   tracker->ptr = ptr;
   tracker->size = size;
+  pthread_mutex_lock(&tracker_lock);
   tracker->next = tracker_list;
   tracker_list = tracker;
+  pthread_mutex_unlock(&tracker_lock);
 }
 
 void mem_untrack(void *ptr){
   struct Mem_Tracker *temp = NULL;
+  pthread_mutex_lock(&tracker_lock);
   for(struct Mem_Tracker *curr = tracker_list; curr; curr = curr->next){
     if(curr->ptr == ptr){
       tracker_list = curr->next;
+      pthread_mutex_unlock(&tracker_lock);
       //free(curr->line);
       free(curr->function);
       free(curr->file);
       free(curr);
       return;
     }else if(curr->next && curr->next->ptr == ptr){
-      temp = curr->next->next;
+      temp = curr->next;
+      curr->next = temp->next;
+      pthread_mutex_unlock(&tracker_lock);
       //free(curr->next->line);
-      free(curr->next->function);
-      free(curr->next->file);
-      free(curr->next);
-      curr->next = temp;
+      free(temp->function);
+      free(temp->file);
+      free(temp);
       return;
     }else if (!ptr){
+      pthread_mutex_unlock(&tracker_lock);
       return;
     }
   }
+  pthread_mutex_unlock(&tracker_lock);
   fprintf(stderr, "Trying to untrack a non-tracked pointer\n");
 }
 
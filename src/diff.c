@@ -0,0 +1,413 @@
+#include <stdio.h>
+#include <math.h>
+
+#include "solver.h"
+
+// Board diff
+// Copper items of both revisions are paired by uuid first, a pair whose
+// geometry hash differs has moved. What is left is paired by geometry hash
+// so items that only lost or changed their uuid still match, anything still
+// unpaired was added or removed. Geometry hashes use micron coordinates and
+// layer and net names, never ordinals, which change between revisions, and
+// layer masks index one table of names both boards share. Every copper
+// layer with a change is then rasterised from both boards over the same box
+// a band at a time, each band XORed as soon as both sides have it.
+
+#define DIFF_ADDED 1
+#define DIFF_REMOVED 2
+#define DIFF_MOVED 3
+
+#define DIFF_SEGMENT 0
+#define DIFF_ARC 1
+#define DIFF_VIA 2
+#define DIFF_PAD 3
+#define DIFF_ZONE 4
+
+static const char *kind_names[] = {"segment", "arc", "via", "pad", "zone"};
+
+struct Diff_Item {
+  int kind, matched;
+  uint64_t key, shape, layers;
+  struct Uuid uuid;
+  const char *net;
+  char name[64];
+  struct Point at;
+};
+
+// Layers of both boards by canonical name, mask bits are slots here
+struct Diff_Layers {
+  const char *names[64];
+  int count;
+};
+
+// masks has the shared bit of each of the board's layer ordinals
+struct Diff_Items {
+  struct Diff_Item *items;
+  uint32_t count, capacity;
+  struct Diff_Layers *layers;
+  uint64_t masks[64];
+};
+
+struct Diff_Change {
+  int type;
+  struct Diff_Item *before, *after;
+};
+
+#define FNV_OFFSET 0xcbf29ce484222325ull
+#define FNV_PRIME 0x100000001b3ull
+
+static uint64_t hash_bytes(uint64_t hash, const void *data, size_t length){
+  const uint8_t *bytes = data;
+  for(size_t i = 0; i < length; i++){
+    hash = (hash ^ bytes[i]) * FNV_PRIME;
+  }
+  return hash;
+}
+
+static uint64_t hash_string(uint64_t hash, const char *string){
+  // The NUL is hashed too so "ab" "c" and "a" "bc" differ
+  return string ? hash_bytes(hash, string, strlen(string) + 1) : hash_bytes(hash, "", 1);
+}
+
+static uint64_t hash_um(uint64_t hash, float mm){
+  int64_t um = (int64_t)llround(mm * 1000.0);
+  return hash_bytes(hash, &um, sizeof(um));
+}
+
+static uint64_t hash_point(uint64_t hash, struct Point point){
+  return hash_um(hash_um(hash, point.x), point.y);
+}
+
+static uint64_t hash_layer(uint64_t hash, struct Layer *layer){
+  return hash_string(hash, layer ? layer->canonical_name.chars : NULL);
+}
+
+static const char *net_name(struct Net *net){
+  return net && net->name.chars ? net->name.chars : "";
+}
+
+static struct Diff_Item *new_item(struct Diff_Items *items, int kind, struct Uuid uuid, struct Net *net, struct Point at){
+  if(items->count == items->capacity){
+    items->capacity = items->capacity ? items->capacity * 2 : 1024;
+    items->items = realloc(items->items, items->capacity * sizeof(struct Diff_Item));
+  }
+  struct Diff_Item *item = &items->items[items->count++];
+  memset(item, 0, sizeof(struct Diff_Item));
+  item->kind = kind;
+  item->uuid = uuid;
+  item->key = uuid_is_nil(uuid) ? 0 : uuid_hash(uuid);
+  item->net = net_name(net);
+  item->at = at;
+  item->shape = hash_string(hash_bytes(FNV_OFFSET, &kind, sizeof(kind)), item->net);
+  return item;
+}
+
+// Lower point first, so a reversed segment hashes the same
+static void order_points(struct Point *start, struct Point *end){
+  if(start->x > end->x || (start->x == end->x && start->y > end->y)){
+    struct Point swap = *start;
+    *start = *end;
+    *end = swap;
+  }
+}
+
+static void map_layers(struct Diff_Items *items){
+  struct Diff_Layers *layers = items->layers;
+  for(struct Layer *layer = pcb->layers.layer; layer; layer = layer->next){
+    if(layer->canonical_name.chars == NULL){
+      continue;
+    }
+    int slot = 0;
+    while(slot < layers->count && strcmp(layers->names[slot], layer->canonical_name.chars) != 0){
+      slot++;
+    }
+    if(slot == 64){
+      continue;
+    }
+    if(slot == layers->count){
+      layers->names[layers->count++] = layer->canonical_name.chars;
+    }
+    items->masks[layer->ordinal & 63] = 1ull << slot;
+  }
+}
+
+static uint64_t item_mask(const struct Diff_Items *items, struct Layer *layer){
+  return layer ? items->masks[layer->ordinal & 63] : 0;
+}
+
+static void collect_items(struct Diff_Items *items){
+  map_layers(items);
+  for(struct Track *track = pcb->tracks; track; track = track->next){
+    if(track->type == TRACK_TYPE_SEG){
+      struct Segment *segment = &track->track.segment;
+      struct Point start = segment->start, end = segment->end;
+      struct Diff_Item *item = new_item(items, DIFF_SEGMENT, track->uuid, segment->net, segment->start);
+      order_points(&start, &end);
+      item->shape = hash_um(hash_point(hash_point(hash_layer(item->shape, segment->layer), start), end), segment->width);
+      item->layers = item_mask(items, segment->layer);
+    }else if(track->type == TRACK_TYPE_ARC){
+      struct Arc *arc = &track->track.arc;
+      struct Point start = arc->start, end = arc->end;
+      struct Diff_Item *item = new_item(items, DIFF_ARC, track->uuid, arc->net, arc->start);
+      order_points(&start, &end);
+      item->shape = hash_um(hash_point(hash_point(hash_point(hash_layer(item->shape, arc->layer), start), arc->mid), end), arc->width);
+      item->layers = item_mask(items, arc->layer);
+    }else if(track->type == TRACK_TYPE_VIA){
+      struct Via *via = &track->track.via;
+      struct Point at = {via->at.x, via->at.y};
+      struct Diff_Item *item = new_item(items, DIFF_VIA, track->uuid, via->net, at);
+      item->shape = hash_um(hash_um(hash_point(item->shape, at), via->size), via->drill.diameter);
+      for(int i = 0; i < via->layer_count; i++){
+        item->shape = hash_layer(item->shape, via->layers[i]);
+      }
+      for(struct Layer *layer = pcb->layers.layer; layer; layer = layer->next){
+        item->layers |= via_on_layer(via, layer) ? item_mask(items, layer) : 0;
+      }
+    }
+  }
+  for(struct Footprint *footprint = pcb->footprints; footprint; footprint = footprint->next){
+    const char *reference = NULL;
+    for(struct Footprint_Property *property = footprint->properties; property; property = property->next){
+      if(property->property && property->property->key.chars && strcmp(property->property->key.chars, "Reference") == 0){
+        reference = property->property->val.chars;
+      }
+    }
+    for(struct Pad *pad = footprint->pads; pad; pad = pad->next){
+      struct Diff_Item *item = new_item(items, DIFF_PAD, pad->uuid, pad->net, pad_position(footprint, pad));
+      snprintf(item->name, sizeof(item->name), "%s.%s", reference ? reference : "?", pad->num.chars ? pad->num.chars : "?");
+      if(uuid_is_nil(item->uuid) && !uuid_is_nil(footprint->uuid)){
+        // Older files have no pad uuids, the footprint's and the number do
+        item->key = hash_string(uuid_hash(footprint->uuid), pad->num.chars);
+      }
+      item->shape = hash_string(hash_point(item->shape, item->at), item->name);
+      item->shape = hash_um(hash_um(hash_um(item->shape, pad->at.angle), pad->size.width), pad->size.height);
+      item->shape = hash_um(hash_bytes(item->shape, &pad->shape, sizeof(pad->shape)), pad->drill.diameter);
+      for(int i = 0; i < pad->layer_count; i++){
+        item->shape = hash_layer(item->shape, pad->layers[i]);
+        item->layers |= is_copper(pad->layers[i]) ? item_mask(items, pad->layers[i]) : 0;
+      }
+    }
+  }
+  for(struct Zone *zone = pcb->zones; zone; zone = zone->next){
+    struct Point at = zone->filled_polygon.points ? zone->filled_polygon.points[0] : (struct Point){0, 0};
+    struct Diff_Item *item = new_item(items, DIFF_ZONE, zone->uuid, zone->net, at);
+    item->shape = hash_layer(item->shape, zone->layer);
+    item->layers = item_mask(items, zone->layer);
+    for(struct Polygon *polygon = &zone->filled_polygon; polygon; polygon = polygon->next){
+      int count = polygon->point_index ? polygon->point_index : polygon->point_count;
+      item->shape = hash_layer(item->shape, polygon->layer);
+      item->layers |= item_mask(items, polygon->layer);
+      for(int i = 0; polygon->points && i < count; i++){
+        item->shape = hash_point(item->shape, polygon->points[i]);
+      }
+    }
+  }
+}
+
+// Slots hold item index + 1, 0 is empty
+static uint32_t *table_create(uint32_t count, uint32_t *mask){
+  uint32_t size = 16;
+  while(size < count * 2){
+    size *= 2;
+  }
+  *mask = size - 1;
+  return calloc(size, sizeof(uint32_t));
+}
+
+static void table_insert(uint32_t *table, uint32_t mask, uint64_t hash, uint32_t index){
+  uint32_t slot = (uint32_t)(hash ^ (hash >> 32)) & mask;
+  while(table[slot]){
+    slot = (slot + 1) & mask;
+  }
+  table[slot] = index + 1;
+}
+
+static struct Diff_Item *match_uuid(uint32_t *table, uint32_t mask, struct Diff_Items *after, struct Diff_Item *item){
+  for(uint32_t slot = (uint32_t)(item->key ^ (item->key >> 32)) & mask; table[slot]; slot = (slot + 1) & mask){
+    struct Diff_Item *other = &after->items[table[slot] - 1];
+    if(!other->matched && other->key == item->key && other->kind == item->kind && uuid_equal(other->uuid, item->uuid)){
+      return other;
+    }
+  }
+  return NULL;
+}
+
+static struct Diff_Item *match_shape(uint32_t *table, uint32_t mask, struct Diff_Items *after, struct Diff_Item *item){
+  for(uint32_t slot = (uint32_t)(item->shape ^ (item->shape >> 32)) & mask; table[slot]; slot = (slot + 1) & mask){
+    struct Diff_Item *other = &after->items[table[slot] - 1];
+    if(!other->matched && other->shape == item->shape && other->kind == item->kind){
+      return other;
+    }
+  }
+  return NULL;
+}
+
+static int match_items(struct Diff_Items *before, struct Diff_Items *after, struct Diff_Change **changes){
+  uint32_t mask, count = 0;
+  *changes = malloc((before->count + after->count + 1) * sizeof(struct Diff_Change));
+  uint32_t *table = table_create(after->count, &mask);
+  for(uint32_t i = 0; i < after->count; i++){
+    if(after->items[i].key){
+      table_insert(table, mask, after->items[i].key, i);
+    }
+  }
+  for(uint32_t i = 0; i < before->count; i++){
+    struct Diff_Item *item = &before->items[i], *other = item->key ? match_uuid(table, mask, after, item) : NULL;
+    if(other){
+      item->matched = other->matched = TRUE;
+      if(item->shape != other->shape){
+        (*changes)[count++] = (struct Diff_Change){DIFF_MOVED, item, other};
+      }
+    }
+  }
+  memset(table, 0, (mask + 1) * sizeof(uint32_t));
+  for(uint32_t i = 0; i < after->count; i++){
+    if(!after->items[i].matched){
+      table_insert(table, mask, after->items[i].shape, i);
+    }
+  }
+  for(uint32_t i = 0; i < before->count; i++){
+    struct Diff_Item *item = &before->items[i], *other = item->matched ? NULL : match_shape(table, mask, after, item);
+    if(other){
+      item->matched = other->matched = TRUE;
+    }else if(!item->matched){
+      (*changes)[count++] = (struct Diff_Change){DIFF_REMOVED, item, NULL};
+    }
+  }
+  for(uint32_t i = 0; i < after->count; i++){
+    if(!after->items[i].matched){
+      (*changes)[count++] = (struct Diff_Change){DIFF_ADDED, NULL, &after->items[i]};
+    }
+  }
+  free(table);
+  return count;
+}
+
+static void print_change(const struct Diff_Change *change){
+  static const char marks[] = " +-~";
+  const struct Diff_Item *item = change->after ? change->after : change->before;
+  printf("%c %s%s%s net \"%s\" at %.4f %.4f", marks[change->type], kind_names[item->kind], item->name[0] ? " " : "", item->name, item->net, item->at.x, item->at.y);
+  if(change->type == DIFF_MOVED){
+    printf(" from %.4f %.4f", change->before->at.x, change->before->at.y);
+  }
+  char uuid[40] = "";
+  printf(" %s\n", uuid_is_nil(item->uuid) ? uuid : uuid_string(item->uuid, uuid));
+}
+
+static _Thread_local const struct Diff_Change *sort_changes;
+
+static int compare_net(const void *_1, const void *_2){
+  const struct Diff_Change *c_1 = &sort_changes[*(const uint32_t *)_1], *c_2 = &sort_changes[*(const uint32_t *)_2];
+  return strcmp((c_1->after ? c_1->after : c_1->before)->net, (c_2->after ? c_2->after : c_2->before)->net);
+}
+
+static void print_nets(const struct Diff_Change *changes, uint32_t count){
+  uint32_t *order = malloc((count + 1) * sizeof(uint32_t));
+  for(uint32_t i = 0; i < count; i++){
+    order[i] = i;
+  }
+  sort_changes = changes;
+  qsort(order, count, sizeof(uint32_t), compare_net);
+  printf("%-24s %8s %8s %8s\n", "Net", "added", "removed", "moved");
+  for(uint32_t i = 0; i < count;){
+    int totals[4] = {0};
+    uint32_t j = i;
+    for(; j < count && compare_net(&order[i], &order[j]) == 0; j++){
+      totals[changes[order[j]].type]++;
+    }
+    const struct Diff_Change *change = &changes[order[i]];
+    const char *net = (change->after ? change->after : change->before)->net;
+    printf("%-24s %8d %8d %8d\n", net[0] ? net : "(none)", totals[DIFF_ADDED], totals[DIFF_REMOVED], totals[DIFF_MOVED]);
+    i = j;
+  }
+  free(order);
+}
+
+static struct Layer *layer_by_name(struct Board *board, const char *name){
+  for(struct Layer *layer = board->layers.layer; layer; layer = layer->next){
+    if(layer->canonical_name.chars && strcmp(layer->canonical_name.chars, name) == 0){
+      return layer;
+    }
+  }
+  return NULL;
+}
+
+// XOR area of the layer named in mm², writes <dir>/<layer>-xor.pbm when
+// dir is set, negative when neither board could be rasterised
+static double layer_xor(struct Board *before, struct Board *after, const char *name, const struct Box *box, float dpi, const char *dir, int threads){
+  uint64_t pixels;
+  struct Raster *xor = raster_xor_layers(before, layer_by_name(before, name), after, layer_by_name(after, name), dpi, box, threads, &pixels);
+  if(xor == NULL){
+    return -1;
+  }
+  if(dir){
+    char path[4096];
+    int length = snprintf(path, sizeof(path), "%s/%s", dir, name);
+    for(char *c = path + strlen(dir) + 1; *c; c++){
+      *c = *c == '.' ? '_' : *c;
+    }
+    snprintf(path + length, sizeof(path) - length, "-xor.pbm");
+    raster_write(xor, path);
+  }
+  double area = pixels / ((double)xor->scale * xor->scale);
+  raster_free(xor);
+  return area;
+}
+
+// Prints every copper change from before to after with totals per layer
+// and net. With dpi > 0 each changed copper layer also gets its XOR area
+// and, when dir is set, a PBM of it. Returns the number of changes.
+int diff_boards(struct Board *before, struct Board *after, const char *dir, float dpi, int threads){
+  struct Board *saved = pcb;
+  struct Diff_Items items[2];
+  struct Diff_Change *changes;
+  struct Diff_Layers layers;
+  memset(items, 0, sizeof(items));
+  memset(&layers, 0, sizeof(layers));
+  items[0].layers = items[1].layers = &layers;
+  pcb = before;
+  collect_items(&items[0]);
+  pcb = after;
+  collect_items(&items[1]);
+  int count = match_items(&items[0], &items[1], &changes);
+
+  int totals[64][4];
+  uint64_t changed = 0;
+  memset(totals, 0, sizeof(totals));
+  for(int i = 0; i < count; i++){
+    print_change(&changes[i]);
+    uint64_t mask = (changes[i].before ? changes[i].before->layers : 0) | (changes[i].after ? changes[i].after->layers : 0);
+    changed |= mask;
+    for(int slot = 0; slot < 64; slot++){
+      totals[slot][changes[i].type] += (mask >> slot) & 1;
+    }
+  }
+
+  struct Box box = {INFINITY, INFINITY, -INFINITY, -INFINITY};
+  if(dpi > 0 && changed){
+    pcb = before;
+    struct Box box_1 = copper_box();
+    pcb = after;
+    struct Box box_2 = copper_box();
+    box = (struct Box){fminf(box_1.min_x, box_2.min_x) - 0.5f, fminf(box_1.min_y, box_2.min_y) - 0.5f, fmaxf(box_1.max_x, box_2.max_x) + 0.5f, fmaxf(box_1.max_y, box_2.max_y) + 0.5f};
+  }
+  printf("%-24s %8s %8s %8s %12s\n", "Layer", "added", "removed", "moved", "xor mm²");
+  for(int slot = 0; slot < layers.count; slot++){
+    if(!((changed >> slot) & 1)){
+      continue;
+    }
+    double area = dpi > 0 ? layer_xor(before, after, layers.names[slot], &box, dpi, dir, threads) : -1;
+    printf("%-24s %8d %8d %8d", layers.names[slot], totals[slot][DIFF_ADDED], totals[slot][DIFF_REMOVED], totals[slot][DIFF_MOVED]);
+    if(area >= 0){
+      printf(" %12.4f", area);
+    }
+    printf("\n");
+  }
+  print_nets(changes, count);
+
+  free(changes);
+  free(items[0].items);
+  free(items[1].items);
+  pcb = saved;
+  return count;
+}
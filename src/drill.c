@@ -0,0 +1,373 @@
+#include <stdio.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "solver.h"
+
+// Excellon drill export
+// Via and pad holes are gathered in world space, grouped into one tool per
+// diameter (rounded to a micron) and written to PTH.drl and NPTH.drl. Every
+// tool's hits are seeded in Hilbert curve order, then 2-opt and Or-opt moves
+// within a window of the path shorten the travel until neither finds a gain.
+// Tools are independent so the worker threads take one each. Oval drills
+// become G85 slots, their midpoint is what the path visits.
+
+#define DRILL_WINDOW 48
+#define DRILL_ROUNDS 16
+#define DRILL_SEGMENT 3
+#define DRILL_GAIN 1e-6
+
+struct Hole {
+  struct Point at, end, key;
+  int64_t diameter;
+  uint64_t order;
+  int plated, slot;
+};
+
+struct Drill_Tool {
+  struct Hole *holes;
+  int count, plated, number;
+  int64_t diameter;
+  double seed, travel;
+};
+
+struct Drill_Context {
+  struct Board *board;
+  struct Drill_Tool *tools;
+  int count, next;
+};
+
+static inline double distance(const struct Hole *_1, const struct Hole *_2){
+  return hypot(_1->key.x - _2->key.x, _1->key.y - _2->key.y);
+}
+
+static double path_length(const struct Hole *holes, int count){
+  double length = 0;
+  for(int i = 1; i < count; i++){
+    length += distance(&holes[i - 1], &holes[i]);
+  }
+  return length;
+}
+
+// Position along a Hilbert curve over a 65536 square grid
+static uint64_t hilbert(uint32_t x, uint32_t y){
+  uint64_t d = 0;
+  for(uint32_t s = 1 << 15; s > 0; s >>= 1){
+    uint32_t rx = (x & s) > 0, ry = (y & s) > 0;
+    d += (uint64_t)s * s * ((3 * rx) ^ ry);
+    if(ry == 0){
+      if(rx == 1){
+        x = s - 1 - x;
+        y = s - 1 - y;
+      }
+      uint32_t t = x;
+      x = y;
+      y = t;
+    }
+  }
+  return d;
+}
+
+static int compare_order(const void *_1, const void *_2){
+  uint64_t o_1 = ((const struct Hole *)_1)->order, o_2 = ((const struct Hole *)_2)->order;
+  return (o_1 > o_2) - (o_1 < o_2);
+}
+
+static void hilbert_seed(struct Hole *holes, int count){
+  float min_x = INFINITY, min_y = INFINITY, max_x = -INFINITY, max_y = -INFINITY;
+  for(int i = 0; i < count; i++){
+    min_x = fminf(min_x, holes[i].key.x), max_x = fmaxf(max_x, holes[i].key.x);
+    min_y = fminf(min_y, holes[i].key.y), max_y = fmaxf(max_y, holes[i].key.y);
+  }
+  double span = fmax(max_x - min_x, max_y - min_y);
+  double scale = span > 0 ? 65535 / span : 0;
+  for(int i = 0; i < count; i++){
+    holes[i].order = hilbert((uint32_t)((holes[i].key.x - min_x) * scale), (uint32_t)((holes[i].key.y - min_y) * scale));
+  }
+  qsort(holes, count, sizeof(struct Hole), compare_order);
+}
+
+static void reverse(struct Hole *holes, int from, int to){
+  for(; from < to; from++, to--){
+    struct Hole swap = holes[from];
+    holes[from] = holes[to];
+    holes[to] = swap;
+  }
+}
+
+// Reverses holes[i + 1..j] when that shortens the open path
+static int two_opt(struct Hole *holes, int count){
+  int improved = FALSE;
+  for(int i = 0; i < count - 2; i++){
+    int last = i + DRILL_WINDOW < count - 1 ? i + DRILL_WINDOW : count - 1;
+    for(int j = i + 2; j <= last; j++){
+      double before = distance(&holes[i], &holes[i + 1]), after = distance(&holes[i], &holes[j]);
+      if(j + 1 < count){
+        before += distance(&holes[j], &holes[j + 1]);
+        after += distance(&holes[i + 1], &holes[j + 1]);
+      }
+      if(after < before - DRILL_GAIN){
+        reverse(holes, i + 1, j);
+        improved = TRUE;
+      }
+    }
+  }
+  return improved;
+}
+
+// Moves runs of up to DRILL_SEGMENT holes, either way round, between two
+// nearby holes when that shortens the path
+static int or_opt(struct Hole *holes, int count){
+  struct Hole run[DRILL_SEGMENT];
+  int improved = FALSE;
+  for(int length = 1; length <= DRILL_SEGMENT; length++){
+    for(int i = 1; i + length < count; i++){
+      int e = i + length - 1;
+      double removed = distance(&holes[i - 1], &holes[i]) + distance(&holes[e], &holes[e + 1]) - distance(&holes[i - 1], &holes[e + 1]);
+      int best = -1, flip = FALSE;
+      double best_gain = DRILL_GAIN;
+      int from = i - 1 - DRILL_WINDOW > 0 ? i - 1 - DRILL_WINDOW : 0, to = e + 1 + DRILL_WINDOW < count - 1 ? e + 1 + DRILL_WINDOW : count - 1;
+      for(int k = from; k < to; k++){
+        if(k >= i - 1 && k <= e){
+          continue;
+        }
+        double gap = distance(&holes[k], &holes[k + 1]);
+        double forward = distance(&holes[k], &holes[i]) + distance(&holes[e], &holes[k + 1]) - gap;
+        double backward = distance(&holes[k], &holes[e]) + distance(&holes[i], &holes[k + 1]) - gap;
+        if(removed - forward > best_gain){
+          best_gain = removed - forward, best = k, flip = FALSE;
+        }
+        if(removed - backward > best_gain){
+          best_gain = removed - backward, best = k, flip = TRUE;
+        }
+      }
+      if(best < 0){
+        continue;
+      }
+      memcpy(run, &holes[i], length * sizeof(struct Hole));
+      int at;
+      if(best > e){
+        memmove(&holes[i], &holes[e + 1], (best - e) * sizeof(struct Hole));
+        at = best - length + 1;
+      }else{
+        memmove(&holes[best + 1 + length], &holes[best + 1], (i - best - 1) * sizeof(struct Hole));
+        at = best + 1;
+      }
+      memcpy(&holes[at], run, length * sizeof(struct Hole));
+      if(flip){
+        reverse(holes, at, at + length - 1);
+      }
+      improved = TRUE;
+    }
+  }
+  return improved;
+}
+
+static void order_tool(struct Drill_Tool *tool){
+  hilbert_seed(tool->holes, tool->count);
+  tool->seed = path_length(tool->holes, tool->count);
+  for(int round = 0; round < DRILL_ROUNDS; round++){
+    int improved = two_opt(tool->holes, tool->count);
+    improved |= or_opt(tool->holes, tool->count);
+    if(!improved){
+      break;
+    }
+  }
+  tool->travel = path_length(tool->holes, tool->count);
+}
+
+static void *drill_worker(void *arg){
+  struct Drill_Context *context = arg;
+  pcb = context->board;
+  while(1){
+    int i = __atomic_fetch_add(&context->next, 1, __ATOMIC_RELAXED);
+    if(i >= context->count){
+      break;
+    }
+    order_tool(&context->tools[i]);
+  }
+  return NULL;
+}
+
+static void add_hole(struct Hole **holes, int *count, int *capacity, struct Hole hole){
+  if(*count == *capacity){
+    *capacity = *capacity ? *capacity * 2 : 256;
+    *holes = realloc(*holes, *capacity * sizeof(struct Hole));
+  }
+  hole.key.x = (hole.at.x + hole.end.x) / 2;
+  hole.key.y = (hole.at.y + hole.end.y) / 2;
+  (*holes)[(*count)++] = hole;
+}
+
+static int64_t microns(float mm){
+  return (int64_t)llround(mm * 1000.0);
+}
+
+static int collect_holes(struct Hole **holes){
+  int count = 0, capacity = 0;
+  *holes = NULL;
+  for(struct Track *track = pcb->tracks; track; track = track->next){
+    if(track->type == TRACK_TYPE_VIA && track->track.via.drill.diameter > 0){
+      struct Point at = {track->track.via.at.x, track->track.via.at.y};
+      add_hole(holes, &count, &capacity, (struct Hole){at, at, {0, 0}, microns(track->track.via.drill.diameter), 0, TRUE, FALSE});
+    }
+  }
+  for(struct Footprint *footprint = pcb->footprints; footprint; footprint = footprint->next){
+    for(struct Pad *pad = footprint->pads; pad; pad = pad->next){
+      struct Drill *drill = &pad->drill;
+      if((pad->type != THRU_HOLE && pad->type != NP_THRU_HOLE) || drill->diameter <= 0){
+        continue;
+      }
+      struct Point centre = pad_position(footprint, pad), offset = rotate_point(drill->offset, pad->at.angle);
+      centre.x += offset.x;
+      centre.y += offset.y;
+      struct Hole hole = {centre, centre, {0, 0}, microns(drill->diameter), 0, pad->type == THRU_HOLE, FALSE};
+      if(drill->oval && microns(drill->diameter) != microns(drill->width)){
+        // The slot runs along the long side with the short side as the tool
+        float half = fabsf(drill->diameter - drill->width) / 2;
+        struct Point axis = drill->diameter > drill->width ? (struct Point){half, 0} : (struct Point){0, half};
+        axis = rotate_point(axis, pad->at.angle);
+        hole.at = (struct Point){centre.x - axis.x, centre.y - axis.y};
+        hole.end = (struct Point){centre.x + axis.x, centre.y + axis.y};
+        hole.diameter = microns(fminf(drill->diameter, drill->width));
+        hole.slot = TRUE;
+      }
+      add_hole(holes, &count, &capacity, hole);
+    }
+  }
+  return count;
+}
+
+static int compare_tool(const void *_1, const void *_2){
+  const struct Hole *h_1 = _1, *h_2 = _2;
+  if(h_1->plated != h_2->plated){
+    return h_2->plated - h_1->plated;
+  }
+  return (h_1->diameter > h_2->diameter) - (h_1->diameter < h_2->diameter);
+}
+
+// Millimetres from microns, without trailing zeros
+static int format_mm(char *out, int64_t um){
+  int length = 0;
+  if(um < 0){
+    out[length++] = '-';
+    um = -um;
+  }
+  length += format_int(out + length, um / 1000);
+  if(um % 1000){
+    length += sprintf(out + length, ".%03d", (int)(um % 1000));
+    while(out[length - 1] == '0'){
+      length--;
+    }
+  }
+  out[length] = '\0';
+  return length;
+}
+
+static void put_point(FILE *file, struct Point point){
+  char x[32], y[32];
+  format_mm(x, microns(point.x));
+  format_mm(y, -microns(point.y));
+  fprintf(file, "X%sY%s", x, y);
+}
+
+static int write_drill_file(const char *dir, int plated, struct Drill_Tool *tools, int count, int copper){
+  char path[4096], diameter[32];
+  snprintf(path, sizeof(path), "%s/%s.drl", dir, plated ? "PTH" : "NPTH");
+  FILE *file = fopen(path, "w");
+  if(file == NULL){
+    perror(path);
+    return ERROR;
+  }
+  fprintf(file, "M48\n; DRILL file generated by Solver\n; FORMAT={-:-/ absolute / metric / decimal}\n");
+  fprintf(file, "; #@! TF.FileFunction,%s,1,%d,%s\nFMAT,2\nMETRIC\n", plated ? "Plated" : "NonPlated", copper, plated ? "PTH" : "NPTH");
+  for(int i = 0; i < count; i++){
+    if(tools[i].plated == plated){
+      format_mm(diameter, tools[i].diameter);
+      fprintf(file, "T%dC%s\n", tools[i].number, diameter);
+    }
+  }
+  fprintf(file, "%%\nG90\nG05\n");
+  for(int i = 0; i < count; i++){
+    if(tools[i].plated != plated){
+      continue;
+    }
+    fprintf(file, "T%d\n", tools[i].number);
+    for(int j = 0; j < tools[i].count; j++){
+      struct Hole *hole = &tools[i].holes[j];
+      put_point(file, hole->at);
+      if(hole->slot){
+        fprintf(file, "G85");
+        put_point(file, hole->end);
+      }
+      fprintf(file, "\n");
+    }
+  }
+  fprintf(file, "M30\n");
+  if(fclose(file) != 0){
+    perror(path);
+    return ERROR;
+  }
+  return SUCCESS;
+}
+
+// Writes <dir>/PTH.drl and <dir>/NPTH.drl with every tool's hits in
+// optimised order. threads <= 0 uses every core. Returns the number of
+// holes or ERROR, seed and travel get the path length in mm before and
+// after the improvement when they are not NULL.
+int export_drills(const char *dir, int threads, double *seed, double *travel){
+  struct Hole *holes;
+  int count = collect_holes(&holes), copper = 0, status = SUCCESS;
+  struct Drill_Context context = {pcb, NULL, 0, 0};
+  if(count > 0){
+    qsort(holes, count, sizeof(struct Hole), compare_tool);
+  }
+  for(int i = 0; i < count; i++){
+    context.count += i == 0 || compare_tool(&holes[i - 1], &holes[i]) != 0;
+  }
+  context.tools = calloc(context.count ? context.count : 1, sizeof(struct Drill_Tool));
+  for(int i = 0, tool = -1; i < count; i++){
+    if(i == 0 || compare_tool(&holes[i - 1], &holes[i]) != 0){
+      tool++;
+      context.tools[tool] = (struct Drill_Tool){&holes[i], 0, holes[i].plated, tool + 1, holes[i].diameter, 0, 0};
+    }
+    context.tools[tool].count++;
+  }
+  for(struct Layer *layer = pcb->layers.layer; layer; layer = layer->next){
+    copper += is_copper(layer);
+  }
+
+  if(threads <= 0){
+    threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  threads = threads > context.count ? context.count : threads;
+  pthread_t *workers = malloc((threads ? threads : 1) * sizeof(pthread_t));
+  for(int i = 0; i < threads; i++){
+    pthread_create(&workers[i], NULL, drill_worker, &context);
+  }
+  for(int i = 0; i < threads; i++){
+    pthread_join(workers[i], NULL);
+  }
+  free(workers);
+
+  if(seed || travel){
+    double before = 0, after = 0;
+    for(int i = 0; i < context.count; i++){
+      before += context.tools[i].seed;
+      after += context.tools[i].travel;
+    }
+    if(seed){
+      *seed = before;
+    }
+    if(travel){
+      *travel = after;
+    }
+  }
+  if(write_drill_file(dir, TRUE, context.tools, context.count, copper) == ERROR || write_drill_file(dir, FALSE, context.tools, context.count, copper) == ERROR){
+    status = ERROR;
+  }
+  free(context.tools);
+  free(holes);
+  return status == ERROR ? ERROR : count;
+}
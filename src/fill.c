@@ -0,0 +1,799 @@
+#include <pthread.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "solver.h"
+
+// Zone filler
+// Every zone is scan converted into rows of [x0, x1) spans in integer
+// nanometres. Clearance grown copper of other nets and higher priority
+// zones is subtracted span by span, so no floating point clipping is done,
+// and the fill keeps the zone clearance from the board edge. Zones on one
+// layer are filled in priority order, everything else runs in parallel.
+
+#define NM(mm) ((int64_t)llround((double)(mm) * 1e6))
+#define MM(nm) ((float)((double)(nm) / 1e6))
+
+struct Span {
+  int64_t x0, x1;
+};
+
+struct Span_Row {
+  int count, capacity;
+  struct Span *spans;
+};
+
+// Row i covers y0 + i * pitch up to y0 + (i + 1) * pitch
+struct Spans {
+  int64_t y0, pitch;
+  int rows;
+  struct Span_Row *row;
+};
+
+struct Zone_Fill {
+  struct Zone *zone;
+  int rank;
+  struct Spans *keepout;
+};
+
+struct Fill_Context {
+  struct Board *board;
+  struct Zone_Fill *fills;
+  int count, wave;
+  int next;
+  int64_t pitch;
+};
+
+// Span rows
+static struct Spans *spans_create(int64_t y0, int rows, int64_t pitch){
+  struct Spans *spans = malloc(sizeof(struct Spans));
+  spans->y0 = y0;
+  spans->rows = rows > 0 ? rows : 0;
+  spans->pitch = pitch;
+  spans->row = calloc(spans->rows + 1, sizeof(struct Span_Row));
+  return spans;
+}
+
+static void spans_free(struct Spans *spans){
+  if(spans){
+    for(int i = 0; i < spans->rows; i++){
+      free(spans->row[i].spans);
+    }
+    free(spans->row);
+    free(spans);
+  }
+}
+
+static void row_push(struct Span_Row *row, int64_t x0, int64_t x1){
+  if(x1 <= x0){
+    return;
+  }
+  if(row->count == row->capacity){
+    row->capacity = row->capacity ? row->capacity * 2 : 8;
+    row->spans = realloc(row->spans, row->capacity * sizeof(struct Span));
+  }
+  row->spans[row->count].x0 = x0;
+  row->spans[row->count].x1 = x1;
+  row->count++;
+}
+
+static int compare_span(const void *_1, const void *_2){
+  const struct Span *span_1 = _1, *span_2 = _2;
+  return (span_1->x0 > span_2->x0) - (span_1->x0 < span_2->x0);
+}
+
+// Sorts and merges overlapping spans
+static void row_normalize(struct Span_Row *row){
+  if(row->count < 2){
+    return;
+  }
+  qsort(row->spans, row->count, sizeof(struct Span), compare_span);
+  int count = 0;
+  for(int i = 1; i < row->count; i++){
+    if(row->spans[i].x0 <= row->spans[count].x1){
+      if(row->spans[i].x1 > row->spans[count].x1){
+        row->spans[count].x1 = row->spans[i].x1;
+      }
+    }else{
+      row->spans[++count] = row->spans[i];
+    }
+  }
+  row->count = count + 1;
+}
+
+// a = a - b, both normalized
+static void row_subtract(struct Span_Row *a, const struct Span_Row *b){
+  if(a->count == 0 || b->count == 0){
+    return;
+  }
+  struct Span_Row out = {0, 0, NULL};
+  int j = 0;
+  for(int i = 0; i < a->count; i++){
+    int64_t x0 = a->spans[i].x0, x1 = a->spans[i].x1;
+    while(j < b->count && b->spans[j].x1 <= x0){
+      j++;
+    }
+    for(int k = j; k < b->count && b->spans[k].x0 < x1; k++){
+      row_push(&out, x0, b->spans[k].x0);
+      if(b->spans[k].x1 > x0){
+        x0 = b->spans[k].x1;
+      }
+    }
+    row_push(&out, x0, x1);
+  }
+  free(a->spans);
+  *a = out;
+}
+
+// a = a & b, both normalized
+static void row_intersect(struct Span_Row *a, const struct Span_Row *b){
+  struct Span_Row out = {0, 0, NULL};
+  int i = 0, j = 0;
+  while(i < a->count && j < b->count){
+    int64_t x0 = a->spans[i].x0 > b->spans[j].x0 ? a->spans[i].x0 : b->spans[j].x0;
+    int64_t x1 = a->spans[i].x1 < b->spans[j].x1 ? a->spans[i].x1 : b->spans[j].x1;
+    row_push(&out, x0, x1);
+    if(a->spans[i].x1 < b->spans[j].x1){
+      i++;
+    }else{
+      j++;
+    }
+  }
+  free(a->spans);
+  *a = out;
+}
+
+static void spans_normalize(struct Spans *spans){
+  for(int i = 0; i < spans->rows; i++){
+    row_normalize(&spans->row[i]);
+  }
+}
+
+static double row_center(const struct Spans *spans, int row){
+  return spans->y0 + (row + 0.5) * spans->pitch;
+}
+
+static void row_range(const struct Spans *spans, double min_y, double max_y, int *first, int *last){
+  *first = (int)ceil((min_y - spans->y0) / spans->pitch - 0.5);
+  *last = (int)floor((max_y - spans->y0) / spans->pitch - 0.5);
+  *first = *first < 0 ? 0 : *first;
+  *last = *last >= spans->rows ? spans->rows - 1 : *last;
+}
+
+// Convex polygon, one span per row from the leftmost to the rightmost crossing
+static void spans_add_convex(struct Spans *spans, const struct Point *points, int count){
+  double min_y = INFINITY, max_y = -INFINITY;
+  for(int i = 0; i < count; i++){
+    min_y = fmin(min_y, points[i].y * 1e6);
+    max_y = fmax(max_y, points[i].y * 1e6);
+  }
+  int first, last;
+  row_range(spans, min_y, max_y, &first, &last);
+  for(int row = first; row <= last; row++){
+    double y = row_center(spans, row), min_x = INFINITY, max_x = -INFINITY;
+    for(int i = 0, j = count - 1; i < count; j = i++){
+      double yi = points[i].y * 1e6, yj = points[j].y * 1e6;
+      if((yi <= y) != (yj <= y)){
+        double x = points[i].x * 1e6 + (y - yi) * (points[j].x - points[i].x) * 1e6 / (yj - yi);
+        min_x = fmin(min_x, x);
+        max_x = fmax(max_x, x);
+      }
+    }
+    if(min_x < max_x){
+      row_push(&spans->row[row], (int64_t)floor(min_x), (int64_t)ceil(max_x));
+    }
+  }
+}
+
+// Crossings of one edge with the row centres, coordinates in nm
+static void edge_crossings(const struct Spans *spans, struct Span_Row *crossings, double xi, double yi, double xj, double yj){
+  int first, last;
+  row_range(spans, fmin(yi, yj), fmax(yi, yj), &first, &last);
+  for(int row = first; row <= last; row++){
+    double y = row_center(spans, row);
+    if((yi <= y) != (yj <= y)){
+      int64_t x = llround(xi + (y - yi) * (xj - xi) / (yj - yi));
+      row_push(&crossings[row], x, x + 1);
+    }
+  }
+}
+
+// Pairs the sorted crossings of each row into spans, even-odd rule
+static void add_crossings(struct Spans *spans, struct Span_Row *crossings){
+  for(int row = 0; row < spans->rows; row++){
+    struct Span_Row *crossing = &crossings[row];
+    qsort(crossing->spans, crossing->count, sizeof(struct Span), compare_span);
+    for(int i = 0; i + 1 < crossing->count; i += 2){
+      row_push(&spans->row[row], crossing->spans[i].x0, crossing->spans[i + 1].x0);
+    }
+    free(crossing->spans);
+  }
+  free(crossings);
+}
+
+// Any simple or self touching polygon, even-odd rule
+static void spans_add_polygon(struct Spans *spans, const struct Point *points, int count){
+  struct Span_Row *crossings = calloc(spans->rows + 1, sizeof(struct Span_Row));
+  for(int i = 0, j = count - 1; i < count; j = i++){
+    edge_crossings(spans, crossings, points[i].x * 1e6, points[i].y * 1e6, points[j].x * 1e6, points[j].y * 1e6);
+  }
+  add_crossings(spans, crossings);
+}
+
+// The board inside its outline, cutouts taken out by the even-odd rule
+static void spans_add_outline(struct Spans *spans, const struct Board_Outline *outline){
+  struct Span_Row *crossings = calloc(spans->rows + 1, sizeof(struct Span_Row));
+  for(const struct Ring *ring = outline->rings; ring; ring = ring->next){
+    for(int i = 0, j = ring->count - 1; i < ring->count; j = i++){
+      edge_crossings(spans, crossings, ring->x[i] * 1e6, ring->y[i] * 1e6, ring->x[j] * 1e6, ring->y[j] * 1e6);
+    }
+  }
+  add_crossings(spans, crossings);
+}
+
+// Round structuring element of radius r, row d away from the centre is
+// the chord of the disc at that height
+static int64_t disc_chord(int64_t r, int64_t pitch, int d){
+  double height = (double)d * pitch;
+  return llround(sqrt(fmax((double)r * r - height * height, 0)));
+}
+
+static struct Spans *spans_dilate(const struct Spans *src, int64_t r){
+  int k = (int)(r / src->pitch);
+  struct Spans *out = spans_create(src->y0 - k * src->pitch, src->rows + 2 * k, src->pitch);
+  for(int d = -k; d <= k; d++){
+    int64_t chord = disc_chord(r, src->pitch, d);
+    for(int row = 0; row < src->rows; row++){
+      for(int i = 0; i < src->row[row].count; i++){
+        row_push(&out->row[row + k + d], src->row[row].spans[i].x0 - chord, src->row[row].spans[i].x1 + chord);
+      }
+    }
+  }
+  spans_normalize(out);
+  return out;
+}
+
+static struct Spans *spans_erode(const struct Spans *src, int64_t r){
+  int k = (int)(r / src->pitch);
+  struct Spans *out = spans_create(src->y0, src->rows, src->pitch);
+  for(int row = k; row < src->rows - k; row++){
+    struct Span_Row *target = &out->row[row];
+    for(int i = 0; i < src->row[row].count; i++){
+      row_push(target, src->row[row].spans[i].x0 + r, src->row[row].spans[i].x1 - r);
+    }
+    for(int d = -k; d <= k && target->count; d++){
+      if(d == 0){
+        continue;
+      }
+      int64_t chord = disc_chord(r, src->pitch, d);
+      struct Span_Row shrunk = {0, 0, NULL};
+      for(int i = 0; i < src->row[row + d].count; i++){
+        row_push(&shrunk, src->row[row + d].spans[i].x0 + chord, src->row[row + d].spans[i].x1 - chord);
+      }
+      row_intersect(target, &shrunk);
+      free(shrunk.spans);
+    }
+  }
+  return out;
+}
+
+// Adds the rows of src that line up with rows of dst, grids share an origin
+static void spans_add_aligned(struct Spans *dst, const struct Spans *src){
+  int offset = (int)((src->y0 - dst->y0) / dst->pitch);
+  for(int row = 0; row < src->rows; row++){
+    if(row + offset < 0 || row + offset >= dst->rows){
+      continue;
+    }
+    for(int i = 0; i < src->row[row].count; i++){
+      row_push(&dst->row[row + offset], src->row[row].spans[i].x0, src->row[row].spans[i].x1);
+    }
+  }
+}
+
+// Obstacles
+struct Obstacles {
+  struct Zone *zone;
+  struct Spans *removed, *gap, *spokes;
+};
+
+static void add_spokes(struct Obstacles *obstacles, struct Footprint *footprint, struct Pad *pad){
+  struct Zone *zone = obstacles->zone;
+  struct Point centre = pad_position(footprint, pad);
+  float reach = fmaxf(pad->size.width, pad->size.height) / 2 + zone->thermal_gap + 2 * MM(obstacles->spokes->pitch);
+  float half = zone->thermal_bridge_width / 2;
+  float sizes[2][2] = {{reach, half}, {half, reach}};
+  for(int spoke = 0; spoke < 2; spoke++){
+    struct Point corners[4] = {{-sizes[spoke][0], -sizes[spoke][1]}, {sizes[spoke][0], -sizes[spoke][1]}, {sizes[spoke][0], sizes[spoke][1]}, {-sizes[spoke][0], sizes[spoke][1]}};
+    for(int i = 0; i < 4; i++){
+      corners[i] = rotate_point(corners[i], pad->at.angle);
+      corners[i].x += centre.x;
+      corners[i].y += centre.y;
+    }
+    spans_add_convex(obstacles->spokes, corners, 4);
+  }
+}
+
+static int add_obstacle(struct Item *item, void *context){
+  struct Obstacles *obstacles = context;
+  struct Zone *zone = obstacles->zone;
+  struct Point points[64], outline[PAD_OUTLINE_MAX];
+  int same_net = zone->net && zone->net->ordinal != 0 && item->net == zone->net;
+  if(item->kind == ITEM_PAD){
+    int mode = zone->connect_pads;
+    if(mode == THRU_HOLE_ONLY){
+      mode = item->pad->type == THRU_HOLE ? THERMAL_RELIEF : SOLID_FILL;
+    }
+    if(!same_net || mode == NO_CONNECT){
+      int count = pad_outline(item->footprint, item->pad, zone->clearance, outline);
+      spans_add_convex(obstacles->removed, outline, count);
+    }else if(mode == THERMAL_RELIEF){
+      int count = pad_outline(item->footprint, item->pad, zone->thermal_gap, outline);
+      spans_add_convex(obstacles->gap, outline, count);
+      add_spokes(obstacles, item->footprint, item->pad);
+    }
+    return TRUE;
+  }
+  if(same_net){
+    return TRUE;
+  }
+  struct Track *track = item->track;
+  switch(track->type){
+    case TRACK_TYPE_SEG:{
+      int count = capsule_outline(track->track.segment.start, track->track.segment.end, track->track.segment.width / 2 + zone->clearance, outline);
+      spans_add_convex(obstacles->removed, outline, count);
+      break;
+    }
+    case TRACK_TYPE_ARC:{
+      int chords = arc_points(track->track.arc.start, track->track.arc.mid, track->track.arc.end, MM(obstacles->removed->pitch), points, 64);
+      for(int i = 0; i + 1 < chords; i++){
+        int count = capsule_outline(points[i], points[i + 1], track->track.arc.width / 2 + zone->clearance, outline);
+        spans_add_convex(obstacles->removed, outline, count);
+      }
+      break;
+    }
+    case TRACK_TYPE_VIA:{
+      struct Point at = {track->track.via.at.x, track->track.via.at.y};
+      int count = capsule_outline(at, at, track->track.via.size / 2 + zone->clearance, outline);
+      spans_add_convex(obstacles->removed, outline, count);
+      break;
+    }
+  }
+  return TRUE;
+}
+
+// Span rows back to polygons
+// The spans sample the boundary at their row centres, so each span end
+// becomes a corner there and the edges between rows follow the copper
+// instead of stepping. Ends are linked in the order the staircase round
+// the spans visits them, spans that only meet at a corner kept apart, so
+// each ring is one boundary with the fill on its right. A ring whose
+// leftmost corner is a right end is a hole; it is joined by a zero width
+// cut along that row to the ring on its left, the way KiCad stores filled
+// polygons. Corners within half a row of the line through their
+// neighbours are dropped.
+
+struct Corner {
+  int64_t x, y;
+  int next, ring;
+};
+
+struct Trace_Ring {
+  int start, min_y, max_y;
+  int64_t x;
+};
+
+// First and last span of b overlapping each span of a, last < first for none
+static void row_overlaps(const struct Span_Row *a, const struct Span_Row *b, int *first, int *last){
+  int low = 0;
+  for(int j = 0; j < a->count; j++){
+    while(low < b->count && b->spans[low].x1 <= a->spans[j].x0){
+      low++;
+    }
+    int high = low;
+    while(high < b->count && b->spans[high].x0 < a->spans[j].x1){
+      high++;
+    }
+    first[j] = low;
+    last[j] = high - 1;
+  }
+}
+
+// Links the corners, left ends go up and right ends go down. 2s and 2s + 1
+// are the left and right end of span s.
+static void link_corners(const struct Spans *spans, const int *offset, struct Corner *corners, int *first, int *last){
+  for(int row = 0; row < spans->rows; row++){
+    const struct Span_Row *current = &spans->row[row];
+    int base = offset[row];
+    if(row + 1 < spans->rows){
+      const struct Span_Row *below = &spans->row[row + 1];
+      row_overlaps(current, below, first, last);
+      for(int j = 0; j < current->count; j++){
+        int k = last[j], next = 2 * (base + j);
+        if(k >= first[j]){
+          next = 2 * (offset[row + 1] + k) + 1;
+          // Along the top of the span below to the next span of this row
+          if(below->spans[k].x1 > current->spans[j].x1 && j + 1 < current->count && current->spans[j + 1].x0 < below->spans[k].x1){
+            next = 2 * (base + j + 1);
+          }
+        }
+        corners[2 * (base + j) + 1].next = next;
+      }
+    }else{
+      for(int j = 0; j < current->count; j++){
+        corners[2 * (base + j) + 1].next = 2 * (base + j);
+      }
+    }
+    if(row > 0){
+      const struct Span_Row *above = &spans->row[row - 1];
+      row_overlaps(current, above, first, last);
+      for(int j = 0; j < current->count; j++){
+        int k = first[j], next = 2 * (base + j) + 1;
+        if(k <= last[j]){
+          next = 2 * (offset[row - 1] + k);
+          // Along the bottom of the span above to the previous span of this row
+          if(above->spans[k].x0 < current->spans[j].x0 && j > 0 && current->spans[j - 1].x1 > above->spans[k].x0){
+            next = 2 * (base + j - 1) + 1;
+          }
+        }
+        corners[2 * (base + j)].next = next;
+      }
+    }else{
+      for(int j = 0; j < current->count; j++){
+        corners[2 * (base + j)].next = 2 * (base + j) + 1;
+      }
+    }
+  }
+}
+
+static int compare_hole(const void *_1, const void *_2){
+  const struct Trace_Ring *ring_1 = _1, *ring_2 = _2;
+  return (ring_1->x > ring_2->x) - (ring_1->x < ring_2->x);
+}
+
+static double chain_distance(const struct Corner *corners, const int *chain, int a, int b, int i){
+  const struct Corner *p = &corners[chain[i]], *s = &corners[chain[a]], *e = &corners[chain[b]];
+  double dx = (double)(e->x - s->x), dy = (double)(e->y - s->y);
+  double px = (double)(p->x - s->x), py = (double)(p->y - s->y);
+  double length2 = dx * dx + dy * dy;
+  double t = length2 > 0 ? fmax(0, fmin(1, (px * dx + py * dy) / length2)) : 0;
+  return hypot(px - t * dx, py - t * dy);
+}
+
+// Douglas-Peucker between kept corners a and b of the chain
+static void thin_chain(const struct Corner *corners, const int *chain, int a, int b, double tolerance, uint8_t *keep, int *stack){
+  int top = 0;
+  stack[top++] = a;
+  stack[top++] = b;
+  while(top){
+    b = stack[--top];
+    a = stack[--top];
+    int farthest = -1;
+    double distance = tolerance;
+    for(int i = a + 1; i < b; i++){
+      double d = chain_distance(corners, chain, a, b, i);
+      if(d > distance){
+        distance = d;
+        farthest = i;
+      }
+    }
+    if(farthest >= 0){
+      keep[farthest] = TRUE;
+      stack[top++] = a;
+      stack[top++] = farthest;
+      stack[top++] = farthest;
+      stack[top++] = b;
+    }
+  }
+}
+
+static struct Polygon *ring_polygon(const struct Spans *spans, const struct Corner *corners, const uint8_t *fixed, int start, struct Layer *layer){
+  int count = 0;
+  for(int c = start; count == 0 || c != start; c = corners[c].next){
+    count++;
+  }
+  // The chain closes on its first corner again
+  int *chain = malloc((count + 1) * sizeof(int));
+  uint8_t *keep = calloc(count + 1, 1);
+  int *stack = malloc(4 * (count + 1) * sizeof(int));
+  int farthest = 0;
+  double distance = -1;
+  for(int i = 0, c = start; i <= count; i++, c = corners[c].next){
+    chain[i] = c;
+    keep[i] = i == 0 || i == count || fixed[c];
+    double d = hypot((double)(corners[c].x - corners[start].x), (double)(corners[c].y - corners[start].y));
+    if(i < count && d > distance){
+      distance = d;
+      farthest = i;
+    }
+  }
+  keep[farthest] = TRUE;
+  for(int a = 0, b = 1; b <= count; b++){
+    if(keep[b]){
+      thin_chain(corners, chain, a, b, spans->pitch / 2.0, keep, stack);
+      a = b;
+    }
+  }
+  struct Polygon *polygon = calloc(1, sizeof(struct Polygon));
+  polygon->points = malloc(count * sizeof(struct Point));
+  for(int i = 0; i < count; i++){
+    if(keep[i]){
+      polygon->points[polygon->point_count++] = (struct Point){MM(corners[chain[i]].x), MM(corners[chain[i]].y)};
+    }
+  }
+  polygon->point_index = polygon->point_count;
+  polygon->layer = layer;
+  free(chain);
+  free(keep);
+  free(stack);
+  return polygon;
+}
+
+static struct Polygon *spans_polygons(const struct Spans *spans, struct Layer *layer){
+  int *offset = malloc((spans->rows + 1) * sizeof(int));
+  int widest = 0;
+  offset[0] = 0;
+  for(int row = 0; row < spans->rows; row++){
+    offset[row + 1] = offset[row] + spans->row[row].count;
+    widest = spans->row[row].count > widest ? spans->row[row].count : widest;
+  }
+  int ends = 2 * offset[spans->rows];
+  if(ends == 0){
+    free(offset);
+    return NULL;
+  }
+  // Every hole adds two corners for its cut
+  struct Corner *corners = malloc(2 * ends * sizeof(struct Corner));
+  uint8_t *fixed = calloc(2 * ends, 1);
+  for(int row = 0; row < spans->rows; row++){
+    int64_t y = spans->y0 + spans->pitch * row + spans->pitch / 2;
+    for(int j = 0; j < spans->row[row].count; j++){
+      int s = offset[row] + j;
+      corners[2 * s] = (struct Corner){spans->row[row].spans[j].x0, y, -1, -1};
+      corners[2 * s + 1] = (struct Corner){spans->row[row].spans[j].x1, y, -1, -1};
+    }
+  }
+  int *first = malloc(widest * sizeof(int)), *last = malloc(widest * sizeof(int));
+  link_corners(spans, offset, corners, first, last);
+  free(first);
+  free(last);
+
+  // Rings with their leftmost corner and the rows they cover
+  struct Trace_Ring *rings = malloc((ends / 2) * sizeof(struct Trace_Ring));
+  int ring_count = 0;
+  for(int c = 0; c < ends; c++){
+    if(corners[c].ring >= 0){
+      continue;
+    }
+    struct Trace_Ring *ring = &rings[ring_count];
+    *ring = (struct Trace_Ring){c, INT32_MAX, -1, corners[c].x};
+    for(int i = c; corners[i].ring < 0; i = corners[i].next){
+      corners[i].ring = ring_count;
+      int row = (int)((corners[i].y - spans->y0) / spans->pitch);
+      ring->min_y = row < ring->min_y ? row : ring->min_y;
+      ring->max_y = row > ring->max_y ? row : ring->max_y;
+      if(corners[i].x < ring->x){
+        ring->x = corners[i].x;
+        ring->start = i;
+      }
+    }
+    ring_count++;
+  }
+
+  // Holes left to right, so the ring on the left of each is already whole
+  struct Trace_Ring *holes = malloc((ring_count ? ring_count : 1) * sizeof(struct Trace_Ring));
+  int hole_count = 0;
+  for(int r = 0; r < ring_count; r++){
+    if((rings[r].start & 1) && rings[r].min_y < rings[r].max_y){
+      holes[hole_count++] = rings[r];
+    }
+  }
+  qsort(holes, hole_count, sizeof(struct Trace_Ring), compare_hole);
+  int count = ends;
+  for(int h = 0; h < hole_count; h++){
+    int hole = holes[h].start, left = hole - 1;
+    // Holes one row high are dropped, the cut runs on through them
+    while(rings[corners[left].ring].min_y == rings[corners[left].ring].max_y){
+      left -= 2;
+    }
+    int cut_hole = count++, cut_left = count++;
+    corners[cut_hole] = (struct Corner){corners[hole].x, corners[hole].y, corners[hole].next, corners[left].ring};
+    corners[cut_left] = (struct Corner){corners[left].x, corners[left].y, corners[left].next, corners[left].ring};
+    corners[left].next = cut_hole;
+    corners[hole].next = cut_left;
+    fixed[hole] = fixed[left] = fixed[cut_hole] = fixed[cut_left] = TRUE;
+  }
+
+  struct Polygon *polygons = NULL;
+  for(int r = 0; r < ring_count; r++){
+    if(!(rings[r].start & 1) && rings[r].min_y < rings[r].max_y){
+      struct Polygon *polygon = ring_polygon(spans, corners, fixed, rings[r].start, layer);
+      polygon->next = polygons;
+      polygons = polygon;
+    }
+  }
+  free(holes);
+  free(rings);
+  free(fixed);
+  free(corners);
+  free(offset);
+  return polygons;
+}
+
+static void replace_fill(struct Zone *zone, struct Polygon *polygons){
+  struct Polygon *polygon = zone->filled_polygon.next;
+  free(zone->filled_polygon.points);
+  while(polygon){
+    struct Polygon *temp = polygon;
+    polygon = polygon->next;
+    free(temp->points);
+    free(temp);
+  }
+  memset(&zone->filled_polygon, 0, sizeof(struct Polygon));
+  if(polygons){
+    // The first polygon lives inside the zone, the rest stay chained
+    zone->filled_polygon = *polygons;
+    free(polygons);
+  }
+  zone->index.set = SECTION_MODIFIED;
+  zone_rings_init(zone);
+}
+
+static void fill_zone(struct Fill_Context *context, struct Zone_Fill *zone_fill){
+  struct Zone *zone = zone_fill->zone;
+  struct Polygon *outline = &zone->polygon;
+  int count = outline->point_index ? outline->point_index : outline->point_count;
+  double min_y = INFINITY, max_y = -INFINITY;
+  struct Box box = {INFINITY, INFINITY, -INFINITY, -INFINITY};
+  for(int i = 0; i < count; i++){
+    box.min_x = fminf(box.min_x, outline->points[i].x);
+    box.min_y = fminf(box.min_y, outline->points[i].y);
+    box.max_x = fmaxf(box.max_x, outline->points[i].x);
+    box.max_y = fmaxf(box.max_y, outline->points[i].y);
+  }
+  min_y = box.min_y * 1e6;
+  max_y = box.max_y * 1e6;
+  int64_t y0 = (int64_t)floor(min_y / context->pitch) * context->pitch;
+  int rows = (int)ceil((max_y - y0) / context->pitch);
+
+  struct Spans *fill = spans_create(y0, rows, context->pitch);
+  spans_add_polygon(fill, outline->points, count);
+  spans_normalize(fill);
+
+  struct Obstacles obstacles = {zone, spans_create(y0, rows, context->pitch), spans_create(y0, rows, context->pitch), spans_create(y0, rows, context->pitch)};
+  float grow = fmaxf(zone->clearance, zone->thermal_gap);
+  struct Box query = {box.min_x - grow, box.min_y - grow, box.max_x + grow, box.max_y + grow};
+  spatial_query(context->board->spatial, query, layer_mask(zone->layer), add_obstacle, &obstacles);
+
+  // Higher priority zones of other nets keep their clearance
+  for(int i = 0; i < context->count; i++){
+    struct Zone_Fill *other = &context->fills[i];
+    if(other->keepout && other->rank < zone_fill->rank && other->zone->layer == zone->layer && other->zone->net != zone->net){
+      spans_add_aligned(obstacles.removed, other->keepout);
+    }
+  }
+
+  spans_normalize(obstacles.gap);
+  spans_normalize(obstacles.spokes);
+  for(int row = 0; row < rows; row++){
+    row_subtract(&obstacles.gap->row[row], &obstacles.spokes->row[row]);
+    for(int i = 0; i < obstacles.gap->row[row].count; i++){
+      row_push(&obstacles.removed->row[row], obstacles.gap->row[row].spans[i].x0, obstacles.gap->row[row].spans[i].x1);
+    }
+    row_normalize(&obstacles.removed->row[row]);
+    row_subtract(&fill->row[row], &obstacles.removed->row[row]);
+  }
+  spans_free(obstacles.removed);
+  spans_free(obstacles.gap);
+  spans_free(obstacles.spokes);
+
+  // The board less the zone clearance from its edges and cutouts, rows
+  // beyond the zone's so the erosion reaches them
+  const struct Board_Outline *board_outline = context->board->outline;
+  if(board_outline->rings){
+    int k = (int)(NM(zone->clearance) / context->pitch) + 1;
+    struct Spans *board = spans_create(y0 - k * context->pitch, rows + 2 * k, context->pitch);
+    spans_add_outline(board, board_outline);
+    spans_normalize(board);
+    struct Spans *inside = spans_erode(board, NM(zone->clearance));
+    spans_free(board);
+    for(int row = 0; row < rows; row++){
+      row_intersect(&fill->row[row], &inside->row[row + k]);
+    }
+    spans_free(inside);
+  }
+
+  // Opening by half the minimum width drops slivers thinner than it
+  if(zone->min_thickness > 0){
+    struct Spans *eroded = spans_erode(fill, NM(zone->min_thickness / 2));
+    spans_free(fill);
+    struct Spans *opened = spans_dilate(eroded, NM(zone->min_thickness / 2));
+    spans_free(eroded);
+    fill = spans_create(y0, rows, context->pitch);
+    spans_add_aligned(fill, opened);
+    spans_free(opened);
+    spans_normalize(fill);
+  }
+
+  zone_fill->keepout = spans_dilate(fill, NM(zone->clearance));
+  replace_fill(zone, spans_polygons(fill, zone->layer));
+  spans_free(fill);
+}
+
+static void *fill_worker(void *arg){
+  struct Fill_Context *context = arg;
+  pcb = context->board;
+  while(1){
+    int i = __atomic_fetch_add(&context->next, 1, __ATOMIC_RELAXED);
+    if(i >= context->count){
+      break;
+    }
+    if(context->fills[i].rank == context->wave){
+      fill_zone(context, &context->fills[i]);
+    }
+  }
+  return NULL;
+}
+
+// Refills every zone with an outline and a layer, resolution is the row
+// pitch in mm and threads <= 0 uses every core
+int fill_zones(float resolution, int threads){
+  struct Fill_Context context;
+  int count = 0, waves = 0;
+  if(threads <= 0){
+    threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  if(pcb->spatial == NULL){
+    spatial_index_init();
+  }
+  if(pcb->outline == NULL){
+    board_outline_init(0);
+  }
+  for(struct Zone *zone = pcb->zones; zone; zone = zone->next){
+    count++;
+  }
+  context.board = pcb;
+  context.pitch = NM(resolution) > 0 ? NM(resolution) : 1;
+  context.fills = calloc(count ? count : 1, sizeof(struct Zone_Fill));
+  context.count = 0;
+  for(struct Zone *zone = pcb->zones; zone; zone = zone->next){
+    if(zone->layer && zone->polygon.points && zone->polygon.point_count >= 3){
+      context.fills[context.count++].zone = zone;
+    }
+  }
+  // Rank is the number of distinct higher priorities on the same layer
+  for(int i = 0; i < context.count; i++){
+    struct Zone *zone = context.fills[i].zone;
+    for(int j = 0; j < context.count; j++){
+      struct Zone *other = context.fills[j].zone;
+      int duplicate = FALSE;
+      if(other->layer != zone->layer || other->priority <= zone->priority){
+        continue;
+      }
+      for(int k = 0; k < j; k++){
+        if(context.fills[k].zone->layer == zone->layer && context.fills[k].zone->priority == other->priority){
+          duplicate = TRUE;
+        }
+      }
+      context.fills[i].rank += duplicate ? 0 : 1;
+    }
+    waves = context.fills[i].rank + 1 > waves ? context.fills[i].rank + 1 : waves;
+  }
+
+  pthread_t *workers = malloc(threads * sizeof(pthread_t));
+  for(context.wave = 0; context.wave < waves; context.wave++){
+    context.next = 0;
+    for(int i = 0; i < threads; i++){
+      pthread_create(&workers[i], NULL, fill_worker, &context);
+    }
+    for(int i = 0; i < threads; i++){
+      pthread_join(workers[i], NULL);
+    }
+  }
+  free(workers);
+
+  for(int i = 0; i < context.count; i++){
+    spans_free(context.fills[i].keepout);
+  }
+  free(context.fills);
+  return context.count;
+}
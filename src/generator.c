@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <math.h>
+
+#include "solver.h"
+
+// Synthetic board generator
+// Writes a KiCad board with the requested item counts. The same settings
+// and seed always give the same bytes, so benchmark runs compare.
+
+#define GENERATOR_INNER_LAYERS 2
+#define GENERATOR_PITCH 5.0
+
+static uint64_t next_random(uint64_t *state){
+  // xorshift64*
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * 0x2545F4914F6CDD1Dull;
+}
+
+static double random_range(uint64_t *state, double min, double max){
+  return min + (max - min) * (double)(next_random(state) >> 11) / (double)(1ull << 53);
+}
+
+static void write_uuid(FILE *file, uint64_t *state){
+  uint64_t high = next_random(state), low = next_random(state);
+  fprintf(file, "(uuid \"%08x-%04x-4%03x-%04x-%012llx\")", (uint32_t)(high >> 32), (uint32_t)(high >> 16) & 0xffff, (uint32_t)high & 0xfff,
+    ((uint32_t)(low >> 48) & 0x3fff) | 0x8000, (unsigned long long)(low & 0xffffffffffffull));
+}
+
+static const char *copper_layer(uint32_t index){
+  static const char *layers[] = {"F.Cu", "In1.Cu", "In2.Cu", "B.Cu"};
+  return layers[index % (GENERATOR_INNER_LAYERS + 2)];
+}
+
+static uint32_t random_net(uint64_t *state, const struct Generator *generator){
+  return generator->nets > 1 ? 1 + next_random(state) % (generator->nets - 1) : 0;
+}
+
+// Pads come in fours: one to the right neighbour, one back to the left
+// one, one down and one back up, so each link is a two pad net
+static uint32_t local_net(const struct Generator *generator, uint32_t columns, uint32_t index, uint32_t pad){
+  uint32_t group = pad % 4, slots = (generator->pads + 3) / 4;
+  if((group == 0 && (index % columns == columns - 1 || index + 1 >= generator->footprints)) || (group == 1 && index % columns == 0) ||
+     (group == 2 && index + columns >= generator->footprints) || (group == 3 && index < columns)){
+    return 0;
+  }
+  uint32_t owner = group == 1 ? index - 1 : (group == 3 ? index - columns : index);
+  uint64_t link = ((uint64_t)owner * 2 + (group >= 2)) * slots + pad / 4;
+  return generator->nets > 1 ? 1 + link % (generator->nets - 1) : 0;
+}
+
+static void write_header(FILE *file, const struct Generator *generator){
+  fprintf(file, "(kicad_pcb\n\t(version 20240108)\n\t(generator \"solver_generator\")\n\t(generator_version \"1.0\")\n");
+  fprintf(file, "\t(general\n\t\t(thickness 1.6)\n\t\t(legacy_teardrops no)\n\t)\n\t(paper \"A4\")\n\t(layers\n");
+  fprintf(file, "\t\t(0 \"F.Cu\" signal)\n\t\t(1 \"In1.Cu\" power)\n\t\t(2 \"In2.Cu\" power)\n\t\t(31 \"B.Cu\" signal)\n");
+  fprintf(file, "\t\t(37 \"F.SilkS\" user \"F.Silkscreen\")\n\t\t(44 \"Edge.Cuts\" user)\n\t\t(47 \"F.CrtYd\" user \"F.Courtyard\")\n\t\t(49 \"F.Fab\" user)\n\t)\n");
+  fprintf(file, "\t(setup\n\t\t(pad_to_mask_clearance 0)\n\t\t(allow_soldermask_bridges_in_footprints no)\n\t)\n");
+  fprintf(file, "\t(net 0 \"\")\n");
+  for(uint32_t net = 1; net < generator->nets; net++){
+    fprintf(file, "\t(net %u \"N%u\")\n", net, net);
+  }
+}
+
+static void write_footprint(FILE *file, uint64_t *state, const struct Generator *generator, uint32_t columns, uint32_t index, double x, double y){
+  fprintf(file, "\t(footprint \"Generated:FP_%u\"\n\t\t(layer \"F.Cu\")\n\t\t", generator->pads);
+  write_uuid(file, state);
+  fprintf(file, "\n\t\t(at %.4f %.4f %d)\n", x, y, (int)(next_random(state) % 4) * 90);
+  fprintf(file, "\t\t(property \"Reference\" \"U%u\"\n\t\t\t(at 0 -1.5 0)\n\t\t\t(layer \"F.SilkS\")\n\t\t\t", index + 1);
+  write_uuid(file, state);
+  fprintf(file, "\n\t\t)\n\t\t(attr smd)\n");
+  fprintf(file, "\t\t(fp_line\n\t\t\t(start -1 -1)\n\t\t\t(end 1 -1)\n\t\t\t(stroke\n\t\t\t\t(width 0.05)\n\t\t\t\t(type solid)\n\t\t\t)\n\t\t\t(layer \"F.CrtYd\")\n\t\t\t");
+  write_uuid(file, state);
+  fprintf(file, "\n\t\t)\n");
+  for(uint32_t pad = 0; pad < generator->pads; pad++){
+    uint32_t net = generator->local ? local_net(generator, columns, index, pad) : random_net(state, generator);
+    // Two rows of pads at a 0.5 mm pitch
+    double pad_x = (pad / 2) * 0.5 - generator->pads * 0.125, pad_y = pad % 2 ? 0.8 : -0.8;
+    fprintf(file, "\t\t(pad \"%u\" smd roundrect\n\t\t\t(at %.4f %.4f)\n\t\t\t(size 0.3 0.6)\n", pad + 1, pad_x, pad_y);
+    fprintf(file, "\t\t\t(layers \"F.Cu\" \"F.Paste\" \"F.Mask\")\n\t\t\t(roundrect_rratio 0.25)\n\t\t\t(net %u \"N%u\")\n\t\t\t", net, net);
+    write_uuid(file, state);
+    fprintf(file, "\n\t\t)\n");
+  }
+  fprintf(file, "\t)\n");
+}
+
+static void write_zone(FILE *file, uint64_t *state, const struct Generator *generator, uint32_t index, double width, double height){
+  uint32_t net = random_net(state, generator);
+  fprintf(file, "\t(zone\n\t\t(net %u)\n\t\t(net_name \"N%u\")\n\t\t(layer \"%s\")\n\t\t", net, net, copper_layer(index));
+  write_uuid(file, state);
+  fprintf(file, "\n\t\t(hatch edge 0.5)\n\t\t(priority %u)\n\t\t(connect_pads\n\t\t\t(clearance 0.5)\n\t\t)\n\t\t(min_thickness 0.25)\n", index);
+  fprintf(file, "\t\t(fill yes\n\t\t\t(thermal_gap 0.5)\n\t\t\t(thermal_bridge_width 0.5)\n\t\t)\n");
+  fprintf(file, "\t\t(polygon\n\t\t\t(pts\n\t\t\t\t(xy 0 0) (xy %.4f 0) (xy %.4f %.4f) (xy 0 %.4f)\n\t\t\t)\n\t\t)\n", width, width, height, height);
+  if(generator->fill_points >= 3){
+    // A wobbly ellipse stands in for a real fill outline
+    fprintf(file, "\t\t(filled_polygon\n\t\t\t(layer \"%s\")\n\t\t\t(pts\n\t\t\t\t", copper_layer(index));
+    for(uint32_t point = 0; point < generator->fill_points; point++){
+      double angle = 2 * M_PI * point / generator->fill_points, wobble = random_range(state, 0.95, 1.0);
+      fprintf(file, "(xy %.6f %.6f)%s", width / 2 + cos(angle) * width / 2 * wobble, height / 2 + sin(angle) * height / 2 * wobble, point % 4 == 3 ? "\n\t\t\t\t" : " ");
+    }
+    fprintf(file, "\n\t\t\t)\n\t\t)\n");
+  }
+  fprintf(file, "\t)\n");
+}
+
+// Returns the number of items written, footprints and pads count one each
+uint64_t generate_board(FILE *file, const struct Generator *generator){
+  uint64_t state = generator->seed ? generator->seed : 0x9E3779B97F4A7C15ull;
+  uint32_t columns = (uint32_t)ceil(sqrt(generator->footprints ? generator->footprints : 1));
+  double width = (columns + 1) * GENERATOR_PITCH, height = width;
+  uint64_t items = 0;
+
+  write_header(file, generator);
+  for(uint32_t i = 0; i < generator->footprints; i++){
+    write_footprint(file, &state, generator, columns, i, (i % columns + 1) * GENERATOR_PITCH, (i / columns + 1) * GENERATOR_PITCH);
+    items += 1 + generator->pads;
+  }
+  for(uint32_t i = 0; i < generator->segments; i++){
+    double x = random_range(&state, 0, width), y = random_range(&state, 0, height);
+    int horizontal = next_random(&state) & 1;
+    double length = random_range(&state, 0.5, 5);
+    fprintf(file, "\t(segment\n\t\t(start %.4f %.4f)\n\t\t(end %.4f %.4f)\n\t\t(width 0.2)\n\t\t(layer \"%s\")\n\t\t(net %u)\n\t\t",
+      x, y, horizontal ? x + length : x, horizontal ? y : y + length, copper_layer(next_random(&state)), random_net(&state, generator));
+    write_uuid(file, &state);
+    fprintf(file, "\n\t)\n");
+  }
+  for(uint32_t i = 0; i < generator->vias; i++){
+    fprintf(file, "\t(via\n\t\t(at %.4f %.4f)\n\t\t(size 0.6)\n\t\t(drill 0.3)\n\t\t(layers \"F.Cu\" \"B.Cu\")\n\t\t(net %u)\n\t\t",
+      random_range(&state, 0, width), random_range(&state, 0, height), random_net(&state, generator));
+    write_uuid(file, &state);
+    fprintf(file, "\n\t)\n");
+  }
+  for(uint32_t i = 0; i < generator->zones; i++){
+    write_zone(file, &state, generator, i, width, height);
+    items += 1 + generator->fill_points;
+  }
+  fprintf(file, ")\n");
+  return items + generator->segments + generator->vias;
+}
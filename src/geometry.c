@@ -0,0 +1,750 @@
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GEOMETRY_X86
+#endif
+#include <math.h>
+
+#include "solver.h"
+
+// Batch kernels for zone fill queries
+// Every kernel has a scalar version, an SSE version (4 lanes) and an AVX2
+// version (8 lanes), the widest one the cpu supports is picked at runtime.
+
+#define SIMD_SCALAR 0
+#define SIMD_SSE 1
+#define SIMD_AVX2 2
+
+static int simd_level = -1;
+
+// Threads may race to set it, they all store the same level
+static int simd(){
+  int level = __atomic_load_n(&simd_level, __ATOMIC_RELAXED);
+  if(level < 0){
+#ifdef GEOMETRY_X86
+    __builtin_cpu_init();
+    level = __builtin_cpu_supports("avx2") ? SIMD_AVX2 : SIMD_SSE;
+#else
+    level = SIMD_SCALAR;
+#endif
+    __atomic_store_n(&simd_level, level, __ATOMIC_RELAXED);
+  }
+  return level;
+}
+
+static float box_point_distance2(const struct Box *box, float x, float y){
+  float dx = fmaxf(fmaxf(box->min_x - x, x - box->max_x), 0.0f);
+  float dy = fmaxf(fmaxf(box->min_y - y, y - box->max_y), 0.0f);
+  return dx * dx + dy * dy;
+}
+
+static float box_box_distance2(const struct Box *_1, const struct Box *_2){
+  float dx = fmaxf(fmaxf(_1->min_x - _2->max_x, _2->min_x - _1->max_x), 0.0f);
+  float dy = fmaxf(fmaxf(_1->min_y - _2->max_y, _2->min_y - _1->max_y), 0.0f);
+  return dx * dx + dy * dy;
+}
+
+static float point_segment_distance2(float px, float py, float ax, float ay, float bx, float by){
+  float dx = bx - ax, dy = by - ay;
+  float dd = fmaxf(dx * dx + dy * dy, 1e-30f);
+  float t = ((px - ax) * dx + (py - ay) * dy) / dd;
+  t = fminf(fmaxf(t, 0.0f), 1.0f);
+  dx = ax + t * dx - px;
+  dy = ay + t * dy - py;
+  return dx * dx + dy * dy;
+}
+
+static float segment_segment_distance2(float ax, float ay, float bx, float by, float cx, float cy, float dx, float dy){
+  float o1 = (dx - cx) * (ay - cy) - (dy - cy) * (ax - cx);
+  float o2 = (dx - cx) * (by - cy) - (dy - cy) * (bx - cx);
+  float o3 = (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
+  float o4 = (bx - ax) * (dy - ay) - (by - ay) * (dx - ax);
+  if(o1 * o2 < 0 && o3 * o4 < 0){
+    return 0.0f;
+  }
+  float d = point_segment_distance2(ax, ay, cx, cy, dx, dy);
+  d = fminf(d, point_segment_distance2(bx, by, cx, cy, dx, dy));
+  d = fminf(d, point_segment_distance2(cx, cy, ax, ay, bx, by));
+  return fminf(d, point_segment_distance2(dx, dy, ax, ay, bx, by));
+}
+
+// Ring construction
+struct Ring *ring_create(struct Polygon *polygon){
+  int count = polygon->point_index ? polygon->point_index : polygon->point_count;
+  if(polygon->points == NULL || count < 3){
+    return NULL;
+  }
+  // The closing point is implicit
+  if(polygon->points[0].x == polygon->points[count - 1].x && polygon->points[0].y == polygon->points[count - 1].y){
+    count--;
+  }
+  struct Ring *ring = calloc(1, sizeof(struct Ring));
+  ring->count = count;
+  ring->block_count = (count + RING_BLOCK - 1) / RING_BLOCK;
+  // Padding edges repeat the first point so they are zero length
+  int padded = ring->block_count * RING_BLOCK + 1;
+  ring->x = malloc(padded * sizeof(float));
+  ring->y = malloc(padded * sizeof(float));
+  ring->slope = malloc(padded * sizeof(float));
+  ring->blocks = malloc(ring->block_count * sizeof(struct Box));
+  for(int i = 0; i < padded; i++){
+    struct Point point = polygon->points[i < count ? i : 0];
+    ring->x[i] = point.x;
+    ring->y[i] = point.y;
+  }
+  ring->box.min_x = ring->box.max_x = ring->x[0];
+  ring->box.min_y = ring->box.max_y = ring->y[0];
+  for(int block = 0; block < ring->block_count; block++){
+    struct Box *box = &ring->blocks[block];
+    int first = block * RING_BLOCK;
+    box->min_x = box->max_x = ring->x[first];
+    box->min_y = box->max_y = ring->y[first];
+    for(int i = first; i <= first + RING_BLOCK; i++){
+      box->min_x = fminf(box->min_x, ring->x[i]);
+      box->max_x = fmaxf(box->max_x, ring->x[i]);
+      box->min_y = fminf(box->min_y, ring->y[i]);
+      box->max_y = fmaxf(box->max_y, ring->y[i]);
+      if(i < first + RING_BLOCK){
+        float dy = ring->y[i + 1] - ring->y[i];
+        ring->slope[i] = dy != 0.0f ? (ring->x[i + 1] - ring->x[i]) / dy : 0.0f;
+      }
+    }
+    ring->box.min_x = fminf(ring->box.min_x, box->min_x);
+    ring->box.max_x = fmaxf(ring->box.max_x, box->max_x);
+    ring->box.min_y = fminf(ring->box.min_y, box->min_y);
+    ring->box.max_y = fmaxf(ring->box.max_y, box->max_y);
+  }
+  ring->slope[padded - 1] = 0.0f;
+  return ring;
+}
+
+void ring_free(struct Ring *ring){
+  while(ring){
+    struct Ring *temp = ring;
+    ring = ring->next;
+    free(temp->x);
+    free(temp->y);
+    free(temp->slope);
+    free(temp->blocks);
+    free(temp);
+  }
+}
+
+// Builds one ring per filled_polygon of the zone
+int zone_rings_init(struct Zone *zone){
+  ring_free(zone->rings);
+  zone->rings = NULL;
+  for(struct Polygon *polygon = &zone->filled_polygon; polygon; polygon = polygon->next){
+    struct Ring *ring = ring_create(polygon);
+    if(ring){
+      ring->next = zone->rings;
+      zone->rings = ring;
+    }
+  }
+  return zone->rings ? SUCCESS : ERROR;
+}
+
+// Point in ring (even-odd), lanes run across the points
+static void contains_scalar(const struct Ring *ring, const struct Point *points, int count, uint8_t *inside){
+  for(int p = 0; p < count; p++){
+    float px = points[p].x, py = points[p].y;
+    int crossings = 0;
+    if(box_point_distance2(&ring->box, px, py) > 0.0f){
+      inside[p] = FALSE;
+      continue;
+    }
+    for(int block = 0; block < ring->block_count; block++){
+      const struct Box *box = &ring->blocks[block];
+      if(box->max_y < py || box->min_y > py || box->max_x < px){
+        continue;
+      }
+      for(int i = block * RING_BLOCK; i < (block + 1) * RING_BLOCK; i++){
+        if((ring->y[i] > py) != (ring->y[i + 1] > py) && px < ring->x[i] + (py - ring->y[i]) * ring->slope[i]){
+          crossings ^= 1;
+        }
+      }
+    }
+    inside[p] = crossings;
+  }
+}
+
+#ifdef GEOMETRY_X86
+static void contains_sse(const struct Ring *ring, const struct Point *points, int count, uint8_t *inside){
+  int p = 0;
+  for(; p + 4 <= count; p += 4){
+    __m128 lo = _mm_loadu_ps(&points[p].x);
+    __m128 hi = _mm_loadu_ps(&points[p + 2].x);
+    __m128 px = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+    __m128 py = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+    __m128 odd = _mm_setzero_ps();
+    float min_x = points[p].x, min_y = points[p].y, max_y = points[p].y;
+    for(int i = 1; i < 4; i++){
+      min_x = fminf(min_x, points[p + i].x);
+      min_y = fminf(min_y, points[p + i].y);
+      max_y = fmaxf(max_y, points[p + i].y);
+    }
+    for(int block = 0; block < ring->block_count; block++){
+      const struct Box *box = &ring->blocks[block];
+      if(box->max_y < min_y || box->min_y > max_y || box->max_x < min_x){
+        continue;
+      }
+      for(int i = block * RING_BLOCK; i < (block + 1) * RING_BLOCK; i++){
+        __m128 yi = _mm_set1_ps(ring->y[i]);
+        __m128 yj = _mm_set1_ps(ring->y[i + 1]);
+        __m128 spans = _mm_xor_ps(_mm_cmpgt_ps(yi, py), _mm_cmpgt_ps(yj, py));
+        __m128 x = _mm_add_ps(_mm_set1_ps(ring->x[i]), _mm_mul_ps(_mm_sub_ps(py, yi), _mm_set1_ps(ring->slope[i])));
+        odd = _mm_xor_ps(odd, _mm_and_ps(spans, _mm_cmplt_ps(px, x)));
+      }
+    }
+    int mask = _mm_movemask_ps(odd);
+    for(int i = 0; i < 4; i++){
+      inside[p + i] = (mask >> i) & 1;
+    }
+  }
+  contains_scalar(ring, &points[p], count - p, &inside[p]);
+}
+
+__attribute__((target("avx2")))
+static void contains_avx2(const struct Ring *ring, const struct Point *points, int count, uint8_t *inside){
+  int p = 0;
+  for(; p + 8 <= count; p += 8){
+    __m256 lo = _mm256_loadu_ps(&points[p].x);
+    __m256 hi = _mm256_loadu_ps(&points[p + 4].x);
+    // Shuffle works per 128 bit lane, the 64 bit permute restores point order
+    __m256 px = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(lo, hi, 0x88)), 0xD8));
+    __m256 py = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(lo, hi, 0xDD)), 0xD8));
+    __m256 odd = _mm256_setzero_ps();
+    float min_x = points[p].x, min_y = points[p].y, max_y = points[p].y;
+    for(int i = 1; i < 8; i++){
+      min_x = fminf(min_x, points[p + i].x);
+      min_y = fminf(min_y, points[p + i].y);
+      max_y = fmaxf(max_y, points[p + i].y);
+    }
+    for(int block = 0; block < ring->block_count; block++){
+      const struct Box *box = &ring->blocks[block];
+      if(box->max_y < min_y || box->min_y > max_y || box->max_x < min_x){
+        continue;
+      }
+      for(int i = block * RING_BLOCK; i < (block + 1) * RING_BLOCK; i++){
+        __m256 yi = _mm256_set1_ps(ring->y[i]);
+        __m256 yj = _mm256_set1_ps(ring->y[i + 1]);
+        __m256 spans = _mm256_xor_ps(_mm256_cmp_ps(yi, py, _CMP_GT_OQ), _mm256_cmp_ps(yj, py, _CMP_GT_OQ));
+        __m256 x = _mm256_add_ps(_mm256_set1_ps(ring->x[i]), _mm256_mul_ps(_mm256_sub_ps(py, yi), _mm256_set1_ps(ring->slope[i])));
+        odd = _mm256_xor_ps(odd, _mm256_and_ps(spans, _mm256_cmp_ps(px, x, _CMP_LT_OQ)));
+      }
+    }
+    int mask = _mm256_movemask_ps(odd);
+    for(int i = 0; i < 8; i++){
+      inside[p + i] = (mask >> i) & 1;
+    }
+  }
+  contains_sse(ring, &points[p], count - p, &inside[p]);
+}
+#endif
+
+void ring_contains_points(const struct Ring *ring, const struct Point *points, int count, uint8_t *inside){
+#ifdef GEOMETRY_X86
+  if(simd() == SIMD_AVX2){
+    contains_avx2(ring, points, count, inside);
+    return;
+  }else if(simd() == SIMD_SSE){
+    contains_sse(ring, points, count, inside);
+    return;
+  }
+#endif
+  contains_scalar(ring, points, count, inside);
+}
+
+int ring_contains_point(const struct Ring *ring, struct Point point){
+  uint8_t inside;
+  contains_scalar(ring, &point, 1, &inside);
+  return inside;
+}
+
+// Distance to the ring boundary, lanes run across the edges of a block
+static float block_point_scalar(const struct Ring *ring, int block, float px, float py, float best){
+  for(int i = block * RING_BLOCK; i < (block + 1) * RING_BLOCK; i++){
+    best = fminf(best, point_segment_distance2(px, py, ring->x[i], ring->y[i], ring->x[i + 1], ring->y[i + 1]));
+  }
+  return best;
+}
+
+static float block_segment_scalar(const struct Ring *ring, int block, float ax, float ay, float bx, float by, float best){
+  for(int i = block * RING_BLOCK; i < (block + 1) * RING_BLOCK; i++){
+    best = fminf(best, segment_segment_distance2(ax, ay, bx, by, ring->x[i], ring->y[i], ring->x[i + 1], ring->y[i + 1]));
+  }
+  return best;
+}
+
+#ifdef GEOMETRY_X86
+static inline __m128 distance2_sse(__m128 px, __m128 py, __m128 ax, __m128 ay, __m128 bx, __m128 by){
+  __m128 dx = _mm_sub_ps(bx, ax), dy = _mm_sub_ps(by, ay);
+  __m128 dd = _mm_max_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_set1_ps(1e-30f));
+  __m128 t = _mm_div_ps(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(px, ax), dx), _mm_mul_ps(_mm_sub_ps(py, ay), dy)), dd);
+  t = _mm_min_ps(_mm_max_ps(t, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+  dx = _mm_sub_ps(_mm_add_ps(ax, _mm_mul_ps(t, dx)), px);
+  dy = _mm_sub_ps(_mm_add_ps(ay, _mm_mul_ps(t, dy)), py);
+  return _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+}
+
+static inline float hmin_sse(__m128 v){
+  v = _mm_min_ps(v, _mm_movehl_ps(v, v));
+  v = _mm_min_ss(v, _mm_shuffle_ps(v, v, 1));
+  return _mm_cvtss_f32(v);
+}
+
+static float block_point_sse(const struct Ring *ring, int block, float px, float py, float best){
+  __m128 x = _mm_set1_ps(px), y = _mm_set1_ps(py);
+  for(int i = block * RING_BLOCK; i < (block + 1) * RING_BLOCK; i += 4){
+    __m128 d = distance2_sse(x, y, _mm_loadu_ps(&ring->x[i]), _mm_loadu_ps(&ring->y[i]), _mm_loadu_ps(&ring->x[i + 1]), _mm_loadu_ps(&ring->y[i + 1]));
+    best = fminf(best, hmin_sse(d));
+  }
+  return best;
+}
+
+static inline __m128 cross_sse(__m128 ox, __m128 oy, __m128 ax, __m128 ay, __m128 bx, __m128 by){
+  return _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(ax, ox), _mm_sub_ps(by, oy)), _mm_mul_ps(_mm_sub_ps(ay, oy), _mm_sub_ps(bx, ox)));
+}
+
+static float block_segment_sse(const struct Ring *ring, int block, float ax, float ay, float bx, float by, float best){
+  __m128 qax = _mm_set1_ps(ax), qay = _mm_set1_ps(ay), qbx = _mm_set1_ps(bx), qby = _mm_set1_ps(by);
+  __m128 zero = _mm_setzero_ps();
+  for(int i = block * RING_BLOCK; i < (block + 1) * RING_BLOCK; i += 4){
+    __m128 cx = _mm_loadu_ps(&ring->x[i]), cy = _mm_loadu_ps(&ring->y[i]);
+    __m128 dx = _mm_loadu_ps(&ring->x[i + 1]), dy = _mm_loadu_ps(&ring->y[i + 1]);
+    __m128 d = distance2_sse(qax, qay, cx, cy, dx, dy);
+    d = _mm_min_ps(d, distance2_sse(qbx, qby, cx, cy, dx, dy));
+    d = _mm_min_ps(d, distance2_sse(cx, cy, qax, qay, qbx, qby));
+    d = _mm_min_ps(d, distance2_sse(dx, dy, qax, qay, qbx, qby));
+    // Strict crossings, touching is already a zero distance above
+    __m128 o1 = _mm_mul_ps(cross_sse(cx, cy, dx, dy, qax, qay), cross_sse(cx, cy, dx, dy, qbx, qby));
+    __m128 o2 = _mm_mul_ps(cross_sse(qax, qay, qbx, qby, cx, cy), cross_sse(qax, qay, qbx, qby, dx, dy));
+    __m128 crossing = _mm_and_ps(_mm_cmplt_ps(o1, zero), _mm_cmplt_ps(o2, zero));
+    d = _mm_andnot_ps(crossing, d);
+    best = fminf(best, hmin_sse(d));
+  }
+  return best;
+}
+
+__attribute__((target("avx2")))
+static inline __m256 distance2_avx2(__m256 px, __m256 py, __m256 ax, __m256 ay, __m256 bx, __m256 by){
+  __m256 dx = _mm256_sub_ps(bx, ax), dy = _mm256_sub_ps(by, ay);
+  __m256 dd = _mm256_max_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_set1_ps(1e-30f));
+  __m256 t = _mm256_div_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(px, ax), dx), _mm256_mul_ps(_mm256_sub_ps(py, ay), dy)), dd);
+  t = _mm256_min_ps(_mm256_max_ps(t, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+  dx = _mm256_sub_ps(_mm256_add_ps(ax, _mm256_mul_ps(t, dx)), px);
+  dy = _mm256_sub_ps(_mm256_add_ps(ay, _mm256_mul_ps(t, dy)), py);
+  return _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+}
+
+__attribute__((target("avx2")))
+static inline float hmin_avx2(__m256 v){
+  return hmin_sse(_mm_min_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1)));
+}
+
+__attribute__((target("avx2")))
+static inline __m256 cross_avx2(__m256 ox, __m256 oy, __m256 ax, __m256 ay, __m256 bx, __m256 by){
+  return _mm256_sub_ps(_mm256_mul_ps(_mm256_sub_ps(ax, ox), _mm256_sub_ps(by, oy)), _mm256_mul_ps(_mm256_sub_ps(ay, oy), _mm256_sub_ps(bx, ox)));
+}
+
+__attribute__((target("avx2")))
+static float block_point_avx2(const struct Ring *ring, int block, float px, float py, float best){
+  int i = block * RING_BLOCK;
+  __m256 d = distance2_avx2(_mm256_set1_ps(px), _mm256_set1_ps(py), _mm256_loadu_ps(&ring->x[i]), _mm256_loadu_ps(&ring->y[i]), _mm256_loadu_ps(&ring->x[i + 1]), _mm256_loadu_ps(&ring->y[i + 1]));
+  return fminf(best, hmin_avx2(d));
+}
+
+__attribute__((target("avx2")))
+static float block_segment_avx2(const struct Ring *ring, int block, float ax, float ay, float bx, float by, float best){
+  int i = block * RING_BLOCK;
+  __m256 qax = _mm256_set1_ps(ax), qay = _mm256_set1_ps(ay), qbx = _mm256_set1_ps(bx), qby = _mm256_set1_ps(by);
+  __m256 zero = _mm256_setzero_ps();
+  __m256 cx = _mm256_loadu_ps(&ring->x[i]), cy = _mm256_loadu_ps(&ring->y[i]);
+  __m256 dx = _mm256_loadu_ps(&ring->x[i + 1]), dy = _mm256_loadu_ps(&ring->y[i + 1]);
+  __m256 d = distance2_avx2(qax, qay, cx, cy, dx, dy);
+  d = _mm256_min_ps(d, distance2_avx2(qbx, qby, cx, cy, dx, dy));
+  d = _mm256_min_ps(d, distance2_avx2(cx, cy, qax, qay, qbx, qby));
+  d = _mm256_min_ps(d, distance2_avx2(dx, dy, qax, qay, qbx, qby));
+  __m256 o1 = _mm256_mul_ps(cross_avx2(cx, cy, dx, dy, qax, qay), cross_avx2(cx, cy, dx, dy, qbx, qby));
+  __m256 o2 = _mm256_mul_ps(cross_avx2(qax, qay, qbx, qby, cx, cy), cross_avx2(qax, qay, qbx, qby, dx, dy));
+  __m256 crossing = _mm256_and_ps(_mm256_cmp_ps(o1, zero, _CMP_LT_OQ), _mm256_cmp_ps(o2, zero, _CMP_LT_OQ));
+  d = _mm256_andnot_ps(crossing, d);
+  return fminf(best, hmin_avx2(d));
+}
+#endif
+
+static float point_distance2(const struct Ring *ring, float px, float py){
+  float (*kernel)(const struct Ring *, int, float, float, float) = block_point_scalar;
+#ifdef GEOMETRY_X86
+  kernel = simd() == SIMD_AVX2 ? block_point_avx2 : block_point_sse;
+#endif
+  float best = INFINITY;
+  for(int block = 0; block < ring->block_count; block++){
+    if(box_point_distance2(&ring->blocks[block], px, py) < best){
+      best = kernel(ring, block, px, py, best);
+    }
+  }
+  return best;
+}
+
+void ring_points_distance(const struct Ring *ring, const struct Point *points, int count, float *distance){
+  for(int p = 0; p < count; p++){
+    distance[p] = sqrtf(point_distance2(ring, points[p].x, points[p].y));
+  }
+}
+
+float ring_point_distance(const struct Ring *ring, struct Point point){
+  return sqrtf(point_distance2(ring, point.x, point.y));
+}
+
+static float segment_distance2(const struct Ring *ring, struct Point start, struct Point end){
+  float (*kernel)(const struct Ring *, int, float, float, float, float, float) = block_segment_scalar;
+#ifdef GEOMETRY_X86
+  kernel = simd() == SIMD_AVX2 ? block_segment_avx2 : block_segment_sse;
+#endif
+  struct Box box = {fminf(start.x, end.x), fminf(start.y, end.y), fmaxf(start.x, end.x), fmaxf(start.y, end.y)};
+  float best = INFINITY;
+  for(int block = 0; block < ring->block_count && best > 0.0f; block++){
+    if(box_box_distance2(&ring->blocks[block], &box) < best){
+      best = kernel(ring, block, start.x, start.y, end.x, end.y, best);
+    }
+  }
+  return best;
+}
+
+// Distance from each segment to the ring boundary, 0 when it crosses an edge
+void ring_segments_distance(const struct Ring *ring, const struct Point *starts, const struct Point *ends, int count, float *distance){
+  for(int s = 0; s < count; s++){
+    distance[s] = sqrtf(segment_distance2(ring, starts[s], ends[s]));
+  }
+}
+
+float ring_segment_distance(const struct Ring *ring, struct Point start, struct Point end){
+  return sqrtf(segment_distance2(ring, start, end));
+}
+
+// A track of the given width overlaps the fill when it starts inside it or
+// comes within half its width of the boundary
+void ring_segments_overlap(const struct Ring *ring, const struct Point *starts, const struct Point *ends, const float *widths, int count, uint8_t *overlap){
+  ring_contains_points(ring, starts, count, overlap);
+  for(int s = 0; s < count; s++){
+    if(overlap[s]){
+      continue;
+    }
+    float half = widths[s] / 2;
+    struct Box box = {fminf(starts[s].x, ends[s].x) - half, fminf(starts[s].y, ends[s].y) - half, fmaxf(starts[s].x, ends[s].x) + half, fmaxf(starts[s].y, ends[s].y) + half};
+    if(box_box_distance2(&ring->box, &box) > 0.0f){
+      continue;
+    }
+    overlap[s] = segment_distance2(ring, starts[s], ends[s]) < half * half;
+  }
+}
+
+int rings_contain_point(const struct Ring *rings, struct Point point){
+  for(const struct Ring *ring = rings; ring; ring = ring->next){
+    if(ring_contains_point(ring, point)){
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+int rings_overlap_segment(const struct Ring *rings, struct Point start, struct Point end, float width){
+  for(const struct Ring *ring = rings; ring; ring = ring->next){
+    uint8_t overlap;
+    ring_segments_overlap(ring, &start, &end, &width, 1, &overlap);
+    if(overlap){
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+// World space shapes
+// KiCad angles are in degrees, counter clockwise on screen with y pointing down
+struct Point rotate_point(struct Point point, float angle){
+  double radians = angle * M_PI / 180.0;
+  double c = cos(radians), s = sin(radians);
+  struct Point rotated = {(float)(point.x * c + point.y * s), (float)(-point.x * s + point.y * c)};
+  return rotated;
+}
+
+struct Point pad_position(struct Footprint *footprint, struct Pad *pad){
+  struct Point local = {pad->at.x, pad->at.y};
+  struct Point world = rotate_point(local, footprint->at.angle);
+  world.x += footprint->at.x;
+  world.y += footprint->at.y;
+  return world;
+}
+
+// Rounded rectangle centred on the origin, corner arcs are split into
+// ARC_STEPS chords pushed out so the polygon covers the true outline
+#define ARC_STEPS 4
+
+static int rounded_rect(float half_width, float half_height, float radius, struct Point *out){
+  if(radius <= 0){
+    out[0].x = -half_width, out[0].y = -half_height;
+    out[1].x = half_width, out[1].y = -half_height;
+    out[2].x = half_width, out[2].y = half_height;
+    out[3].x = -half_width, out[3].y = half_height;
+    return 4;
+  }
+  radius = fminf(radius, fminf(half_width, half_height));
+  float cover = radius / cosf(M_PI / 4 / ARC_STEPS);
+  float corners[4][2] = {{half_width - radius, half_height - radius}, {-(half_width - radius), half_height - radius}, {-(half_width - radius), -(half_height - radius)}, {half_width - radius, -(half_height - radius)}};
+  int count = 0;
+  for(int corner = 0; corner < 4; corner++){
+    for(int step = 0; step <= ARC_STEPS; step++){
+      double angle = (corner * 90.0 + step * 90.0 / ARC_STEPS) * M_PI / 180.0;
+      float r = (step == 0 || step == ARC_STEPS) ? radius : cover;
+      out[count].x = corners[corner][0] + r * cos(angle);
+      out[count].y = corners[corner][1] + r * sin(angle);
+      count++;
+    }
+  }
+  return count;
+}
+
+// Convex outline of a pad in board coordinates grown by inflate,
+// out needs room for PAD_OUTLINE_MAX points
+int pad_outline(struct Footprint *footprint, struct Pad *pad, float inflate, struct Point *out){
+  float half_width = pad->size.width / 2, half_height = pad->size.height / 2, radius = 0;
+  switch(pad->shape){
+    case CIRCLE:
+      half_height = half_width;
+      radius = half_width;
+      break;
+    case OVAL:
+      radius = fminf(half_width, half_height);
+      break;
+    case ROUNDRECT:
+      radius = pad->roundrect_rratio * fminf(pad->size.width, pad->size.height);
+      break;
+  }
+  if(inflate > 0){
+    half_width += inflate;
+    half_height += inflate;
+    radius += inflate;
+  }
+  int count = rounded_rect(half_width, half_height, radius, out);
+  struct Point centre = pad_position(footprint, pad);
+  for(int i = 0; i < count; i++){
+    out[i] = rotate_point(out[i], pad->at.angle);
+    out[i].x += centre.x;
+    out[i].y += centre.y;
+  }
+  return count;
+}
+
+// Track of the given radius between two points as a convex polygon
+int capsule_outline(struct Point start, struct Point end, float radius, struct Point *out){
+  float dx = end.x - start.x, dy = end.y - start.y;
+  float length = sqrtf(dx * dx + dy * dy);
+  float half_length = length / 2;
+  int count = rounded_rect(half_length + radius, radius, radius, out);
+  float c = length > 0 ? dx / length : 1, s = length > 0 ? dy / length : 0;
+  for(int i = 0; i < count; i++){
+    struct Point point = out[i];
+    out[i].x = (start.x + end.x) / 2 + point.x * c - point.y * s;
+    out[i].y = (start.y + end.y) / 2 + point.x * s + point.y * c;
+  }
+  return count;
+}
+
+// Circle through the three points of a track arc, FALSE when they are collinear
+int arc_center(struct Point start, struct Point mid, struct Point end, struct Point *center){
+  double ax = start.x, ay = start.y, bx = mid.x, by = mid.y, cx = end.x, cy = end.y;
+  double d = 2 * (ax * (by - cy) + bx * (cy - ay) + cx * (ay - by));
+  if(fabs(d) < 1e-12){
+    return FALSE;
+  }
+  double a2 = ax * ax + ay * ay, b2 = bx * bx + by * by, c2 = cx * cx + cy * cy;
+  center->x = (float)((a2 * (by - cy) + b2 * (cy - ay) + c2 * (ay - by)) / d);
+  center->y = (float)((a2 * (cx - bx) + b2 * (ax - cx) + c2 * (bx - ax)) / d);
+  return TRUE;
+}
+
+// Splits an arc into chords no further than max_error from the true arc,
+// writes at most max points and returns how many were written
+int arc_points(struct Point start, struct Point mid, struct Point end, float max_error, struct Point *out, int max){
+  struct Point center;
+  if(max < 2 || !arc_center(start, mid, end, &center)){
+    out[0] = start;
+    out[1] = end;
+    return 2;
+  }
+  double radius = hypot(start.x - center.x, start.y - center.y);
+  double a0 = atan2(start.y - center.y, start.x - center.x);
+  double am = atan2(mid.y - center.y, mid.x - center.x);
+  double a1 = atan2(end.y - center.y, end.x - center.x);
+  // Sweep from start to end through mid
+  double sweep = a1 - a0, to_mid = am - a0;
+  while(to_mid < 0) to_mid += 2 * M_PI;
+  while(sweep < 0) sweep += 2 * M_PI;
+  if(to_mid > sweep){
+    sweep -= 2 * M_PI;
+  }
+  double step = max_error < radius ? 2 * acos(1 - max_error / radius) : M_PI / 2;
+  int count = (int)ceil(fabs(sweep) / step);
+  count = count < 1 ? 1 : (count > max - 1 ? max - 1 : count);
+  for(int i = 0; i <= count; i++){
+    double angle = a0 + sweep * i / count;
+    out[i].x = (float)(center.x + radius * cos(angle));
+    out[i].y = (float)(center.y + radius * sin(angle));
+  }
+  out[0] = start;
+  out[count] = end;
+  return count + 1;
+}
+
+// Length along the arc from start through mid to end
+double arc_length(struct Point start, struct Point mid, struct Point end){
+  struct Point center;
+  if(!arc_center(start, mid, end, &center)){
+    return hypot(end.x - start.x, end.y - start.y);
+  }
+  double radius = hypot(start.x - center.x, start.y - center.y);
+  double a0 = atan2(start.y - center.y, start.x - center.x);
+  double am = atan2(mid.y - center.y, mid.x - center.x);
+  double a1 = atan2(end.y - center.y, end.x - center.x);
+  double sweep = a1 - a0, to_mid = am - a0;
+  while(to_mid < 0) to_mid += 2 * M_PI;
+  while(sweep < 0) sweep += 2 * M_PI;
+  if(to_mid > sweep){
+    sweep = 2 * M_PI - sweep;
+  }
+  return radius * sweep;
+}
+
+// Copper layers end in .Cu, Edge.Cuts only contains it
+int is_copper(struct Layer *layer){
+  if(!layer || !layer->canonical_name.chars){
+    return FALSE;
+  }
+  size_t length = strlen(layer->canonical_name.chars);
+  return length >= 3 && strcmp(layer->canonical_name.chars + length - 3, ".Cu") == 0;
+}
+
+int pad_on_layer(struct Pad *pad, struct Layer *layer){
+  for(int i = 0; i < pad->layer_count; i++){
+    if(pad->layers[i] == layer){
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+// Vias span every copper layer between their two end layers
+int via_on_layer(struct Via *via, struct Layer *layer){
+  if(!is_copper(layer) || via->layer_count == 0){
+    return FALSE;
+  }
+  int low = 64, high = -1;
+  for(int i = 0; i < via->layer_count; i++){
+    if(via->layers[i]){
+      low = via->layers[i]->ordinal < low ? via->layers[i]->ordinal : low;
+      high = via->layers[i]->ordinal > high ? via->layers[i]->ordinal : high;
+    }
+  }
+  return layer->ordinal >= low && layer->ordinal <= high;
+}
+
+struct Layer *track_layer(struct Track *track){
+  switch(track->type){
+    case TRACK_TYPE_SEG:
+      return track->track.segment.layer;
+    case TRACK_TYPE_ARC:
+      return track->track.arc.layer;
+  }
+  return NULL;
+}
+
+struct Net *track_net(struct Track *track){
+  switch(track->type){
+    case TRACK_TYPE_SEG:
+      return track->track.segment.net;
+    case TRACK_TYPE_ARC:
+      return track->track.arc.net;
+    case TRACK_TYPE_VIA:
+      return track->track.via.net;
+  }
+  return NULL;
+}
+
+static int compare_stackup(const void *_1, const void *_2){
+  uint64_t start_1 = (*(struct Layer *const *)_1)->index.section_start, start_2 = (*(struct Layer *const *)_2)->index.section_start;
+  return start_1 < start_2 ? -1 : start_1 > start_2;
+}
+
+static int compare_ordinal(const void *_1, const void *_2){
+  return (*(struct Layer *const *)_1)->ordinal - (*(struct Layer *const *)_2)->ordinal;
+}
+
+// Copper layers top to bottom, each with the dielectric down to the next
+// and its mean permittivity, from the stackup section or when the board has
+// none equal FR4 between them. Power layers and layers with a zone are
+// references, every layer is when none is. Returns the count, at most max.
+int copper_stack(struct Stack_Layer *stack, int max){
+  struct Layer *layers[STACK_MAX_LAYERS * 2];
+  int count = 0, copper = 0;
+  uint64_t start = pcb->stackup.index.section_start, end = pcb->stackup.index.section_end;
+  for(struct Layer *layer = pcb->layers.layer; layer && count < STACK_MAX_LAYERS * 2; layer = layer->next){
+    int dielectric = layer->canonical_name.chars && strncmp(layer->canonical_name.chars, "dielectric", 10) == 0;
+    if(end > start && layer->index.section_start >= start && layer->index.section_start < end && (is_copper(layer) || dielectric)){
+      layers[count++] = layer;
+      copper += is_copper(layer);
+    }
+  }
+  int stack_count = 0;
+  if(copper > 0){
+    qsort(layers, count, sizeof(struct Layer *), compare_stackup);
+    double weighted = 0;
+    for(int i = 0; i < count; i++){
+      if(is_copper(layers[i])){
+        if(stack_count == max){
+          break;
+        }
+        if(stack_count > 0){
+          stack[stack_count - 1].epsilon_r = stack[stack_count - 1].below > 0 ? weighted / stack[stack_count - 1].below : STACK_EPSILON_R;
+        }
+        stack[stack_count++] = (struct Stack_Layer){layers[i], layers[i]->thickness > 0 ? layers[i]->thickness : STACK_COPPER, 0, STACK_EPSILON_R, FALSE};
+        weighted = 0;
+      }else if(stack_count > 0){
+        stack[stack_count - 1].below += layers[i]->thickness;
+        weighted += layers[i]->thickness * (layers[i]->epsilon_r > 0 ? layers[i]->epsilon_r : STACK_EPSILON_R);
+      }
+    }
+  }else{
+    for(struct Layer *layer = pcb->layers.layer; layer && copper < STACK_MAX_LAYERS; layer = layer->next){
+      if(is_copper(layer)){
+        layers[copper++] = layer;
+      }
+    }
+    qsort(layers, copper, sizeof(struct Layer *), compare_ordinal);
+    copper = copper < max ? copper : max;
+    float board = pcb->general.thickness > 0 ? pcb->general.thickness : STACK_BOARD;
+    float dielectric = copper > 1 ? (board - copper * STACK_COPPER) / (copper - 1) : 0;
+    for(int i = 0; i < copper; i++){
+      stack[stack_count++] = (struct Stack_Layer){layers[i], STACK_COPPER, dielectric, STACK_EPSILON_R, FALSE};
+    }
+  }
+  // Dielectric of zero thickness would short the layers, the last has none
+  for(int i = 0; i + 1 < stack_count; i++){
+    stack[i].below = stack[i].below > 0 ? stack[i].below : 0.1f;
+  }
+  if(stack_count > 0){
+    stack[stack_count - 1].below = 0;
+  }
+
+  int references = 0;
+  for(int i = 0; i < stack_count; i++){
+    stack[i].reference = stack[i].layer->type == LAYER_TYPE_POWER;
+    for(struct Zone *zone = pcb->zones; zone && !stack[i].reference; zone = zone->next){
+      stack[i].reference = zone->layer == stack[i].layer;
+    }
+    references += stack[i].reference;
+  }
+  for(int i = 0; i < stack_count && references == 0; i++){
+    stack[i].reference = TRUE;
+  }
+  return stack_count;
+}
@@ -0,0 +1,369 @@
+#include <stdio.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "solver.h"
+
+// Gerber export
+// Writes one RS-274X file with X2 attributes per copper layer, the layers
+// are shared out between worker threads and each streams its own file.
+// Coordinates are integer nanometres (format 4.6 in mm) with Y flipped,
+// KiCad's Y axis points down. Apertures are looked up in a per layer hash
+// and defined the first time they are used. Pads that are not a plain
+// circle, or a rectangle or oval at a multiple of 90 degrees, are written as
+// regions from pad_outline, as are the zone fills.
+
+#define GERBER_BUFFER (1 << 18)
+#define GERBER_FIRST_CODE 10
+
+#define APERTURE_CIRCLE 1
+#define APERTURE_RECT 2
+#define APERTURE_OBROUND 3
+
+#define GERBER_NM(mm) ((int64_t)llround((double)(mm) * 1e6))
+
+struct Aperture {
+  int shape, code;
+  int64_t width, height;
+};
+
+struct Gerber_Layer {
+  struct Layer *layer;
+  int number, count;
+  char path[4096];
+  int status;
+};
+
+struct Gerber_Writer {
+  int fd, status;
+  char *buffer;
+  size_t length;
+  struct Aperture *apertures;
+  int capacity, used, next_code, current;
+};
+
+struct Gerber_Context {
+  struct Board *board;
+  struct Gerber_Layer *layers;
+  int count, next;
+};
+
+static void gerber_flush(struct Gerber_Writer *gerber){
+  size_t written = 0;
+  while(written < gerber->length && gerber->status == SUCCESS){
+    ssize_t count = write(gerber->fd, gerber->buffer + written, gerber->length - written);
+    if(count < 0){
+      gerber->status = ERROR;
+    }else{
+      written += count;
+    }
+  }
+  gerber->length = 0;
+}
+
+static void out(struct Gerber_Writer *gerber, const char *text, size_t length){
+  if(gerber->length + length > GERBER_BUFFER){
+    gerber_flush(gerber);
+  }
+  memcpy(gerber->buffer + gerber->length, text, length);
+  gerber->length += length;
+}
+
+static void out_text(struct Gerber_Writer *gerber, const char *text){
+  out(gerber, text, strlen(text));
+}
+
+static void out_int(struct Gerber_Writer *gerber, int64_t value){
+  char digits[24];
+  out(gerber, digits, format_int(digits, value));
+}
+
+// Millimetres from nanometres, without trailing zeros
+static void out_mm(struct Gerber_Writer *gerber, int64_t nm){
+  char digits[32];
+  int length = 0;
+  if(nm < 0){
+    digits[length++] = '-';
+    nm = -nm;
+  }
+  length += format_int(digits + length, nm / 1000000);
+  int64_t fraction = nm % 1000000;
+  if(fraction){
+    int places = 6;
+    for(; fraction % 10 == 0; places--){
+      fraction /= 10;
+    }
+    digits[length++] = '.';
+    for(int i = places - 1; i >= 0; i--){
+      digits[length + i] = '0' + fraction % 10;
+      fraction /= 10;
+    }
+    length += places;
+  }
+  out(gerber, digits, length);
+}
+
+static void out_point(struct Gerber_Writer *gerber, struct Point point, const char *operation){
+  out_text(gerber, "X");
+  out_int(gerber, GERBER_NM(point.x));
+  out_text(gerber, "Y");
+  out_int(gerber, -GERBER_NM(point.y));
+  out_text(gerber, operation);
+}
+
+static uint64_t aperture_hash(int shape, int64_t width, int64_t height){
+  uint64_t hash = (uint64_t)shape * 0x9E3779B97F4A7C15ull;
+  hash = (hash ^ (uint64_t)width) * 0xBF58476D1CE4E5B9ull;
+  hash = (hash ^ (uint64_t)height) * 0x94D049BB133111EBull;
+  return hash ^ (hash >> 31);
+}
+
+static void aperture_grow(struct Gerber_Writer *gerber){
+  struct Aperture *old = gerber->apertures;
+  int old_capacity = gerber->capacity;
+  gerber->capacity = old_capacity ? old_capacity * 2 : 64;
+  gerber->apertures = calloc(gerber->capacity, sizeof(struct Aperture));
+  for(int i = 0; i < old_capacity; i++){
+    if(old[i].shape){
+      uint64_t slot = aperture_hash(old[i].shape, old[i].width, old[i].height) & (gerber->capacity - 1);
+      while(gerber->apertures[slot].shape){
+        slot = (slot + 1) & (gerber->capacity - 1);
+      }
+      gerber->apertures[slot] = old[i];
+    }
+  }
+  free(old);
+}
+
+// Selects the aperture, defining it the first time it is seen
+static void use_aperture(struct Gerber_Writer *gerber, int shape, int64_t width, int64_t height){
+  static const char *templates[] = {"", "C", "R", "O"};
+  if(shape == APERTURE_CIRCLE){
+    height = width;
+  }
+  if(gerber->used * 2 >= gerber->capacity){
+    aperture_grow(gerber);
+  }
+  uint64_t slot = aperture_hash(shape, width, height) & (gerber->capacity - 1);
+  while(gerber->apertures[slot].shape){
+    struct Aperture *aperture = &gerber->apertures[slot];
+    if(aperture->shape == shape && aperture->width == width && aperture->height == height){
+      break;
+    }
+    slot = (slot + 1) & (gerber->capacity - 1);
+  }
+  struct Aperture *aperture = &gerber->apertures[slot];
+  if(aperture->shape == 0){
+    *aperture = (struct Aperture){shape, gerber->next_code++, width, height};
+    gerber->used++;
+    out_text(gerber, "%ADD");
+    out_int(gerber, aperture->code);
+    out_text(gerber, templates[shape]);
+    out_text(gerber, ",");
+    out_mm(gerber, width);
+    if(shape != APERTURE_CIRCLE){
+      out_text(gerber, "X");
+      out_mm(gerber, height);
+    }
+    out_text(gerber, "*%\n");
+  }
+  if(gerber->current != aperture->code){
+    gerber->current = aperture->code;
+    out_text(gerber, "D");
+    out_int(gerber, aperture->code);
+    out_text(gerber, "*\n");
+  }
+}
+
+static void region(struct Gerber_Writer *gerber, const struct Point *points, int count){
+  if(count < 3){
+    return;
+  }
+  out_text(gerber, "G36*\n");
+  out_point(gerber, points[0], "D02*\n");
+  for(int i = 1; i < count; i++){
+    out_point(gerber, points[i], "D01*\n");
+  }
+  out_point(gerber, points[0], "D01*\n");
+  out_text(gerber, "G37*\n");
+}
+
+static void segment(struct Gerber_Writer *gerber, struct Point start, struct Point end, float width){
+  use_aperture(gerber, APERTURE_CIRCLE, GERBER_NM(width), 0);
+  if(GERBER_NM(start.x) == GERBER_NM(end.x) && GERBER_NM(start.y) == GERBER_NM(end.y)){
+    out_point(gerber, start, "D03*\n");
+    return;
+  }
+  out_point(gerber, start, "D02*\n");
+  out_point(gerber, end, "D01*\n");
+}
+
+static void arc(struct Gerber_Writer *gerber, const struct Arc *arc){
+  struct Point center;
+  if(!arc_center(arc->start, arc->mid, arc->end, &center)){
+    segment(gerber, arc->start, arc->end, arc->width);
+    return;
+  }
+  use_aperture(gerber, APERTURE_CIRCLE, GERBER_NM(arc->width), 0);
+  // Turning direction with Y flipped, positive is counterclockwise
+  double cross = (double)(arc->mid.x - arc->start.x) * (arc->start.y - arc->end.y) - (double)(arc->start.y - arc->mid.y) * (arc->end.x - arc->start.x);
+  out_point(gerber, arc->start, "D02*\n");
+  out_text(gerber, cross > 0 ? "G03*\n" : "G02*\n");
+  out_point(gerber, arc->end, "I");
+  out_int(gerber, GERBER_NM(center.x) - GERBER_NM(arc->start.x));
+  out_text(gerber, "J");
+  out_int(gerber, GERBER_NM(arc->start.y) - GERBER_NM(center.y));
+  out_text(gerber, "D01*\nG01*\n");
+}
+
+static void pad(struct Gerber_Writer *gerber, struct Footprint *footprint, struct Pad *pad){
+  struct Point centre = pad_position(footprint, pad);
+  float angle = fmodf(pad->at.angle, 360);
+  angle = angle < 0 ? angle + 360 : angle;
+  int square = fmodf(angle, 90) == 0, turned = angle == 90 || angle == 270;
+  int64_t width = GERBER_NM(turned ? pad->size.height : pad->size.width), height = GERBER_NM(turned ? pad->size.width : pad->size.height);
+  if(pad->shape == CIRCLE){
+    use_aperture(gerber, APERTURE_CIRCLE, GERBER_NM(pad->size.width), 0);
+  }else if(pad->shape == RECT && square){
+    use_aperture(gerber, APERTURE_RECT, width, height);
+  }else if(pad->shape == OVAL && square){
+    use_aperture(gerber, APERTURE_OBROUND, width, height);
+  }else{
+    struct Point outline[PAD_OUTLINE_MAX];
+    region(gerber, outline, pad_outline(footprint, pad, 0, outline));
+    return;
+  }
+  out_point(gerber, centre, "D03*\n");
+}
+
+static int open_layer(struct Gerber_Writer *gerber, struct Gerber_Layer *layer){
+  gerber->fd = open(layer->path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if(gerber->fd < 0){
+    perror(layer->path);
+    return ERROR;
+  }
+  gerber->status = SUCCESS;
+  gerber->buffer = malloc(GERBER_BUFFER);
+  gerber->length = 0;
+  gerber->apertures = NULL;
+  gerber->capacity = gerber->used = gerber->current = 0;
+  gerber->next_code = GERBER_FIRST_CODE;
+  return SUCCESS;
+}
+
+static void write_layer(struct Gerber_Layer *layer){
+  struct Gerber_Writer gerber;
+  if(open_layer(&gerber, layer) == ERROR){
+    layer->status = ERROR;
+    return;
+  }
+  out_text(&gerber, "%TF.GenerationSoftware,Solver,Solver,1.0*%\n%TF.FileFunction,Copper,L");
+  out_int(&gerber, layer->number);
+  out_text(&gerber, layer->number == 1 ? ",Top*%\n" : layer->number == layer->count ? ",Bot*%\n" : ",Inr*%\n");
+  out_text(&gerber, "%TF.FilePolarity,Positive*%\n%FSLAX46Y46*%\n%MOMM*%\n%LPD*%\nG75*\nG01*\n");
+
+  // Zone fills first, everything else is drawn over them
+  for(struct Zone *zone = pcb->zones; zone; zone = zone->next){
+    for(struct Polygon *polygon = &zone->filled_polygon; polygon; polygon = polygon->next){
+      if(polygon->points && (polygon->layer ? polygon->layer : zone->layer) == layer->layer){
+        region(&gerber, polygon->points, polygon->point_index ? polygon->point_index : polygon->point_count);
+      }
+    }
+  }
+  for(struct Track *track = pcb->tracks; track; track = track->next){
+    if(track->type == TRACK_TYPE_SEG && track->track.segment.layer == layer->layer){
+      segment(&gerber, track->track.segment.start, track->track.segment.end, track->track.segment.width);
+    }else if(track->type == TRACK_TYPE_ARC && track->track.arc.layer == layer->layer){
+      arc(&gerber, &track->track.arc);
+    }else if(track->type == TRACK_TYPE_VIA && via_on_layer(&track->track.via, layer->layer)){
+      use_aperture(&gerber, APERTURE_CIRCLE, GERBER_NM(track->track.via.size), 0);
+      out_point(&gerber, (struct Point){track->track.via.at.x, track->track.via.at.y}, "D03*\n");
+    }
+  }
+  for(struct Footprint *footprint = pcb->footprints; footprint; footprint = footprint->next){
+    for(struct Pad *item = footprint->pads; item; item = item->next){
+      if(pad_on_layer(item, layer->layer)){
+        pad(&gerber, footprint, item);
+      }
+    }
+  }
+  out_text(&gerber, "M02*\n");
+  gerber_flush(&gerber);
+  if(close(gerber.fd) != 0 || gerber.status == ERROR){
+    perror(layer->path);
+    gerber.status = ERROR;
+  }
+  layer->status = gerber.status;
+  free(gerber.buffer);
+  free(gerber.apertures);
+}
+
+static void *gerber_worker(void *arg){
+  struct Gerber_Context *context = arg;
+  pcb = context->board;
+  while(1){
+    int i = __atomic_fetch_add(&context->next, 1, __ATOMIC_RELAXED);
+    if(i >= context->count){
+      break;
+    }
+    write_layer(&context->layers[i]);
+  }
+  return NULL;
+}
+
+static int compare_layers(const void *_1, const void *_2){
+  return ((const struct Gerber_Layer *)_1)->layer->ordinal - ((const struct Gerber_Layer *)_2)->layer->ordinal;
+}
+
+// Writes <dir>/<layer>.gbr for every copper layer, dots in the layer name
+// become underscores. threads <= 0 uses every core. Returns the number of
+// files written or ERROR.
+int export_gerbers(const char *dir, int threads){
+  struct Gerber_Context context = {pcb, NULL, 0, 0};
+  int status = SUCCESS;
+  for(struct Layer *layer = pcb->layers.layer; layer; layer = layer->next){
+    context.count += is_copper(layer);
+  }
+  if(context.count == 0){
+    printf("No copper layers to export\n");
+    return ERROR;
+  }
+  context.layers = calloc(context.count, sizeof(struct Gerber_Layer));
+  context.count = 0;
+  for(struct Layer *layer = pcb->layers.layer; layer; layer = layer->next){
+    if(is_copper(layer)){
+      context.layers[context.count++].layer = layer;
+    }
+  }
+  qsort(context.layers, context.count, sizeof(struct Gerber_Layer), compare_layers);
+  for(int i = 0; i < context.count; i++){
+    struct Gerber_Layer *layer = &context.layers[i];
+    layer->number = i + 1;
+    layer->count = context.count;
+    snprintf(layer->path, sizeof(layer->path), "%s/%s.gbr", dir, layer->layer->canonical_name.chars);
+    for(char *c = layer->path + strlen(dir) + 1; *c; c++){
+      *c = *c == '.' && strcmp(c, ".gbr") != 0 ? '_' : *c;
+    }
+  }
+
+  if(threads <= 0){
+    threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  threads = threads > context.count ? context.count : threads;
+  pthread_t *workers = malloc(threads * sizeof(pthread_t));
+  for(int i = 0; i < threads; i++){
+    pthread_create(&workers[i], NULL, gerber_worker, &context);
+  }
+  for(int i = 0; i < threads; i++){
+    pthread_join(workers[i], NULL);
+  }
+  free(workers);
+
+  for(int i = 0; i < context.count; i++){
+    status = context.layers[i].status == ERROR ? ERROR : status;
+  }
+  free(context.layers);
+  return status == ERROR ? ERROR : context.count;
+}
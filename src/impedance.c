@@ -0,0 +1,874 @@
+#include <stdio.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "solver.h"
+
+// Trace impedance
+// The stackup is read top to bottom into slabs of copper and dielectric.
+// Copper layers of type power or carrying a zone are reference planes, a
+// board with neither takes every copper layer as one. A trace between two
+// planes is an asymmetric stripline, under or over one plane a microstrip,
+// embedded when dielectric covers it, and a microstrip beside a pour of
+// another net within twice its height a grounded coplanar waveguide. Each
+// unique width, layer and gap is a cross section, worked out once in closed
+// form and kept on the board. The field solver relaxes the Laplace equation
+// over the cross section twice, with and without the dielectrics, and takes
+// the impedance from the two capacitances. Cross sections are solved in
+// parallel.
+
+#define IMPEDANCE_COPPER 0.035f
+#define IMPEDANCE_EPSILON_R 4.5f
+#define IMPEDANCE_BOARD 1.6f
+#define IMPEDANCE_TOLERANCE 0.1f
+#define IMPEDANCE_MAX_SLABS 128
+#define IMPEDANCE_ETA 376.730313
+// Coplanar ground further than this many heights away is ignored
+#define IMPEDANCE_COPLANAR 2.0f
+// Gaps are rounded to this many microns so nearby traces share a section
+#define IMPEDANCE_GAP_STEP 10
+// Field solver: walls this many heights out, cells growing by this much of
+// their distance from the trace up to a limit of this many a side
+#define IMPEDANCE_WALLS 50.0f
+#define IMPEDANCE_GROWTH 0.08
+#define IMPEDANCE_CELLS 200
+#define IMPEDANCE_ITERATIONS 50000
+#define IMPEDANCE_CONVERGED 1e-7
+// Track ends closer than this meet
+#define IMPEDANCE_JOIN 0.001f
+#define IMPEDANCE_ARC_ERROR 0.005f
+#define IMPEDANCE_ARC_POINTS 128
+#define IMPEDANCE_CHUNK 256
+
+#define SECTION_NONE 0
+#define SECTION_MICROSTRIP 1
+#define SECTION_EMBEDDED 2
+#define SECTION_STRIPLINE 3
+#define SECTION_COPLANAR 4
+
+static const char *kind_names[] = {"none", "microstrip", "embedded", "stripline", "coplanar"};
+
+struct Slab {
+  struct Layer *layer;
+  float thickness, epsilon_r;
+  int copper, reference;
+};
+
+// Width and gap in microns, gap 0 without coplanar ground
+struct Cross_Section {
+  int width, gap, slab, kind;
+  float closed, field;
+};
+
+struct Impedance_Cache {
+  struct Slab slabs[IMPEDANCE_MAX_SLABS];
+  int slab_count;
+  struct Cross_Section *sections;
+  int count, capacity;
+  // Open addressing into sections, -1 empty
+  int *table, table_size;
+};
+
+// Stackup
+
+static int compare_stackup(const void *_1, const void *_2){
+  uint64_t start_1 = (*(struct Layer *const *)_1)->index.section_start, start_2 = (*(struct Layer *const *)_2)->index.section_start;
+  return start_1 < start_2 ? -1 : start_1 > start_2;
+}
+
+static int compare_ordinal(const void *_1, const void *_2){
+  return (*(struct Layer *const *)_1)->ordinal - (*(struct Layer *const *)_2)->ordinal;
+}
+
+static int is_dielectric(struct Layer *layer){
+  return layer->canonical_name.chars && strncmp(layer->canonical_name.chars, "dielectric", 10) == 0;
+}
+
+// Slabs from the stackup section, or when the board has none, the copper
+// layers in ordinal order with equal FR4 between them
+static void build_stack(struct Impedance_Cache *cache){
+  struct Layer *layers[IMPEDANCE_MAX_SLABS];
+  int count = 0, copper = 0;
+  uint64_t start = pcb->stackup.index.section_start, end = pcb->stackup.index.section_end;
+  for(struct Layer *layer = pcb->layers.layer; layer && count < IMPEDANCE_MAX_SLABS; layer = layer->next){
+    if(end > start && layer->index.section_start >= start && layer->index.section_start < end && (is_copper(layer) || is_dielectric(layer))){
+      layers[count++] = layer;
+      copper += is_copper(layer);
+    }
+  }
+  if(copper > 0){
+    qsort(layers, count, sizeof(struct Layer *), compare_stackup);
+    for(int i = 0; i < count; i++){
+      struct Slab *slab = &cache->slabs[i];
+      slab->layer = is_copper(layers[i]) ? layers[i] : NULL;
+      slab->copper = slab->layer != NULL;
+      slab->thickness = layers[i]->thickness > 0 ? layers[i]->thickness : (slab->copper ? IMPEDANCE_COPPER : 0);
+      slab->epsilon_r = layers[i]->epsilon_r > 0 ? layers[i]->epsilon_r : IMPEDANCE_EPSILON_R;
+    }
+    cache->slab_count = count;
+  }else{
+    for(struct Layer *layer = pcb->layers.layer; layer && copper < IMPEDANCE_MAX_SLABS / 2; layer = layer->next){
+      if(is_copper(layer)){
+        layers[copper++] = layer;
+      }
+    }
+    qsort(layers, copper, sizeof(struct Layer *), compare_ordinal);
+    float board = pcb->general.thickness > 0 ? pcb->general.thickness : IMPEDANCE_BOARD;
+    float dielectric = copper > 1 ? (board - copper * IMPEDANCE_COPPER) / (copper - 1) : 0;
+    for(int i = 0; i < copper; i++){
+      if(i > 0){
+        cache->slabs[cache->slab_count++] = (struct Slab){NULL, dielectric, IMPEDANCE_EPSILON_R, FALSE, FALSE};
+      }
+      cache->slabs[cache->slab_count++] = (struct Slab){layers[i], IMPEDANCE_COPPER, IMPEDANCE_EPSILON_R, TRUE, FALSE};
+    }
+  }
+  // Dielectric of zero thickness would short the planes
+  for(int i = 0; i < cache->slab_count; i++){
+    if(!cache->slabs[i].copper && cache->slabs[i].thickness <= 0){
+      cache->slabs[i].thickness = 0.1f;
+    }
+  }
+
+  int references = 0;
+  for(int i = 0; i < cache->slab_count; i++){
+    struct Slab *slab = &cache->slabs[i];
+    if(slab->copper){
+      slab->reference = slab->layer->type == LAYER_TYPE_POWER;
+      for(struct Zone *zone = pcb->zones; zone && !slab->reference; zone = zone->next){
+        slab->reference = zone->layer == slab->layer;
+      }
+      references += slab->reference;
+    }
+  }
+  for(int i = 0; i < cache->slab_count && references == 0; i++){
+    cache->slabs[i].reference = cache->slabs[i].copper;
+  }
+}
+
+static int slab_of(const struct Impedance_Cache *cache, const struct Layer *layer){
+  for(int i = 0; i < cache->slab_count; i++){
+    if(cache->slabs[i].layer == layer){
+      return i;
+    }
+  }
+  return -1;
+}
+
+// What lies on one side of a trace's slab: the height to the nearest plane
+// and the mean permittivity on the way, or with no plane, the dielectric
+// that covers the trace
+struct Side {
+  int reference;
+  float height, cover, epsilon_r;
+};
+
+static struct Side side_of(const struct Impedance_Cache *cache, int slab, int direction){
+  struct Side side = {-1, 0, 0, 0};
+  float weighted = 0, dielectric = 0;
+  int i;
+  for(i = slab + direction; i >= 0 && i < cache->slab_count && !cache->slabs[i].reference; i += direction){
+    side.height += cache->slabs[i].thickness;
+    if(!cache->slabs[i].copper){
+      weighted += cache->slabs[i].thickness * cache->slabs[i].epsilon_r;
+      dielectric += cache->slabs[i].thickness;
+    }
+  }
+  side.epsilon_r = dielectric > 0 ? weighted / dielectric : IMPEDANCE_EPSILON_R;
+  if(i >= 0 && i < cache->slab_count){
+    side.reference = i;
+  }else{
+    side.cover = side.height;
+    side.height = 0;
+  }
+  return side;
+}
+
+// Closed forms, lengths in any one unit
+
+static double coth(double x){
+  return 1 / tanh(x);
+}
+
+// Hammerstad and Jensen, impedance of a strip of width ratio u in air
+static double microstrip_air(double u){
+  double f = 6 + (2 * M_PI - 6) * exp(-pow(30.666 / u, 0.7528));
+  return 60 * log(f / u + sqrt(1 + 4 / (u * u)));
+}
+
+static double microstrip_effective(double u, double epsilon_r){
+  double a = 1 + log((pow(u, 4) + pow(u / 52, 2)) / (pow(u, 4) + 0.432)) / 49 + log(1 + pow(u / 18.1, 3)) / 18.7;
+  double b = 0.564 * pow((epsilon_r - 0.9) / (epsilon_r + 3), 0.053);
+  return (epsilon_r + 1) / 2 + (epsilon_r - 1) / 2 * pow(1 + 10 / u, -a * b);
+}
+
+// Hammerstad and Jensen with the strip widened for its thickness. A cover
+// of dielectric raises the effective permittivity towards the bulk.
+static double microstrip(double w, double h, double t, double epsilon_r, double cover){
+  double u = w / h, tn = t / h;
+  double du1 = tn > 0 ? tn / M_PI * log(1 + 4 * M_E / (tn * pow(coth(sqrt(6.517 * u)), 2))) : 0;
+  double dur = 0.5 * (1 + 1 / cosh(sqrt(epsilon_r - 1))) * du1;
+  double z1 = microstrip_air(u + du1), zr = microstrip_air(u + dur);
+  double effective = microstrip_effective(u + dur, epsilon_r) * (z1 / zr) * (z1 / zr);
+  if(cover > 0){
+    effective = fmax(effective, epsilon_r * (1 - exp(-1.55 * (h + t + cover) / h)));
+  }
+  return zr / sqrt(effective);
+}
+
+// Wheeler, strip of thickness t centred between planes b apart
+static double stripline_symmetric(double w, double b, double t, double epsilon_r){
+  double x = t / b, m = 6 / (3 + 2 * x / (1 - x));
+  double dw = x > 0 ? x / (M_PI * (1 - x)) * (1 - 0.5 * log(pow(x / (2 - x), 2) + pow(0.0796 * x / (w / b + 1.1 * x), m))) : 0;
+  double wp = w / (b - t) + dw, q = 8 / (M_PI * wp);
+  return 30 / sqrt(epsilon_r) * log(1 + 4 / (M_PI * wp) * (q + sqrt(q * q + 6.27)));
+}
+
+// Off centre, the two halves in parallel
+static double stripline(double w, double h1, double h2, double t, double epsilon_r){
+  double z1 = stripline_symmetric(w, 2 * h1 + t, t, epsilon_r), z2 = stripline_symmetric(w, 2 * h2 + t, t, epsilon_r);
+  return 2 * z1 * z2 / (z1 + z2);
+}
+
+// K(k)/K(k') of the complete elliptic integrals, Hilberg
+static double elliptic_ratio(double k){
+  double kp = sqrt(1 - k * k);
+  if(k <= M_SQRT1_2){
+    return M_PI / log(2 * (1 + sqrt(kp)) / (1 - sqrt(kp)));
+  }
+  return log(2 * (1 + sqrt(k)) / (1 - sqrt(k))) / M_PI;
+}
+
+// Grounded coplanar waveguide, zero thickness
+static double coplanar(double w, double s, double h, double epsilon_r){
+  double k = w / (w + 2 * s);
+  double k1 = tanh(M_PI * w / (4 * h)) / tanh(M_PI * (w + 2 * s) / (4 * h));
+  double r = elliptic_ratio(k), r1 = elliptic_ratio(k1), q = r1 / r;
+  double effective = (1 + epsilon_r * q) / (1 + q);
+  return 60 * M_PI / sqrt(effective) / (r + r1);
+}
+
+static void closed_form(const struct Impedance_Cache *cache, struct Cross_Section *section){
+  struct Side above = side_of(cache, section->slab, -1), below = side_of(cache, section->slab, 1);
+  double w = section->width / 1000.0, s = section->gap / 1000.0, t = cache->slabs[section->slab].thickness;
+  if((above.reference < 0 && below.reference < 0) || (above.reference >= 0 && above.height <= 0) || (below.reference >= 0 && below.height <= 0)){
+    section->kind = SECTION_NONE;
+    section->closed = 0;
+  }else if(above.reference >= 0 && below.reference >= 0){
+    double height = above.height + below.height;
+    double epsilon_r = (above.height * above.epsilon_r + below.height * below.epsilon_r) / height;
+    section->kind = SECTION_STRIPLINE;
+    section->closed = stripline(w, above.height, below.height, t, epsilon_r);
+  }else{
+    struct Side plane = above.reference >= 0 ? above : below, open = above.reference >= 0 ? below : above;
+    if(open.cover > 0){
+      section->kind = SECTION_EMBEDDED;
+      section->closed = microstrip(w, plane.height, t, plane.epsilon_r, open.cover);
+    }else if(s > 0){
+      section->kind = SECTION_COPLANAR;
+      section->closed = coplanar(w, s, plane.height, plane.epsilon_r);
+    }else{
+      section->kind = SECTION_MICROSTRIP;
+      section->closed = microstrip(w, plane.height, t, plane.epsilon_r, 0);
+    }
+  }
+}
+
+// Field solver
+
+struct Region {
+  float top, bottom, epsilon_r;
+};
+
+// Vertical profile from the upper boundary down, planes are the boundaries
+// and an open side gets air up to a grounded lid
+static int profile(const struct Impedance_Cache *cache, const struct Cross_Section *section, struct Region *regions, float *trace_top, float *trace_bottom, float *reach){
+  struct Side above = side_of(cache, section->slab, -1), below = side_of(cache, section->slab, 1);
+  float height = fmaxf(above.reference >= 0 ? above.height : 0, below.reference >= 0 ? below.height : 0);
+  int first = above.reference >= 0 ? above.reference + 1 : 0;
+  int last = below.reference >= 0 ? below.reference - 1 : cache->slab_count - 1;
+  int count = 0;
+  float y = 0;
+  *reach = IMPEDANCE_WALLS * height;
+  if(above.reference < 0){
+    regions[count++] = (struct Region){y, y + *reach, 1};
+    y += *reach;
+  }
+  for(int i = first; i <= last; i++){
+    const struct Slab *slab = &cache->slabs[i];
+    float epsilon_r = slab->epsilon_r;
+    if(slab->copper){
+      // Copper slabs are filled by the dielectric beside them, outer ones
+      // by air
+      int near = i + 1 <= last ? i + 1 : i - 1;
+      epsilon_r = near >= first && !cache->slabs[near].copper ? cache->slabs[near].epsilon_r : IMPEDANCE_EPSILON_R;
+      epsilon_r = i == 0 || i == cache->slab_count - 1 ? 1 : epsilon_r;
+      if(i == section->slab){
+        *trace_top = y;
+        *trace_bottom = y + slab->thickness;
+      }
+    }
+    regions[count++] = (struct Region){y, y + slab->thickness, epsilon_r};
+    y += slab->thickness;
+  }
+  if(below.reference < 0){
+    regions[count++] = (struct Region){y, y + *reach, 1};
+  }
+  return count;
+}
+
+// Grid lines from start to end, cells of size fine at the focus points
+// growing outward to at most coarse, every breakpoint on a line
+static int grid_lines(const float *breaks, int break_count, const float *focus, int focus_count, float fine, float coarse, double **lines){
+  int count = 0, capacity = 64;
+  *lines = malloc(capacity * sizeof(double));
+  (*lines)[count++] = breaks[0];
+  for(int b = 1; b < break_count; b++){
+    double position = breaks[b - 1], end = breaks[b];
+    if(end - position <= 0){
+      continue;
+    }
+    while(position < end){
+      double distance = INFINITY;
+      for(int f = 0; f < focus_count; f++){
+        distance = fmin(distance, fabs(position - focus[f]));
+      }
+      double step = fmin(coarse, fine + IMPEDANCE_GROWTH * distance);
+      // The last cell of an interval takes what is left, never a sliver
+      position = end - position < 1.5 * step ? end : position + step;
+      if(count == capacity){
+        capacity *= 2;
+        *lines = realloc(*lines, capacity * sizeof(double));
+      }
+      (*lines)[count++] = position;
+    }
+  }
+  return count;
+}
+
+static int compare_float(const void *_1, const void *_2){
+  float float_1 = *(const float *)_1, float_2 = *(const float *)_2;
+  return float_1 < float_2 ? -1 : float_1 > float_2;
+}
+
+// Successive over-relaxation, then the sum over grid edges of weight times
+// the squared potential step, the capacitance over that of free space
+static double relax(double *potential, const uint8_t *fixed, const double *weight_x, const double *weight_y, int nx, int ny){
+  double omega = 2 / (1 + sin(M_PI / (nx > ny ? nx : ny)));
+  for(int iteration = 0; iteration < IMPEDANCE_ITERATIONS; iteration++){
+    double change = 0;
+    for(int j = 1; j < ny - 1; j++){
+      for(int i = 1; i < nx - 1; i++){
+        int node = j * nx + i;
+        if(fixed[node]){
+          continue;
+        }
+        // weight_x[node] joins node to the one right of it, weight_y[node]
+        // to the one below
+        double left = weight_x[node - 1], right = weight_x[node], up = weight_y[node - nx], down = weight_y[node];
+        double value = (left * potential[node - 1] + right * potential[node + 1] + up * potential[node - nx] + down * potential[node + nx]) / (left + right + up + down);
+        double step = omega * (value - potential[node]);
+        potential[node] += step;
+        change = fmax(change, fabs(step));
+      }
+    }
+    if(change < IMPEDANCE_CONVERGED){
+      break;
+    }
+  }
+  double energy = 0;
+  for(int j = 0; j < ny; j++){
+    for(int i = 0; i < nx; i++){
+      int node = j * nx + i;
+      if(i + 1 < nx){
+        energy += weight_x[node] * (potential[node + 1] - potential[node]) * (potential[node + 1] - potential[node]);
+      }
+      if(j + 1 < ny){
+        energy += weight_y[node] * (potential[node + nx] - potential[node]) * (potential[node + nx] - potential[node]);
+      }
+    }
+  }
+  return energy;
+}
+
+// Finite differences on a grid graded from the trace edges out to grounded
+// walls, solved once with the dielectrics and once in free space
+static void field_solve(const struct Impedance_Cache *cache, struct Cross_Section *section){
+  struct Region regions[IMPEDANCE_MAX_SLABS + 2];
+  float trace_top = 0, trace_bottom = 0, reach = 0;
+  int region_count = profile(cache, section, regions, &trace_top, &trace_bottom, &reach);
+  float w = section->width / 1000.0f, s = section->gap / 1000.0f;
+  float half = w / 2 + s + reach;
+  float fine = fminf(w / 20, (trace_bottom - trace_top) / 4), coarse = fmaxf(2 * half, regions[region_count - 1].bottom) / IMPEDANCE_CELLS;
+  fine = fminf(fine, coarse);
+
+  float breaks_x[6] = {-half, w / 2, -w / 2, half, -w / 2 - s, w / 2 + s};
+  int break_x_count = s > 0 ? 6 : 4;
+  qsort(breaks_x, break_x_count, sizeof(float), compare_float);
+  float breaks_y[IMPEDANCE_MAX_SLABS + 3], focus_y[2] = {trace_top, trace_bottom};
+  for(int i = 0; i < region_count; i++){
+    breaks_y[i] = regions[i].top;
+  }
+  breaks_y[region_count] = regions[region_count - 1].bottom;
+  double *x, *y;
+  int nx = grid_lines(breaks_x, break_x_count, breaks_x + (s > 0), s > 0 ? 4 : 2, fine, coarse, &x);
+  int ny = grid_lines(breaks_y, region_count + 1, focus_y, 2, fine, coarse, &y);
+  int nodes = nx * ny;
+  double *potential = calloc(nodes, sizeof(double)), *weight_x = calloc(nodes, sizeof(double)), *weight_y = calloc(nodes, sizeof(double));
+  float *epsilon = malloc((nx - 1) * (ny - 1) * sizeof(float));
+  uint8_t *fixed = calloc(nodes, sizeof(uint8_t));
+
+  // Permittivity per cell from the region its centre falls in
+  for(int j = 0, region = 0; j < ny - 1; j++){
+    double centre = (y[j] + y[j + 1]) / 2;
+    while(region + 1 < region_count && centre >= regions[region].bottom){
+      region++;
+    }
+    for(int i = 0; i < nx - 1; i++){
+      epsilon[j * (nx - 1) + i] = regions[region].epsilon_r;
+    }
+  }
+  // Conductors: the walls at 0, the trace at 1, coplanar ground at 0
+  float tolerance = fine / 4;
+  for(int j = 0; j < ny; j++){
+    for(int i = 0; i < nx; i++){
+      int node = j * nx + i;
+      int in_slab = y[j] >= trace_top - tolerance && y[j] <= trace_bottom + tolerance;
+      if(i == 0 || j == 0 || i == nx - 1 || j == ny - 1){
+        fixed[node] = TRUE;
+      }else if(in_slab && fabs(x[i]) <= w / 2 + tolerance){
+        fixed[node] = TRUE;
+        potential[node] = 1;
+      }else if(in_slab && s > 0 && fabs(x[i]) >= w / 2 + s - tolerance){
+        fixed[node] = TRUE;
+      }
+    }
+  }
+
+  double capacitance[2];
+  for(int pass = 0; pass < 2; pass++){
+    // An edge carries the flux through half of each cell beside it, the
+    // second pass in free space
+    for(int j = 0; j < ny; j++){
+      for(int i = 0; i < nx; i++){
+        int node = j * nx + i;
+        if(i + 1 < nx){
+          double above = j > 0 ? (pass ? 1 : epsilon[(j - 1) * (nx - 1) + i]) * (y[j] - y[j - 1]) : 0;
+          double below = j + 1 < ny ? (pass ? 1 : epsilon[j * (nx - 1) + i]) * (y[j + 1] - y[j]) : 0;
+          weight_x[node] = (above + below) / 2 / (x[i + 1] - x[i]);
+        }
+        if(j + 1 < ny){
+          double before = i > 0 ? (pass ? 1 : epsilon[j * (nx - 1) + i - 1]) * (x[i] - x[i - 1]) : 0;
+          double after = i + 1 < nx ? (pass ? 1 : epsilon[j * (nx - 1) + i]) * (x[i + 1] - x[i]) : 0;
+          weight_y[node] = (before + after) / 2 / (y[j + 1] - y[j]);
+        }
+      }
+    }
+    capacitance[pass] = relax(potential, fixed, weight_x, weight_y, nx, ny);
+  }
+  section->field = capacitance[0] > 0 && capacitance[1] > 0 ? IMPEDANCE_ETA / sqrt(capacitance[0] * capacitance[1]) : 0;
+
+  free(x);
+  free(y);
+  free(potential);
+  free(weight_x);
+  free(weight_y);
+  free(epsilon);
+  free(fixed);
+}
+
+// Cache
+
+static struct Impedance_Cache *impedance_cache(){
+  if(pcb->impedance == NULL){
+    pcb->impedance = calloc(1, sizeof(struct Impedance_Cache));
+    build_stack(pcb->impedance);
+  }
+  return pcb->impedance;
+}
+
+void impedance_cache_free(struct Impedance_Cache *cache){
+  if(cache == NULL){
+    return;
+  }
+  free(cache->sections);
+  free(cache->table);
+  free(cache);
+}
+
+static uint32_t section_hash(int width, int gap, int slab){
+  uint32_t hash = 2166136261u;
+  hash = (hash ^ (uint32_t)width) * 16777619u;
+  hash = (hash ^ (uint32_t)gap) * 16777619u;
+  return (hash ^ (uint32_t)slab) * 16777619u;
+}
+
+static void table_grow(struct Impedance_Cache *cache){
+  free(cache->table);
+  cache->table_size = cache->table_size ? cache->table_size * 2 : 64;
+  cache->table = malloc(cache->table_size * sizeof(int));
+  memset(cache->table, 0xff, cache->table_size * sizeof(int));
+  for(int i = 0; i < cache->count; i++){
+    struct Cross_Section *section = &cache->sections[i];
+    uint32_t slot = section_hash(section->width, section->gap, section->slab) & (cache->table_size - 1);
+    while(cache->table[slot] >= 0){
+      slot = (slot + 1) & (cache->table_size - 1);
+    }
+    cache->table[slot] = i;
+  }
+}
+
+// Index of the cross section, worked out in closed form the first time
+static int section_of(struct Impedance_Cache *cache, int width, int gap, int slab){
+  if(2 * (cache->count + 1) > cache->table_size){
+    table_grow(cache);
+  }
+  uint32_t slot = section_hash(width, gap, slab) & (cache->table_size - 1);
+  for(; cache->table[slot] >= 0; slot = (slot + 1) & (cache->table_size - 1)){
+    struct Cross_Section *section = &cache->sections[cache->table[slot]];
+    if(section->width == width && section->gap == gap && section->slab == slab){
+      return cache->table[slot];
+    }
+  }
+  if(cache->count == cache->capacity){
+    cache->capacity = cache->capacity ? cache->capacity * 2 : 64;
+    cache->sections = realloc(cache->sections, cache->capacity * sizeof(struct Cross_Section));
+  }
+  struct Cross_Section *section = &cache->sections[cache->count];
+  *section = (struct Cross_Section){width, gap, slab, SECTION_NONE, 0, 0};
+  closed_form(cache, section);
+  cache->table[slot] = cache->count;
+  return cache->count++;
+}
+
+// Tracks
+
+static int track_geometry(const struct Track *track, struct Point *points, float *width, struct Layer **layer){
+  if(track->type == TRACK_TYPE_SEG){
+    points[0] = track->track.segment.start;
+    points[1] = track->track.segment.end;
+    *width = track->track.segment.width;
+    *layer = track->track.segment.layer;
+    return 2;
+  }
+  if(track->type == TRACK_TYPE_ARC){
+    const struct Arc *arc = &track->track.arc;
+    *width = arc->width;
+    *layer = arc->layer;
+    return arc_points(arc->start, arc->mid, arc->end, IMPEDANCE_ARC_ERROR, points, IMPEDANCE_ARC_POINTS);
+  }
+  return 0;
+}
+
+// Edge gap to the nearest pour of another net on the trace's layer, in
+// microns, 0 when none is near enough to count
+static int coplanar_gap(const struct Impedance_Cache *cache, const struct Track *track){
+  struct Point points[IMPEDANCE_ARC_POINTS];
+  float width = 0;
+  struct Layer *layer = NULL;
+  int count = track_geometry(track, points, &width, &layer);
+  int slab = slab_of(cache, layer);
+  if(count < 2 || slab < 0){
+    return 0;
+  }
+  struct Side above = side_of(cache, slab, -1), below = side_of(cache, slab, 1);
+  float height = above.reference >= 0 ? above.height : below.height;
+  if(above.reference >= 0 && below.reference >= 0){
+    height = fminf(above.height, below.height);
+  }
+  float best = INFINITY;
+  struct Net *net = track_net((struct Track *)track);
+  for(struct Zone *zone = pcb->zones; zone; zone = zone->next){
+    if(zone->layer != layer || zone->net == net){
+      continue;
+    }
+    for(struct Ring *ring = zone->rings; ring; ring = ring->next){
+      for(int i = 0; i + 1 < count; i++){
+        best = fminf(best, ring_segment_distance(ring, points[i], points[i + 1]) - width / 2);
+      }
+    }
+  }
+  if(best <= 0 || best > IMPEDANCE_COPLANAR * height){
+    return 0;
+  }
+  int gap = (int)lroundf(best * 1000 / IMPEDANCE_GAP_STEP) * IMPEDANCE_GAP_STEP;
+  return gap > 0 ? gap : IMPEDANCE_GAP_STEP;
+}
+
+static float section_impedance(const struct Cross_Section *section, int field){
+  return field && section->field > 0 ? section->field : section->closed;
+}
+
+// Impedance of one segment or arc in ohm, 0 with no reference plane. The
+// field solver runs on this thread when the section has not been solved.
+float track_impedance(struct Track *track, int field){
+  struct Impedance_Cache *cache = impedance_cache();
+  struct Point points[IMPEDANCE_ARC_POINTS];
+  float width = 0;
+  struct Layer *layer = NULL;
+  if(track_geometry(track, points, &width, &layer) < 2 || slab_of(cache, layer) < 0){
+    return 0;
+  }
+  for(struct Zone *zone = pcb->zones; zone; zone = zone->next){
+    if(zone->layer == layer && zone->rings == NULL && zone->filled_polygon.points){
+      zone_rings_init(zone);
+    }
+  }
+  // section_of may grow the sections, index them after
+  int index = section_of(cache, (int)lroundf(width * 1000), coplanar_gap(cache, track), slab_of(cache, layer));
+  struct Cross_Section *section = &cache->sections[index];
+  if(field && section->field == 0 && section->kind != SECTION_NONE){
+    field_solve(cache, section);
+  }
+  return section_impedance(section, field);
+}
+
+// Report
+
+struct Impedance_Run {
+  struct Board *board;
+  struct Impedance_Cache *cache;
+  struct Track **tracks;
+  int *gaps, track_count;
+  int *unsolved, unsolved_count;
+  int next;
+};
+
+static void *gap_worker(void *arg){
+  struct Impedance_Run *run = arg;
+  pcb = run->board;
+  while(TRUE){
+    int first = __atomic_fetch_add(&run->next, IMPEDANCE_CHUNK, __ATOMIC_RELAXED);
+    if(first >= run->track_count){
+      break;
+    }
+    int last = first + IMPEDANCE_CHUNK < run->track_count ? first + IMPEDANCE_CHUNK : run->track_count;
+    for(int i = first; i < last; i++){
+      run->gaps[i] = coplanar_gap(run->cache, run->tracks[i]);
+    }
+  }
+  return NULL;
+}
+
+static void *field_worker(void *arg){
+  struct Impedance_Run *run = arg;
+  pcb = run->board;
+  while(TRUE){
+    int i = __atomic_fetch_add(&run->next, 1, __ATOMIC_RELAXED);
+    if(i >= run->unsolved_count){
+      break;
+    }
+    field_solve(run->cache, &run->cache->sections[run->unsolved[i]]);
+  }
+  return NULL;
+}
+
+static void run_threads(struct Impedance_Run *run, void *(*worker)(void *), int threads){
+  pthread_t *thread = malloc(threads * sizeof(pthread_t));
+  run->next = 0;
+  for(int i = 0; i < threads; i++){
+    pthread_create(&thread[i], NULL, worker, run);
+  }
+  for(int i = 0; i < threads; i++){
+    pthread_join(thread[i], NULL);
+  }
+  free(thread);
+}
+
+struct Track_End {
+  float x, y;
+  int track;
+};
+
+static int compare_end(const void *_1, const void *_2){
+  const struct Track_End *end_1 = _1, *end_2 = _2;
+  return end_1->x < end_2->x ? -1 : end_1->x > end_2->x;
+}
+
+static double track_length(const struct Track *track){
+  if(track->type == TRACK_TYPE_SEG){
+    return hypot(track->track.segment.end.x - track->track.segment.start.x, track->track.segment.end.y - track->track.segment.start.y);
+  }
+  return arc_length(track->track.arc.start, track->track.arc.mid, track->track.arc.end);
+}
+
+static struct Point track_end(const struct Track *track, int which){
+  if(track->type == TRACK_TYPE_SEG){
+    return which ? track->track.segment.end : track->track.segment.start;
+  }
+  return which ? track->track.arc.end : track->track.arc.start;
+}
+
+// One net's profile: length by cross section, then every junction where
+// the impedance steps by more than tolerance
+static int report_net(FILE *report, struct Impedance_Run *run, struct Net *net, int *members, int count, int *sections, const struct Impedance_Options *options, float tolerance){
+  struct Impedance_Cache *cache = run->cache;
+  double total = 0, weighted = 0, low = INFINITY, high = 0;
+  // Sections in the order the net first uses them
+  int *order = malloc(count * sizeof(int)), order_count = 0;
+  double *lengths = calloc(count, sizeof(double));
+  for(int i = 0; i < count; i++){
+    int section = sections[members[i]], slot = 0;
+    while(slot < order_count && order[slot] != section){
+      slot++;
+    }
+    if(slot == order_count){
+      order[order_count++] = section;
+    }
+    double length = track_length(run->tracks[members[i]]);
+    float z = section_impedance(&cache->sections[section], options->field);
+    lengths[slot] += length;
+    total += length;
+    if(z > 0){
+      weighted += z * length;
+      low = fmin(low, z);
+      high = fmax(high, z);
+    }
+  }
+  double referenced = 0;
+  for(int i = 0; i < order_count; i++){
+    referenced += section_impedance(&cache->sections[order[i]], options->field) > 0 ? lengths[i] : 0;
+  }
+  fprintf(report, "net %s length %.4f", net->name.chars, total);
+  if(referenced > 0){
+    fprintf(report, " impedance %.2f (%.2f to %.2f)\n", weighted / referenced, low, high);
+  }else{
+    fprintf(report, " no reference\n");
+  }
+  for(int i = 0; i < order_count; i++){
+    const struct Cross_Section *section = &cache->sections[order[i]];
+    fprintf(report, "  %-8s %7.4f %-10s %7.2f %10.4f", cache->slabs[section->slab].layer->canonical_name.chars, section->width / 1000.0, kind_names[section->kind],
+      section_impedance(section, options->field), lengths[i]);
+    if(section->gap){
+      fprintf(report, " gap %.3f", section->gap / 1000.0);
+    }
+    fprintf(report, "\n");
+  }
+
+  struct Track_End *ends = malloc(2 * count * sizeof(struct Track_End));
+  for(int i = 0; i < 2 * count; i++){
+    struct Point point = track_end(run->tracks[members[i / 2]], i & 1);
+    ends[i] = (struct Track_End){point.x, point.y, members[i / 2]};
+  }
+  qsort(ends, 2 * count, sizeof(struct Track_End), compare_end);
+  int steps = 0;
+  for(int i = 0; i < 2 * count; i++){
+    for(int j = i + 1; j < 2 * count && ends[j].x - ends[i].x <= IMPEDANCE_JOIN; j++){
+      if(fabsf(ends[j].y - ends[i].y) > IMPEDANCE_JOIN || ends[i].track == ends[j].track){
+        continue;
+      }
+      float z_1 = section_impedance(&cache->sections[sections[ends[i].track]], options->field);
+      float z_2 = section_impedance(&cache->sections[sections[ends[j].track]], options->field);
+      if(z_1 > 0 && z_2 > 0 && fabsf(z_1 - z_2) > tolerance * fminf(z_1, z_2)){
+        fprintf(report, "  ! %.4f %.4f %.2f -> %.2f\n", ends[i].x, ends[i].y, z_1, z_2);
+        steps++;
+      }
+    }
+  }
+  free(ends);
+  free(order);
+  free(lengths);
+  return steps;
+}
+
+// Impedance profile of every net with segments or arcs. field adds the
+// field solver, tolerance is the relative step flagged as a discontinuity,
+// 10% when 0. Returns the number of discontinuities.
+int check_impedance(const struct Impedance_Options *options, FILE *report, struct Impedance_Stats *stats){
+  struct Impedance_Stats local_stats;
+  stats = stats ? stats : &local_stats;
+  memset(stats, 0, sizeof(struct Impedance_Stats));
+  float tolerance = options->tolerance > 0 ? options->tolerance : IMPEDANCE_TOLERANCE;
+  int threads = options->threads > 0 ? options->threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+  threads = threads < 1 ? 1 : threads;
+  struct Impedance_Run run;
+  memset(&run, 0, sizeof(run));
+  run.board = pcb;
+  run.cache = impedance_cache();
+
+  for(struct Zone *zone = pcb->zones; zone; zone = zone->next){
+    if(zone->rings == NULL && zone->filled_polygon.points){
+      zone_rings_init(zone);
+    }
+  }
+  int max_ordinal = 0;
+  for(struct Net *net = pcb->nets; net; net = net->next){
+    max_ordinal = net->ordinal > max_ordinal ? net->ordinal : max_ordinal;
+  }
+  for(struct Track *track = pcb->tracks; track; track = track->next){
+    struct Point points[IMPEDANCE_ARC_POINTS];
+    float width = 0;
+    struct Layer *layer = NULL;
+    run.track_count += track->type != TRACK_TYPE_VIA && track_geometry(track, points, &width, &layer) >= 2 && slab_of(run.cache, layer) >= 0;
+  }
+  run.tracks = malloc((run.track_count ? run.track_count : 1) * sizeof(struct Track *));
+  run.gaps = malloc((run.track_count ? run.track_count : 1) * sizeof(int));
+  run.track_count = 0;
+  for(struct Track *track = pcb->tracks; track; track = track->next){
+    struct Point points[IMPEDANCE_ARC_POINTS];
+    float width = 0;
+    struct Layer *layer = NULL;
+    if(track->type != TRACK_TYPE_VIA && track_geometry(track, points, &width, &layer) >= 2 && slab_of(run.cache, layer) >= 0){
+      run.tracks[run.track_count++] = track;
+    }
+  }
+  run_threads(&run, gap_worker, threads);
+
+  // Cross sections are found in track order on this thread
+  int sections_before = run.cache->count;
+  int *sections = malloc((run.track_count ? run.track_count : 1) * sizeof(int));
+  for(int i = 0; i < run.track_count; i++){
+    struct Point points[IMPEDANCE_ARC_POINTS];
+    float width = 0;
+    struct Layer *layer = NULL;
+    track_geometry(run.tracks[i], points, &width, &layer);
+    sections[i] = section_of(run.cache, (int)lroundf(width * 1000), run.gaps[i], slab_of(run.cache, layer));
+  }
+  stats->tracks = run.track_count;
+  stats->sections = run.cache->count;
+  stats->new_sections = run.cache->count - sections_before;
+  if(options->field){
+    run.unsolved = malloc((run.cache->count ? run.cache->count : 1) * sizeof(int));
+    for(int i = 0; i < run.cache->count; i++){
+      if(run.cache->sections[i].field == 0 && run.cache->sections[i].kind != SECTION_NONE){
+        run.unsolved[run.unsolved_count++] = i;
+      }
+    }
+    run_threads(&run, field_worker, threads < run.unsolved_count ? threads : (run.unsolved_count ? run.unsolved_count : 1));
+    stats->solved = run.unsolved_count;
+    free(run.unsolved);
+  }
+
+  // Tracks bucketed by net
+  int *start = calloc(max_ordinal + 2, sizeof(int));
+  int *members = malloc((run.track_count ? run.track_count : 1) * sizeof(int));
+  for(int i = 0; i < run.track_count; i++){
+    struct Net *net = track_net(run.tracks[i]);
+    start[(net && net->ordinal > 0 && net->ordinal <= max_ordinal ? net->ordinal : 0) + 1]++;
+  }
+  for(int i = 0; i <= max_ordinal; i++){
+    start[i + 1] += start[i];
+  }
+  int *fill = malloc((max_ordinal + 1) * sizeof(int));
+  memcpy(fill, start, (max_ordinal + 1) * sizeof(int));
+  for(int i = 0; i < run.track_count; i++){
+    struct Net *net = track_net(run.tracks[i]);
+    members[fill[net && net->ordinal > 0 && net->ordinal <= max_ordinal ? net->ordinal : 0]++] = i;
+  }
+  free(fill);
+
+  fprintf(report, "%-8s %7s %-10s %7s %10s\n", "layer", "width", "kind", "ohm", "length");
+  for(struct Net *net = pcb->nets; net; net = net->next){
+    if(net->ordinal > 0 && net->ordinal <= max_ordinal && start[net->ordinal + 1] > start[net->ordinal]){
+      stats->discontinuities += report_net(report, &run, net, members + start[net->ordinal], start[net->ordinal + 1] - start[net->ordinal], sections, options, tolerance);
+      stats->nets++;
+    }
+  }
+
+  free(start);
+  free(members);
+  free(sections);
+  free(run.tracks);
+  free(run.gaps);
+  return stats->discontinuities;
+}
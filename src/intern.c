@@ -0,0 +1,139 @@
+#include <pthread.h>
+
+#include "solver.h"
+
+// String interning
+// Every string the parser keeps is interned in its board's table, so equal
+// strings share one copy and compare equal by pointer. The characters live
+// in blocks that never move or shrink, so a String handed out stays valid
+// until the board is freed. Lookups and inserts take the table's lock, any
+// number of threads may intern into one table.
+
+#define INTERN_BLOCK (64 * 1024)
+
+struct Intern_Block {
+  struct Intern_Block *next;
+  size_t used, size;
+  char chars[];
+};
+
+struct Intern_Slot {
+  uint64_t hash;
+  char *chars;
+  uint64_t length;
+};
+
+struct Intern_Table {
+  pthread_mutex_t lock;
+  struct Intern_Slot *slots;
+  uint32_t capacity, count;
+  struct Intern_Block *blocks;
+};
+
+struct Intern_Table *intern_table_create(){
+  struct Intern_Table *table = calloc(1, sizeof(struct Intern_Table));
+  pthread_mutex_init(&table->lock, NULL);
+  table->capacity = 1024;
+  table->slots = calloc(table->capacity, sizeof(struct Intern_Slot));
+  return table;
+}
+
+void intern_table_free(struct Intern_Table *table){
+  if(table == NULL){
+    return;
+  }
+  while(table->blocks){
+    struct Intern_Block *block = table->blocks;
+    table->blocks = block->next;
+    free(block);
+  }
+  pthread_mutex_destroy(&table->lock);
+  free(table->slots);
+  free(table);
+}
+
+static uint64_t intern_hash(const char *chars, uint64_t length){
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for(uint64_t i = 0; i < length; i++){
+    hash = (hash ^ (uint8_t)chars[i]) * 0x100000001b3ull;
+  }
+  return hash;
+}
+
+static char *intern_copy(struct Intern_Table *table, const char *chars, uint64_t length){
+  struct Intern_Block *block = table->blocks;
+  if(block == NULL || block->size - block->used < length + 1){
+    // Long strings get a block of their own, the current one stays open
+    size_t size = length + 1 > INTERN_BLOCK / 4 ? length + 1 : INTERN_BLOCK;
+    struct Intern_Block *fresh = malloc(sizeof(struct Intern_Block) + size);
+    fresh->used = 0;
+    fresh->size = size;
+    if(block && size != INTERN_BLOCK){
+      fresh->next = block->next;
+      block->next = fresh;
+    }else{
+      fresh->next = block;
+      table->blocks = fresh;
+    }
+    block = fresh;
+  }
+  char *copy = block->chars + block->used;
+  memcpy(copy, chars, length);
+  copy[length] = '\0';
+  block->used += length + 1;
+  return copy;
+}
+
+static void intern_grow(struct Intern_Table *table){
+  struct Intern_Slot *old = table->slots;
+  uint32_t old_capacity = table->capacity;
+  table->capacity *= 2;
+  table->slots = calloc(table->capacity, sizeof(struct Intern_Slot));
+  for(uint32_t i = 0; i < old_capacity; i++){
+    if(old[i].chars){
+      uint32_t slot = (uint32_t)old[i].hash & (table->capacity - 1);
+      while(table->slots[slot].chars){
+        slot = (slot + 1) & (table->capacity - 1);
+      }
+      table->slots[slot] = old[i];
+    }
+  }
+  free(old);
+}
+
+// The one copy of chars[0..length), the returned length counts the NUL
+// like every other parsed String
+String intern(struct Intern_Table *table, const char *chars, uint64_t length){
+  uint64_t hash = intern_hash(chars, length);
+  String string;
+  pthread_mutex_lock(&table->lock);
+  if(table->count * 2 >= table->capacity){
+    intern_grow(table);
+  }
+  uint32_t slot = (uint32_t)hash & (table->capacity - 1);
+  for(; table->slots[slot].chars; slot = (slot + 1) & (table->capacity - 1)){
+    struct Intern_Slot *entry = &table->slots[slot];
+    if(entry->hash == hash && entry->length == length && memcmp(entry->chars, chars, length) == 0){
+      break;
+    }
+  }
+  if(table->slots[slot].chars == NULL){
+    table->slots[slot] = (struct Intern_Slot){hash, intern_copy(table, chars, length), length};
+    table->count++;
+  }
+  string.chars = table->slots[slot].chars;
+  string.length = length + 1;
+  pthread_mutex_unlock(&table->lock);
+  return string;
+}
+
+// Number of distinct strings and the bytes their blocks take
+void intern_stats(struct Intern_Table *table, uint32_t *count, uint64_t *bytes){
+  pthread_mutex_lock(&table->lock);
+  *count = table->count;
+  *bytes = table->capacity * sizeof(struct Intern_Slot);
+  for(struct Intern_Block *block = table->blocks; block; block = block->next){
+    *bytes += sizeof(struct Intern_Block) + block->size;
+  }
+  pthread_mutex_unlock(&table->lock);
+}
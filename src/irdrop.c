@@ -0,0 +1,716 @@
+#include <stdio.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "solver.h"
+
+// IR drop
+// One net's copper becomes a resistor network. Each copper layer is cut
+// into square cells; a cell inside a zone fill or pad of the net is a node
+// joined to its copper neighbours by the sheet conductance. Tracks join the
+// nodes at their two ends, and vias and plated holes join the node at
+// their centre on each layer they span to the next. Source pads are held
+// at the supply voltage and sink pads draw their current, spread over
+// their nodes. The drop below the supply solves the Laplacian, stored as
+// CSR, by the multigrid solver. Nodes no source reaches are left out.
+
+#define IR_CELL 0.1f
+// Copper, ohm mm
+#define IR_RESISTIVITY 1.72e-5
+#define IR_COPPER 0.035f
+#define IR_PLATING 0.025f
+#define IR_BOARD 1.6f
+#define IR_TOLERANCE 1e-10
+#define IR_HOTSPOTS 10
+#define IR_MAX_CELLS (1 << 28)
+#define IR_MAX_LAYERS 64
+#define IR_PATH 4096
+
+#define IR_PLANE 0
+#define IR_TRACK 1
+#define IR_VIA 2
+
+static const char *edge_names[] = {"plane", "track", "via"};
+
+struct IR_Layer {
+  struct Layer *layer;
+  float thickness, z;
+  int32_t *node;
+  uint8_t *copper;
+};
+
+// Current flows through area, mm^2, and the edge is reported at point
+struct IR_Edge {
+  int from, to, kind;
+  double conductance, area;
+  struct Point point;
+  int layer;
+};
+
+struct IR_Pad {
+  struct Footprint *footprint;
+  struct Pad *pad;
+  struct Point outline[PAD_OUTLINE_MAX];
+  int count;
+  struct Box box;
+};
+
+struct IR_Mesh {
+  struct Board *board;
+  struct Net *net;
+  struct Box box;
+  float cell;
+  int nx, ny;
+  struct IR_Layer layers[IR_MAX_LAYERS];
+  int layer_count;
+  struct IR_Pad *pads;
+  int pad_count;
+  int node_count, node_capacity;
+  int *node_layer, *node_cell;
+  struct IR_Edge *edges;
+  int edge_count, edge_capacity;
+  int next;
+};
+
+static int compare_ordinal(const void *_1, const void *_2){
+  return (*(struct Layer *const *)_1)->ordinal - (*(struct Layer *const *)_2)->ordinal;
+}
+
+static int mesh_layer(const struct IR_Mesh *mesh, const struct Layer *layer){
+  for(int i = 0; i < mesh->layer_count; i++){
+    if(mesh->layers[i].layer == layer){
+      return i;
+    }
+  }
+  return -1;
+}
+
+static void grow_box(struct Box *box, struct Point point, float by){
+  box->min_x = fminf(box->min_x, point.x - by);
+  box->min_y = fminf(box->min_y, point.y - by);
+  box->max_x = fmaxf(box->max_x, point.x + by);
+  box->max_y = fmaxf(box->max_y, point.y + by);
+}
+
+static int inside_outline(const struct Point *outline, int count, float x, float y){
+  int inside = FALSE;
+  for(int i = 0, j = count - 1; i < count; j = i++){
+    if((outline[i].y > y) != (outline[j].y > y) && x < (outline[j].x - outline[i].x) * (y - outline[i].y) / (outline[j].y - outline[i].y) + outline[i].x){
+      inside = !inside;
+    }
+  }
+  return inside;
+}
+
+// Marks the copper cells of zone fills and pads, a row at a time
+static void *mark_worker(void *arg){
+  struct IR_Mesh *mesh = arg;
+  pcb = mesh->board;
+  struct Point *points = malloc(mesh->nx * sizeof(struct Point));
+  uint8_t *inside = malloc(mesh->nx);
+  while(TRUE){
+    int row = __atomic_fetch_add(&mesh->next, 1, __ATOMIC_RELAXED);
+    if(row >= mesh->ny * mesh->layer_count){
+      break;
+    }
+    struct IR_Layer *layer = &mesh->layers[row / mesh->ny];
+    int j = row % mesh->ny;
+    float y = mesh->box.min_y + (j + 0.5f) * mesh->cell;
+    uint8_t *copper = layer->copper + (size_t)j * mesh->nx;
+    for(struct Zone *zone = pcb->zones; zone; zone = zone->next){
+      if(zone->net != mesh->net || zone->layer != layer->layer){
+        continue;
+      }
+      for(struct Ring *ring = zone->rings; ring; ring = ring->next){
+        if(y < ring->box.min_y || y > ring->box.max_y){
+          continue;
+        }
+        int first = (int)floorf((ring->box.min_x - mesh->box.min_x) / mesh->cell), last = (int)ceilf((ring->box.max_x - mesh->box.min_x) / mesh->cell);
+        first = first < 0 ? 0 : first;
+        last = last >= mesh->nx ? mesh->nx - 1 : last;
+        if(last < first){
+          continue;
+        }
+        for(int i = first; i <= last; i++){
+          points[i - first] = (struct Point){mesh->box.min_x + (i + 0.5f) * mesh->cell, y};
+        }
+        ring_contains_points(ring, points, last - first + 1, inside);
+        for(int i = first; i <= last; i++){
+          copper[i] |= inside[i - first];
+        }
+      }
+    }
+    for(int p = 0; p < mesh->pad_count; p++){
+      struct IR_Pad *pad = &mesh->pads[p];
+      if(y < pad->box.min_y || y > pad->box.max_y || !pad_on_layer(pad->pad, layer->layer)){
+        continue;
+      }
+      int first = (int)floorf((pad->box.min_x - mesh->box.min_x) / mesh->cell), last = (int)ceilf((pad->box.max_x - mesh->box.min_x) / mesh->cell);
+      first = first < 0 ? 0 : first;
+      last = last >= mesh->nx ? mesh->nx - 1 : last;
+      for(int i = first; i <= last; i++){
+        float x = mesh->box.min_x + (i + 0.5f) * mesh->cell;
+        if(inside_outline(pad->outline, pad->count, x, y)){
+          copper[i] = TRUE;
+        }
+      }
+    }
+  }
+  free(points);
+  free(inside);
+  return NULL;
+}
+
+static int add_node(struct IR_Mesh *mesh, int layer, int cell){
+  if(mesh->node_count == mesh->node_capacity){
+    mesh->node_capacity = mesh->node_capacity ? mesh->node_capacity * 2 : 1024;
+    mesh->node_layer = realloc(mesh->node_layer, mesh->node_capacity * sizeof(int));
+    mesh->node_cell = realloc(mesh->node_cell, mesh->node_capacity * sizeof(int));
+  }
+  mesh->node_layer[mesh->node_count] = layer;
+  mesh->node_cell[mesh->node_count] = cell;
+  mesh->layers[layer].node[cell] = mesh->node_count;
+  return mesh->node_count++;
+}
+
+static int cell_of(const struct IR_Mesh *mesh, struct Point point){
+  int i = (int)floorf((point.x - mesh->box.min_x) / mesh->cell), j = (int)floorf((point.y - mesh->box.min_y) / mesh->cell);
+  i = i < 0 ? 0 : (i >= mesh->nx ? mesh->nx - 1 : i);
+  j = j < 0 ? 0 : (j >= mesh->ny ? mesh->ny - 1 : j);
+  return j * mesh->nx + i;
+}
+
+// Node of the cell under point, made when the cell has no copper of its own
+static int node_at(struct IR_Mesh *mesh, int layer, struct Point point){
+  int cell = cell_of(mesh, point);
+  int node = mesh->layers[layer].node[cell];
+  return node >= 0 ? node : add_node(mesh, layer, cell);
+}
+
+static void add_edge(struct IR_Mesh *mesh, int from, int to, int kind, double conductance, double area, struct Point point, int layer){
+  if(from == to || conductance <= 0){
+    return;
+  }
+  if(mesh->edge_count == mesh->edge_capacity){
+    mesh->edge_capacity = mesh->edge_capacity ? mesh->edge_capacity * 2 : 1024;
+    mesh->edges = realloc(mesh->edges, mesh->edge_capacity * sizeof(struct IR_Edge));
+  }
+  mesh->edges[mesh->edge_count++] = (struct IR_Edge){from, to, kind, conductance, area, point, layer};
+}
+
+// Barrel of a via or plated hole between each pair of layers it joins
+static void add_barrel(struct IR_Mesh *mesh, struct Point at, float drill, const int *layers, int count){
+  double r = drill / 2, area = M_PI * ((r + IR_PLATING) * (r + IR_PLATING) - r * r);
+  for(int i = 0; i + 1 < count; i++){
+    int from = node_at(mesh, layers[i], at), to = node_at(mesh, layers[i + 1], at);
+    double length = fmax(mesh->layers[layers[i + 1]].z - mesh->layers[layers[i]].z, 1e-3);
+    add_edge(mesh, from, to, IR_VIA, area / (IR_RESISTIVITY * length), area, at, layers[i]);
+  }
+}
+
+static void mesh_free(struct IR_Mesh *mesh){
+  for(int i = 0; i < mesh->layer_count; i++){
+    free(mesh->layers[i].node);
+    free(mesh->layers[i].copper);
+  }
+  free(mesh->pads);
+  free(mesh->node_layer);
+  free(mesh->node_cell);
+  free(mesh->edges);
+}
+
+static int build_mesh(struct IR_Mesh *mesh, float cell, int threads){
+  struct Layer *copper[IR_MAX_LAYERS];
+  int copper_count = 0;
+  for(struct Layer *layer = pcb->layers.layer; layer && copper_count < IR_MAX_LAYERS; layer = layer->next){
+    if(is_copper(layer)){
+      copper[copper_count++] = layer;
+    }
+  }
+  qsort(copper, copper_count, sizeof(struct Layer *), compare_ordinal);
+  float board = pcb->general.thickness > 0 ? pcb->general.thickness : IR_BOARD;
+  for(int i = 0; i < copper_count; i++){
+    mesh->layers[i].layer = copper[i];
+    mesh->layers[i].thickness = copper[i]->thickness > 0 ? copper[i]->thickness : IR_COPPER;
+    mesh->layers[i].z = copper_count > 1 ? board * i / (copper_count - 1) : 0;
+  }
+  mesh->layer_count = copper_count;
+
+  // The box round everything on the net
+  struct Box box = {INFINITY, INFINITY, -INFINITY, -INFINITY};
+  for(struct Zone *zone = pcb->zones; zone; zone = zone->next){
+    if(zone->net == mesh->net && mesh_layer(mesh, zone->layer) >= 0){
+      if(zone->rings == NULL && zone->filled_polygon.points){
+        zone_rings_init(zone);
+      }
+      for(struct Ring *ring = zone->rings; ring; ring = ring->next){
+        grow_box(&box, (struct Point){ring->box.min_x, ring->box.min_y}, 0);
+        grow_box(&box, (struct Point){ring->box.max_x, ring->box.max_y}, 0);
+      }
+    }
+  }
+  for(struct Track *track = pcb->tracks; track; track = track->next){
+    if(track_net(track) != mesh->net){
+      continue;
+    }
+    if(track->type == TRACK_TYPE_VIA){
+      grow_box(&box, (struct Point){track->track.via.at.x, track->track.via.at.y}, 0);
+    }else{
+      grow_box(&box, track->type == TRACK_TYPE_SEG ? track->track.segment.start : track->track.arc.start, 0);
+      grow_box(&box, track->type == TRACK_TYPE_SEG ? track->track.segment.end : track->track.arc.end, 0);
+    }
+  }
+  for(struct Footprint *footprint = pcb->footprints; footprint; footprint = footprint->next){
+    for(struct Pad *pad = footprint->pads; pad; pad = pad->next){
+      if(pad->net == mesh->net){
+        mesh->pads = realloc(mesh->pads, (mesh->pad_count + 1) * sizeof(struct IR_Pad));
+        struct IR_Pad *entry = &mesh->pads[mesh->pad_count++];
+        entry->footprint = footprint;
+        entry->pad = pad;
+        entry->count = pad_outline(footprint, pad, 0, entry->outline);
+        entry->box = (struct Box){INFINITY, INFINITY, -INFINITY, -INFINITY};
+        for(int i = 0; i < entry->count; i++){
+          grow_box(&entry->box, entry->outline[i], 0);
+        }
+        grow_box(&box, pad_position(footprint, pad), 0);
+        if(entry->count){
+          grow_box(&box, (struct Point){entry->box.min_x, entry->box.min_y}, 0);
+          grow_box(&box, (struct Point){entry->box.max_x, entry->box.max_y}, 0);
+        }
+      }
+    }
+  }
+  if(box.min_x > box.max_x || copper_count == 0){
+    printf("IR drop: net %s has no copper\n", mesh->net->name.chars);
+    return ERROR;
+  }
+  mesh->cell = cell;
+  mesh->box = (struct Box){box.min_x - cell, box.min_y - cell, box.max_x + cell, box.max_y + cell};
+  mesh->nx = (int)ceilf((mesh->box.max_x - mesh->box.min_x) / cell);
+  mesh->ny = (int)ceilf((mesh->box.max_y - mesh->box.min_y) / cell);
+  if((double)mesh->nx * mesh->ny * copper_count > IR_MAX_CELLS){
+    printf("IR drop: %d x %d cells on %d layers is too many, use a larger cell\n", mesh->nx, mesh->ny, copper_count);
+    return ERROR;
+  }
+  size_t cells = (size_t)mesh->nx * mesh->ny;
+  for(int i = 0; i < copper_count; i++){
+    mesh->layers[i].copper = calloc(cells, 1);
+    mesh->layers[i].node = malloc(cells * sizeof(int32_t));
+    memset(mesh->layers[i].node, 0xff, cells * sizeof(int32_t));
+  }
+
+  pthread_t *thread = malloc(threads * sizeof(pthread_t));
+  mesh->next = 0;
+  for(int i = 0; i < threads; i++){
+    pthread_create(&thread[i], NULL, mark_worker, mesh);
+  }
+  for(int i = 0; i < threads; i++){
+    pthread_join(thread[i], NULL);
+  }
+  free(thread);
+  // Pads smaller than a cell still get the one under their centre
+  for(int p = 0; p < mesh->pad_count; p++){
+    for(int i = 0; i < copper_count; i++){
+      if(pad_on_layer(mesh->pads[p].pad, mesh->layers[i].layer)){
+        mesh->layers[i].copper[cell_of(mesh, pad_position(mesh->pads[p].footprint, mesh->pads[p].pad))] = TRUE;
+      }
+    }
+  }
+
+  // Copper cells are nodes joined to their right and lower neighbours
+  for(int l = 0; l < copper_count; l++){
+    struct IR_Layer *layer = &mesh->layers[l];
+    for(size_t c = 0; c < cells; c++){
+      if(layer->copper[c]){
+        add_node(mesh, l, (int)c);
+      }
+    }
+    double sheet = layer->thickness / IR_RESISTIVITY;
+    for(int j = 0; j < mesh->ny; j++){
+      for(int i = 0; i < mesh->nx; i++){
+        int c = j * mesh->nx + i;
+        if(!layer->copper[c]){
+          continue;
+        }
+        struct Point centre = {mesh->box.min_x + (i + 0.5f) * cell, mesh->box.min_y + (j + 0.5f) * cell};
+        if(i + 1 < mesh->nx && layer->copper[c + 1]){
+          add_edge(mesh, layer->node[c], layer->node[c + 1], IR_PLANE, sheet, cell * layer->thickness, (struct Point){centre.x + cell / 2, centre.y}, l);
+        }
+        if(j + 1 < mesh->ny && layer->copper[c + mesh->nx]){
+          add_edge(mesh, layer->node[c], layer->node[c + mesh->nx], IR_PLANE, sheet, cell * layer->thickness, (struct Point){centre.x, centre.y + cell / 2}, l);
+        }
+      }
+    }
+  }
+
+  // Tracks, vias and plated holes
+  int spans[IR_MAX_LAYERS];
+  for(struct Track *track = pcb->tracks; track; track = track->next){
+    if(track_net(track) != mesh->net){
+      continue;
+    }
+    if(track->type == TRACK_TYPE_VIA){
+      int count = 0;
+      for(int l = 0; l < copper_count; l++){
+        if(via_on_layer(&track->track.via, mesh->layers[l].layer)){
+          spans[count++] = l;
+        }
+      }
+      add_barrel(mesh, (struct Point){track->track.via.at.x, track->track.via.at.y}, track->track.via.drill.diameter, spans, count);
+      continue;
+    }
+    int l = mesh_layer(mesh, track_layer(track));
+    if(l < 0){
+      continue;
+    }
+    struct Point start, end;
+    double length, width;
+    if(track->type == TRACK_TYPE_SEG){
+      start = track->track.segment.start;
+      end = track->track.segment.end;
+      length = hypot(end.x - start.x, end.y - start.y);
+      width = track->track.segment.width;
+    }else{
+      start = track->track.arc.start;
+      end = track->track.arc.end;
+      length = arc_length(track->track.arc.start, track->track.arc.mid, track->track.arc.end);
+      width = track->track.arc.width;
+    }
+    double area = width * mesh->layers[l].thickness;
+    int from = node_at(mesh, l, start), to = node_at(mesh, l, end);
+    add_edge(mesh, from, to, IR_TRACK, area / (IR_RESISTIVITY * fmax(length, 1e-6)), area, (struct Point){(start.x + end.x) / 2, (start.y + end.y) / 2}, l);
+  }
+  for(int p = 0; p < mesh->pad_count; p++){
+    struct Pad *pad = mesh->pads[p].pad;
+    if(pad->drill.diameter <= 0){
+      continue;
+    }
+    int count = 0;
+    for(int l = 0; l < copper_count; l++){
+      if(pad_on_layer(pad, mesh->layers[l].layer)){
+        spans[count++] = l;
+      }
+    }
+    add_barrel(mesh, pad_position(mesh->pads[p].footprint, pad), pad->drill.diameter, spans, count);
+  }
+  return SUCCESS;
+}
+
+// System
+
+// Builds the symmetric CSR from the edges. Sources and nodes no source
+// reaches are fixed rows, with their entries dropped from every row.
+static void build_system(struct Grid_System *system, const struct IR_Mesh *mesh, const uint8_t *source, uint8_t *reached){
+  int n = mesh->node_count;
+  system->n = n;
+  system->layers = mesh->layer_count;
+  system->nx = mesh->nx;
+  system->ny = mesh->ny;
+  system->row = calloc(n + 1, sizeof(int));
+  system->diagonal = calloc(n ? n : 1, sizeof(double));
+  system->fixed = malloc(n ? n : 1);
+  for(int e = 0; e < mesh->edge_count; e++){
+    system->row[mesh->edges[e].from + 1]++;
+    system->row[mesh->edges[e].to + 1]++;
+  }
+  for(int i = 0; i < n; i++){
+    system->row[i + 1] += system->row[i];
+  }
+  system->column = malloc((system->row[n] ? system->row[n] : 1) * sizeof(int));
+  system->value = malloc((system->row[n] ? system->row[n] : 1) * sizeof(double));
+  int *fill = malloc((n ? n : 1) * sizeof(int));
+  memcpy(fill, system->row, n * sizeof(int));
+  for(int e = 0; e < mesh->edge_count; e++){
+    const struct IR_Edge *edge = &mesh->edges[e];
+    system->column[fill[edge->from]] = edge->to;
+    system->value[fill[edge->from]++] = edge->conductance;
+    system->column[fill[edge->to]] = edge->from;
+    system->value[fill[edge->to]++] = edge->conductance;
+    system->diagonal[edge->from] += edge->conductance;
+    system->diagonal[edge->to] += edge->conductance;
+  }
+
+  // Breadth first from the sources
+  int head = 0, tail = 0;
+  memset(reached, 0, n);
+  for(int i = 0; i < n; i++){
+    if(source[i]){
+      reached[i] = TRUE;
+      fill[tail++] = i;
+    }
+  }
+  while(head < tail){
+    int i = fill[head++];
+    for(int k = system->row[i]; k < system->row[i + 1]; k++){
+      if(!reached[system->column[k]]){
+        reached[system->column[k]] = TRUE;
+        fill[tail++] = system->column[k];
+      }
+    }
+  }
+  free(fill);
+  for(int i = 0; i < n; i++){
+    system->fixed[i] = source[i] || !reached[i];
+    system->diagonal[i] = system->fixed[i] || system->diagonal[i] <= 0 ? 1 : system->diagonal[i];
+  }
+  int kept = 0;
+  for(int i = 0; i < n; i++){
+    int begin = system->row[i];
+    system->row[i] = kept;
+    for(int k = begin; k < system->row[i + 1] && !system->fixed[i]; k++){
+      if(!system->fixed[system->column[k]]){
+        system->column[kept] = system->column[k];
+        system->value[kept++] = system->value[k];
+      }
+    }
+  }
+  system->row[n] = kept;
+
+  system->x_cell = malloc((n ? n : 1) * sizeof(int));
+  system->y_cell = malloc((n ? n : 1) * sizeof(int));
+  system->layer = malloc((n ? n : 1) * sizeof(int));
+  for(int i = 0; i < n; i++){
+    system->x_cell[i] = mesh->node_cell[i] % mesh->nx;
+    system->y_cell[i] = mesh->node_cell[i] / mesh->nx;
+    system->layer[i] = mesh->node_layer[i];
+  }
+}
+
+static void system_free(struct Grid_System *system){
+  free(system->row);
+  free(system->column);
+  free(system->value);
+  free(system->diagonal);
+  free(system->b);
+  free(system->x_cell);
+  free(system->y_cell);
+  free(system->layer);
+  free(system->fixed);
+}
+
+// Report
+
+static const char *footprint_reference(const struct Footprint *footprint){
+  for(struct Footprint_Property *property = footprint->properties; property; property = property->next){
+    if(property->property && property->property->key.chars && strcmp(property->property->key.chars, "Reference") == 0){
+      return property->property->val.chars;
+    }
+  }
+  return NULL;
+}
+
+struct IR_Density {
+  double density;
+  int edge;
+};
+
+static int compare_density(const void *_1, const void *_2){
+  double density_1 = ((const struct IR_Density *)_1)->density, density_2 = ((const struct IR_Density *)_2)->density;
+  return density_1 > density_2 ? -1 : density_1 < density_2;
+}
+
+// Drop map of one layer as a grey PGM, white at the supply, black at the
+// largest drop or off the copper
+static int write_map(const struct IR_Mesh *mesh, int layer, const double *drop, const uint8_t *reached, double max_drop, const char *prefix){
+  char path[IR_PATH];
+  snprintf(path, sizeof(path), "%s-%s.pgm", prefix, mesh->layers[layer].layer->canonical_name.chars);
+  FILE *file = fopen(path, "wb");
+  if(file == NULL){
+    perror(path);
+    return ERROR;
+  }
+  fprintf(file, "P5\n%d %d\n255\n", mesh->nx, mesh->ny);
+  uint8_t *row = malloc(mesh->nx);
+  for(int j = 0; j < mesh->ny; j++){
+    for(int i = 0; i < mesh->nx; i++){
+      int node = mesh->layers[layer].node[j * mesh->nx + i];
+      row[i] = node >= 0 && reached[node] ? (uint8_t)lround(255 - 254 * (max_drop > 0 ? drop[node] / max_drop : 0)) : 0;
+    }
+    fwrite(row, 1, mesh->nx, file);
+  }
+  free(row);
+  if(fclose(file) != 0){
+    perror(path);
+    return ERROR;
+  }
+  return SUCCESS;
+}
+
+// DC drop on one net between source pads at options->voltage and sink
+// pads drawing their current. Writes the sink voltages and the densest
+// current to report, and a drop map per layer when options->map names a
+// prefix. Returns ERROR when the net, a pad or a source is missing.
+int ir_drop(const struct IR_Options *options, FILE *report, struct IR_Stats *stats){
+  struct IR_Stats local_stats;
+  stats = stats ? stats : &local_stats;
+  memset(stats, 0, sizeof(struct IR_Stats));
+  int threads = options->threads > 0 ? options->threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+  threads = threads < 1 ? 1 : threads;
+  float cell = options->cell > 0 ? options->cell : IR_CELL;
+
+  struct IR_Mesh mesh;
+  memset(&mesh, 0, sizeof(mesh));
+  mesh.board = pcb;
+  for(struct Net *net = pcb->nets; net && options->net; net = net->next){
+    if(net->name.chars && strcmp(net->name.chars, options->net) == 0){
+      mesh.net = net;
+    }
+  }
+  if(mesh.net == NULL){
+    printf("IR drop: no net %s\n", options->net ? options->net : "");
+    return ERROR;
+  }
+  // Terminals to pads of the net
+  int *terminal_pad = malloc((options->terminal_count ? options->terminal_count : 1) * sizeof(int));
+  int status = build_mesh(&mesh, cell, threads);
+  int sources = 0;
+  for(int t = 0; t < options->terminal_count && status == SUCCESS; t++){
+    const struct IR_Terminal *terminal = &options->terminals[t];
+    terminal_pad[t] = -1;
+    for(int p = 0; p < mesh.pad_count; p++){
+      const char *reference = footprint_reference(mesh.pads[p].footprint);
+      if(reference && strcmp(reference, terminal->reference) == 0 && mesh.pads[p].pad->num.chars && strcmp(mesh.pads[p].pad->num.chars, terminal->pad) == 0){
+        terminal_pad[t] = p;
+      }
+    }
+    if(terminal_pad[t] < 0){
+      printf("IR drop: no pad %s.%s on net %s\n", terminal->reference, terminal->pad, options->net);
+      status = ERROR;
+    }
+    sources += terminal->current <= 0;
+  }
+  if(status == SUCCESS && sources == 0){
+    printf("IR drop: no source pad\n");
+    status = ERROR;
+  }
+  if(status == ERROR){
+    free(terminal_pad);
+    mesh_free(&mesh);
+    return ERROR;
+  }
+
+  // Terminal nodes are those in the pad's outline on its layers
+  int n = mesh.node_count;
+  uint8_t *source = calloc(n ? n : 1, 1), *reached = malloc(n ? n : 1);
+  struct Grid_System system;
+  memset(&system, 0, sizeof(system));
+  system.b = calloc(n ? n : 1, sizeof(double));
+  int **terminal_nodes = calloc(options->terminal_count, sizeof(int *));
+  int *terminal_count = calloc(options->terminal_count, sizeof(int));
+  for(int t = 0; t < options->terminal_count; t++){
+    struct IR_Pad *pad = &mesh.pads[terminal_pad[t]];
+    struct Point centre = pad_position(pad->footprint, pad->pad);
+    for(int l = 0; l < mesh.layer_count; l++){
+      if(!pad_on_layer(pad->pad, mesh.layers[l].layer)){
+        continue;
+      }
+      int centre_cell = cell_of(&mesh, centre);
+      for(int j = 0; j < mesh.ny; j++){
+        float y = mesh.box.min_y + (j + 0.5f) * cell;
+        if(y < pad->box.min_y - cell || y > pad->box.max_y + cell){
+          continue;
+        }
+        int first = (int)floorf((pad->box.min_x - cell - mesh.box.min_x) / cell), last = (int)ceilf((pad->box.max_x + cell - mesh.box.min_x) / cell);
+        first = first < 0 ? 0 : first;
+        last = last >= mesh.nx ? mesh.nx - 1 : last;
+        for(int i = first; i <= last; i++){
+          float x = mesh.box.min_x + (i + 0.5f) * cell;
+          int c = j * mesh.nx + i, node = mesh.layers[l].node[c];
+          if(node >= 0 && (c == centre_cell || inside_outline(pad->outline, pad->count, x, y))){
+            terminal_nodes[t] = realloc(terminal_nodes[t], (terminal_count[t] + 1) * sizeof(int));
+            terminal_nodes[t][terminal_count[t]++] = node;
+          }
+        }
+      }
+    }
+    for(int k = 0; k < terminal_count[t]; k++){
+      if(options->terminals[t].current <= 0){
+        source[terminal_nodes[t][k]] = TRUE;
+      }else{
+        system.b[terminal_nodes[t][k]] += options->terminals[t].current / terminal_count[t];
+      }
+    }
+  }
+
+  build_system(&system, &mesh, source, reached);
+  double *drop = calloc(n ? n : 1, sizeof(double)), residual;
+  int iterations = grid_solve(&system, drop, IR_TOLERANCE, threads, &residual);
+
+  stats->nodes = n;
+  stats->edges = mesh.edge_count;
+  stats->iterations = iterations;
+  stats->residual = residual;
+  for(int i = 0; i < n; i++){
+    stats->islands += !reached[i];
+    if(reached[i] && drop[i] > stats->max_drop){
+      stats->max_drop = drop[i];
+    }
+  }
+  fprintf(report, "net %s %.4f V, %d nodes and %d edges on %d layers, cell %.4f mm\n", options->net, options->voltage, n, mesh.edge_count, mesh.layer_count, cell);
+  fprintf(report, "%d iterations, residual %.3g%s\n", iterations, residual, residual > IR_TOLERANCE ? " not converged" : "");
+  if(stats->islands){
+    fprintf(report, "%u nodes not reached from a source\n", stats->islands);
+  }
+  for(int t = 0; t < options->terminal_count; t++){
+    const struct IR_Terminal *terminal = &options->terminals[t];
+    if(terminal->current <= 0){
+      continue;
+    }
+    double worst = 0, mean = 0;
+    int unreached = 0;
+    for(int k = 0; k < terminal_count[t]; k++){
+      int node = terminal_nodes[t][k];
+      unreached += !reached[node];
+      worst = fmax(worst, drop[node]);
+      mean += drop[node] / terminal_count[t];
+    }
+    if(unreached){
+      fprintf(report, "sink %s.%s %.4f A not connected to a source\n", terminal->reference, terminal->pad, terminal->current);
+      stats->unconnected++;
+    }else{
+      fprintf(report, "sink %s.%s %.4f A: %.6f V, worst %.6f V, drop %.3f mV\n", terminal->reference, terminal->pad, terminal->current,
+        options->voltage - mean, options->voltage - worst, worst * 1000);
+    }
+  }
+
+  // Densest current, each edge's current over the area it flows through
+  struct IR_Density *density = malloc((mesh.edge_count ? mesh.edge_count : 1) * sizeof(struct IR_Density));
+  for(int e = 0; e < mesh.edge_count; e++){
+    const struct IR_Edge *edge = &mesh.edges[e];
+    double current = edge->conductance * fabs(drop[edge->from] - drop[edge->to]);
+    density[e] = (struct IR_Density){reached[edge->from] && reached[edge->to] ? current / edge->area : 0, e};
+  }
+  qsort(density, mesh.edge_count, sizeof(struct IR_Density), compare_density);
+  int hotspots = mesh.edge_count < IR_HOTSPOTS ? mesh.edge_count : IR_HOTSPOTS;
+  stats->max_density = hotspots ? density[0].density : 0;
+  fprintf(report, "max drop %.3f mV, densest current A/mm^2:\n", stats->max_drop * 1000);
+  for(int h = 0; h < hotspots && density[h].density > 0; h++){
+    const struct IR_Edge *edge = &mesh.edges[density[h].edge];
+    fprintf(report, "  %10.4f %-5s %-8s %.4f %.4f\n", density[h].density, edge_names[edge->kind], mesh.layers[edge->layer].layer->canonical_name.chars, edge->point.x, edge->point.y);
+  }
+  free(density);
+
+  for(int l = 0; options->map && l < mesh.layer_count; l++){
+    int used = FALSE;
+    for(size_t c = 0; c < (size_t)mesh.nx * mesh.ny && !used; c++){
+      used = mesh.layers[l].node[c] >= 0;
+    }
+    if(used && write_map(&mesh, l, drop, reached, stats->max_drop, options->map) == ERROR){
+      status = ERROR;
+    }
+  }
+
+  for(int t = 0; t < options->terminal_count; t++){
+    free(terminal_nodes[t]);
+  }
+  free(terminal_nodes);
+  free(terminal_count);
+  free(terminal_pad);
+  free(source);
+  free(reached);
+  free(drop);
+  system_free(&system);
+  mesh_free(&mesh);
+  return status;
+}
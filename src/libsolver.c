@@ -0,0 +1,782 @@
+#include <math.h>
+#include <pthread.h>
+
+#include "solver.h"
+#include "libsolver.h"
+
+// Library entry points
+// The parser and every derived step work on the thread local pcb, so each
+// call points pcb at its handle for the duration and puts it back after.
+
+_Thread_local struct Board *pcb;
+
+static pthread_mutex_t token_table_lock = PTHREAD_MUTEX_INITIALIZER;
+static int token_table_ready = FALSE;
+
+#define ENTER(board) struct Board *saved_pcb = pcb; pcb = (board)
+#define LEAVE() (pcb = saved_pcb)
+
+static const char *string_out(const String *string, uint64_t *length){
+  // Lengths stored by the parser count the terminating NUL
+  if(length){
+    *length = string->chars ? strlen(string->chars) : 0;
+  }
+  return string->chars;
+}
+
+static struct Board *board_open(const char *path, const char *buffer, uint64_t length){
+  pthread_mutex_lock(&token_table_lock);
+  if(!token_table_ready){
+    token_table_init();
+    token_table_ready = TRUE;
+  }
+  pthread_mutex_unlock(&token_table_lock);
+  struct Board *board = calloc(1, sizeof(struct Board));
+  ENTER(board);
+  int status = path ? open_pcb(path) : open_pcb_buffer(buffer, length);
+  if(status == ERROR){
+    free_pcb();
+    board = NULL;
+  }
+  LEAVE();
+  return board;
+}
+
+struct Board *solver_open(const char *path){
+  return board_open(path, NULL, 0);
+}
+
+struct Board *solver_open_buffer(const char *buffer, uint64_t length){
+  return board_open(NULL, buffer, length);
+}
+
+void solver_close(struct Board *board){
+  if(board){
+    ENTER(board);
+    free_pcb();
+    LEAVE();
+  }
+}
+
+// Frees the shared token table, only while no board is being opened, the
+// next open builds it again. Profiled builds print the parse profile here.
+void solver_cleanup(){
+  pthread_mutex_lock(&token_table_lock);
+#ifdef PROFILE
+  profile_dump();
+#endif
+  if(token_table_ready){
+    token_table_free();
+    token_table_ready = FALSE;
+  }
+  pthread_mutex_unlock(&token_table_lock);
+}
+
+void solver_print(struct Board *board){
+  print_zone(board->zones);
+}
+
+struct Net *solver_next_net(struct Board *board, struct Net *net){
+  return net ? net->next : board->nets;
+}
+
+struct Footprint *solver_next_footprint(struct Board *board, struct Footprint *footprint){
+  return footprint ? footprint->next : board->footprints;
+}
+
+struct Pad *solver_next_pad(struct Footprint *footprint, struct Pad *pad){
+  return pad ? pad->next : footprint->pads;
+}
+
+struct Track *solver_next_track(struct Board *board, struct Track *track){
+  return track ? track->next : board->tracks;
+}
+
+struct Zone *solver_next_zone(struct Board *board, struct Zone *zone){
+  return zone ? zone->next : board->zones;
+}
+
+int solver_net_ordinal(const struct Net *net){
+  return net ? net->ordinal : 0;
+}
+
+const char *solver_net_name(const struct Net *net, uint64_t *length){
+  return string_out(&net->name, length);
+}
+
+const char *solver_footprint_name(const struct Footprint *footprint, uint64_t *length){
+  return string_out(&footprint->library_link, length);
+}
+
+static const char *uuid_out(struct Uuid uuid, char *out){
+  if(uuid_is_nil(uuid)){
+    return NULL;
+  }
+  return uuid_string(uuid, out);
+}
+
+const char *solver_footprint_uuid(const struct Footprint *footprint, char *out){
+  return uuid_out(footprint->uuid, out);
+}
+
+// Value of the Reference property, NULL when there is none
+const char *solver_footprint_reference(const struct Footprint *footprint, uint64_t *length){
+  for(struct Footprint_Property *property = footprint->properties; property; property = property->next){
+    if(property->property && property->property->key.chars && strcmp(property->property->key.chars, "Reference") == 0){
+      return string_out(&property->property->val, length);
+    }
+  }
+  if(length){
+    *length = 0;
+  }
+  return NULL;
+}
+
+void solver_footprint_position(const struct Footprint *footprint, float *x, float *y, float *angle){
+  *x = footprint->at.x;
+  *y = footprint->at.y;
+  *angle = footprint->at.angle;
+}
+
+const char *solver_pad_number(const struct Pad *pad, uint64_t *length){
+  return string_out(&pad->num, length);
+}
+
+void solver_pad_position(struct Footprint *footprint, struct Pad *pad, float *x, float *y){
+  struct Point position = pad_position(footprint, pad);
+  *x = position.x;
+  *y = position.y;
+}
+
+struct Net *solver_pad_net(const struct Pad *pad){
+  return pad->net;
+}
+
+const char *solver_pad_uuid(const struct Pad *pad, char *out){
+  return uuid_out(pad->uuid, out);
+}
+
+int solver_track_type(const struct Track *track){
+  return track->type;
+}
+
+void solver_track_points(const struct Track *track, float *start_x, float *start_y, float *end_x, float *end_y){
+  switch(track->type){
+    case TRACK_TYPE_SEG:
+      *start_x = track->track.segment.start.x, *start_y = track->track.segment.start.y;
+      *end_x = track->track.segment.end.x, *end_y = track->track.segment.end.y;
+      break;
+    case TRACK_TYPE_ARC:
+      *start_x = track->track.arc.start.x, *start_y = track->track.arc.start.y;
+      *end_x = track->track.arc.end.x, *end_y = track->track.arc.end.y;
+      break;
+    case TRACK_TYPE_VIA:
+      *start_x = *end_x = track->track.via.at.x;
+      *start_y = *end_y = track->track.via.at.y;
+      break;
+  }
+}
+
+float solver_track_width(const struct Track *track){
+  switch(track->type){
+    case TRACK_TYPE_SEG:
+      return track->track.segment.width;
+    case TRACK_TYPE_ARC:
+      return track->track.arc.width;
+    case TRACK_TYPE_VIA:
+      return track->track.via.size;
+  }
+  return 0;
+}
+
+// Vias span several layers and return NULL
+const char *solver_track_layer(struct Track *track, uint64_t *length){
+  struct Layer *layer = track_layer(track);
+  if(layer == NULL){
+    if(length){
+      *length = 0;
+    }
+    return NULL;
+  }
+  return string_out(&layer->canonical_name, length);
+}
+
+struct Net *solver_track_net(struct Track *track){
+  return track_net(track);
+}
+
+const char *solver_track_uuid(const struct Track *track, char *out){
+  return uuid_out(track->uuid, out);
+}
+
+const char *solver_zone_uuid(const struct Zone *zone, char *out){
+  return uuid_out(zone->uuid, out);
+}
+
+const char *solver_zone_layer(const struct Zone *zone, uint64_t *length){
+  if(zone->layer == NULL){
+    if(length){
+      *length = 0;
+    }
+    return NULL;
+  }
+  return string_out(&zone->layer->canonical_name, length);
+}
+
+struct Net *solver_zone_net(const struct Zone *zone){
+  return zone->net;
+}
+
+uint32_t solver_zone_priority(const struct Zone *zone){
+  return zone->priority;
+}
+
+// Number of filled polygons, points gets their total point count
+int solver_zone_filled(const struct Zone *zone, int *points){
+  int polygons = 0;
+  if(points){
+    *points = 0;
+  }
+  for(const struct Polygon *polygon = &zone->filled_polygon; polygon && polygon->points; polygon = polygon->next){
+    polygons++;
+    if(points){
+      *points += polygon->point_count;
+    }
+  }
+  return polygons;
+}
+
+struct Query {
+  int (*callback)(int kind, void *item, struct Footprint *footprint, void *context);
+  void *context;
+};
+
+static int query_item(struct Item *item, void *context){
+  struct Query *query = context;
+  if(item->kind == ITEM_TRACK){
+    return query->callback(SOLVER_ITEM_TRACK, item->track, NULL, query->context) ? TRUE : FALSE;
+  }
+  return query->callback(SOLVER_ITEM_PAD, item->pad, item->footprint, query->context) ? TRUE : FALSE;
+}
+
+// Copper items whose bounds touch the box, on the named layer or on every
+// copper layer when layer is NULL
+int solver_query(struct Board *board, float min_x, float min_y, float max_x, float max_y, const char *layer, int (*callback)(int kind, void *item, struct Footprint *footprint, void *context), void *context){
+  struct Box box = {min_x, min_y, max_x, max_y};
+  struct Query query = {callback, context};
+  uint64_t layers = layer ? 0 : ~0ull;
+  ENTER(board);
+  if(pcb->spatial == NULL){
+    spatial_index_init();
+  }
+  for(struct Layer *current = pcb->layers.layer; layer && current; current = current->next){
+    if(current->canonical_name.chars && strcmp(layer, current->canonical_name.chars) == 0){
+      layers |= layer_mask(current);
+    }
+  }
+  int status = layers ? spatial_query(pcb->spatial, box, layers, query_item, &query) : ERROR;
+  LEAVE();
+  return status;
+}
+
+// Builds the derived data queries would otherwise build on first use
+int solver_prepare(struct Board *board){
+  ENTER(board);
+  int status = pcb->spatial ? SUCCESS : spatial_index_init();
+  if(status == SUCCESS && pcb->uuids == NULL){
+    status = uuid_index_init();
+  }
+  if(status == SUCCESS && pcb->outline == NULL){
+    // A board without Edge.Cuts has an empty outline
+    board_outline_init(0);
+  }
+  if(status == SUCCESS && pcb->metrics == NULL){
+    pcb->metrics = net_metrics_build(0);
+  }
+  for(struct Zone *zone = pcb->zones; status == SUCCESS && zone; zone = zone->next){
+    if(zone->rings == NULL && zone->filled_polygon.points){
+      zone_rings_init(zone);
+    }
+  }
+  LEAVE();
+  return status;
+}
+
+void *solver_find_uuid(struct Board *board, const char *uuid, int *kind, struct Footprint **footprint){
+  ENTER(board);
+  if(pcb->uuids == NULL){
+    uuid_index_init();
+  }
+  const struct Uuid_Entry *entry = uuid_find(pcb->uuids, uuid_parse(uuid, strlen(uuid)));
+  LEAVE();
+  if(kind){
+    *kind = entry ? entry->kind : 0;
+  }
+  if(footprint){
+    *footprint = entry ? entry->footprint : NULL;
+  }
+  return entry ? entry->item : NULL;
+}
+
+int solver_fill_zones(struct Board *board, float resolution, int threads){
+  ENTER(board);
+  int count = fill_zones(resolution, threads);
+  LEAVE();
+  return count;
+}
+
+int solver_export_gerbers(struct Board *board, const char *dir, int threads){
+  ENTER(board);
+  int count = export_gerbers(dir, threads);
+  LEAVE();
+  return count;
+}
+
+int solver_export_drills(struct Board *board, const char *dir, int threads, double *seed, double *travel){
+  ENTER(board);
+  int count = export_drills(dir, threads, seed, travel);
+  LEAVE();
+  return count;
+}
+
+struct Raster *solver_rasterise(struct Board *board, const char *layer, float dpi, int depth, int threads){
+  struct Raster *raster = NULL;
+  ENTER(board);
+  for(struct Layer *current = pcb->layers.layer; current; current = current->next){
+    if(current->canonical_name.chars && strcmp(layer, current->canonical_name.chars) == 0){
+      raster = rasterise_layer(current, dpi, depth, NULL, threads);
+      break;
+    }
+  }
+  LEAVE();
+  return raster;
+}
+
+void solver_raster_size(const struct Raster *raster, int *width, int *height){
+  *width = raster->width;
+  *height = raster->height;
+}
+
+uint8_t solver_raster_pixel(const struct Raster *raster, int x, int y){
+  return raster_pixel(raster, x, y);
+}
+
+int solver_raster_write(const struct Raster *raster, const char *path){
+  return raster_write(raster, path) == SUCCESS ? 0 : -1;
+}
+
+void solver_raster_free(struct Raster *raster){
+  raster_free(raster);
+}
+
+struct Diff_Open {
+  const char *path;
+  struct Board *board;
+};
+
+static void *diff_open(void *arg){
+  struct Diff_Open *open = arg;
+  open->board = solver_open(open->path);
+  return NULL;
+}
+
+int solver_diff(const char *before, const char *after, const char *dir, float dpi, int threads){
+  struct Diff_Open opens[2] = {{before, NULL}, {after, NULL}};
+  pthread_t thread;
+  int status = -1;
+  pthread_create(&thread, NULL, diff_open, &opens[1]);
+  diff_open(&opens[0]);
+  pthread_join(thread, NULL);
+  if(opens[0].board && opens[1].board){
+    status = diff_boards(opens[0].board, opens[1].board, dir, dpi, threads);
+  }
+  solver_close(opens[0].board);
+  solver_close(opens[1].board);
+  return status;
+}
+
+int solver_route(struct Board *board, float grid, float width, float clearance, int threads, int *connections){
+  struct Route_Options options = {grid, width, clearance, 0, 0, 0, threads};
+  struct Route_Stats stats;
+  ENTER(board);
+  int routed = route_board(&options, &stats);
+  LEAVE();
+  if(connections){
+    *connections = stats.connections;
+  }
+  return routed;
+}
+
+int solver_place(struct Board *board, float effort, int threads, uint64_t seed, double wirelength[2]){
+  struct Place_Options options = {effort, 0, 0, 0, threads, seed};
+  struct Place_Stats stats;
+  ENTER(board);
+  int moved = place_board(&options, &stats);
+  LEAVE();
+  if(wirelength){
+    wirelength[0] = stats.wirelength_before;
+    wirelength[1] = stats.wirelength;
+  }
+  return moved;
+}
+
+// Takes the track off the board, the writer leaves out what the model no
+// longer has
+void solver_remove_track(struct Board *board, struct Track *track){
+  ENTER(board);
+  net_metrics_track(pcb->metrics, track, -1);
+  if(track->prev){
+    track->prev->next = track->next;
+  }else{
+    pcb->tracks = track->next;
+  }
+  if(track->next){
+    track->next->prev = track->prev;
+  }
+  spatial_index_free(pcb->spatial);
+  pcb->spatial = NULL;
+  uuid_index_free(pcb->uuids);
+  pcb->uuids = NULL;
+  if(track->type == TRACK_TYPE_VIA){
+    free(track->track.via.layers);
+  }
+  free(track);
+  LEAVE();
+}
+
+static const struct Net_Metric *metric_of(const struct Net *net){
+  if(pcb->metrics == NULL){
+    pcb->metrics = net_metrics_build(0);
+  }
+  return net_metric(pcb->metrics, net ? net->ordinal : -1);
+}
+
+int solver_net_metrics(struct Board *board, const struct Net *net, double *length, double *hpwl, int *vias, int *pads){
+  ENTER(board);
+  const struct Net_Metric *metric = metric_of(net);
+  LEAVE();
+  if(metric == NULL){
+    return -1;
+  }
+  *length = metric->length;
+  *hpwl = metric->hpwl;
+  *vias = metric->vias;
+  *pads = metric->pads;
+  return 0;
+}
+
+double solver_net_layer_length(struct Board *board, const struct Net *net, const char *layer){
+  double length = 0;
+  ENTER(board);
+  const struct Net_Metric *metric = metric_of(net);
+  for(int slot = 0; metric && net_metrics_layer(pcb->metrics, slot); slot++){
+    length += strcmp(net_metrics_layer(pcb->metrics, slot)->canonical_name.chars, layer) == 0 ? metric->layer_length[slot] : 0;
+  }
+  LEAVE();
+  return length;
+}
+
+int solver_net_report(struct Board *board, const char *path, const char *sort, int threads){
+  static const char *keys[] = {"name", "length", "hpwl", "vias", "ratio"};
+  int key = NET_SORT_NAME;
+  for(int i = 0; sort && i < (int)(sizeof(keys) / sizeof(keys[0])); i++){
+    key = strcmp(sort, keys[i]) == 0 ? i : key;
+  }
+  FILE *file = path ? fopen(path, "w") : stdout;
+  if(file == NULL){
+    perror(path);
+    return -1;
+  }
+  ENTER(board);
+  if(pcb->metrics == NULL){
+    pcb->metrics = net_metrics_build(threads);
+  }
+  int count = net_metrics_report(file, pcb->metrics, key);
+  LEAVE();
+  if(path){
+    fclose(file);
+  }
+  return count;
+}
+
+int solver_check_pairs(struct Board *board, const char *patterns, float max_gap, float max_skew, int threads, const char *path){
+  struct Pair_Options options = {max_gap, 0, max_skew, threads, patterns};
+  FILE *file = path ? fopen(path, "w") : stdout;
+  if(file == NULL){
+    perror(path);
+    return -1;
+  }
+  ENTER(board);
+  int violations = check_pairs(&options, file, NULL);
+  LEAVE();
+  if(path){
+    fclose(file);
+  }
+  return violations;
+}
+
+double solver_track_impedance(struct Board *board, struct Track *track, int field){
+  ENTER(board);
+  double impedance = track_impedance(track, field);
+  LEAVE();
+  return impedance;
+}
+
+int solver_impedance_report(struct Board *board, int field, float tolerance, int threads, const char *path){
+  struct Impedance_Options options = {tolerance, field, threads};
+  FILE *file = path ? fopen(path, "w") : stdout;
+  if(file == NULL){
+    perror(path);
+    return -1;
+  }
+  ENTER(board);
+  int steps = check_impedance(&options, file, NULL);
+  LEAVE();
+  if(path){
+    fclose(file);
+  }
+  return steps;
+}
+
+int solver_check_crosstalk(struct Board *board, float max_spacing, float rise_time, int top, int threads, const char *path, double *worst){
+  struct Crosstalk_Options options = {max_spacing, 0, rise_time, 0, top, threads};
+  struct Crosstalk_Stats stats;
+  FILE *file = path ? fopen(path, "w") : stdout;
+  if(file == NULL){
+    perror(path);
+    return -1;
+  }
+  ENTER(board);
+  int victims = check_crosstalk(&options, file, &stats);
+  LEAVE();
+  if(path){
+    fclose(file);
+  }
+  if(worst){
+    *worst = fmax(stats.worst_next, stats.worst_fext);
+  }
+  return victims;
+}
+
+int solver_board_outline(struct Board *board, float max_error, double *area, float *box, int *cutouts, int *open_chains){
+  ENTER(board);
+  if(pcb->outline == NULL){
+    board_outline_init(max_error);
+  }
+  const struct Board_Outline *outline = pcb->outline;
+  if(area){
+    *area = outline->area;
+  }
+  if(box){
+    struct Box extent = outline->rings ? outline->box : (struct Box){0, 0, 0, 0};
+    box[0] = extent.min_x, box[1] = extent.min_y, box[2] = extent.max_x, box[3] = extent.max_y;
+  }
+  if(cutouts){
+    *cutouts = outline->cutouts;
+  }
+  if(open_chains){
+    *open_chains = outline->open_chains;
+  }
+  int rings = outline->ring_count;
+  LEAVE();
+  return rings;
+}
+
+int solver_board_contains(struct Board *board, float x, float y){
+  ENTER(board);
+  if(pcb->outline == NULL){
+    board_outline_init(0);
+  }
+  int inside = board_contains_point(pcb->outline, (struct Point){x, y});
+  LEAVE();
+  return inside;
+}
+
+int solver_check_courtyards(struct Board *board, float clearance, float edge_clearance, int threads, const char *path){
+  struct Courtyard_Options options = {clearance, edge_clearance, threads};
+  FILE *file = path ? fopen(path, "w") : stdout;
+  if(file == NULL){
+    perror(path);
+    return -1;
+  }
+  ENTER(board);
+  int violations = check_courtyards(&options, file, NULL);
+  LEAVE();
+  if(path){
+    fclose(file);
+  }
+  return violations;
+}
+
+int solver_ir_drop(struct Board *board, const char *net, float voltage, const char **pads, const float *currents, int count, float cell, int threads, const char *map, const char *path, double *max_drop){
+  struct IR_Terminal *terminals = malloc((count ? count : 1) * sizeof(struct IR_Terminal));
+  char **references = malloc((count ? count : 1) * sizeof(char *));
+  for(int i = 0; i < count; i++){
+    // REF.PAD, the reference up to the first dot
+    const char *dot = strchr(pads[i], '.');
+    size_t length = dot ? (size_t)(dot - pads[i]) : strlen(pads[i]);
+    references[i] = malloc(length + 1);
+    memcpy(references[i], pads[i], length);
+    references[i][length] = '\0';
+    terminals[i] = (struct IR_Terminal){references[i], dot ? dot + 1 : "", currents[i]};
+  }
+  struct IR_Options options = {net, terminals, count, voltage, cell, threads, map};
+  struct IR_Stats stats;
+  FILE *file = path ? fopen(path, "w") : stdout;
+  int status = ERROR;
+  if(file == NULL){
+    perror(path);
+  }else{
+    ENTER(board);
+    status = ir_drop(&options, file, &stats);
+    LEAVE();
+    if(path){
+      fclose(file);
+    }
+  }
+  for(int i = 0; i < count; i++){
+    free(references[i]);
+  }
+  free(references);
+  free(terminals);
+  if(max_drop){
+    *max_drop = status == SUCCESS ? stats.max_drop : 0;
+  }
+  return status == SUCCESS ? 0 : -1;
+}
+
+int solver_thermal(struct Board *board, float cell, float ambient, const char *property, int threads, const char *map, const char *path, double *max_temperature){
+  struct Thermal_Options options = {cell, ambient, 0, property, threads, map};
+  struct Thermal_Stats stats;
+  FILE *file = path ? fopen(path, "w") : stdout;
+  if(file == NULL){
+    perror(path);
+    return -1;
+  }
+  ENTER(board);
+  int status = thermal_solve(&options, file, &stats);
+  LEAVE();
+  if(path){
+    fclose(file);
+  }
+  if(max_temperature){
+    *max_temperature = status == SUCCESS ? stats.max_temperature : 0;
+  }
+  return status == SUCCESS ? 0 : -1;
+}
+
+int solver_save(struct Board *board, const char *path){
+  ENTER(board);
+  int status = write_pcb(path);
+  LEAVE();
+  return status == SUCCESS ? 0 : -1;
+}
+
+void free_pcb(){
+  //a();
+  struct Layer *layer = pcb->layers.layer;
+  struct Net *net = pcb->nets;
+  struct Footprint *footprint = pcb->footprints;
+  struct Track *track = pcb->tracks;
+  struct Zone *zone = pcb->zones;
+  
+  //a();
+  free(pcb->source.chars);
+  while(layer){
+    struct Layer *temp = layer;
+    layer = layer->next;
+    free(temp);
+  }
+  //a();
+  while(net){
+    struct Net *temp = net;
+    net = net->next;
+    free(temp);
+  }
+  //a();
+  while(footprint){
+    struct Footprint *temp = footprint;
+    footprint = footprint->next;
+      if(temp->properties){
+        struct Footprint_Property *property = temp->properties;
+        struct Footprint_Property *temp_property;
+        while(property){ 
+          temp_property = property;
+          property = property->next;
+          free(temp_property->property);
+          free(temp_property);
+        }
+      }
+      //a();
+      if(temp->pads){
+        struct Pad *pad = temp->pads;
+        struct Pad * temp_pad;
+        while(pad){
+          temp_pad = pad;
+          //printf("Pad: %p\n", pad);
+          pad = pad->next;
+          free(temp_pad);
+        }
+      }
+      while(temp->fp_rects){
+        struct Rect *rect = temp->fp_rects;
+        temp->fp_rects = rect->next;
+        free(rect);
+      }
+      while(temp->fp_circles){
+        struct Circle *circle = temp->fp_circles;
+        temp->fp_circles = circle->next;
+        free(circle);
+      }
+      while(temp->fp_arcs){
+        struct Footprint_Arc *arc = temp->fp_arcs;
+        temp->fp_arcs = arc->next;
+        free(arc);
+      }
+      while(temp->fp_poly){
+        struct Polygon *polygon = temp->fp_poly;
+        temp->fp_poly = polygon->next;
+        free(polygon->points);
+        free(polygon);
+      }
+      free(temp->line_uuids);
+    free(temp);
+  }
+  while(track){
+    struct Track *temp = track;
+    track = track->next;
+    if(temp->type == TRACK_TYPE_VIA){
+      free(temp->track.via.layers);
+    }
+    free(temp);
+  }
+  while(zone){
+    struct Zone *temp = zone;
+    zone = zone->next;
+    free(temp->polygon.points);
+    free(temp->filled_polygon.points);
+    struct Polygon *polygon = temp->filled_polygon.next;
+    while(polygon){
+      struct Polygon *temp_polygon = polygon;
+      polygon = polygon->next;
+      free(temp_polygon->points);
+      free(temp_polygon);
+    }
+    ring_free(temp->rings);
+    free(temp);
+  }
+  while(pcb->graphics.drawings){
+    struct Drawing *temp = pcb->graphics.drawings;
+    pcb->graphics.drawings = temp->next;
+    free(temp->points);
+    free(temp);
+  }
+  footprint_bodies_free(pcb->bodies);
+  spatial_index_free(pcb->spatial);
+  uuid_index_free(pcb->uuids);
+  net_metrics_free(pcb->metrics);
+  impedance_cache_free(pcb->impedance);
+  board_outline_free(pcb->outline);
+  intern_table_free(pcb->strings);
+  free(pcb);
+}
\ No newline at end of file
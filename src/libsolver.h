@@ -0,0 +1,228 @@
+#ifndef LIBSOLVER_H
+#define LIBSOLVER_H
+
+#include <stdint.h>
+
+// Public interface of libsolver
+// Every board is an opaque handle and owns everything reached through it.
+// Handles are independent, any number can be open at once, but a single
+// handle must not be used from two threads at the same time. The one
+// exception is a handle after solver_prepare, which builds everything the
+// other calls would build on first use: from then on any number of
+// threads may share it for calls that only read, which is every call but
+// solver_fill_zones, solver_route, solver_place, solver_remove_track and
+// the impedance calls, which cache cross sections on the handle. Strings
+// are NUL terminated, length (when not NULL) gets their length without
+// it.
+
+struct Board;
+struct Net;
+struct Footprint;
+struct Pad;
+struct Track;
+struct Zone;
+struct Raster;
+
+#define SOLVER_TRACK_SEGMENT 1
+#define SOLVER_TRACK_VIA 2
+#define SOLVER_TRACK_ARC 3
+
+#define SOLVER_ITEM_TRACK 1
+#define SOLVER_ITEM_PAD 2
+
+#define SOLVER_UUID_FOOTPRINT 1
+#define SOLVER_UUID_PROPERTY 2
+#define SOLVER_UUID_LINE 3
+#define SOLVER_UUID_PAD 4
+#define SOLVER_UUID_TRACK 5
+#define SOLVER_UUID_ZONE 6
+
+// Uuids are written to out as 36 characters and a NUL, the accessors
+// return out or NULL when the item has no uuid. One the file wrote in
+// another form comes back as written, good until the board is closed.
+#define SOLVER_UUID_SIZE 37
+
+// Boards
+struct Board *solver_open(const char *path);
+struct Board *solver_open_buffer(const char *buffer, uint64_t length);
+void solver_close(struct Board *board);
+void solver_cleanup();
+void solver_print(struct Board *board);
+// Writes the board as a kicad_pcb, unchanged items are copied byte for byte
+// from the file it was opened from, returns 0 on success
+int solver_save(struct Board *board, const char *path);
+
+// Iteration, pass NULL for the first item, NULL is returned after the last
+struct Net *solver_next_net(struct Board *board, struct Net *net);
+struct Footprint *solver_next_footprint(struct Board *board, struct Footprint *footprint);
+struct Pad *solver_next_pad(struct Footprint *footprint, struct Pad *pad);
+struct Track *solver_next_track(struct Board *board, struct Track *track);
+struct Zone *solver_next_zone(struct Board *board, struct Zone *zone);
+
+// Uuids
+// Item with the uuid in any case, NULL when there is none. kind gets the
+// SOLVER_UUID_* of the item and footprint, when not NULL, the footprint a
+// property, line or pad belongs to. The index is built on first use or by
+// solver_prepare.
+void *solver_find_uuid(struct Board *board, const char *uuid, int *kind, struct Footprint **footprint);
+
+// Nets
+int solver_net_ordinal(const struct Net *net);
+const char *solver_net_name(const struct Net *net, uint64_t *length);
+
+// Footprints and pads
+const char *solver_footprint_name(const struct Footprint *footprint, uint64_t *length);
+const char *solver_footprint_uuid(const struct Footprint *footprint, char *out);
+const char *solver_footprint_reference(const struct Footprint *footprint, uint64_t *length);
+void solver_footprint_position(const struct Footprint *footprint, float *x, float *y, float *angle);
+const char *solver_pad_number(const struct Pad *pad, uint64_t *length);
+void solver_pad_position(struct Footprint *footprint, struct Pad *pad, float *x, float *y);
+struct Net *solver_pad_net(const struct Pad *pad);
+const char *solver_pad_uuid(const struct Pad *pad, char *out);
+
+// Tracks, a via has start == end and its size as width
+int solver_track_type(const struct Track *track);
+void solver_track_points(const struct Track *track, float *start_x, float *start_y, float *end_x, float *end_y);
+float solver_track_width(const struct Track *track);
+const char *solver_track_layer(struct Track *track, uint64_t *length);
+struct Net *solver_track_net(struct Track *track);
+const char *solver_track_uuid(const struct Track *track, char *out);
+
+// Zones
+const char *solver_zone_uuid(const struct Zone *zone, char *out);
+const char *solver_zone_layer(const struct Zone *zone, uint64_t *length);
+struct Net *solver_zone_net(const struct Zone *zone);
+uint32_t solver_zone_priority(const struct Zone *zone);
+int solver_zone_filled(const struct Zone *zone, int *points);
+
+// Queries
+// The callback gets a struct Track or struct Pad per item kind, footprint
+// is set for pads, and stops the query by returning 0. solver_prepare
+// builds the spatial and uuid indexes, the outline, the net metrics and
+// the rings of filled zones, returns 0 or -1.
+int solver_prepare(struct Board *board);
+int solver_query(struct Board *board, float min_x, float min_y, float max_x, float max_y, const char *layer, int (*callback)(int kind, void *item, struct Footprint *footprint, void *context), void *context);
+int solver_fill_zones(struct Board *board, float resolution, int threads);
+
+// Export
+// One RS-274X file per copper layer in dir, returns the number written or -1
+int solver_export_gerbers(struct Board *board, const char *dir, int threads);
+// PTH.drl and NPTH.drl in dir, returns the number of holes or -1, seed and
+// travel get the drill path in mm before and after ordering, can be NULL
+int solver_export_drills(struct Board *board, const char *dir, int threads, double *seed, double *travel);
+
+// Rasters
+// Copper of one layer at dpi, depth is 1 or 8 bits a pixel, the raster
+// covers the copper of every layer so a board's layers line up. Pixels
+// read back as 0-255 at either depth. Writes PBM at depth 1, PGM at 8.
+struct Raster *solver_rasterise(struct Board *board, const char *layer, float dpi, int depth, int threads);
+void solver_raster_size(const struct Raster *raster, int *width, int *height);
+uint8_t solver_raster_pixel(const struct Raster *raster, int x, int y);
+int solver_raster_write(const struct Raster *raster, const char *path);
+void solver_raster_free(struct Raster *raster);
+
+// Routing
+// Routes the connections the board's copper leaves open on a grid and adds
+// the tracks and vias to the board, 0 takes the defaults: 0.15 mm tracks
+// and clearance on a grid of their sum, every core. Returns the number of
+// connections routed, connections gets how many there were.
+int solver_route(struct Board *board, float grid, float width, float clearance, int threads, int *connections);
+
+// Net metrics
+// Routed length, arcs along the arc, pad half perimeter, vias and pads of
+// a net, 0 on success. The metrics are built over every net on first use
+// and kept up to date as tracks are routed or removed and footprints placed.
+int solver_net_metrics(struct Board *board, const struct Net *net, double *length, double *hpwl, int *vias, int *pads);
+// Routed length of the net on one copper layer by canonical name
+double solver_net_layer_length(struct Board *board, const struct Net *net, const char *layer);
+// One line per net to path, stdout when NULL, sorted by "name", "length",
+// "hpwl", "vias" or "ratio" of length to hpwl, the numbers largest first.
+// Returns the number of nets written or -1.
+int solver_net_report(struct Board *board, const char *path, const char *sort, int threads);
+// Removes a track from the board and frees it
+void solver_remove_track(struct Board *board, struct Track *track);
+
+// Differential pairs
+// Nets named with _P/_N or +/- suffixes, or suffixes from the patterns
+// file, are checked for length skew, uncoupled length and the gap between
+// the two sides, coupled when within max_gap mm edge to edge. The patterns
+// file may also set length groups. Skew over max_skew, when above 0, and
+// group nets off target are violations. Writes the report to path, stdout
+// when NULL, and returns the number of violations or -1.
+int solver_check_pairs(struct Board *board, const char *patterns, float max_gap, float max_skew, int threads, const char *path);
+
+// Impedance
+// Characteristic impedance in ohm of a segment or arc from the stackup,
+// 0 when no plane is near. field != 0 runs the finite difference solver on
+// cross sections not solved before, the closed forms are used otherwise.
+double solver_track_impedance(struct Board *board, struct Track *track, int field);
+// Impedance profile of every net to path, stdout when NULL, flagging joins
+// where the impedance steps by more than tolerance, 0.1 by default.
+// Returns the number of discontinuities or -1.
+int solver_impedance_report(struct Board *board, int field, float tolerance, int threads, const char *path);
+
+// Crosstalk
+// Near and far end crosstalk between segments of different nets within
+// max_spacing mm, 0.5 by default, for aggressor edges of rise_time ns, 1
+// by default, listing top aggressors per net, 5 by default, to path,
+// stdout when NULL. worst gets the largest total on one net as a
+// fraction of the aggressor swing. Returns the number of victim nets.
+int solver_check_crosstalk(struct Board *board, float max_spacing, float rise_time, int top, int threads, const char *path, double *worst);
+
+// Board outline
+// Closed rings of the Edge.Cuts drawings of the board and its footprints,
+// arcs and circles cut into chords within max_error mm, 0.005 by default,
+// arcs in poly outlines within 0.005 as they are read. The
+// outline is built once, by solver_prepare or the first call that needs
+// it, and kept; max_error only applies to that first build, so a prepared
+// handle stays read only. Returns the number of rings, 0 when nothing
+// closes. area gets the board's in mm^2 less its cutouts, box min x, min y,
+// max x and max y, cutouts the rings cut out of the board and open_chains
+// the runs of edges that never close. Each can be NULL.
+int solver_board_outline(struct Board *board, float max_error, double *area, float *box, int *cutouts, int *open_chains);
+// 1 when the point is on the board and not in a cutout, 1 everywhere when
+// the board has no outline. The outline is built on first use or by
+// solver_prepare.
+int solver_board_contains(struct Board *board, float x, float y);
+
+// Courtyards
+// Footprint courtyards on the same side of the board that overlap or come
+// within clearance mm of each other, and those off the board outline or
+// within edge_clearance mm of its edge, written to path, stdout when NULL,
+// largest overlap first. Courtyards are drawn with lines, rects, circles,
+// arcs and polys, footprints without any use the box round their pads and
+// lines. Returns the number of violations or -1.
+int solver_check_courtyards(struct Board *board, float clearance, float edge_clearance, int threads, const char *path);
+
+// IR drop
+// DC voltage drop over the copper of net. pads are "REF.PAD" with the
+// current in A each draws in currents, 0 for a source held at voltage.
+// The copper is meshed at cell mm, 0.1 when 0. Writes the report to path,
+// stdout when NULL, and when map is set one PGM per layer named
+// <map>-<layer>.pgm. max_drop gets the largest drop in V. Returns 0 or -1.
+int solver_ir_drop(struct Board *board, const char *net, float voltage, const char **pads, const float *currents, int count, float cell, int threads, const char *map, const char *path, double *max_drop);
+
+// Thermal
+// Steady state temperatures with each footprint dissipating the watts in
+// its property, "Power" when NULL, on a grid of cell mm, 0.5 when 0, at
+// ambient C, 25 when 0. Writes the report to path, stdout when NULL, and
+// when map is set one PGM per layer named <map>-<layer>.pgm.
+// max_temperature gets the hottest point in C. Returns 0 or -1.
+int solver_thermal(struct Board *board, float cell, float ambient, const char *property, int threads, const char *map, const char *path, double *max_temperature);
+
+// Placement
+// Anneals the positions of the footprints that are not locked to shorten
+// the nets without overlapping. With an outline on Edge.Cuts they end on
+// the board clear of its edge, without one inside the box they span now.
+// 0 takes the defaults: effort 1, one chain per core. Returns how many
+// footprints moved, wirelength gets the total before and after in mm.
+int solver_place(struct Board *board, float effort, int threads, uint64_t seed, double wirelength[2]);
+
+// Diff
+// Parses both revisions in parallel and prints the copper added, removed
+// and moved per item, layer and net. dpi > 0 adds each changed layer's XOR
+// area, and an XOR PBM per layer in dir when dir is not NULL. Returns the
+// number of changes or -1 when either board fails to open.
+int solver_diff(const char *before, const char *after, const char *dir, float dpi, int threads);
+
+#endif
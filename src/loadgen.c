@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Load generator for the board server
+// Every client thread keeps one connection open and sends a fixed mix of
+// queries back to back, waiting for each reply. The first query of the run
+// loads the board and is reported on its own.
+//
+// Solver --load <socket> <board> [--clients N] [--queries N]
+
+struct Load_Client {
+  const char *socket_path, *board;
+  int queries, failed;
+  double *latency_us;
+  pthread_t thread;
+};
+
+static double now_us(){
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec * 1e6 + time.tv_nsec / 1e3;
+}
+
+static int connect_server(const char *path){
+  struct sockaddr_un address;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+  if(fd < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0){
+    perror("Error connecting");
+    if(fd >= 0){
+      close(fd);
+    }
+    return -1;
+  }
+  return fd;
+}
+
+// Reads one whole reply, returns 0 for OK, the body is only counted
+static int read_reply(int fd, char *buffer, size_t size){
+  size_t length = 0, scanned = 0;
+  int lines = -1;
+  while(1){
+    ssize_t got = recv(fd, buffer + length, size - length - 1, 0);
+    if(got <= 0){
+      return -1;
+    }
+    length += got;
+    buffer[length] = '\0';
+    for(; scanned < length; scanned++){
+      if(buffer[scanned] != '\n'){
+        continue;
+      }
+      if(lines < 0){
+        if(strncmp(buffer, "OK ", 3) != 0){
+          return -1;
+        }
+        lines = atoi(buffer + 3);
+      }else{
+        lines--;
+      }
+      if(lines == 0){
+        return 0;
+      }
+    }
+    if(lines >= 0){
+      length = scanned = 3;
+    }
+  }
+}
+
+static int query(int fd, const char *request, char *buffer, size_t size){
+  size_t length = strlen(request), sent = 0;
+  while(sent < length){
+    ssize_t count = send(fd, request + sent, length - sent, MSG_NOSIGNAL);
+    if(count <= 0){
+      return -1;
+    }
+    sent += count;
+  }
+  return read_reply(fd, buffer, size);
+}
+
+static void *load_client(void *arg){
+  struct Load_Client *client = arg;
+  char requests[4][1024], buffer[1 << 16];
+  int fd = connect_server(client->socket_path);
+  if(fd < 0){
+    client->failed = client->queries;
+    return NULL;
+  }
+  snprintf(requests[0], sizeof(requests[0]), "STATS %s\n", client->board);
+  snprintf(requests[1], sizeof(requests[1]), "NET %s GND\n", client->board);
+  snprintf(requests[2], sizeof(requests[2]), "PADS %s R1001\n", client->board);
+  snprintf(requests[3], sizeof(requests[3]), "REGION %s * 0 0 50 50\n", client->board);
+  for(int i = 0; i < client->queries; i++){
+    double start = now_us();
+    // Lookups that miss still make a full round trip, only I/O errors count
+    int status = query(fd, requests[i % 4], buffer, sizeof(buffer));
+    client->latency_us[i] = now_us() - start;
+    if(status != 0 && strncmp(buffer, "ERR", 3) != 0){
+      client->failed++;
+    }
+  }
+  close(fd);
+  return NULL;
+}
+
+static int compare_double(const void *_1, const void *_2){
+  double a_1 = *(const double *)_1, a_2 = *(const double *)_2;
+  return (a_1 > a_2) - (a_1 < a_2);
+}
+
+// argv holds the socket, the board and the options after --load
+int run_load(int argc, char **argv){
+  int clients = 4, queries = 10000, failed = 0;
+  char buffer[1 << 16];
+  if(argc < 2){
+    printf("Usage --load <socket> <board> [--clients N] [--queries N]\n");
+    return -1;
+  }
+  for(int i = 2; i + 1 < argc; i += 2){
+    if(strcmp(argv[i], "--clients") == 0){
+      clients = atoi(argv[i + 1]) > 0 ? atoi(argv[i + 1]) : 1;
+    }else if(strcmp(argv[i], "--queries") == 0){
+      queries = atoi(argv[i + 1]) > 0 ? atoi(argv[i + 1]) : 1;
+    }
+  }
+
+  // Cold query, parses the board on the server
+  int fd = connect_server(argv[0]);
+  if(fd < 0){
+    return -1;
+  }
+  char request[1024];
+  snprintf(request, sizeof(request), "STATS %s\n", argv[1]);
+  double start = now_us();
+  int status = query(fd, request, buffer, sizeof(buffer));
+  double cold_us = now_us() - start;
+  close(fd);
+  if(status != 0){
+    printf("Server can't load %s: %s", argv[1], buffer);
+    return -1;
+  }
+
+  struct Load_Client *load = calloc(clients, sizeof(struct Load_Client));
+  start = now_us();
+  for(int i = 0; i < clients; i++){
+    load[i].socket_path = argv[0];
+    load[i].board = argv[1];
+    load[i].queries = queries;
+    load[i].latency_us = malloc(queries * sizeof(double));
+    pthread_create(&load[i].thread, NULL, load_client, &load[i]);
+  }
+  double *latency_us = malloc((size_t)clients * queries * sizeof(double));
+  for(int i = 0; i < clients; i++){
+    pthread_join(load[i].thread, NULL);
+    memcpy(latency_us + (size_t)i * queries, load[i].latency_us, queries * sizeof(double));
+    failed += load[i].failed;
+    free(load[i].latency_us);
+  }
+  double wall_us = now_us() - start;
+  size_t total = (size_t)clients * queries;
+  qsort(latency_us, total, sizeof(double), compare_double);
+  printf("cold_us %.1f\n", cold_us);
+  printf("clients %d queries %zu failed %d wall_ms %.1f queries_per_s %.0f\n", clients, total, failed, wall_us / 1e3, total * 1e6 / wall_us);
+  printf("latency_us p50 %.1f p90 %.1f p99 %.1f max %.1f\n", latency_us[total / 2], latency_us[total * 9 / 10], latency_us[total * 99 / 100], latency_us[total - 1]);
+  free(latency_us);
+  free(load);
+  return failed ? -1 : 0;
+}
+
+#else
+
+int run_load(int argc, char **argv){
+  printf("The load generator needs Linux\n");
+  return -1;
+}
+
+#endif
@@ -0,0 +1,290 @@
+#include <stdio.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "solver.h"
+
+// Net metrics
+// Per net: routed length of segments and arcs, arcs measured on the circle
+// through their start, mid and end, the same length split by copper layer,
+// vias and the half perimeter of the box round the net's pads. Built in one
+// parallel pass over tracks and pads bucketed by net. After that, tracks
+// added or removed are added or taken off their net's sums, and a moved
+// footprint rebuilds only the pad boxes of its nets.
+
+#define METRICS_CHUNK 64
+
+struct Net_Metrics {
+  int count;
+  struct Net_Metric *nets;
+  struct Layer *layers[NET_METRIC_LAYERS];
+  int layer_count;
+  // Pads bucketed by net ordinal
+  int *pad_start;
+  struct Footprint **pad_footprints;
+  struct Pad **pads;
+};
+
+static int layer_slot(const struct Net_Metrics *metrics, const struct Layer *layer){
+  for(int i = 0; i < metrics->layer_count; i++){
+    if(metrics->layers[i] == layer){
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Adds the track to its net's sums, or with sign -1 takes it off
+static void add_track(struct Net_Metrics *metrics, struct Net_Metric *metric, const struct Track *track, int sign){
+  double length = 0;
+  struct Layer *layer = NULL;
+  switch(track->type){
+    case TRACK_TYPE_SEG:{
+      const struct Segment *segment = &track->track.segment;
+      length = hypot(segment->end.x - segment->start.x, segment->end.y - segment->start.y);
+      layer = segment->layer;
+      metric->segments += sign;
+      break;
+    }
+    case TRACK_TYPE_ARC:{
+      const struct Arc *arc = &track->track.arc;
+      length = arc_length(arc->start, arc->mid, arc->end);
+      layer = arc->layer;
+      metric->arcs += sign;
+      break;
+    }
+    case TRACK_TYPE_VIA:
+      metric->vias += sign;
+      return;
+  }
+  metric->length += sign * length;
+  int slot = layer_slot(metrics, layer);
+  if(slot >= 0){
+    metric->layer_length[slot] += sign * length;
+  }
+  // Taking everything off leaves rounding behind
+  if(metric->segments + metric->arcs == 0){
+    metric->length = 0;
+    memset(metric->layer_length, 0, sizeof(metric->layer_length));
+  }
+}
+
+static void net_hpwl(struct Net_Metrics *metrics, struct Net_Metric *metric, int ordinal){
+  struct Box box = {INFINITY, INFINITY, -INFINITY, -INFINITY};
+  for(int i = metrics->pad_start[ordinal]; i < metrics->pad_start[ordinal + 1]; i++){
+    struct Point at = pad_position(metrics->pad_footprints[i], metrics->pads[i]);
+    box.min_x = fminf(box.min_x, at.x);
+    box.min_y = fminf(box.min_y, at.y);
+    box.max_x = fmaxf(box.max_x, at.x);
+    box.max_y = fmaxf(box.max_y, at.y);
+  }
+  metric->pads = metrics->pad_start[ordinal + 1] - metrics->pad_start[ordinal];
+  metric->hpwl = metric->pads ? (double)(box.max_x - box.min_x) + (box.max_y - box.min_y) : 0;
+}
+
+struct Metrics_Build {
+  struct Board *board;
+  struct Net_Metrics *metrics;
+  int *track_start;
+  struct Track **tracks;
+  int next;
+};
+
+static void *metrics_worker(void *arg){
+  struct Metrics_Build *build = arg;
+  struct Net_Metrics *metrics = build->metrics;
+  pcb = build->board;
+  while(TRUE){
+    int first = __atomic_fetch_add(&build->next, METRICS_CHUNK, __ATOMIC_RELAXED);
+    if(first >= metrics->count){
+      break;
+    }
+    int last = first + METRICS_CHUNK < metrics->count ? first + METRICS_CHUNK : metrics->count;
+    for(int ordinal = first; ordinal < last; ordinal++){
+      struct Net_Metric *metric = &metrics->nets[ordinal];
+      for(int i = build->track_start[ordinal]; i < build->track_start[ordinal + 1]; i++){
+        add_track(metrics, metric, build->tracks[i], 1);
+      }
+      net_hpwl(metrics, metric, ordinal);
+    }
+  }
+  return NULL;
+}
+
+static int compare_layer(const void *_1, const void *_2){
+  return (*(struct Layer *const *)_1)->ordinal - (*(struct Layer *const *)_2)->ordinal;
+}
+
+static int ordinal_of(const struct Net *net, int count){
+  return net && net->ordinal > 0 && net->ordinal < count ? net->ordinal : 0;
+}
+
+// Metrics of every net on pcb, threads <= 0 uses every core
+struct Net_Metrics *net_metrics_build(int threads){
+  struct Net_Metrics *metrics = calloc(1, sizeof(struct Net_Metrics));
+  for(struct Layer *layer = pcb->layers.layer; layer && metrics->layer_count < NET_METRIC_LAYERS; layer = layer->next){
+    if(is_copper(layer)){
+      metrics->layers[metrics->layer_count++] = layer;
+    }
+  }
+  qsort(metrics->layers, metrics->layer_count, sizeof(struct Layer *), compare_layer);
+  int max_ordinal = 0;
+  for(struct Net *net = pcb->nets; net; net = net->next){
+    max_ordinal = net->ordinal > max_ordinal ? net->ordinal : max_ordinal;
+  }
+  metrics->count = max_ordinal + 1;
+  metrics->nets = calloc(metrics->count, sizeof(struct Net_Metric));
+  for(struct Net *net = pcb->nets; net; net = net->next){
+    if(net->ordinal >= 0){
+      metrics->nets[net->ordinal].net = net;
+    }
+  }
+
+  // Bucket tracks and pads by net
+  struct Metrics_Build build = {pcb, metrics, calloc(metrics->count + 1, sizeof(int)), NULL, 0};
+  int track_count = 0, pad_count = 0;
+  metrics->pad_start = calloc(metrics->count + 1, sizeof(int));
+  for(struct Track *track = pcb->tracks; track; track = track->next, track_count++){
+    build.track_start[ordinal_of(track_net(track), metrics->count) + 1]++;
+  }
+  for(struct Footprint *footprint = pcb->footprints; footprint; footprint = footprint->next){
+    for(struct Pad *pad = footprint->pads; pad; pad = pad->next, pad_count++){
+      metrics->pad_start[ordinal_of(pad->net, metrics->count) + 1]++;
+    }
+  }
+  for(int i = 0; i < metrics->count; i++){
+    build.track_start[i + 1] += build.track_start[i];
+    metrics->pad_start[i + 1] += metrics->pad_start[i];
+  }
+  build.tracks = malloc((track_count ? track_count : 1) * sizeof(struct Track *));
+  metrics->pad_footprints = malloc((pad_count ? pad_count : 1) * sizeof(struct Footprint *));
+  metrics->pads = malloc((pad_count ? pad_count : 1) * sizeof(struct Pad *));
+  int *fill = malloc(metrics->count * sizeof(int));
+  memcpy(fill, build.track_start, metrics->count * sizeof(int));
+  for(struct Track *track = pcb->tracks; track; track = track->next){
+    build.tracks[fill[ordinal_of(track_net(track), metrics->count)]++] = track;
+  }
+  memcpy(fill, metrics->pad_start, metrics->count * sizeof(int));
+  for(struct Footprint *footprint = pcb->footprints; footprint; footprint = footprint->next){
+    for(struct Pad *pad = footprint->pads; pad; pad = pad->next){
+      int slot = fill[ordinal_of(pad->net, metrics->count)]++;
+      metrics->pad_footprints[slot] = footprint;
+      metrics->pads[slot] = pad;
+    }
+  }
+  free(fill);
+
+  threads = threads > 0 ? threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+  threads = threads < 1 ? 1 : threads;
+  pthread_t *thread = malloc(threads * sizeof(pthread_t));
+  for(int i = 0; i < threads; i++){
+    pthread_create(&thread[i], NULL, metrics_worker, &build);
+  }
+  for(int i = 0; i < threads; i++){
+    pthread_join(thread[i], NULL);
+  }
+  free(thread);
+  free(build.tracks);
+  free(build.track_start);
+  return metrics;
+}
+
+void net_metrics_free(struct Net_Metrics *metrics){
+  if(metrics == NULL){
+    return;
+  }
+  free(metrics->nets);
+  free(metrics->pad_start);
+  free(metrics->pad_footprints);
+  free(metrics->pads);
+  free(metrics);
+}
+
+// Keeps the sums right for a track just put on the board, sign 1, or about
+// to come off it, sign -1
+void net_metrics_track(struct Net_Metrics *metrics, const struct Track *track, int sign){
+  if(metrics){
+    add_track(metrics, &metrics->nets[ordinal_of(track_net((struct Track *)track), metrics->count)], track, sign);
+  }
+}
+
+// Rebuilds the pad boxes of the nets on a footprint that moved
+void net_metrics_footprint(struct Net_Metrics *metrics, struct Footprint *footprint){
+  if(metrics == NULL){
+    return;
+  }
+  for(struct Pad *pad = footprint->pads; pad; pad = pad->next){
+    int ordinal = ordinal_of(pad->net, metrics->count);
+    net_hpwl(metrics, &metrics->nets[ordinal], ordinal);
+  }
+}
+
+// NULL past the last ordinal
+const struct Net_Metric *net_metric(const struct Net_Metrics *metrics, int ordinal){
+  return ordinal >= 0 && ordinal < metrics->count ? &metrics->nets[ordinal] : NULL;
+}
+
+// Copper layer the slot of layer_length stands for, NULL past the last
+struct Layer *net_metrics_layer(const struct Net_Metrics *metrics, int slot){
+  return slot >= 0 && slot < metrics->layer_count ? metrics->layers[slot] : NULL;
+}
+
+static double sort_value(const struct Net_Metric *metric, int sort){
+  switch(sort){
+    case NET_SORT_LENGTH:
+      return metric->length;
+    case NET_SORT_HPWL:
+      return metric->hpwl;
+    case NET_SORT_VIAS:
+      return metric->vias;
+    case NET_SORT_RATIO:
+      return metric->hpwl > 0 ? metric->length / metric->hpwl : 0;
+  }
+  return 0;
+}
+
+static _Thread_local int report_sort;
+
+static int compare_metric(const void *_1, const void *_2){
+  const struct Net_Metric *metric_1 = *(const struct Net_Metric *const *)_1, *metric_2 = *(const struct Net_Metric *const *)_2;
+  if(report_sort != NET_SORT_NAME){
+    double value_1 = sort_value(metric_1, report_sort), value_2 = sort_value(metric_2, report_sort);
+    if(value_1 != value_2){
+      return value_1 > value_2 ? -1 : 1;
+    }
+  }
+  int name = strcmp(metric_1->net->name.chars, metric_2->net->name.chars);
+  return name ? name : metric_1->net->ordinal - metric_2->net->ordinal;
+}
+
+// One line per net with pads or tracks, NET_SORT_NAME ascending, the other
+// keys largest first. Returns the number of nets written.
+int net_metrics_report(FILE *file, const struct Net_Metrics *metrics, int sort){
+  const struct Net_Metric **rows = malloc((metrics->count ? metrics->count : 1) * sizeof(struct Net_Metric *));
+  int count = 0;
+  for(int ordinal = 1; ordinal < metrics->count; ordinal++){
+    const struct Net_Metric *metric = &metrics->nets[ordinal];
+    if(metric->net && (metric->pads || metric->segments || metric->arcs || metric->vias)){
+      rows[count++] = metric;
+    }
+  }
+  report_sort = sort;
+  qsort(rows, count, sizeof(struct Net_Metric *), compare_metric);
+  fprintf(file, "%-24s %10s %10s %6s %5s %5s %5s %4s", "net", "length", "hpwl", "ratio", "segs", "arcs", "vias", "pads");
+  for(int i = 0; i < metrics->layer_count; i++){
+    fprintf(file, " %9s", metrics->layers[i]->canonical_name.chars);
+  }
+  fprintf(file, "\n");
+  for(int i = 0; i < count; i++){
+    const struct Net_Metric *metric = rows[i];
+    fprintf(file, "%-24s %10.4f %10.4f %6.3f %5u %5u %5u %4u", metric->net->name.chars, metric->length, metric->hpwl, sort_value(metric, NET_SORT_RATIO),
+      metric->segments, metric->arcs, metric->vias, metric->pads);
+    for(int j = 0; j < metrics->layer_count; j++){
+      fprintf(file, " %9.4f", metric->layer_length[j]);
+    }
+    fprintf(file, "\n");
+  }
+  free(rows);
+  return count;
+}
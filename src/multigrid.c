@@ -0,0 +1,422 @@
+#include <stdio.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "solver.h"
+
+// Multigrid
+// Solves a grid system by conjugate gradients preconditioned with one
+// multigrid V-cycle. Each level joins the nodes of two by two blocks of the
+// level above on a layer into one, the matrix summed over the blocks, down
+// to a few hundred nodes solved by Cholesky. Damped Jacobi sweeps smooth
+// before and after the coarse correction, the same number each way so the
+// cycle stays symmetric. Summing the conductances across a block edge makes
+// the coarse grid twice too stiff in the plane, so the links within a
+// layer are halved as if laid out again at twice the pitch; those between
+// layers and into the diagonal grow with the area and stay summed. Every
+// thread owns a band of rows on each level through the whole solve and
+// they meet at barriers.
+
+#define GRID_SMOOTH 2
+#define GRID_OMEGA 0.67
+#define GRID_LATERAL 0.5
+#define GRID_COARSEST 256
+#define GRID_MAX_LEVELS 32
+#define GRID_ITERATIONS 100000
+
+struct Grid_Level {
+  int n, nx, ny;
+  int *row, *column;
+  double *value, *diagonal;
+  int *x_cell, *y_cell, *layer;
+  // Each node's block on the next level, -1 for fixed nodes, and each
+  // block's nodes on the level above
+  int *parent, *child_row, *child;
+  double *b, *x, *r;
+  // Coarsest level only, lower triangle by rows
+  double *factor;
+};
+
+struct Grid_Solver {
+  const struct Grid_System *system;
+  int threads;
+  struct Grid_Level levels[GRID_MAX_LEVELS];
+  int level_count;
+  double tolerance;
+  double *x, *r, *z, *p, *q;
+  // Three partial sums per thread, padded to a cache line
+  double *partial;
+  pthread_barrier_t barrier;
+  int next_id, iterations;
+  double residual;
+};
+
+static double sum_partial(const struct Grid_Solver *solver, int slot){
+  double sum = 0;
+  for(int t = 0; t < solver->threads; t++){
+    sum += solver->partial[t * 8 + slot];
+  }
+  return sum;
+}
+
+static void band(int n, int id, int threads, int *first, int *last){
+  *first = (int)((int64_t)n * id / threads);
+  *last = (int)((int64_t)n * (id + 1) / threads);
+}
+
+static void level_residual(struct Grid_Level *level, int first, int last){
+  for(int i = first; i < last; i++){
+    double sum = level->b[i] - level->diagonal[i] * level->x[i];
+    for(int k = level->row[i]; k < level->row[i + 1]; k++){
+      sum += level->value[k] * level->x[level->column[k]];
+    }
+    level->r[i] = sum;
+  }
+}
+
+// One damped Jacobi sweep, the residual complete before x moves
+static void smooth(struct Grid_Solver *solver, struct Grid_Level *level, int first, int last){
+  pthread_barrier_wait(&solver->barrier);
+  level_residual(level, first, last);
+  pthread_barrier_wait(&solver->barrier);
+  for(int i = first; i < last; i++){
+    level->x[i] += GRID_OMEGA * level->r[i] / level->diagonal[i];
+  }
+}
+
+static void cholesky_solve(struct Grid_Level *level){
+  int n = level->n;
+  const double *factor = level->factor;
+  for(int i = 0; i < n; i++){
+    double sum = level->b[i];
+    for(int k = 0; k < i; k++){
+      sum -= factor[(size_t)i * n + k] * level->x[k];
+    }
+    level->x[i] = sum / factor[(size_t)i * n + i];
+  }
+  for(int i = n - 1; i >= 0; i--){
+    double sum = level->x[i];
+    for(int k = i + 1; k < n; k++){
+      sum -= factor[(size_t)k * n + i] * level->x[k];
+    }
+    level->x[i] = sum / factor[(size_t)i * n + i];
+  }
+}
+
+// x = M b on level l, every thread taking part; ends at a barrier
+static void v_cycle(struct Grid_Solver *solver, int l, int id){
+  struct Grid_Level *level = &solver->levels[l];
+  if(l == solver->level_count - 1){
+    if(id == 0){
+      cholesky_solve(level);
+    }
+    pthread_barrier_wait(&solver->barrier);
+    return;
+  }
+  struct Grid_Level *coarse = &solver->levels[l + 1];
+  int first, last;
+  band(level->n, id, solver->threads, &first, &last);
+  for(int i = first; i < last; i++){
+    level->x[i] = GRID_OMEGA * level->b[i] / level->diagonal[i];
+  }
+  for(int sweep = 1; sweep < GRID_SMOOTH; sweep++){
+    smooth(solver, level, first, last);
+  }
+  pthread_barrier_wait(&solver->barrier);
+  level_residual(level, first, last);
+  pthread_barrier_wait(&solver->barrier);
+  int coarse_first, coarse_last;
+  band(coarse->n, id, solver->threads, &coarse_first, &coarse_last);
+  for(int c = coarse_first; c < coarse_last; c++){
+    double sum = 0;
+    for(int k = coarse->child_row[c]; k < coarse->child_row[c + 1]; k++){
+      sum += level->r[coarse->child[k]];
+    }
+    coarse->b[c] = sum;
+  }
+  pthread_barrier_wait(&solver->barrier);
+  v_cycle(solver, l + 1, id);
+  for(int i = first; i < last; i++){
+    if(level->parent[i] >= 0){
+      level->x[i] += coarse->x[level->parent[i]];
+    }
+  }
+  for(int sweep = 0; sweep < GRID_SMOOTH; sweep++){
+    smooth(solver, level, first, last);
+  }
+  pthread_barrier_wait(&solver->barrier);
+}
+
+static void *pcg_worker(void *arg){
+  struct Grid_Solver *solver = arg;
+  int id = __atomic_fetch_add(&solver->next_id, 1, __ATOMIC_RELAXED);
+  const struct Grid_Level *level = &solver->levels[0];
+  int first, last;
+  band(level->n, id, solver->threads, &first, &last);
+  double *partial = &solver->partial[id * 8];
+  for(int i = first; i < last; i++){
+    solver->x[i] = 0;
+    solver->r[i] = solver->system->fixed && solver->system->fixed[i] ? 0 : solver->system->b[i];
+  }
+  v_cycle(solver, 0, id);
+  double rz = 0, bb = 0;
+  for(int i = first; i < last; i++){
+    solver->p[i] = solver->z[i];
+    rz += solver->r[i] * solver->z[i];
+    bb += solver->r[i] * solver->r[i];
+  }
+  partial[1] = rz;
+  partial[2] = bb;
+  pthread_barrier_wait(&solver->barrier);
+  rz = sum_partial(solver, 1);
+  bb = sum_partial(solver, 2);
+  int iteration = 0;
+  double rr = bb;
+  for(; iteration < GRID_ITERATIONS && rr > solver->tolerance * solver->tolerance * bb && bb > 0; iteration++){
+    // q = A p, fixed rows have no off diagonals and p is 0 there
+    double pq = 0;
+    for(int i = first; i < last; i++){
+      double sum = level->diagonal[i] * solver->p[i];
+      for(int k = level->row[i]; k < level->row[i + 1]; k++){
+        sum -= level->value[k] * solver->p[level->column[k]];
+      }
+      solver->q[i] = sum;
+      pq += solver->p[i] * sum;
+    }
+    partial[0] = pq;
+    pthread_barrier_wait(&solver->barrier);
+    double alpha = rz / sum_partial(solver, 0);
+    for(int i = first; i < last; i++){
+      solver->x[i] += alpha * solver->p[i];
+      solver->r[i] -= alpha * solver->q[i];
+    }
+    v_cycle(solver, 0, id);
+    double rz_next = 0;
+    rr = 0;
+    for(int i = first; i < last; i++){
+      rz_next += solver->r[i] * solver->z[i];
+      rr += solver->r[i] * solver->r[i];
+    }
+    partial[1] = rz_next;
+    partial[2] = rr;
+    pthread_barrier_wait(&solver->barrier);
+    rz_next = sum_partial(solver, 1);
+    rr = sum_partial(solver, 2);
+    double beta = rz_next / rz;
+    rz = rz_next;
+    for(int i = first; i < last; i++){
+      solver->p[i] = solver->z[i] + beta * solver->p[i];
+    }
+    pthread_barrier_wait(&solver->barrier);
+  }
+  if(id == 0){
+    solver->iterations = iteration;
+    solver->residual = bb > 0 ? sqrt(rr / bb) : 0;
+  }
+  return NULL;
+}
+
+// Joins the free nodes of fine in two by two blocks into coarse, whose
+// matrix is the fine one summed over the blocks
+static void coarsen(struct Grid_Level *fine, struct Grid_Level *coarse, const uint8_t *fixed, int layers){
+  coarse->nx = (fine->nx + 1) / 2;
+  coarse->ny = (fine->ny + 1) / 2;
+  size_t cells = (size_t)layers * coarse->nx * coarse->ny;
+  int *block = malloc(cells * sizeof(int));
+  memset(block, 0xff, cells * sizeof(int));
+  fine->parent = malloc((fine->n ? fine->n : 1) * sizeof(int));
+  coarse->x_cell = malloc((fine->n ? fine->n : 1) * sizeof(int));
+  coarse->y_cell = malloc((fine->n ? fine->n : 1) * sizeof(int));
+  coarse->layer = malloc((fine->n ? fine->n : 1) * sizeof(int));
+  int n = 0;
+  for(int i = 0; i < fine->n; i++){
+    fine->parent[i] = -1;
+    if(fixed && fixed[i]){
+      continue;
+    }
+    size_t key = ((size_t)fine->layer[i] * coarse->ny + fine->y_cell[i] / 2) * coarse->nx + fine->x_cell[i] / 2;
+    if(block[key] < 0){
+      coarse->x_cell[n] = fine->x_cell[i] / 2;
+      coarse->y_cell[n] = fine->y_cell[i] / 2;
+      coarse->layer[n] = fine->layer[i];
+      block[key] = n++;
+    }
+    fine->parent[i] = block[key];
+  }
+  free(block);
+  coarse->n = n;
+
+  coarse->child_row = calloc(n + 1, sizeof(int));
+  coarse->child = malloc((fine->n ? fine->n : 1) * sizeof(int));
+  for(int i = 0; i < fine->n; i++){
+    if(fine->parent[i] >= 0){
+      coarse->child_row[fine->parent[i] + 1]++;
+    }
+  }
+  for(int c = 0; c < n; c++){
+    coarse->child_row[c + 1] += coarse->child_row[c];
+  }
+  int *fill = malloc((n ? n : 1) * sizeof(int));
+  memcpy(fill, coarse->child_row, n * sizeof(int));
+  for(int i = 0; i < fine->n; i++){
+    if(fine->parent[i] >= 0){
+      coarse->child[fill[fine->parent[i]]++] = i;
+    }
+  }
+
+  // Entries between blocks add up, those inside a block come off its diagonal
+  int capacity = fine->row[fine->n] ? fine->row[fine->n] : 1;
+  coarse->row = malloc((n + 1) * sizeof(int));
+  coarse->column = malloc(capacity * sizeof(int));
+  coarse->value = malloc(capacity * sizeof(double));
+  coarse->diagonal = malloc((n ? n : 1) * sizeof(double));
+  int *position = fill;
+  memset(position, 0xff, (n ? n : 1) * sizeof(int));
+  int count = 0;
+  for(int c = 0; c < n; c++){
+    coarse->row[c] = count;
+    double diagonal = 0;
+    for(int k = coarse->child_row[c]; k < coarse->child_row[c + 1]; k++){
+      int i = coarse->child[k];
+      diagonal += fine->diagonal[i];
+      for(int e = fine->row[i]; e < fine->row[i + 1]; e++){
+        int to = fine->parent[fine->column[e]];
+        double value = fine->value[e];
+        if(to == c){
+          diagonal -= value;
+          continue;
+        }
+        if(coarse->layer[to] == coarse->layer[c]){
+          value *= GRID_LATERAL;
+          diagonal -= fine->value[e] - value;
+        }
+        if(position[to] < coarse->row[c]){
+          position[to] = count;
+          coarse->column[count] = to;
+          coarse->value[count++] = value;
+        }else{
+          coarse->value[position[to]] += value;
+        }
+      }
+    }
+    coarse->diagonal[c] = diagonal > 0 ? diagonal : 1;
+  }
+  coarse->row[n] = count;
+  free(fill);
+  coarse->column = realloc(coarse->column, (count ? count : 1) * sizeof(int));
+  coarse->value = realloc(coarse->value, (count ? count : 1) * sizeof(double));
+}
+
+static void factor_coarsest(struct Grid_Level *level){
+  int n = level->n;
+  double *factor = calloc(n > 0 ? (size_t)n * n : 1, sizeof(double));
+  for(int i = 0; i < n; i++){
+    factor[(size_t)i * n + i] = level->diagonal[i];
+    for(int k = level->row[i]; k < level->row[i + 1]; k++){
+      factor[(size_t)i * n + level->column[k]] = -level->value[k];
+    }
+  }
+  for(int j = 0; j < n; j++){
+    double pivot = factor[(size_t)j * n + j];
+    for(int k = 0; k < j; k++){
+      pivot -= factor[(size_t)j * n + k] * factor[(size_t)j * n + k];
+    }
+    pivot = pivot > 0 ? sqrt(pivot) : 1;
+    factor[(size_t)j * n + j] = pivot;
+    for(int i = j + 1; i < n; i++){
+      double sum = factor[(size_t)i * n + j];
+      for(int k = 0; k < j; k++){
+        sum -= factor[(size_t)i * n + k] * factor[(size_t)j * n + k];
+      }
+      factor[(size_t)i * n + j] = sum / pivot;
+    }
+  }
+  level->factor = factor;
+}
+
+// Levels down to the coarsest and the vectors each cycle works in
+static void build_levels(struct Grid_Solver *solver){
+  const struct Grid_System *system = solver->system;
+  struct Grid_Level *level = &solver->levels[0];
+  *level = (struct Grid_Level){system->n, system->nx, system->ny, system->row, system->column, system->value, system->diagonal,
+    system->x_cell, system->y_cell, system->layer};
+  solver->level_count = 1;
+  while(solver->levels[solver->level_count - 1].n > GRID_COARSEST && solver->level_count < GRID_MAX_LEVELS){
+    struct Grid_Level *fine = &solver->levels[solver->level_count - 1];
+    coarsen(fine, fine + 1, solver->level_count == 1 ? system->fixed : NULL, system->layers);
+    solver->level_count++;
+  }
+  factor_coarsest(&solver->levels[solver->level_count - 1]);
+  for(int l = 0; l < solver->level_count; l++){
+    level = &solver->levels[l];
+    int n = level->n ? level->n : 1;
+    level->b = l ? malloc(n * sizeof(double)) : solver->r;
+    level->x = l ? malloc(n * sizeof(double)) : solver->z;
+    level->r = malloc(n * sizeof(double));
+  }
+}
+
+// The system's own arrays are level 0 and stay with the caller
+static void levels_free(struct Grid_Solver *solver){
+  for(int l = 0; l < solver->level_count; l++){
+    struct Grid_Level *level = &solver->levels[l];
+    if(l){
+      free(level->row);
+      free(level->column);
+      free(level->value);
+      free(level->diagonal);
+      free(level->x_cell);
+      free(level->y_cell);
+      free(level->layer);
+      free(level->b);
+      free(level->x);
+    }
+    free(level->parent);
+    free(level->child_row);
+    free(level->child);
+    free(level->r);
+    free(level->factor);
+  }
+}
+
+// Solves the system into x to a residual of tolerance relative to b.
+// Fixed rows come out 0. threads <= 0 uses every core. Returns the
+// iterations taken and the final relative residual in residual.
+int grid_solve(const struct Grid_System *system, double *x, double tolerance, int threads, double *residual){
+  threads = threads > 0 ? threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+  threads = threads < 1 ? 1 : threads;
+  int n = system->n ? system->n : 1;
+  struct Grid_Solver solver;
+  memset(&solver, 0, sizeof(solver));
+  solver.system = system;
+  solver.threads = threads;
+  solver.tolerance = tolerance;
+  solver.x = x;
+  solver.r = malloc(n * sizeof(double));
+  solver.z = malloc(n * sizeof(double));
+  solver.p = malloc(n * sizeof(double));
+  solver.q = malloc(n * sizeof(double));
+  solver.partial = calloc(threads * 8, sizeof(double));
+  build_levels(&solver);
+  pthread_barrier_init(&solver.barrier, NULL, threads);
+  pthread_t *thread = malloc(threads * sizeof(pthread_t));
+  for(int i = 0; i < threads; i++){
+    pthread_create(&thread[i], NULL, pcg_worker, &solver);
+  }
+  for(int i = 0; i < threads; i++){
+    pthread_join(thread[i], NULL);
+  }
+  free(thread);
+  pthread_barrier_destroy(&solver.barrier);
+  levels_free(&solver);
+  free(solver.r);
+  free(solver.z);
+  free(solver.p);
+  free(solver.q);
+  free(solver.partial);
+  if(residual){
+    *residual = solver.residual;
+  }
+  return solver.iterations;
+}
@@ -0,0 +1,421 @@
+#include <stdio.h>
+#include <math.h>
+
+#include "solver.h"
+
+// Board outline
+// Edge.Cuts drawings of the board and of its footprints, placed, become
+// pieces, polylines with arcs and circles cut into chords that stray at most
+// max_error from them, arcs in the outline of a poly too. Circles, rects
+// and polys are closed on their own.
+// The ends of the open pieces go into a hash on a grid of OUTLINE_SNAP
+// cells, each chain grows by the unused piece with an end within
+// OUTLINE_SNAP of its own until it comes back to its start. Chains that
+// never close are counted and left out.
+//
+// Rings inside an odd number of others are cutouts. Point queries count
+// the rings round a point, the board is where that count is odd.
+
+#define OUTLINE_SNAP 1e-3f
+#define OUTLINE_MAX_ERROR 0.005f
+#define OUTLINE_ARC_MAX 1024
+
+struct Outline_Piece {
+  struct Point *points;
+  int count, closed, used;
+};
+
+struct Piece_List {
+  struct Outline_Piece *pieces;
+  int count, capacity;
+};
+
+// Piece ends by cell, head per bucket and next per end, end is
+// 2 * piece + 1 for the last point
+struct End_Hash {
+  int *head, *next;
+  uint32_t mask;
+};
+
+static void add_piece(struct Piece_List *list, const struct Point *points, int count, int closed){
+  if(count < 2){
+    return;
+  }
+  if(list->count == list->capacity){
+    list->capacity = list->capacity ? list->capacity * 2 : 64;
+    list->pieces = realloc(list->pieces, list->capacity * sizeof(struct Outline_Piece));
+  }
+  struct Outline_Piece *piece = &list->pieces[list->count++];
+  piece->points = malloc(count * sizeof(struct Point));
+  memcpy(piece->points, points, count * sizeof(struct Point));
+  piece->count = count;
+  piece->closed = closed;
+  piece->used = FALSE;
+}
+
+static int on_layer(const struct Layer *layer, const char *name){
+  return layer && layer->canonical_name.chars && strcmp(layer->canonical_name.chars, name) == 0;
+}
+
+static int is_edge(const struct Layer *layer){
+  return on_layer(layer, "Edge.Cuts");
+}
+
+// Chords round a circle no further than max_error from it
+static int circle_points(struct Point center, float radius, float max_error, struct Point *out, int max){
+  double step = max_error < radius ? 2 * acos(1 - max_error / radius) : M_PI / 2;
+  int count = (int)ceil(2 * M_PI / step);
+  count = count < 8 ? 8 : (count > max ? max : count);
+  for(int i = 0; i < count; i++){
+    double angle = 2 * M_PI * i / count;
+    out[i] = (struct Point){(float)(center.x + radius * cos(angle)), (float)(center.y + radius * sin(angle))};
+  }
+  return count;
+}
+
+// Pieces of the footprint's lines, rects, circles, arcs and polys on the
+// layer named name, placed on the board when placed is set
+static void footprint_pieces(struct Piece_List *list, struct Footprint *footprint, const char *name, float max_error, int placed){
+  struct Point points[OUTLINE_ARC_MAX];
+  int first = list->count;
+  for(struct Line *line = footprint->fp_lines; line; line = line->next){
+    if(on_layer(line->layer, name)){
+      points[0] = line->start;
+      points[1] = line->end;
+      add_piece(list, points, 2, FALSE);
+    }
+  }
+  for(struct Footprint_Arc *arc = footprint->fp_arcs; arc; arc = arc->next){
+    if(on_layer(arc->layer, name)){
+      add_piece(list, points, arc_points(arc->start, arc->mid, arc->end, max_error, points, OUTLINE_ARC_MAX), FALSE);
+    }
+  }
+  for(struct Circle *circle = footprint->fp_circles; circle; circle = circle->next){
+    float radius = hypotf(circle->end.x - circle->center.x, circle->end.y - circle->center.y);
+    if(on_layer(circle->layer, name) && radius > 0){
+      add_piece(list, points, circle_points(circle->center, radius, max_error, points, OUTLINE_ARC_MAX), TRUE);
+    }
+  }
+  for(struct Rect *rect = footprint->fp_rects; rect; rect = rect->next){
+    if(on_layer(rect->layer, name)){
+      points[0] = rect->start;
+      points[1] = (struct Point){rect->end.x, rect->start.y};
+      points[2] = rect->end;
+      points[3] = (struct Point){rect->start.x, rect->end.y};
+      add_piece(list, points, 4, TRUE);
+    }
+  }
+  for(struct Polygon *polygon = footprint->fp_poly; polygon; polygon = polygon->next){
+    if(on_layer(polygon->layer, name)){
+      add_piece(list, polygon->points, polygon->point_index, TRUE);
+    }
+  }
+  for(int p = first; placed && p < list->count; p++){
+    struct Outline_Piece *piece = &list->pieces[p];
+    for(int i = 0; i < piece->count; i++){
+      piece->points[i] = rotate_point(piece->points[i], footprint->at.angle);
+      piece->points[i].x += footprint->at.x;
+      piece->points[i].y += footprint->at.y;
+    }
+  }
+}
+
+static void collect_pieces(struct Piece_List *list, float max_error){
+  struct Point points[OUTLINE_ARC_MAX];
+  for(struct Drawing *drawing = pcb->graphics.drawings; drawing; drawing = drawing->next){
+    if(!is_edge(drawing->layer)){
+      continue;
+    }
+    switch(drawing->type){
+      case DRAWING_LINE:
+        points[0] = drawing->start;
+        points[1] = drawing->end;
+        add_piece(list, points, 2, FALSE);
+        break;
+      case DRAWING_ARC:
+        add_piece(list, points, arc_points(drawing->start, drawing->mid, drawing->end, max_error, points, OUTLINE_ARC_MAX), FALSE);
+        break;
+      case DRAWING_CIRCLE: {
+        float radius = hypotf(drawing->end.x - drawing->start.x, drawing->end.y - drawing->start.y);
+        add_piece(list, points, radius > 0 ? circle_points(drawing->start, radius, max_error, points, OUTLINE_ARC_MAX) : 0, TRUE);
+        break;
+      }
+      case DRAWING_RECT:
+        points[0] = drawing->start;
+        points[1] = (struct Point){drawing->end.x, drawing->start.y};
+        points[2] = drawing->end;
+        points[3] = (struct Point){drawing->start.x, drawing->end.y};
+        add_piece(list, points, 4, TRUE);
+        break;
+      case DRAWING_POLY:
+        add_piece(list, drawing->points, drawing->point_index, TRUE);
+        break;
+    }
+  }
+  for(struct Footprint *footprint = pcb->footprints; footprint; footprint = footprint->next){
+    footprint_pieces(list, footprint, "Edge.Cuts", max_error, TRUE);
+  }
+}
+
+static uint32_t cell_hash(int64_t x, int64_t y, uint32_t mask){
+  uint64_t hash = (uint64_t)x * 0x9E3779B97F4A7C15ull ^ (uint64_t)y * 0xC2B2AE3D27D4EB4Full;
+  return (uint32_t)(hash >> 32) & mask;
+}
+
+static struct Point piece_end(const struct Piece_List *list, int end){
+  const struct Outline_Piece *piece = &list->pieces[end / 2];
+  return piece->points[end % 2 ? piece->count - 1 : 0];
+}
+
+static void hash_ends(struct End_Hash *hash, const struct Piece_List *list){
+  uint32_t capacity = 16;
+  while(capacity < 4 * (uint32_t)list->count){
+    capacity *= 2;
+  }
+  hash->mask = capacity - 1;
+  hash->head = malloc(capacity * sizeof(int));
+  hash->next = malloc((2 * list->count + 1) * sizeof(int));
+  memset(hash->head, 0xff, capacity * sizeof(int));
+  for(int end = 0; end < 2 * list->count; end++){
+    if(list->pieces[end / 2].closed){
+      continue;
+    }
+    struct Point point = piece_end(list, end);
+    uint32_t bucket = cell_hash(llroundf(point.x / OUTLINE_SNAP), llroundf(point.y / OUTLINE_SNAP), hash->mask);
+    hash->next[end] = hash->head[bucket];
+    hash->head[bucket] = end;
+  }
+}
+
+// An end of an unused piece within OUTLINE_SNAP of point, -1 when none
+static int find_end(const struct End_Hash *hash, const struct Piece_List *list, struct Point point){
+  int64_t x = llroundf(point.x / OUTLINE_SNAP), y = llroundf(point.y / OUTLINE_SNAP);
+  for(int64_t dy = -1; dy <= 1; dy++){
+    for(int64_t dx = -1; dx <= 1; dx++){
+      for(int end = hash->head[cell_hash(x + dx, y + dy, hash->mask)]; end >= 0; end = hash->next[end]){
+        struct Point other = piece_end(list, end);
+        if(!list->pieces[end / 2].used && fabsf(other.x - point.x) <= OUTLINE_SNAP && fabsf(other.y - point.y) <= OUTLINE_SNAP){
+          return end;
+        }
+      }
+    }
+  }
+  return -1;
+}
+
+static void free_pieces(struct Piece_List *list){
+  for(int p = 0; p < list->count; p++){
+    free(list->pieces[p].points);
+  }
+  free(list->pieces);
+}
+
+// Grows a chain from every unused piece and hands each to done, closed
+// ones without their repeated end
+static void chain_pieces(struct Piece_List *list, void (*done)(void *arg, struct Point *points, int count, int closed), void *arg){
+  struct End_Hash hash;
+  hash_ends(&hash, list);
+  int capacity = 256;
+  struct Point *chain = malloc(capacity * sizeof(struct Point));
+  for(int p = 0; p < list->count; p++){
+    struct Outline_Piece *piece = &list->pieces[p];
+    if(piece->used){
+      continue;
+    }
+    piece->used = TRUE;
+    if(piece->closed){
+      done(arg, piece->points, piece->count, TRUE);
+      continue;
+    }
+    int count = 0, closed = FALSE, flipped = FALSE;
+    for(int end = 2 * p, reversed = FALSE; end >= 0;){
+      const struct Outline_Piece *next = &list->pieces[end / 2];
+      if(count + next->count > capacity){
+        while(count + next->count > capacity){
+          capacity *= 2;
+        }
+        chain = realloc(chain, capacity * sizeof(struct Point));
+      }
+      // The first point is the last of the chain so far
+      for(int i = count ? 1 : 0; i < next->count; i++){
+        chain[count++] = next->points[reversed ? next->count - 1 - i : i];
+      }
+      struct Point last = chain[count - 1];
+      if(count > 2 && fabsf(last.x - chain[0].x) <= OUTLINE_SNAP && fabsf(last.y - chain[0].y) <= OUTLINE_SNAP){
+        closed = TRUE;
+        break;
+      }
+      end = find_end(&hash, list, last);
+      if(end < 0 && !flipped){
+        // Grow the other way from the first piece
+        flipped = TRUE;
+        for(int i = 0; i < count / 2; i++){
+          struct Point swap = chain[i];
+          chain[i] = chain[count - 1 - i];
+          chain[count - 1 - i] = swap;
+        }
+        end = find_end(&hash, list, chain[count - 1]);
+      }
+      if(end >= 0){
+        list->pieces[end / 2].used = TRUE;
+        reversed = end % 2;
+      }
+    }
+    done(arg, chain, closed ? count - 1 : count, closed);
+  }
+  free(chain);
+  free(hash.head);
+  free(hash.next);
+}
+
+// Chains that never close are counted and left out
+static void outline_chain(void *arg, struct Point *points, int count, int closed){
+  struct Board_Outline *outline = arg;
+  if(!closed){
+    outline->open_chains++;
+    return;
+  }
+  struct Polygon polygon = {0};
+  polygon.points = points;
+  polygon.point_count = count;
+  struct Ring *ring = ring_create(&polygon);
+  if(ring){
+    ring->next = outline->rings;
+    outline->rings = ring;
+    outline->ring_count++;
+  }
+}
+
+static double ring_area(const struct Ring *ring){
+  double area = 0;
+  for(int i = 0; i < ring->count; i++){
+    area += (double)ring->x[i] * ring->y[i + 1] - (double)ring->x[i + 1] * ring->y[i];
+  }
+  return fabs(area) / 2;
+}
+
+// Chains the Edge.Cuts drawings and footprint lines into rings, arcs and
+// circles within max_error mm, 0.005 by default. The outline replaces any
+// built before. Returns ERROR when nothing closes.
+int board_outline_init(float max_error){
+  board_outline_free(pcb->outline);
+  struct Board_Outline *outline = calloc(1, sizeof(struct Board_Outline));
+  pcb->outline = outline;
+  outline->max_error = max_error > 0 ? max_error : OUTLINE_MAX_ERROR;
+  outline->box = (struct Box){INFINITY, INFINITY, -INFINITY, -INFINITY};
+  struct Piece_List list = {0};
+  collect_pieces(&list, outline->max_error);
+  chain_pieces(&list, outline_chain, outline);
+  free_pieces(&list);
+
+  // Nesting by the first point of each ring
+  for(struct Ring *ring = outline->rings; ring; ring = ring->next){
+    int depth = 0;
+    for(struct Ring *other = outline->rings; other; other = other->next){
+      depth += other != ring && ring_contains_point(other, (struct Point){ring->x[0], ring->y[0]});
+    }
+    double area = ring_area(ring);
+    if(depth % 2){
+      outline->cutouts++;
+      outline->area -= area;
+    }else{
+      outline->area += area;
+      outline->box.min_x = fminf(outline->box.min_x, ring->box.min_x);
+      outline->box.min_y = fminf(outline->box.min_y, ring->box.min_y);
+      outline->box.max_x = fmaxf(outline->box.max_x, ring->box.max_x);
+      outline->box.max_y = fmaxf(outline->box.max_y, ring->box.max_y);
+    }
+  }
+  return outline->rings ? SUCCESS : ERROR;
+}
+
+void board_outline_free(struct Board_Outline *outline){
+  if(outline){
+    ring_free(outline->rings);
+    free(outline);
+  }
+}
+
+struct Chain_List {
+  struct Point *points;
+  int *sizes;
+  int count, capacity, point_count, point_capacity;
+};
+
+static void keep_chain(void *arg, struct Point *points, int count, int closed){
+  struct Chain_List *chains = arg;
+  if(chains->count == chains->capacity){
+    chains->capacity = chains->capacity ? chains->capacity * 2 : 4;
+    chains->sizes = realloc(chains->sizes, chains->capacity * sizeof(int));
+  }
+  if(chains->point_count + count > chains->point_capacity){
+    while(chains->point_count + count > chains->point_capacity){
+      chains->point_capacity = chains->point_capacity ? chains->point_capacity * 2 : 64;
+    }
+    chains->points = realloc(chains->points, chains->point_capacity * sizeof(struct Point));
+  }
+  memcpy(chains->points + chains->point_count, points, count * sizeof(struct Point));
+  chains->point_count += count;
+  chains->sizes[chains->count++] = closed ? count : -count;
+}
+
+// Chains of the footprint's drawings on the layer named name as placed on
+// the board, arcs and circles within max_error mm, 0.005 by default.
+// points gets every chain's points one after another and sizes the count
+// of each, negated when the chain does not close, both malloc'd. Returns
+// the number of chains.
+int footprint_chains(struct Footprint *footprint, const char *name, float max_error, struct Point **points, int **sizes){
+  struct Piece_List list = {0};
+  struct Chain_List chains = {0};
+  footprint_pieces(&list, footprint, name, max_error > 0 ? max_error : OUTLINE_MAX_ERROR, TRUE);
+  if(list.count){
+    chain_pieces(&list, keep_chain, &chains);
+  }
+  free_pieces(&list);
+  *points = chains.points;
+  *sizes = chains.sizes;
+  return chains.count;
+}
+
+// Inside the board and not in a cutout, everywhere when the board has no
+// outline
+int board_contains_point(const struct Board_Outline *outline, struct Point point){
+  if(outline == NULL || outline->rings == NULL){
+    return TRUE;
+  }
+  if(point.x < outline->box.min_x || point.x > outline->box.max_x || point.y < outline->box.min_y || point.y > outline->box.max_y){
+    return FALSE;
+  }
+  int inside = FALSE;
+  for(const struct Ring *ring = outline->rings; ring; ring = ring->next){
+    inside ^= ring_contains_point(ring, point);
+  }
+  return inside;
+}
+
+// The batch form, inside has count entries
+void board_contains_points(const struct Board_Outline *outline, const struct Point *points, int count, uint8_t *inside){
+  if(outline == NULL || outline->rings == NULL){
+    memset(inside, TRUE, count);
+    return;
+  }
+  memset(inside, FALSE, count);
+  uint8_t *ring_inside = malloc(count ? count : 1);
+  for(const struct Ring *ring = outline->rings; ring; ring = ring->next){
+    ring_contains_points(ring, points, count, ring_inside);
+    for(int i = 0; i < count; i++){
+      inside[i] ^= ring_inside[i];
+    }
+  }
+  free(ring_inside);
+}
+
+// Distance from a segment to the nearest edge of the board, 0 when it
+// crosses one, INFINITY without an outline
+float board_edge_distance(const struct Board_Outline *outline, struct Point start, struct Point end){
+  float distance = INFINITY;
+  for(const struct Ring *ring = outline ? outline->rings : NULL; ring && distance > 0; ring = ring->next){
+    distance = fminf(distance, ring_segment_distance(ring, start, end));
+  }
+  return distance;
+}
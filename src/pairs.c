@@ -0,0 +1,406 @@
+#include <stdio.h>
+#include <math.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "solver.h"
+
+// Differential pairs and length groups
+// Pairs are found by name: two nets that differ only in a suffix pair,
+// _P/_N and +/- unless the pattern file adds more. For each pair the
+// routed lengths give the skew. Each side's tracks are then walked in
+// steps. At every step the spatial index finds the other side's tracks on
+// the same layer, and the edge to edge gap to the nearest is recorded. A
+// step with nothing within max_gap counts as uncoupled. Pairs are checked
+// in parallel.
+//
+// The pattern file is read a line at a time, # starts a comment:
+//   pair <positive suffix> <negative suffix>
+//   group <name> <target mm> <tolerance mm> <net glob>...
+// A group's nets must each be within tolerance of target, a target of 0
+// matches them to the longest.
+
+#define PAIRS_MAX_SUFFIXES 16
+#define PAIRS_SUFFIX 16
+#define PAIRS_MAX_GAP 1.0f
+#define PAIRS_STEP 0.1f
+#define PAIRS_ARC_ERROR 0.005f
+#define PAIRS_ARC_POINTS 128
+#define PAIRS_LINE 1024
+
+struct Pair_Suffix {
+  char positive[PAIRS_SUFFIX], negative[PAIRS_SUFFIX];
+};
+
+struct Length_Group {
+  char name[64];
+  float target, tolerance;
+  char **globs;
+  int glob_count;
+  struct Length_Group *next;
+};
+
+struct Pair {
+  struct Net *positive, *negative;
+  double length_positive, length_negative;
+  double uncoupled, gap_min, gap_max, gap_sum, gap_sum2;
+  uint64_t samples;
+};
+
+struct Pair_Check {
+  struct Board *board;
+  struct Pair_Options options;
+  struct Pair *pairs;
+  int pair_count, next;
+  // Tracks bucketed by net ordinal
+  int *track_start;
+  struct Track **tracks;
+};
+
+// Patterns
+
+static void add_suffix(struct Pair_Suffix *suffixes, int *count, const char *positive, const char *negative){
+  if(*count < PAIRS_MAX_SUFFIXES){
+    snprintf(suffixes[*count].positive, PAIRS_SUFFIX, "%.*s", PAIRS_SUFFIX - 1, positive);
+    snprintf(suffixes[*count].negative, PAIRS_SUFFIX, "%.*s", PAIRS_SUFFIX - 1, negative);
+    (*count)++;
+  }
+}
+
+static void free_groups(struct Length_Group *groups){
+  while(groups){
+    struct Length_Group *group = groups;
+    groups = group->next;
+    for(int i = 0; i < group->glob_count; i++){
+      free(group->globs[i]);
+    }
+    free(group->globs);
+    free(group);
+  }
+}
+
+static int read_patterns(const char *path, struct Pair_Suffix *suffixes, int *suffix_count, struct Length_Group **groups){
+  FILE *file = fopen(path, "r");
+  if(file == NULL){
+    perror(path);
+    return ERROR;
+  }
+  char line[PAIRS_LINE];
+  int number = 0, status = SUCCESS;
+  struct Length_Group **tail = groups;
+  while(fgets(line, sizeof(line), file)){
+    number++;
+    char *comment = strchr(line, '#');
+    if(comment){
+      *comment = '\0';
+    }
+    char keyword[16], first[64], second[64];
+    float target, tolerance;
+    int used = 0;
+    if(sscanf(line, "%15s", keyword) != 1){
+      continue;
+    }
+    if(strcmp(keyword, "pair") == 0 && sscanf(line, "%*s %15s %15s", first, second) == 2){
+      add_suffix(suffixes, suffix_count, first, second);
+    }else if(strcmp(keyword, "group") == 0 && sscanf(line, "%*s %63s %f %f %n", first, &target, &tolerance, &used) == 3 && used > 0){
+      struct Length_Group *group = calloc(1, sizeof(struct Length_Group));
+      snprintf(group->name, sizeof(group->name), "%s", first);
+      group->target = target;
+      group->tolerance = tolerance;
+      for(char *glob = line + used; sscanf(glob, "%63s%n", second, &used) == 1; glob += used){
+        group->globs = realloc(group->globs, (group->glob_count + 1) * sizeof(char *));
+        group->globs[group->glob_count] = malloc(strlen(second) + 1);
+        strcpy(group->globs[group->glob_count++], second);
+      }
+      *tail = group;
+      tail = &group->next;
+    }else{
+      printf("%s:%d: expected pair or group\n", path, number);
+      status = ERROR;
+    }
+  }
+  fclose(file);
+  return status;
+}
+
+// Pairing
+
+static int compare_name(const void *_1, const void *_2){
+  return strcmp((*(struct Net *const *)_1)->name.chars, (*(struct Net *const *)_2)->name.chars);
+}
+
+static struct Net *find_name(struct Net **nets, int count, const char *name){
+  struct Net key = {.name = {(char *)name, strlen(name) + 1}}, *key_pointer = &key;
+  struct Net **found = bsearch(&key_pointer, nets, count, sizeof(struct Net *), compare_name);
+  return found ? *found : NULL;
+}
+
+static int ends_with(const char *name, size_t length, const char *suffix){
+  size_t suffix_length = strlen(suffix);
+  return suffix_length > 0 && length > suffix_length && strcmp(name + length - suffix_length, suffix) == 0;
+}
+
+static int find_pairs(struct Pair_Check *check, struct Net **nets, int count, const struct Pair_Suffix *suffixes, int suffix_count){
+  char name[PAIRS_LINE];
+  for(int i = 0; i < count; i++){
+    const char *positive = nets[i]->name.chars;
+    size_t length = strlen(positive);
+    for(int j = 0; j < suffix_count; j++){
+      size_t suffix_length = strlen(suffixes[j].positive);
+      if(!ends_with(positive, length, suffixes[j].positive) || length - suffix_length + strlen(suffixes[j].negative) >= sizeof(name)){
+        continue;
+      }
+      snprintf(name, sizeof(name), "%.*s%s", (int)(length - suffix_length), positive, suffixes[j].negative);
+      struct Net *negative = find_name(nets, count, name);
+      if(negative && negative != nets[i]){
+        check->pairs = realloc(check->pairs, (check->pair_count + 1) * sizeof(struct Pair));
+        check->pairs[check->pair_count++] = (struct Pair){.positive = nets[i], .negative = negative};
+        break;
+      }
+    }
+  }
+  return check->pair_count;
+}
+
+// Gaps
+
+struct Gap_Query {
+  struct Net *net;
+  struct Layer *layer;
+  struct Point point;
+  float half_width, best;
+};
+
+static float segment_distance(struct Point point, struct Point start, struct Point end){
+  float dx = end.x - start.x, dy = end.y - start.y, length2 = dx * dx + dy * dy;
+  float t = length2 > 0 ? ((point.x - start.x) * dx + (point.y - start.y) * dy) / length2 : 0;
+  t = t < 0 ? 0 : (t > 1 ? 1 : t);
+  return hypotf(point.x - start.x - t * dx, point.y - start.y - t * dy);
+}
+
+static int nearest_track(struct Item *item, void *context){
+  struct Gap_Query *query = context;
+  struct Track *track = item->track;
+  if(item->kind != ITEM_TRACK || item->net != query->net || track->type == TRACK_TYPE_VIA || track_layer(track) != query->layer){
+    return TRUE;
+  }
+  float distance = INFINITY, width = 0;
+  if(track->type == TRACK_TYPE_SEG){
+    distance = segment_distance(query->point, track->track.segment.start, track->track.segment.end);
+    width = track->track.segment.width;
+  }else{
+    struct Arc *arc = &track->track.arc;
+    struct Point points[PAIRS_ARC_POINTS];
+    int count = arc_points(arc->start, arc->mid, arc->end, PAIRS_ARC_ERROR, points, PAIRS_ARC_POINTS);
+    for(int i = 0; i + 1 < count; i++){
+      distance = fminf(distance, segment_distance(query->point, points[i], points[i + 1]));
+    }
+    width = arc->width;
+  }
+  query->best = fminf(query->best, distance - width / 2 - query->half_width);
+  return TRUE;
+}
+
+// Walks one side's tracks, gathering the gap to the other side
+static void walk_side(struct Pair_Check *check, struct Pair *pair, struct Net *side, struct Net *other, int gaps, double *uncoupled){
+  float max_gap = check->options.max_gap, step = check->options.step;
+  // The other side's widest track bounds the query
+  float reach = 0;
+  for(int i = check->track_start[other->ordinal]; i < check->track_start[other->ordinal + 1]; i++){
+    struct Track *track = check->tracks[i];
+    reach = fmaxf(reach, track->type == TRACK_TYPE_SEG ? track->track.segment.width : (track->type == TRACK_TYPE_ARC ? track->track.arc.width : 0));
+  }
+  for(int i = check->track_start[side->ordinal]; i < check->track_start[side->ordinal + 1]; i++){
+    struct Track *track = check->tracks[i];
+    struct Point points[PAIRS_ARC_POINTS];
+    int count = 0;
+    float width = 0;
+    if(track->type == TRACK_TYPE_SEG){
+      points[0] = track->track.segment.start;
+      points[1] = track->track.segment.end;
+      count = 2;
+      width = track->track.segment.width;
+    }else if(track->type == TRACK_TYPE_ARC){
+      struct Arc *arc = &track->track.arc;
+      count = arc_points(arc->start, arc->mid, arc->end, PAIRS_ARC_ERROR, points, PAIRS_ARC_POINTS);
+      width = arc->width;
+    }
+    for(int j = 0; j + 1 < count; j++){
+      float length = hypotf(points[j + 1].x - points[j].x, points[j + 1].y - points[j].y);
+      int steps = (int)ceilf(length / step);
+      for(int k = 0; k < steps; k++){
+        // Midpoint of each step
+        float t = (k + 0.5f) / steps;
+        struct Gap_Query query = {other, track_layer(track), {points[j].x + t * (points[j + 1].x - points[j].x), points[j].y + t * (points[j + 1].y - points[j].y)}, width / 2, INFINITY};
+        float grow = max_gap + width / 2 + reach / 2;
+        struct Box box = {query.point.x - grow, query.point.y - grow, query.point.x + grow, query.point.y + grow};
+        spatial_query(pcb->spatial, box, layer_mask(query.layer), nearest_track, &query);
+        if(query.best > max_gap){
+          *uncoupled += length / steps;
+        }else if(gaps){
+          pair->gap_min = fmin(pair->gap_min, query.best);
+          pair->gap_max = fmax(pair->gap_max, query.best);
+          pair->gap_sum += query.best;
+          pair->gap_sum2 += (double)query.best * query.best;
+          pair->samples++;
+        }
+      }
+    }
+  }
+}
+
+static void *pair_worker(void *arg){
+  struct Pair_Check *check = arg;
+  pcb = check->board;
+  while(TRUE){
+    int i = __atomic_fetch_add(&check->next, 1, __ATOMIC_RELAXED);
+    if(i >= check->pair_count){
+      break;
+    }
+    struct Pair *pair = &check->pairs[i];
+    double uncoupled_positive = 0, uncoupled_negative = 0;
+    pair->gap_min = INFINITY;
+    pair->gap_max = -INFINITY;
+    walk_side(check, pair, pair->positive, pair->negative, TRUE, &uncoupled_positive);
+    walk_side(check, pair, pair->negative, pair->positive, FALSE, &uncoupled_negative);
+    pair->uncoupled = fmax(uncoupled_positive, uncoupled_negative);
+  }
+  return NULL;
+}
+
+// Report
+
+static void report_groups(FILE *report, struct Length_Group *groups, struct Net **nets, int count, struct Pair_Stats *stats){
+  double *lengths = malloc((count ? count : 1) * sizeof(double));
+  int *members = malloc((count ? count : 1) * sizeof(int));
+  for(struct Length_Group *group = groups; group; group = group->next){
+    int member_count = 0;
+    double longest = 0;
+    for(int i = 0; i < count; i++){
+      for(int j = 0; j < group->glob_count; j++){
+        if(fnmatch(group->globs[j], nets[i]->name.chars, 0) == 0){
+          lengths[member_count] = net_metric(pcb->metrics, nets[i]->ordinal)->length;
+          longest = fmax(longest, lengths[member_count]);
+          members[member_count++] = i;
+          break;
+        }
+      }
+    }
+    double target = group->target > 0 ? group->target : longest;
+    int outside = 0;
+    for(int i = 0; i < member_count; i++){
+      outside += fabs(lengths[i] - target) > group->tolerance;
+    }
+    fprintf(report, "group %s target %.4f tolerance %.4f: %d nets, %d outside\n", group->name, target, group->tolerance, member_count, outside);
+    for(int i = 0; i < member_count; i++){
+      double deviation = lengths[i] - target;
+      fprintf(report, "  %-32s %10.4f %+10.4f%s\n", nets[members[i]]->name.chars, lengths[i], deviation, fabs(deviation) > group->tolerance ? " !" : "");
+    }
+    stats->groups++;
+    stats->grouped += member_count;
+    stats->violations += outside;
+  }
+  free(members);
+  free(lengths);
+}
+
+// Checks every differential pair and length group on pcb and writes the
+// report. Zero options take the defaults: pairs coupled within 1 mm edge
+// to edge, walked in 0.1 mm steps, skew unchecked, every core. Returns the
+// number of violations or ERROR when the pattern file is bad.
+int check_pairs(const struct Pair_Options *options, FILE *report, struct Pair_Stats *stats){
+  struct Pair_Stats local_stats;
+  struct Pair_Check check;
+  memset(&check, 0, sizeof(check));
+  stats = stats ? stats : &local_stats;
+  memset(stats, 0, sizeof(struct Pair_Stats));
+  check.board = pcb;
+  check.options = *options;
+  check.options.max_gap = options->max_gap > 0 ? options->max_gap : PAIRS_MAX_GAP;
+  check.options.step = options->step > 0 ? options->step : PAIRS_STEP;
+  int threads = options->threads > 0 ? options->threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+  struct Pair_Suffix suffixes[PAIRS_MAX_SUFFIXES];
+  int suffix_count = 0;
+  struct Length_Group *groups = NULL;
+  add_suffix(suffixes, &suffix_count, "_P", "_N");
+  add_suffix(suffixes, &suffix_count, "+", "-");
+  if(options->patterns && read_patterns(options->patterns, suffixes, &suffix_count, &groups) == ERROR){
+    free_groups(groups);
+    return ERROR;
+  }
+  if(pcb->spatial == NULL){
+    spatial_index_init();
+  }
+  if(pcb->metrics == NULL){
+    pcb->metrics = net_metrics_build(threads);
+  }
+
+  int count = 0, max_ordinal = 0;
+  for(struct Net *net = pcb->nets; net; net = net->next){
+    count += net->ordinal > 0 && net->name.chars != NULL;
+    max_ordinal = net->ordinal > max_ordinal ? net->ordinal : max_ordinal;
+  }
+  struct Net **nets = malloc((count ? count : 1) * sizeof(struct Net *));
+  count = 0;
+  for(struct Net *net = pcb->nets; net; net = net->next){
+    if(net->ordinal > 0 && net->name.chars != NULL){
+      nets[count++] = net;
+    }
+  }
+  qsort(nets, count, sizeof(struct Net *), compare_name);
+  find_pairs(&check, nets, count, suffixes, suffix_count);
+
+  // Bucket tracks by net
+  int track_count = 0;
+  check.track_start = calloc(max_ordinal + 2, sizeof(int));
+  for(struct Track *track = pcb->tracks; track; track = track->next, track_count++){
+    struct Net *net = track_net(track);
+    check.track_start[(net && net->ordinal > 0 && net->ordinal <= max_ordinal ? net->ordinal : 0) + 1]++;
+  }
+  for(int i = 0; i <= max_ordinal; i++){
+    check.track_start[i + 1] += check.track_start[i];
+  }
+  check.tracks = malloc((track_count ? track_count : 1) * sizeof(struct Track *));
+  int *fill = malloc((max_ordinal + 1) * sizeof(int));
+  memcpy(fill, check.track_start, (max_ordinal + 1) * sizeof(int));
+  for(struct Track *track = pcb->tracks; track; track = track->next){
+    struct Net *net = track_net(track);
+    check.tracks[fill[net && net->ordinal > 0 && net->ordinal <= max_ordinal ? net->ordinal : 0]++] = track;
+  }
+  free(fill);
+
+  threads = threads < check.pair_count ? threads : check.pair_count;
+  pthread_t *thread = malloc((threads > 0 ? threads : 1) * sizeof(pthread_t));
+  for(int i = 0; i < threads; i++){
+    pthread_create(&thread[i], NULL, pair_worker, &check);
+  }
+  for(int i = 0; i < threads; i++){
+    pthread_join(thread[i], NULL);
+  }
+  free(thread);
+
+  fprintf(report, "%-32s %10s %10s %8s %9s %8s %8s %8s %8s\n", "pair", "length_p", "length_n", "skew", "uncoupled", "gap_min", "gap_max", "gap_mean", "gap_dev");
+  for(int i = 0; i < check.pair_count; i++){
+    struct Pair *pair = &check.pairs[i];
+    pair->length_positive = net_metric(pcb->metrics, pair->positive->ordinal)->length;
+    pair->length_negative = net_metric(pcb->metrics, pair->negative->ordinal)->length;
+    double skew = fabs(pair->length_positive - pair->length_negative);
+    double mean = pair->samples ? pair->gap_sum / pair->samples : 0;
+    double deviation = pair->samples ? sqrt(fmax(0, pair->gap_sum2 / pair->samples - mean * mean)) : 0;
+    int violation = options->max_skew > 0 && skew > options->max_skew;
+    fprintf(report, "%-32s %10.4f %10.4f %8.4f %9.4f %8.4f %8.4f %8.4f %8.4f%s\n", pair->positive->name.chars, pair->length_positive, pair->length_negative,
+      skew, pair->uncoupled, pair->samples ? pair->gap_min : 0, pair->samples ? pair->gap_max : 0, mean, deviation, violation ? " !" : "");
+    stats->violations += violation;
+  }
+  stats->pairs = check.pair_count;
+  report_groups(report, groups, nets, count, stats);
+
+  free(check.pairs);
+  free(check.track_start);
+  free(check.tracks);
+  free(nets);
+  free_groups(groups);
+  return stats->violations;
+}
@@ -11,6 +11,9 @@
 #define COPY(token, index, buff) (token[(index++)] = BUFF[(buff++)])
 
 #define PUSH(new, list) (list == NULL) ? (list = new, new->next = NULL) : (list->prev = new, new->next = list, list = new)
+// Arcs in the outline of a gr_poly or fp_poly are cut into chords as read
+#define POLY_ARC_MAX_ERROR 0.005f
+#define POLY_ARC_MAX 1024
 
 // Hash table
 static int token_lookup(const char *token);
@@ -21,6 +24,7 @@ static void free_token(struct token *token);
 static void free_table(struct table *table);
 static void insert(struct table *table, char* key, int* (*handler)());
 static void *search_token(struct table *table, char* key);
+static struct token *find_token(struct table *table, char *key);
 static void print_table(struct table *table);
 static void handle_collision(struct table *table, unsigned long index, struct token *token);
 static void print_search(struct table *table, char *key);
@@ -33,6 +37,7 @@ static void free_overflow(struct table *table);
 static void table_delete(struct table *table, char *key);
 
 // Parsing
+static int parse_buffer(char *buffer, uint64_t length);
 static void parse_pcb(uint64_t start, uint64_t end);
 static int parse_token(uint64_t start, uint64_t end, String *token);
 
@@ -64,6 +69,7 @@ static int *handle_at(uint64_t start, uint64_t end);
 static int *handle_fp_line(uint64_t start, uint64_t end);
 static int *handle_start(uint64_t start, uint64_t end);
 static int *handle_end(uint64_t start, uint64_t end);
+static int *handle_mid(uint64_t start, uint64_t end);
 static int *handle_pad(uint64_t start, uint64_t end);
 static int *handle_size(uint64_t start, uint64_t end);
 static int *handle_model(uint64_t start, uint64_t end);
@@ -83,6 +89,19 @@ static int *handle_polygon(uint64_t start, uint64_t end);
 static int *handle_filled_polygon(uint64_t start, uint64_t end);
 static int *handle_pts(uint64_t start, uint64_t end);
 static int *handle_xy(uint64_t start, uint64_t end);
+static int *handle_roundrect_rratio(uint64_t start, uint64_t end);
+static int *handle_priority(uint64_t start, uint64_t end);
+static int *handle_connect_pads(uint64_t start, uint64_t end);
+static int *handle_clearance(uint64_t start, uint64_t end);
+static int *handle_min_thickness(uint64_t start, uint64_t end);
+static int *handle_hatch(uint64_t start, uint64_t end);
+static int *handle_fill(uint64_t start, uint64_t end);
+static int *handle_thermal_gap(uint64_t start, uint64_t end);
+static int *handle_thermal_bridge_width(uint64_t start, uint64_t end);
+static int *handle_locked(uint64_t start, uint64_t end);
+static int *handle_drawing(uint64_t start, uint64_t end);
+static int *handle_center(uint64_t start, uint64_t end);
+static int *handle_fp_shape(uint64_t start, uint64_t end);
 
 // Handler Helpers
 static int handle_quotes(uint64_t *start, uint64_t end, String *quote);
@@ -90,10 +109,14 @@ static void set_section_index(uint64_t start, uint64_t end, struct Section_Index
 static void handle_value_token(uint64_t *start, uint64_t end, String *token);
 static struct Layer *find_layer(String name);
 static struct Net *find_net(int ordinal);
+static int handle_layer_list(uint64_t start, uint64_t end, struct Layer ***layers);
 
 struct token{
   char *key;
   int* (*handler)();
+#ifdef PROFILE
+  int slot;
+#endif
 };
 
 struct table{
@@ -109,7 +132,60 @@ struct collision_list{
 
 static struct table *tokens = NULL;
 
+#ifdef BENCH
+#include <time.h>
+
+// Top level items are the children of kicad_pcb, two parse_pcb levels down
+#define BENCH_CLASSES 64
+#define BENCH_DEPTH 2
+static _Thread_local struct Parse_Timing timings[BENCH_CLASSES];
+static _Thread_local int timing_count, parse_depth;
+
+static double bench_seconds(){
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static void bench_record(const char *name, double seconds){
+  int i = 0;
+  while(i < timing_count && strcmp(timings[i].name, name) != 0){
+    i++;
+  }
+  if(i == timing_count){
+    if(timing_count == BENCH_CLASSES){
+      return;
+    }
+    strncpy(timings[i].name, name, sizeof(timings[i].name) - 1);
+    timing_count++;
+  }
+  timings[i].count++;
+  timings[i].seconds += seconds;
+}
+
+int parse_timings(struct Parse_Timing **out){
+  *out = timings;
+  return timing_count;
+}
+
+void parse_timings_reset(){
+  memset(timings, 0, sizeof(timings));
+  timing_count = 0;
+}
+#endif
+
+#ifdef PROFILE
+// Nodes without a handler and the helpers worth seeing on their own
+static int profile_unknown, profile_parse_token, profile_find_net, profile_find_layer;
+#endif
+
 void token_table_init(){
+#ifdef PROFILE
+  profile_unknown = profile_register("(unknown)");
+  profile_parse_token = profile_register("parse_token");
+  profile_find_net = profile_register("find_net");
+  profile_find_layer = profile_register("find_layer");
+#endif
   tokens = create_table(HASH_CAP);
   printf("Tokens %p\n", tokens);
   insert(tokens, (char *)"kicad_pcb", handle_kicadpcb);
@@ -134,6 +210,7 @@ void token_table_init(){
   insert(tokens, (char *)"via", handle_via);
   insert(tokens, (char *)"segment", handle_segment);
   insert(tokens, (char *)"arc", handle_arc);
+  insert(tokens, (char *)"drill", handle_drill);
   insert(tokens, (char *)"uuid", handle_uuid);
   insert(tokens, (char *)"property", handle_property);
   insert(tokens, (char *)"descr", handle_descr);
@@ -141,6 +218,7 @@ void token_table_init(){
   insert(tokens, (char *)"fp_line", handle_fp_line);
   insert(tokens, (char *)"start", handle_start);
   insert(tokens, (char *)"end", handle_end);
+  insert(tokens, (char *)"mid", handle_mid);
   insert(tokens, (char *)"pad", handle_pad);
   insert(tokens, (char *)"size", handle_size);
   insert(tokens, (char *)"model", handle_model);
@@ -156,13 +234,40 @@ void token_table_init(){
   insert(tokens, (char *)"filled_polygon", handle_filled_polygon);
   insert(tokens, (char *)"pts", handle_pts);
   insert(tokens, (char *)"xy", handle_xy);
+  insert(tokens, (char *)"roundrect_rratio", handle_roundrect_rratio);
+  insert(tokens, (char *)"priority", handle_priority);
+  insert(tokens, (char *)"connect_pads", handle_connect_pads);
+  insert(tokens, (char *)"clearance", handle_clearance);
+  insert(tokens, (char *)"min_thickness", handle_min_thickness);
+  insert(tokens, (char *)"hatch", handle_hatch);
+  insert(tokens, (char *)"fill", handle_fill);
+  insert(tokens, (char *)"thermal_gap", handle_thermal_gap);
+  insert(tokens, (char *)"thermal_bridge_width", handle_thermal_bridge_width);
+  insert(tokens, (char *)"locked", handle_locked);
+  insert(tokens, (char *)"gr_line", handle_drawing);
+  insert(tokens, (char *)"gr_arc", handle_drawing);
+  insert(tokens, (char *)"gr_circle", handle_drawing);
+  insert(tokens, (char *)"gr_rect", handle_drawing);
+  insert(tokens, (char *)"gr_poly", handle_drawing);
+  insert(tokens, (char *)"center", handle_center);
+  insert(tokens, (char *)"fp_rect", handle_fp_shape);
+  insert(tokens, (char *)"fp_circle", handle_fp_shape);
+  insert(tokens, (char *)"fp_arc", handle_fp_shape);
+  insert(tokens, (char *)"fp_poly", handle_fp_shape);
   //print_table(tokens);
 }
 
+// The table is read only once built and shared by every parsing thread
+void token_table_free(){
+  free_table(tokens);
+  tokens = NULL;
+}
+
 int open_pcb(const char *path){
   long length, bytes_read = 0;
   char *buffer = NULL;
   FILE *file;
+  int status = ERROR;
 
   printf("Opening file %s\n", path);
   file = fopen(path, "rb");
@@ -170,7 +275,6 @@ int open_pcb(const char *path){
   if (file == NULL){
     perror("Error opening file");
     goto clean_up;
-    return ERROR;
   }
   //pcb->file = file;
   fseek(file, 0, SEEK_END);
@@ -186,24 +290,55 @@ int open_pcb(const char *path){
     goto clean_up;
   }
   
+  status = parse_buffer(buffer, length);
+  buffer = NULL;
+
+clean_up:
+  free(buffer);
+  return status;
+}
+
+// Parses a board already in memory, the board keeps its own copy so the
+// caller's buffer is not referenced once this returns
+int open_pcb_buffer(const char *buffer, uint64_t length){
+  if(buffer == NULL || length == 0){
+    return ERROR;
+  }
+  char *copy = malloc(length);
+  memcpy(copy, buffer, length);
+  return parse_buffer(copy, length);
+}
+
+// Takes ownership of buffer, it stays with the board as the source the
+// writer copies unmodified sections from
+static int parse_buffer(char *buffer, uint64_t length){
+  if(length == 0){
+    free(buffer);
+    return ERROR;
+  }
+  pcb->source.chars = buffer;
+  pcb->source.length = length;
   pcb->file_buffer.buffer.chars = buffer;
   pcb->file_buffer.buffer.length = length;
   pcb->file_buffer.index = 0;
+  pcb->strings = intern_table_create();
 
   //index_sections();
   parse_pcb(0, 0);
+  footprint_bodies_init();
 
-clean_up:
-  free(buffer);
-  free_table(tokens);
+  pcb->file_buffer.buffer.chars = NULL;
   return SUCCESS;
 }
 
 static void parse_pcb(uint64_t start, uint64_t end){
   uint64_t opens = 0;
-  uint64_t index = start, new_start, new_end;
+  uint64_t index = start, new_start = start, new_end;
   int *section_set = NULL;
-  end = (end ? end : LENGTH);
+  end = (end ? end : LENGTH - 1);
+#ifdef BENCH
+  parse_depth++;
+#endif
   while(index <= end){
     if(BUFF[index] == '('){
       if(opens == 0){
@@ -217,20 +352,44 @@ static void parse_pcb(uint64_t start, uint64_t end){
         new_end = index;
         //index = new_start;
         String token;
+#ifdef BENCH
+        double bench_start = parse_depth == BENCH_DEPTH ? bench_seconds() : 0;
+#endif
+#ifdef PROFILE
+        uint64_t profile_start = profile_enter(), profile_handler = 0, profile_token = profile_enter();
+#endif
         if(parse_token(new_start, new_end, &token) == ERROR){
           //printf("ERROR\n");
         }
-        int* (*handler)(uint64_t, uint64_t) = search_token(tokens, token.chars);
+        struct token *entry = find_token(tokens, token.chars);
+#ifdef PROFILE
+        profile_leave(profile_parse_token, profile_token, token.length, 0);
+#endif
+        int* (*handler)(uint64_t, uint64_t) = entry ? entry->handler : NULL;
         if(handler){
+#ifdef PROFILE
+          profile_handler = profile_now();
+#endif
           section_set = handler(new_start, new_end);
+#ifdef PROFILE
+          profile_handler = profile_now() - profile_handler;
+#endif
           
           //printf("SUCCESS\n");
         }
         
         //printf("OPENS: %ld\n", opens);
         //printf("%s", token.chars);
-        free(token.chars);
         parse_pcb(new_start+1, new_end-1);
+#ifdef PROFILE
+        profile_leave(entry ? entry->slot : profile_unknown, profile_start, new_end - new_start + 1, profile_handler);
+#endif
+#ifdef BENCH
+        if(parse_depth == BENCH_DEPTH){
+          bench_record(token.chars, bench_seconds() - bench_start);
+        }
+#endif
+        free(token.chars);
         //printf(")");
         if(section_set){
           //printf("SECTION UNSET\n");
@@ -240,6 +399,9 @@ static void parse_pcb(uint64_t start, uint64_t end){
     }
     index++;
   }
+#ifdef BENCH
+  parse_depth--;
+#endif
 }
 
 static int parse_token(uint64_t start, uint64_t end, String *token){
@@ -300,6 +462,10 @@ static struct token *create_token(const char *key, int* (*handler)()){
   token->key = (char*) malloc(strlen(key) + 1);
   strcpy(token->key, key);
   token->handler = handler;
+#ifdef PROFILE
+  // Keys come from literals in token_table_init, the copy goes with the table
+  token->slot = profile_register(key);
+#endif
   return token;
 }
 
@@ -352,12 +518,17 @@ static void insert(struct table *table, char* key, int* (*handler)()){
 }
 
 static void *search_token(struct table *table, char* key){
+  struct token *token = find_token(table, key);
+  return token ? token->handler : NULL;
+}
+
+static struct token *find_token(struct table *table, char *key){
   int index = hash(key);
   struct token *token = table->tokens[index];
   struct collision_list *head = table->overflow[index];
   while (token != NULL){
     if (strcmp(token->key, key) == 0)
-      return token->handler;
+      return token;
 
     if (head == NULL)
       return NULL;
@@ -391,6 +562,7 @@ static void handle_collision(struct table *table, unsigned long index, struct to
   if (head == NULL){
     head = allocate_list();
     head->token = token;
+    head->next = NULL;
     table->overflow[index] = head;
     return;
   }
@@ -546,24 +718,18 @@ static void table_delete(struct table *table, char *key){
 // Handle helpers
 static void handle_value_token(uint64_t *start, uint64_t end, String *token){
   //printf("Handle Value Token (%ld)\n", *start);
-  char val[TOKEN_SZ];
-  int token_index = 0;
-  String quote;
-  quote.chars = NULL;
-  quote.length = 0;
-  while(BUFF[(*start)++] != ' '); 
-  if(BUFF[*start] == '\"'){
-    handle_quotes(start, end, &quote);
-    *token = quote;
+  while(*start < end && BUFF[(*start)++] != ' ');
+  if(*start >= end){
+    // Nothing left before the closing paren
+    *token = intern(pcb->strings, "", 0);
+  }else if(BUFF[*start] == '\"'){
+    handle_quotes(start, end, token);
   }else{
+    uint64_t from = *start;
     while(BUFF[*start] != ')' && BUFF[*start] != '(' && BUFF[*start] != ' ' && BUFF[*start] > 32 && *start < end){
-      val[token_index++] = BUFF[(*start)++];
-      //(*start)++;
+      (*start)++;
     }
-    val[token_index++] = '\0';
-    token->chars = malloc(token_index * sizeof(char));
-    strncpy(token->chars, val, token_index);
-    token->length = token_index;
+    *token = intern(pcb->strings, &BUFF[from], *start - from);
   }
   //printf("Printing Token: %s\n", token->chars);
 }
@@ -573,27 +739,21 @@ static int handle_quotes(uint64_t *start, uint64_t end, String *quote){
   //printf("Handle Quotes\n");
   //printf("Start %ld End %ld\n", *start, end);
   uint64_t index = *start;
-  int token_index = 0;
-  char token[TOKEN_SZ];
   if(BUFF[index++] != '\"'){
     printf("Weird weird\n");
     return ERROR;
   }
+  uint64_t from = index;
   while(index < end){
     if(BUFF[index] == '\"'){
       break;
     }
-    token[token_index++] = BUFF[index++];
-    //token_index++;
-    //index++;
+    index++;
   }
-  token[token_index++] = 0;
-  *start = ++index;
   if(quote){
-    quote->chars = malloc(token_index * sizeof(char));
-    strncpy(quote->chars, token, token_index);
-    quote->length = token_index;
+    *quote = intern(pcb->strings, &BUFF[from], index - from);
   }
+  *start = ++index;
   return SUCCESS;
 }
 
@@ -605,23 +765,32 @@ static void set_section_index(uint64_t start, uint64_t end, struct Section_Index
 }
 
 static struct Layer *find_layer(String name){
-  for(struct Layer *layer = pcb->layers.layer; layer; layer = layer->next){
-    if(string_compare(name, layer->canonical_name) == TRUE){
-      return layer;
-      //printf("(ORDINAL: %d; CANONICAL_NAME: \"%s\"; TYPE: %d; USER_NAME: \"%s\")\n", pcb->footprints->layer->ordinal, pcb->footprints->layer->canonical_name.chars, pcb->footprints->layer->type, pcb->footprints->layer->user_name.chars);
-    }
-    //printf("%s = %s\n", name.chars, layer->canonical_name.chars);
+#ifdef PROFILE
+  uint64_t profile_start = profile_enter();
+#endif
+  struct Layer *layer = pcb->layers.layer;
+  // Both names come from the board's interner
+  while(layer && layer->canonical_name.chars != name.chars){
+    layer = layer->next;
   }
-  return NULL;
+#ifdef PROFILE
+  profile_leave(profile_find_layer, profile_start, name.length, 0);
+#endif
+  return layer;
 }
 
 static struct Net *find_net(int ordinal){
-  for(struct Net *net = pcb->nets; net; net = net->next){
-    if(ordinal == net->ordinal){
-      return net;
-    }
+#ifdef PROFILE
+  uint64_t profile_start = profile_enter();
+#endif
+  struct Net *net = pcb->nets;
+  while(net && net->ordinal != ordinal){
+    net = net->next;
   }
-  return NULL;
+#ifdef PROFILE
+  profile_leave(profile_find_net, profile_start, 0, 0);
+#endif
+  return net;
 }
 
 // Handlers
@@ -684,6 +853,51 @@ static int *handle_general(uint64_t start, uint64_t end){
   return NULL;
 }
 
+// The stackup entry being parsed, copper entries name a layer from the
+// layers section rather than the newest one
+static struct Layer *stackup_layer(){
+  if(pcb->stackup.index.set == SECTION_SET && pcb->stackup.layer && pcb->stackup.layer->index.set == SECTION_SET){
+    return pcb->stackup.layer;
+  }
+  return NULL;
+}
+
+// The board graphic being parsed
+static struct Drawing *open_drawing(){
+  if(pcb->graphics.drawings && pcb->graphics.drawings->index.set == SECTION_SET){
+    return pcb->graphics.drawings;
+  }
+  return NULL;
+}
+
+// The footprint being parsed and its rect, circle, arc or poly
+static struct Footprint *open_footprint(){
+  if(pcb->footprints && pcb->footprints->index.set == SECTION_SET){
+    return pcb->footprints;
+  }
+  return NULL;
+}
+
+static struct Rect *open_fp_rect(){
+  struct Footprint *footprint = open_footprint();
+  return footprint && footprint->fp_rects && footprint->fp_rects->index.set == SECTION_SET ? footprint->fp_rects : NULL;
+}
+
+static struct Circle *open_fp_circle(){
+  struct Footprint *footprint = open_footprint();
+  return footprint && footprint->fp_circles && footprint->fp_circles->index.set == SECTION_SET ? footprint->fp_circles : NULL;
+}
+
+static struct Footprint_Arc *open_fp_arc(){
+  struct Footprint *footprint = open_footprint();
+  return footprint && footprint->fp_arcs && footprint->fp_arcs->index.set == SECTION_SET ? footprint->fp_arcs : NULL;
+}
+
+static struct Polygon *open_fp_poly(){
+  struct Footprint *footprint = open_footprint();
+  return footprint && footprint->fp_poly && footprint->fp_poly->index.set == SECTION_SET ? footprint->fp_poly : NULL;
+}
+
 static int *handle_thickness(uint64_t start, uint64_t end){
   //printf("Handle Thickness\n");
   if(pcb->general.index.set == SECTION_SET){
@@ -692,12 +906,12 @@ static int *handle_thickness(uint64_t start, uint64_t end){
       printf("thickness 1\n");
     }
     pcb->general.thickness = thickness;
-  }else if(pcb->layers.layer->index.set == SECTION_SET){
+  }else if(stackup_layer()){
     float thickness;
     if(sscanf(&BUFF[start], "(thickness %f)", &thickness) != 1){
       printf("thickness 2\n");
     }
-    pcb->layers.layer->thickness = thickness;
+    pcb->stackup.layer->thickness = thickness;
   }
   return NULL;
 }
@@ -750,42 +964,53 @@ static int *handle_layers(uint64_t start, uint64_t end){
     }
     return &pcb->layers.index.set;
   }else if(pcb->footprints && pcb->footprints->index.set == SECTION_SET && pcb->footprints->pads && pcb->footprints->pads->index.set == SECTION_SET){
-    int layer_count = 0, index = start;
-    while(++index < end){
-      //handle_value_token(&start, end, )
-      if(BUFF[index] == ' '){
-        layer_count++;
-      }
+    pcb->footprints->pads->layer_count = handle_layer_list(start, end, &pcb->footprints->pads->layers);
+  }else if(pcb->tracks && pcb->tracks->index.set == SECTION_SET && pcb->tracks->type == TRACK_TYPE_VIA){
+    pcb->tracks->track.via.layer_count = handle_layer_list(start, end, &pcb->tracks->track.via.layers);
+  }else if(pcb->zones && pcb->zones->index.set == SECTION_SET && pcb->zones->layer == NULL){
+    struct Layer **layers;
+    if(handle_layer_list(start, end, &layers) > 0){
+      pcb->zones->layer = layers[0];
+    }
+    free(layers);
+  }
+  return NULL;
+}
+
+// Layer names of a (layers ...) list, wildcards like "*.Cu" expand to every
+// matching layer and unknown names are dropped
+static int handle_layer_list(uint64_t start, uint64_t end, struct Layer ***layers){
+  int name_count = 0, layer_count = 0, total = 0;
+  uint64_t index = start;
+  while(++index < end){
+    if(BUFF[index] == ' '){
+      name_count++;
     }
-    struct Layer **layer = calloc(layer_count, sizeof(struct Layer *));
-    String layer_name;
-    for(int i = 0; i < layer_count; i++){
-      handle_value_token(&start, end, &layer_name);
-      layer[i] = find_layer(layer_name);
-      free(layer_name.chars);
-      //printf("Layer[%d] \"%s\"\n", i, layer[i]->canonical_name.chars);
+  }
+  for(struct Layer *layer = pcb->layers.layer; layer; layer = layer->next){
+    total++;
+  }
+  struct Layer **layer = calloc(name_count * total + 1, sizeof(struct Layer *));
+  String layer_name;
+  // Spaces inside quoted names are counted too, so the list may run out
+  for(int i = 0; i < name_count && start < end; i++){
+    handle_value_token(&start, end, &layer_name);
+    if(layer_name.chars == NULL || layer_name.length == 0){
+      continue;
     }
-    pcb->footprints->pads->layer_count = layer_count;
-    pcb->footprints->pads->layers = layer;
-  }else if(pcb->tracks && pcb->tracks->index.set == SECTION_SET && pcb->tracks->type == TRACK_TYPE_VIA){
-    int layer_count = 0, index = start;
-    while(++index < end){
-      if(BUFF[index] == ' '){
-        layer_count++;
+    if(layer_name.chars[0] == '*'){
+      for(struct Layer *match = pcb->layers.layer; match; match = match->next){
+        char *suffix = match->canonical_name.chars ? strchr(match->canonical_name.chars, '.') : NULL;
+        if(suffix && strcmp(suffix, &layer_name.chars[1]) == 0){
+          layer[layer_count++] = match;
+        }
       }
+    }else if((layer[layer_count] = find_layer(layer_name))){
+      layer_count++;
     }
-    struct Layer **layer = calloc(layer_count, sizeof(struct Layer *));
-    String layer_name;
-    for(int i = 0; i < layer_count; i++){
-      handle_value_token(&start, end, &layer_name);
-      layer[i] = find_layer(layer_name);
-      free(layer_name.chars);
-      //printf("Layer[%d] \"%s\"\n", i, layer[i]->canonical_name.chars);
-    }
-    pcb->tracks->track.via.layer_count = layer_count;
-    pcb->tracks->track.via.layers = layer;
   }
-  return NULL;
+  *layers = layer;
+  return layer_count;
 }
 
 static int *handle_layer(uint64_t start, uint64_t end){
@@ -817,7 +1042,7 @@ static int *handle_layer(uint64_t start, uint64_t end){
     s_ordinal[layer_index] = 0;
     type[type_index] = 0;
     ordinal = atoi(s_ordinal);
-    struct Layer *layer = malloc(sizeof(struct Layer));
+    struct Layer *layer = calloc(1, sizeof(struct Layer));
     layer->index.section_start = start;
     layer->index.section_end = end;
     layer->index.set = SECTION_SET;
@@ -848,25 +1073,41 @@ static int *handle_layer(uint64_t start, uint64_t end){
       pcb->layers.layer = layer;
     }
     return &layer->index.set;
+  }else if(open_drawing() && open_drawing()->layer == NULL){
+    String name;
+    name.chars = NULL;
+    handle_value_token(&start, end, &name);
+    open_drawing()->layer = find_layer(name);
+  }else if(open_fp_rect() || open_fp_circle() || open_fp_arc() || open_fp_poly()){
+    String name;
+    name.chars = NULL;
+    handle_value_token(&start, end, &name);
+    struct Layer *layer = find_layer(name);
+    if(open_fp_rect()){
+      open_fp_rect()->layer = layer;
+    }else if(open_fp_circle()){
+      open_fp_circle()->layer = layer;
+    }else if(open_fp_arc()){
+      open_fp_arc()->layer = layer;
+    }else{
+      open_fp_poly()->layer = layer;
+    }
   }else if(pcb->footprints && pcb->footprints->index.set == SECTION_SET && pcb->footprints->properties && pcb->footprints->properties->index.set == SECTION_SET){
     String name;
     name.chars = NULL;
     name.length = 0;
     handle_value_token(&start, end, &name);
     pcb->footprints->properties->layer = find_layer(name);
-    free(name.chars);
   }else if(pcb->footprints && pcb->footprints->index.set == SECTION_SET && pcb->footprints->layer == NULL){
     String name;
     name.chars = NULL;
     handle_value_token(&start, end, &name);
     pcb->footprints->layer = find_layer(name);
-    free(name.chars);
   }else if(pcb->footprints && pcb->footprints->index.set == SECTION_SET && pcb->footprints->fp_lines && pcb->footprints->fp_lines->index.set == SECTION_SET && pcb->footprints->fp_lines->layer == NULL){
     String name;
     name.chars = NULL;
     handle_value_token(&start, end, &name);
     pcb->footprints->fp_lines->layer = find_layer(name);
-    free(name.chars);
   }else if(pcb->tracks && pcb->tracks->index.set == SECTION_SET){
     String name;
     name.chars = NULL;
@@ -876,7 +1117,11 @@ static int *handle_layer(uint64_t start, uint64_t end){
     }else if(pcb->tracks->type == TRACK_TYPE_SEG){
       pcb->tracks->track.segment.layer = find_layer(name);
     }
-    free(name.chars);
+  }else if(pcb->zones && pcb->zones->index.set == SECTION_SET && pcb->zones->layer == NULL){
+    String name;
+    name.chars = NULL;
+    handle_value_token(&start, end, &name);
+    pcb->zones->layer = find_layer(name);
   }else if(pcb->stackup.index.set == SECTION_SET){
     String name;
     name.length = 0;
@@ -888,27 +1133,26 @@ static int *handle_layer(uint64_t start, uint64_t end){
     if(layer == NULL){
       if(sscanf(name.chars, "dielectric %d", &dielectric) == 1){
         //printf("Dielectric layer\n");
-        layer = malloc(sizeof(struct Layer));
-        //while(BUFF[++start] != '\"');
-        handle_value_token(&start, end, &layer->canonical_name);
+        layer = calloc(1, sizeof(struct Layer));
+        layer->canonical_name = name;
         PUSH(layer, pcb->layers.layer);
       }
     }
-    free(name.chars);
     layer->index.section_start = start;
     layer->index.section_end = end;
     layer->index.set = SECTION_SET;
+    pcb->stackup.layer = layer;
     return &layer->index.set;
   }
   return NULL;
 }
 
 static int *handle_type(uint64_t start, uint64_t end){
-  if(pcb->layers.layer && pcb->layers.layer->index.set == SECTION_SET){
+  if(stackup_layer()){
     String type;
     //while(BUFF[++start] != '\"');
     handle_value_token(&start, end, &type);
-    pcb->layers.layer->stackup_type = type;
+    pcb->stackup.layer->stackup_type = type;
   }
   return NULL;
 }
@@ -942,7 +1186,6 @@ static int *handle_pad_to_mask_clearance(uint64_t start, uint64_t end){
     handle_value_token(&start, end, &clearance);    
     char *endptr;
     f_clearance = strtof(clearance.chars, &endptr);
-    free(clearance.chars);
     if(clearance.chars == endptr){
       return NULL;
     }
@@ -1052,7 +1295,7 @@ static int *handle_net(uint64_t start, uint64_t end){
         handle_quotes(&start, end, &name);
       }
     }
-    struct Net *net = malloc(sizeof(struct Net));
+    struct Net *net = calloc(1, sizeof(struct Net));
     net->index.section_start = start;
     net->index.section_end = end;
     net->index.set = SECTION_SET;
@@ -1071,7 +1314,7 @@ static int *handle_net(uint64_t start, uint64_t end){
 
 static int *handle_footprint(uint64_t start, uint64_t end){
   //printf("Handle Foot1\n");
-  struct Footprint *footprint = malloc(sizeof(struct Footprint));
+  struct Footprint *footprint = calloc(1, sizeof(struct Footprint));
   footprint->index.section_start = start;
   footprint->index.section_end = end;
   footprint->index.set = SECTION_SET;
@@ -1081,6 +1324,11 @@ static int *handle_footprint(uint64_t start, uint64_t end){
   handle_value_token(&start, end, &library);
 
   footprint->library_link = library;
+  // Older boards flag the footprint with a bare word after the link
+  while(BUFF[start] == ' ' || BUFF[start] == '\t' || BUFF[start] == '\n' || BUFF[start] == '\r'){
+    start++;
+  }
+  footprint->locked = strncmp(&BUFF[start], "locked", 6) == 0;
   footprint->layer = NULL;
   footprint->properties = NULL;
   footprint->fp_lines = NULL;
@@ -1102,8 +1350,8 @@ static int *handle_footprint(uint64_t start, uint64_t end){
 
 static int *handle_property(uint64_t start, uint64_t end){
   if(pcb->footprints && pcb->footprints->index.set == SECTION_SET){
-    struct Footprint_Property *footprint_property = malloc(sizeof(struct Footprint_Property));
-    struct Property *property = malloc(sizeof(struct Property));
+    struct Footprint_Property *footprint_property = calloc(1, sizeof(struct Footprint_Property));
+    struct Property *property = calloc(1, sizeof(struct Property));
     String key, val;
     key.chars = NULL;
     val.chars = NULL;
@@ -1133,8 +1381,6 @@ static int *handle_property(uint64_t start, uint64_t end){
       printf("IDK\n");
       free(footprint_property);
       free(property);
-      free(key.chars);
-      free(val.chars);
     }
 
     return &footprint_property->index.set;
@@ -1144,10 +1390,16 @@ static int *handle_property(uint64_t start, uint64_t end){
 
 static int *handle_zone(uint64_t start, uint64_t end){
   //printf("Handle Zone1\n");
-  struct Zone *zone = malloc(sizeof(struct Zone));
+  struct Zone *zone = calloc(1, sizeof(struct Zone));
   zone->index.section_start = start;
   zone->index.section_end = end;
   zone->index.set = SECTION_SET;
+  // KiCad defaults for settings the file leaves out
+  zone->connect_pads = THERMAL_RELIEF;
+  zone->clearance = 0.5;
+  zone->min_thickness = 0.25;
+  zone->thermal_gap = 0.5;
+  zone->thermal_bridge_width = 0.5;
   PUSH(zone, pcb->zones);
   //printf("Handle Zone2\n");
   return &pcb->zones->index.set;
@@ -1168,13 +1420,36 @@ static int *handle_zone(uint64_t start, uint64_t end){
   return &pcb->tracks->index.set;
 }*/
 
+// Parsed straight out of the buffer into 128 bits, nothing is allocated
 static int *handle_uuid(uint64_t start, uint64_t end){
   //printf("Handle_UUID\n");
-  String uuid;
-  uuid.chars = NULL;
-  uuid.length = 0;
-  handle_value_token(&start, end, &uuid);
-  if(pcb->footprints && pcb->footprints->index.set == SECTION_SET && pcb->footprints->uuid.chars == NULL){   
+  while(BUFF[start] != ' ' && start < end){
+    start++;
+  }
+  while((BUFF[start] == ' ' || BUFF[start] == '\"') && start < end){
+    start++;
+  }
+  uint64_t length = 0;
+  while(start + length < end && BUFF[start + length] != '\"' && BUFF[start + length] != ')' && BUFF[start + length] > 32){
+    length++;
+  }
+  struct Uuid uuid = uuid_parse(&BUFF[start], length);
+  char canonical[40];
+  uuid_format(uuid, canonical);
+  if(length != 36 || memcmp(canonical, &BUFF[start], 36) != 0){
+    uuid.text = intern(pcb->strings, &BUFF[start], length).chars;
+  }
+  if(open_drawing()){
+    open_drawing()->uuid = uuid;
+  }else if(open_fp_rect()){
+    open_fp_rect()->uuid = uuid;
+  }else if(open_fp_circle()){
+    open_fp_circle()->uuid = uuid;
+  }else if(open_fp_arc()){
+    open_fp_arc()->uuid = uuid;
+  }else if(open_fp_poly()){
+    open_fp_poly()->uuid = uuid;
+  }else if(pcb->footprints && pcb->footprints->index.set == SECTION_SET && uuid_is_nil(pcb->footprints->uuid)){
     pcb->footprints->uuid = uuid;
   }
   else if(pcb->footprints && pcb->footprints->index.set == SECTION_SET && pcb->footprints->properties && pcb->footprints->properties->index.set == SECTION_SET){ // Needs work
@@ -1186,8 +1461,8 @@ static int *handle_uuid(uint64_t start, uint64_t end){
     pcb->footprints->pads->uuid = uuid;
   }else if(pcb->tracks && pcb->tracks->index.set == SECTION_SET){
     pcb->tracks->uuid = uuid;
-  }else{
-    free(uuid.chars);
+  }else if(pcb->zones && pcb->zones->index.set == SECTION_SET && uuid_is_nil(pcb->zones->uuid)){
+    pcb->zones->uuid = uuid;
   }
   return NULL;
 }
@@ -1211,7 +1486,9 @@ static int *handle_at(uint64_t start, uint64_t end){
     pcb->footprints->properties->at = at;
   }else if(pcb->footprints && pcb->footprints->index.set == SECTION_SET && pcb->footprints->pads && pcb->footprints->pads->index.set == SECTION_SET){
     pcb->footprints->pads->at = at;
-  }else if(pcb->footprints && pcb->footprints->index.set == SECTION_SET){
+  }else if(pcb->footprints && pcb->footprints->index.set == SECTION_SET && !pcb->footprints->properties && !pcb->footprints->fp_lines && !pcb->footprints->pads){
+    // The footprint's own at comes before its texts, graphics and pads, the
+    // at of an fp_text must not move the footprint
     pcb->footprints->at = at;
   }else if(pcb->tracks && pcb->tracks->index.set == SECTION_SET && pcb->tracks->type == TRACK_TYPE_VIA){
     pcb->tracks->track.via.at = at;
@@ -1234,7 +1511,7 @@ static int *handle_descr(uint64_t start, uint64_t end){
 static int *handle_fp_line(uint64_t start, uint64_t end){
   //printf("FP_LIME\n");
   if(pcb->footprints && pcb->footprints->index.set == SECTION_SET){
-    struct Line *line = malloc(sizeof(struct Line));
+    struct Line *line = calloc(1, sizeof(struct Line));
     line->index.section_start = start;
     line->index.section_end = end;
     line->index.set = SECTION_SET;
@@ -1258,7 +1535,13 @@ static int *handle_start(uint64_t start, uint64_t end){
   }else{
     fprintf(stderr, "Weird start\n");
   }
-  if(pcb->footprints->fp_lines && pcb->footprints->fp_lines->index.set == SECTION_SET){
+  if(open_drawing()){
+    open_drawing()->start = point;
+  }else if(open_fp_rect()){
+    open_fp_rect()->start = point;
+  }else if(open_fp_arc()){
+    open_fp_arc()->start = point;
+  }else if(pcb->footprints && pcb->footprints->fp_lines && pcb->footprints->fp_lines->index.set == SECTION_SET){
     pcb->footprints->fp_lines->start = point;
   }else if(pcb->tracks && pcb->tracks->index.set == SECTION_SET && pcb->tracks->type == TRACK_TYPE_SEG){
     pcb->tracks->track.segment.start = point;
@@ -1275,7 +1558,15 @@ static int *handle_end(uint64_t start, uint64_t end){
   }else{
     //fprintf(stderr, "Weird end\n");
   }
-  if(pcb->footprints->fp_lines && pcb->footprints->fp_lines->index.set == SECTION_SET){
+  if(open_drawing()){
+    open_drawing()->end = point;
+  }else if(open_fp_rect()){
+    open_fp_rect()->end = point;
+  }else if(open_fp_circle()){
+    open_fp_circle()->end = point;
+  }else if(open_fp_arc()){
+    open_fp_arc()->end = point;
+  }else if(pcb->footprints && pcb->footprints->fp_lines && pcb->footprints->fp_lines->index.set == SECTION_SET){
     pcb->footprints->fp_lines->end = point;
   }else if(pcb->tracks && pcb->tracks->index.set == SECTION_SET && pcb->tracks->type == TRACK_TYPE_SEG){
     pcb->tracks->track.segment.end = point;
@@ -1285,6 +1576,21 @@ static int *handle_end(uint64_t start, uint64_t end){
   return NULL;
 }
 
+static int *handle_mid(uint64_t start, uint64_t end){
+  struct Point point;
+  if(sscanf(&BUFF[start], "(mid %f %f)", &point.x, &point.y) != 2){
+    fprintf(stderr, "Weird mid\n");
+  }
+  if(open_drawing()){
+    open_drawing()->mid = point;
+  }else if(open_fp_arc()){
+    open_fp_arc()->mid = point;
+  }else if(pcb->tracks && pcb->tracks->index.set == SECTION_SET && pcb->tracks->type == TRACK_TYPE_ARC){
+    pcb->tracks->track.arc.mid = point;
+  }
+  return NULL;
+}
+
 static int *handle_width(uint64_t start, uint64_t end){
   float width = 0.0;
   if(sscanf(&BUFF[start], "(width %f)", &width) == 1){
@@ -1292,7 +1598,17 @@ static int *handle_width(uint64_t start, uint64_t end){
   }else{
     fprintf(stderr, "Weird width\n");
   }
-  if(pcb->tracks && pcb->tracks->index.set == SECTION_SET && pcb->tracks->type == TRACK_TYPE_ARC){
+  if(open_drawing()){
+    open_drawing()->width = width;
+  }else if(open_fp_rect()){
+    open_fp_rect()->width = width;
+  }else if(open_fp_circle()){
+    open_fp_circle()->width = width;
+  }else if(open_fp_arc()){
+    open_fp_arc()->width = width;
+  }else if(open_fp_poly()){
+    open_fp_poly()->width = width;
+  }else if(pcb->tracks && pcb->tracks->index.set == SECTION_SET && pcb->tracks->type == TRACK_TYPE_ARC){
     pcb->tracks->track.arc.width = width;
   }else if(pcb->tracks && pcb->tracks->index.set == SECTION_SET && pcb->tracks->type == TRACK_TYPE_SEG){
     pcb->tracks->track.segment.width = width;
@@ -1302,7 +1618,7 @@ static int *handle_width(uint64_t start, uint64_t end){
 
 static int *handle_pad(uint64_t start, uint64_t end){
   if(pcb->footprints && pcb->footprints->index.set == SECTION_SET){
-    struct Pad *pad = malloc(sizeof(struct Pad));
+    struct Pad *pad = calloc(1, sizeof(struct Pad));
     pad->index.section_start = start;
     pad->index.section_end = end;
     pad->index.set = SECTION_SET;
@@ -1322,7 +1638,6 @@ static int *handle_pad(uint64_t start, uint64_t end){
     }else{
       pad->type = SMD;
     }
-    free(type.chars);
     if(strncmp(shape.chars, "circle", shape.length) == 0){
       pad->shape = CIRCLE;
     }else if(strncmp(shape.chars, "oval", shape.length) == 0){
@@ -1336,7 +1651,6 @@ static int *handle_pad(uint64_t start, uint64_t end){
     }*/else{
       pad->shape = RECT;
     }
-    free(shape.chars);
     //printf("Pad1: %p", pad);
 
     if(pcb->footprints->pads == NULL){
@@ -1374,7 +1688,7 @@ static int *handle_size(uint64_t start, uint64_t end){
 static int *handle_model(uint64_t start, uint64_t end){
   //printf("Handle Model\n");
   if(pcb->footprints && pcb->footprints->index.set == SECTION_SET && pcb->footprints->model == NULL){
-    struct Model *model = malloc(sizeof(struct Model));
+    struct Model *model = calloc(1, sizeof(struct Model));
     model->index.section_start = start;
     model->index.section_end = end;
     model->index.set = SECTION_SET;
@@ -1386,6 +1700,13 @@ static int *handle_model(uint64_t start, uint64_t end){
 }
 
 static int *handle_offset(uint64_t start, uint64_t end){
+  if(pcb->footprints && pcb->footprints->index.set == SECTION_SET && pcb->footprints->pads && pcb->footprints->pads->drill.index.set == SECTION_SET){
+    struct Drill *drill = &pcb->footprints->pads->drill;
+    if(sscanf(&BUFF[start], "(offset %f %f)", &drill->offset.x, &drill->offset.y) != 2){
+      printf("Weird drill offset\n");
+    }
+    return NULL;
+  }
   if(pcb->footprints && pcb->footprints->index.set == SECTION_SET && pcb->footprints->model && pcb->footprints->model->index.set == SECTION_SET){
     struct Offset offset;
     offset.index.set = SECTION_SET;
@@ -1441,7 +1762,7 @@ static int *handle_xyz(uint64_t start, uint64_t end){
 
 static int *handle_via(uint64_t start, uint64_t end){
   //struct Via *via = malloc(sizeof(struct Via));
-  struct Track *track = malloc(sizeof(struct Track));
+  struct Track *track = calloc(1, sizeof(struct Track));
   track->index.set = SECTION_SET;
   track->index.section_start = start;
   track->index.section_end = end;
@@ -1457,7 +1778,7 @@ static int *handle_via(uint64_t start, uint64_t end){
 }
 
 static int *handle_segment(uint64_t start, uint64_t end){
-  struct Track *track = malloc(sizeof(struct Track));
+  struct Track *track = calloc(1, sizeof(struct Track));
   track->index.set = SECTION_SET;
   track->index.section_start = start;
   track->index.section_end = end;
@@ -1474,23 +1795,65 @@ static int *handle_segment(uint64_t start, uint64_t end){
 
 
 
+// (drill d), (drill oval w h), either can hold an (offset x y) child
 static int *handle_drill(uint64_t start, uint64_t end){
-  float diameter;
-  if(sscanf(&BUFF[start], "(drill %f", &diameter) != 1){
-      printf("Missed capturing drill width\n");
-    }
+  struct Drill drill = {0};
+  if(sscanf(&BUFF[start], "(drill oval %f %f", &drill.diameter, &drill.width) == 2){
+    drill.oval = TRUE;
+  }else if(sscanf(&BUFF[start], "(drill %f", &drill.diameter) == 1){
+    drill.width = drill.diameter;
+  }else{
+    printf("Missed capturing drill width\n");
+  }
+  set_section_index(start, end, &drill.index);
   if(pcb->tracks && pcb->tracks->index.set == SECTION_SET && pcb->tracks->type == TRACK_TYPE_VIA){
-    pcb->tracks->track.via.drill.diameter = diameter;
+    pcb->tracks->track.via.drill = drill;
+    return &pcb->tracks->track.via.drill.index.set;
+  }
+  if(pcb->footprints && pcb->footprints->index.set == SECTION_SET && pcb->footprints->pads && pcb->footprints->pads->index.set == SECTION_SET){
+    pcb->footprints->pads->drill = drill;
+    return &pcb->footprints->pads->drill.index.set;
   }
   return NULL;
 }
 
+// Chords of an arc in a poly outline appended to its points. They grow by
+// the chords on each arc so the room handle_pts counted for the points
+// still to come is kept. The start is left out when it repeats the last
+// point.
+static void poly_arc(uint64_t start, struct Point **points, int *point_count, int *point_index){
+  struct Point arc[3], chords[POLY_ARC_MAX];
+  if(sscanf(&BUFF[start], "(arc (start %f %f) (mid %f %f) (end %f %f)", &arc[0].x, &arc[0].y, &arc[1].x, &arc[1].y, &arc[2].x, &arc[2].y) != 6){
+    return;
+  }
+  int count = arc_points(arc[0], arc[1], arc[2], POLY_ARC_MAX_ERROR, chords, POLY_ARC_MAX);
+  int first = *point_index && count && (*points)[*point_index - 1].x == chords[0].x && (*points)[*point_index - 1].y == chords[0].y;
+  *point_count += count;
+  *points = realloc(*points, *point_count * sizeof(struct Point));
+  for(int i = first; i < count; i++){
+    (*points)[(*point_index)++] = chords[i];
+  }
+}
+
 static int *handle_arc(uint64_t start, uint64_t end){
-  struct Track *track = malloc(sizeof(struct Track));
+  // Arcs in the outline of a gr_poly or fp_poly are not tracks, they are
+  // points of the outline
+  if(open_drawing()){
+    if(open_drawing()->points){
+      poly_arc(start, &open_drawing()->points, &open_drawing()->point_count, &open_drawing()->point_index);
+    }
+    return NULL;
+  }else if(open_fp_poly()){
+    if(open_fp_poly()->points){
+      poly_arc(start, &open_fp_poly()->points, &open_fp_poly()->point_count, &open_fp_poly()->point_index);
+    }
+    return NULL;
+  }
+  struct Track *track = calloc(1, sizeof(struct Track));
   track->index.set = SECTION_SET;
   track->index.section_start = start;
   track->index.section_end = end;
-  track->type = TRACK_TYPE_SEG;
+  track->type = TRACK_TYPE_ARC;
   if(pcb->tracks == NULL){
     pcb->tracks = track;
   }else{
@@ -1502,33 +1865,33 @@ static int *handle_arc(uint64_t start, uint64_t end){
 }
 
 static int *handle_material(uint64_t start, uint64_t end){
-  if(pcb->layers.layer->index.set == SECTION_SET){
+  if(stackup_layer()){
     String material;
     //while(BUFF[++start] != '\"');
     handle_value_token(&start, end, &material);
-    pcb->layers.layer->material = material;
+    pcb->stackup.layer->material = material;
   }
   return NULL;
 }
 
 static int *handle_epsilon_r(uint64_t start, uint64_t end){
-  if(pcb->layers.layer && pcb->layers.layer->index.set == SECTION_SET){
+  if(stackup_layer()){
     float epsilon_r;
     if(sscanf(&BUFF[start], "(epsilon_r %f)", &epsilon_r) != 1){
       printf("Epsilon_r Error\n");
     }
-    pcb->layers.layer->epsilon_r = epsilon_r;
+    pcb->stackup.layer->epsilon_r = epsilon_r;
   }
   return NULL;
 }
 
 static int *handle_loss_tangent(uint64_t start, uint64_t end){
-  if(pcb->layers.layer && pcb->layers.layer->index.set == SECTION_SET){
+  if(stackup_layer()){
     float loss;
     if(sscanf(&BUFF[start], "(loss_tangent %f)", &loss) != 1){
       printf("Loss error\n");
     }
-    pcb->layers.layer->loss_tangent = loss;
+    pcb->stackup.layer->loss_tangent = loss;
   }
   return NULL;
 }
@@ -1546,6 +1909,13 @@ static int *handle_polygon(uint64_t start, uint64_t end){
 
 static int *handle_filled_polygon(uint64_t start, uint64_t end){
   if(pcb->zones && pcb->zones->index.set == SECTION_SET){
+    // One filled_polygon per island, older ones are chained behind the newest
+    if(pcb->zones->filled_polygon.points){
+      struct Polygon *polygon = malloc(sizeof(struct Polygon));
+      *polygon = pcb->zones->filled_polygon;
+      memset(&pcb->zones->filled_polygon, 0, sizeof(struct Polygon));
+      pcb->zones->filled_polygon.next = polygon;
+    }
     pcb->zones->filled_polygon.index.section_start = start;
     pcb->zones->filled_polygon.index.section_end = end;
     pcb->zones->filled_polygon.index.set = SECTION_SET;
@@ -1591,6 +1961,18 @@ static int *handle_pts(uint64_t start, uint64_t end){
     pcb->zones->filled_polygon.point_index = 0;
     pcb->zones->filled_polygon.point_count = point_count;
     //printf("Number of Filled Points %d opens %d\n", point_count, open);
+  }else if(open_drawing()){
+    while(++start < end){
+      point_count += BUFF[start] == '(';
+    }
+    open_drawing()->points = calloc(point_count ? point_count : 1, sizeof(struct Point));
+    open_drawing()->point_count = point_count;
+  }else if(open_fp_poly()){
+    while(++start < end){
+      point_count += BUFF[start] == '(';
+    }
+    open_fp_poly()->points = calloc(point_count ? point_count : 1, sizeof(struct Point));
+    open_fp_poly()->point_count = point_count;
   }
   return NULL;
 }
@@ -1601,7 +1983,11 @@ static int *handle_xy(uint64_t start, uint64_t end){
   if(sscanf(&BUFF[start], "(xy %f %f)", &point.x, &point.y) != 2){
     printf("XY Error\n");
   }
-  if(pcb->zones && pcb->zones->polygon.index.set == SECTION_SET){
+  if(open_drawing() && open_drawing()->points){
+    open_drawing()->points[open_drawing()->point_index++] = point;
+  }else if(open_fp_poly() && open_fp_poly()->points){
+    open_fp_poly()->points[open_fp_poly()->point_index++] = point;
+  }else if(pcb->zones && pcb->zones->polygon.index.set == SECTION_SET){
     pcb->zones->polygon.points[pcb->zones->polygon.point_index++] = point;
   }else if(pcb->zones && pcb->zones->filled_polygon.index.set == SECTION_SET){
     pcb->zones->filled_polygon.points[pcb->zones->filled_polygon.point_index++] = point;
@@ -1609,47 +1995,196 @@ static int *handle_xy(uint64_t start, uint64_t end){
   return NULL;
 }
 
-/*
-static int *handle_text(uint64_t start, uint64_t end){
+static int *handle_roundrect_rratio(uint64_t start, uint64_t end){
+  if(pcb->footprints && pcb->footprints->index.set == SECTION_SET && pcb->footprints->pads && pcb->footprints->pads->index.set == SECTION_SET){
+    float ratio;
+    if(sscanf(&BUFF[start], "(roundrect_rratio %f)", &ratio) != 1){
+      printf("Roundrect ratio error\n");
+      return NULL;
+    }
+    pcb->footprints->pads->roundrect_rratio = ratio;
+  }
   return NULL;
 }
 
-static int *handle_rect(uint64_t start, uint64_t end){
-  if(pcb->footprints && pcb->footprints->index.set == SECTION_SET){
-    struct Rect *rect = malloc(sizeof(struct Rect));
-    rect->index.section_start = start;
-    rect->index.section_end = end;
-    rect->index.set == SECTION_SET;
+static int *handle_priority(uint64_t start, uint64_t end){
+  if(pcb->zones && pcb->zones->index.set == SECTION_SET){
+    uint32_t priority;
+    if(sscanf(&BUFF[start], "(priority %u)", &priority) != 1){
+      printf("Priority error\n");
+      return NULL;
+    }
+    pcb->zones->priority = priority;
+  }
+  return NULL;
+}
 
-    if(pcb->footprints->fp_rects == NULL){
-      
+static int *handle_connect_pads(uint64_t start, uint64_t end){
+  if(pcb->zones && pcb->zones->index.set == SECTION_SET){
+    char mode[TOKEN_SZ];
+    // No keyword before the nested clearance means thermal reliefs
+    if(sscanf(&BUFF[start], "(connect_pads %299[a-z_]", mode) != 1){
+      pcb->zones->connect_pads = THERMAL_RELIEF;
+    }else if(strcmp(mode, "yes") == 0){
+      pcb->zones->connect_pads = SOLID_FILL;
+    }else if(strcmp(mode, "no") == 0){
+      pcb->zones->connect_pads = NO_CONNECT;
+    }else if(strcmp(mode, "thru_hole_only") == 0){
+      pcb->zones->connect_pads = THRU_HOLE_ONLY;
     }
+  }
+  return NULL;
+}
 
-    return &rect->index.set;
+static int *handle_clearance(uint64_t start, uint64_t end){
+  if(pcb->zones && pcb->zones->index.set == SECTION_SET){
+    float clearance;
+    if(sscanf(&BUFF[start], "(clearance %f)", &clearance) != 1){
+      printf("Clearance error\n");
+      return NULL;
+    }
+    pcb->zones->clearance = clearance;
   }
   return NULL;
 }
 
-static int *handle_circle(uint64_t start, uint64_t end){
-  if(pcb->kicad_pcb.set == SECTION_SET){
-    struct Circle *circle = malloc(sizeof(struct Circle));
+static int *handle_min_thickness(uint64_t start, uint64_t end){
+  if(pcb->zones && pcb->zones->index.set == SECTION_SET){
+    float thickness;
+    if(sscanf(&BUFF[start], "(min_thickness %f)", &thickness) != 1){
+      printf("Min thickness error\n");
+      return NULL;
+    }
+    pcb->zones->min_thickness = thickness;
   }
   return NULL;
 }
 
-static int *handle_arc(uint64_t start, uint64_t end){
+static int *handle_hatch(uint64_t start, uint64_t end){
+  if(pcb->zones && pcb->zones->index.set == SECTION_SET){
+    char style[TOKEN_SZ];
+    float pitch;
+    if(sscanf(&BUFF[start], "(hatch %299s %f)", style, &pitch) != 2){
+      printf("Hatch error\n");
+      return NULL;
+    }
+    if(strcmp(style, "none") == 0){
+      pcb->zones->hatch_style = HATCH_NONE;
+    }else if(strcmp(style, "full") == 0){
+      pcb->zones->hatch_style = HATCH_FULL;
+    }else{
+      pcb->zones->hatch_style = HATCH_EDGE;
+    }
+    pcb->zones->hatch_pitch = pitch;
+  }
   return NULL;
 }
 
-static int *handle_polygon(uint64_t start, uint64_t end){
+// Zones fill with yes, footprint shapes with yes or solid
+static int *handle_fill(uint64_t start, uint64_t end){
+  int fill = strncmp(&BUFF[start], "(fill yes", 9) == 0 || strncmp(&BUFF[start], "(fill solid", 11) == 0;
+  if(open_fp_rect()){
+    open_fp_rect()->fill = fill;
+  }else if(open_fp_circle()){
+    open_fp_circle()->fill = fill;
+  }else if(open_fp_poly()){
+    open_fp_poly()->fill = fill;
+  }else if(pcb->zones && pcb->zones->index.set == SECTION_SET){
+    pcb->zones->fill = strncmp(&BUFF[start], "(fill yes", 9) == 0 ? TRUE : FALSE;
+  }
+  return NULL;
+}
+
+static int *handle_thermal_gap(uint64_t start, uint64_t end){
+  if(pcb->zones && pcb->zones->index.set == SECTION_SET){
+    float gap;
+    if(sscanf(&BUFF[start], "(thermal_gap %f)", &gap) != 1){
+      printf("Thermal gap error\n");
+      return NULL;
+    }
+    pcb->zones->thermal_gap = gap;
+  }
   return NULL;
 }
 
-static int *handle_curve(uint64_t start, uint64_t end){
+static int *handle_thermal_bridge_width(uint64_t start, uint64_t end){
+  if(pcb->zones && pcb->zones->index.set == SECTION_SET){
+    float width;
+    if(sscanf(&BUFF[start], "(thermal_bridge_width %f)", &width) != 1){
+      printf("Thermal bridge width error\n");
+      return NULL;
+    }
+    pcb->zones->thermal_bridge_width = width;
+  }
   return NULL;
 }
 
-static int *handle_bounding_box(uint64_t start, uint64_t end){
+static int *handle_locked(uint64_t start, uint64_t end){
+  struct Footprint *footprint = pcb->footprints;
+  if(footprint && footprint->index.set == SECTION_SET && !(footprint->pads && footprint->pads->index.set == SECTION_SET) &&
+     !(footprint->properties && footprint->properties->index.set == SECTION_SET)){
+    char value[TOKEN_SZ] = "yes";
+    sscanf(&BUFF[start], "(locked %15[a-z])", value);
+    footprint->locked = strcmp(value, "no") != 0;
+  }
   return NULL;
 }
-*/
+
+// gr_line, gr_arc, gr_circle, gr_rect and gr_poly, the type comes from the
+// keyword
+static int *handle_drawing(uint64_t start, uint64_t end){
+  static const char *keywords[] = {"gr_line", "gr_arc", "gr_circle", "gr_rect", "gr_poly"};
+  struct Drawing *drawing = calloc(1, sizeof(struct Drawing));
+  set_section_index(start, end, &drawing->index);
+  for(int i = 0; i < 5; i++){
+    size_t length = strlen(keywords[i]);
+    if(strncmp(&BUFF[start + 1], keywords[i], length) == 0 && (unsigned char)BUFF[start + 1 + length] <= ' '){
+      drawing->type = DRAWING_LINE + i;
+    }
+  }
+  PUSH(drawing, pcb->graphics.drawings);
+  return &drawing->index.set;
+}
+
+// Circles keep their centre as the start
+static int *handle_center(uint64_t start, uint64_t end){
+  struct Point point;
+  if(sscanf(&BUFF[start], "(center %f %f)", &point.x, &point.y) != 2){
+    fprintf(stderr, "Weird center\n");
+  }
+  if(open_drawing()){
+    open_drawing()->start = point;
+  }else if(open_fp_circle()){
+    open_fp_circle()->center = point;
+  }
+  return NULL;
+}
+
+// fp_rect, fp_circle, fp_arc and fp_poly, each into its own list
+static int *handle_fp_shape(uint64_t start, uint64_t end){
+  struct Footprint *footprint = open_footprint();
+  if(footprint == NULL){
+    return NULL;
+  }
+  if(strncmp(&BUFF[start], "(fp_rect", 8) == 0){
+    struct Rect *rect = calloc(1, sizeof(struct Rect));
+    set_section_index(start, end, &rect->index);
+    PUSH(rect, footprint->fp_rects);
+    return &rect->index.set;
+  }else if(strncmp(&BUFF[start], "(fp_circle", 10) == 0){
+    struct Circle *circle = calloc(1, sizeof(struct Circle));
+    set_section_index(start, end, &circle->index);
+    PUSH(circle, footprint->fp_circles);
+    return &circle->index.set;
+  }else if(strncmp(&BUFF[start], "(fp_arc", 7) == 0){
+    struct Footprint_Arc *arc = calloc(1, sizeof(struct Footprint_Arc));
+    set_section_index(start, end, &arc->index);
+    PUSH(arc, footprint->fp_arcs);
+    return &arc->index.set;
+  }
+  struct Polygon *polygon = calloc(1, sizeof(struct Polygon));
+  set_section_index(start, end, &polygon->index);
+  PUSH(polygon, footprint->fp_poly);
+  return &polygon->index.set;
+}
+
@@ -0,0 +1,741 @@
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "solver.h"
+
+// Placer
+// Simulated annealing over footprint positions. The cost is the half
+// perimeter wirelength of every net plus the area footprint boxes overlap
+// on one side of the board times a weight that grows as it cools. A move
+// displaces a footprint within a range that shrinks as the temperature
+// falls, or swaps it with the footprint found at the target, or turns it a
+// quarter. Only the nets on the moved footprints are looked at, their boxes
+// are updated from the moved pins and rebuilt only when a pin leaves an
+// edge. Overlap comes from
+// a grid of bins twice the furthest any footprint reaches from its origin,
+// so only the 3x3 bins round a footprint's origin can hold one it touches.
+//
+// Locked footprints and those cutting the board on Edge.Cuts stay put but
+// still count. No move takes a footprint outside the box round the board
+// outline and every footprint as placed. With an outline a footprint's box
+// must also lie on the board at least half the spacing off its edge: moves
+// that take a box further from that are turned down and how far each falls
+// short is costed like overlap, so those placed off the board come on and
+// stay on. Each thread anneals its own chain from the same start with its
+// own seed, the cheapest result goes into the board.
+
+#define PLACE_MOVES 10
+#define PLACE_SPACING 0.25f
+#define PLACE_OVERLAP_WEIGHT 10.0f
+#define PLACE_NET_MAX 500
+#define PLACE_SWAP_RATE 0.5
+#define PLACE_TURN_RATE 0.1
+#define PLACE_TEMPERATURES 400
+#define PLACE_TARGET_RATE 0.44
+#define PLACE_FULL_REBUILD 8
+#define PLACE_WEIGHT_GROWTH 1.05
+
+// A footprint, box is its body's box in its own frame grown by half the
+// spacing
+struct Place_Part {
+  struct Footprint *footprint;
+  struct Box box;
+  int locked, side;
+  int pin_start, pin_count;
+};
+
+// A pad on a net, at its offset in the footprint's frame
+struct Place_Pin {
+  int part, net;
+  struct Point offset;
+};
+
+struct Placer {
+  struct Board *board;
+  struct Place_Options options;
+  struct Place_Part *parts;
+  int part_count, *movable, movable_count;
+  struct Place_Pin *pins;
+  int pin_count;
+  // Pins grouped by net
+  int *net_start, *net_pins, net_count;
+  // NULL when the board has no outline
+  const struct Board_Outline *outline;
+  struct Box region;
+  float bin;
+  int bx, by;
+};
+
+struct Place_Pose {
+  float x, y, angle, cos, sin;
+};
+
+struct Place_Chain {
+  const struct Placer *placer;
+  uint64_t random;
+  struct Place_Pose *pose;
+  struct Box *net_box, *new_box;
+  uint32_t *net_stamp, stamp;
+  int *touched, touched_count;
+  int *bin_head, *bin_next, *bin_prev, *part_bin;
+  float *excess;
+  double wirelength, overlap, outside, cost, weight;
+  uint64_t moves, accepted;
+  uint32_t temperatures;
+};
+
+static uint64_t next_random(uint64_t *state){
+  // xorshift64*
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * 0x2545F4914F6CDD1Dull;
+}
+
+static double random_unit(uint64_t *state){
+  return (double)(next_random(state) >> 11) / (double)(1ull << 53);
+}
+
+// Poses
+
+static struct Place_Pose make_pose(float x, float y, float angle){
+  double radians = angle * M_PI / 180.0;
+  return (struct Place_Pose){x, y, angle, (float)cos(radians), (float)sin(radians)};
+}
+
+// Same turn as rotate_point
+static struct Point place_point(const struct Place_Pose *pose, struct Point offset){
+  return (struct Point){pose->x + offset.x * pose->cos + offset.y * pose->sin, pose->y - offset.x * pose->sin + offset.y * pose->cos};
+}
+
+static struct Box part_box(const struct Placer *placer, const struct Place_Pose *pose, int part){
+  struct Box local = placer->parts[part].box, box = {INFINITY, INFINITY, -INFINITY, -INFINITY};
+  struct Point corners[4] = {{local.min_x, local.min_y}, {local.max_x, local.min_y}, {local.max_x, local.max_y}, {local.min_x, local.max_y}};
+  for(int i = 0; i < 4; i++){
+    struct Point corner = place_point(pose, corners[i]);
+    box.min_x = fminf(box.min_x, corner.x);
+    box.min_y = fminf(box.min_y, corner.y);
+    box.max_x = fmaxf(box.max_x, corner.x);
+    box.max_y = fmaxf(box.max_y, corner.y);
+  }
+  return box;
+}
+
+// Lines on Edge.Cuts shape the board, moving them would move its edge
+static int cuts_board(const struct Footprint *footprint){
+  for(const struct Line *line = footprint->fp_lines; line; line = line->next){
+    if(line->layer && line->layer->canonical_name.chars && strcmp(line->layer->canonical_name.chars, "Edge.Cuts") == 0){
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+static int inside_region(const struct Placer *placer, const struct Box *box){
+  return box->min_x >= placer->region.min_x - 1e-3f && box->min_y >= placer->region.min_y - 1e-3f &&
+         box->max_x <= placer->region.max_x + 1e-3f && box->max_y <= placer->region.max_y + 1e-3f;
+}
+
+// How far the part's box at pose falls short of lying on the board half
+// the spacing off its edge, 0 when it does or the board has no outline.
+// Boxes off or across the edge add how far their corners are out.
+static float edge_excess(const struct Placer *placer, const struct Place_Pose *pose, int part){
+  const struct Board_Outline *outline = placer->outline;
+  if(outline == NULL || placer->parts[part].locked){
+    return 0;
+  }
+  struct Box local = placer->parts[part].box;
+  struct Point corners[4] = {{local.min_x, local.min_y}, {local.max_x, local.min_y}, {local.max_x, local.max_y}, {local.min_x, local.max_y}};
+  for(int i = 0; i < 4; i++){
+    corners[i] = place_point(pose, corners[i]);
+  }
+  float margin = placer->options.spacing / 2, distance = INFINITY;
+  for(int i = 0; i < 4 && distance > 0; i++){
+    distance = fminf(distance, board_edge_distance(outline, corners[i], corners[(i + 1) % 4]));
+  }
+  // A ring wholly inside the box is a cutout under it
+  for(const struct Ring *ring = outline->rings; ring && distance > 0; ring = ring->next){
+    float x = ring->x[0] - pose->x, y = ring->y[0] - pose->y;
+    float local_x = x * pose->cos - y * pose->sin, local_y = x * pose->sin + y * pose->cos;
+    distance = local_x >= local.min_x && local_x <= local.max_x && local_y >= local.min_y && local_y <= local.max_y ? 0 : distance;
+  }
+  if(distance > 0 && board_contains_point(outline, corners[0])){
+    return distance >= margin ? 0 : margin - distance;
+  }
+  float excess = margin;
+  for(int i = 0; i < 4; i++){
+    excess += board_contains_point(outline, corners[i]) ? 0 : board_edge_distance(outline, corners[i], corners[i]);
+  }
+  return excess;
+}
+
+// Nets
+
+static struct Box empty_box(){
+  return (struct Box){INFINITY, INFINITY, -INFINITY, -INFINITY};
+}
+
+static void box_grow(struct Box *box, struct Point point){
+  box->min_x = fminf(box->min_x, point.x);
+  box->min_y = fminf(box->min_y, point.y);
+  box->max_x = fmaxf(box->max_x, point.x);
+  box->max_y = fmaxf(box->max_y, point.y);
+}
+
+static double box_length(const struct Box *box){
+  return box->max_x >= box->min_x ? (double)(box->max_x - box->min_x) + (box->max_y - box->min_y) : 0;
+}
+
+static struct Box net_box(const struct Place_Chain *chain, int net){
+  const struct Placer *placer = chain->placer;
+  struct Box box = empty_box();
+  for(int i = placer->net_start[net]; i < placer->net_start[net + 1]; i++){
+    const struct Place_Pin *pin = &placer->pins[placer->net_pins[i]];
+    box_grow(&box, place_point(&chain->pose[pin->part], pin->offset));
+  }
+  return box;
+}
+
+static int on_edge(const struct Box *box, struct Point point){
+  return point.x <= box->min_x || point.x >= box->max_x || point.y <= box->min_y || point.y >= box->max_y;
+}
+
+// Marks the nets of part as touched and updates their proposed boxes for
+// the part moving from before to after. A pin leaving an edge of the old
+// box means the box has to be rebuilt, done once all moves are in.
+static void touch_nets(struct Place_Chain *chain, int part, const struct Place_Pose *before, const struct Place_Pose *after){
+  const struct Placer *placer = chain->placer;
+  const struct Place_Part *place_part = &placer->parts[part];
+  for(int i = 0; i < place_part->pin_count; i++){
+    const struct Place_Pin *pin = &placer->pins[place_part->pin_start + i];
+    int net = pin->net;
+    if(chain->net_stamp[net] != chain->stamp){
+      chain->net_stamp[net] = chain->stamp;
+      chain->new_box[net] = chain->net_box[net];
+      chain->touched[chain->touched_count++] = net;
+    }
+    struct Box *box = &chain->new_box[net];
+    if(box->min_x > box->max_x){
+      continue;
+    }
+    if(on_edge(&chain->net_box[net], place_point(before, pin->offset))){
+      // Rebuilt later
+      box->min_x = INFINITY, box->max_x = -INFINITY;
+      continue;
+    }
+    box_grow(box, place_point(after, pin->offset));
+  }
+}
+
+static double touched_delta(struct Place_Chain *chain){
+  double delta = 0;
+  for(int i = 0; i < chain->touched_count; i++){
+    int net = chain->touched[i];
+    if(chain->new_box[net].min_x > chain->new_box[net].max_x){
+      chain->new_box[net] = net_box(chain, net);
+    }
+    delta += box_length(&chain->new_box[net]) - box_length(&chain->net_box[net]);
+  }
+  return delta;
+}
+
+// Bins
+
+static int bin_of(const struct Placer *placer, const struct Place_Pose *pose){
+  int x = (int)((pose->x - placer->region.min_x) / placer->bin), y = (int)((pose->y - placer->region.min_y) / placer->bin);
+  x = x < 0 ? 0 : (x >= placer->bx ? placer->bx - 1 : x);
+  y = y < 0 ? 0 : (y >= placer->by ? placer->by - 1 : y);
+  return y * placer->bx + x;
+}
+
+static void bin_remove(struct Place_Chain *chain, int part){
+  int bin = chain->part_bin[part];
+  if(chain->bin_prev[part] >= 0){
+    chain->bin_next[chain->bin_prev[part]] = chain->bin_next[part];
+  }else{
+    chain->bin_head[bin] = chain->bin_next[part];
+  }
+  if(chain->bin_next[part] >= 0){
+    chain->bin_prev[chain->bin_next[part]] = chain->bin_prev[part];
+  }
+}
+
+static void bin_insert(struct Place_Chain *chain, int part){
+  int bin = bin_of(chain->placer, &chain->pose[part]);
+  chain->part_bin[part] = bin;
+  chain->bin_prev[part] = -1;
+  chain->bin_next[part] = chain->bin_head[bin];
+  if(chain->bin_head[bin] >= 0){
+    chain->bin_prev[chain->bin_head[bin]] = part;
+  }
+  chain->bin_head[bin] = part;
+}
+
+static double box_overlap(const struct Box *_1, const struct Box *_2){
+  float width = fminf(_1->max_x, _2->max_x) - fmaxf(_1->min_x, _2->min_x);
+  float height = fminf(_1->max_y, _2->max_y) - fmaxf(_1->min_y, _2->min_y);
+  return width > 0 && height > 0 ? (double)width * height : 0;
+}
+
+// Area part covers of every other footprint on its side but skip, at pose
+static double part_overlap(const struct Place_Chain *chain, int part, const struct Place_Pose *pose, int skip){
+  const struct Placer *placer = chain->placer;
+  struct Box box = part_box(placer, pose, part);
+  int bin = bin_of(placer, pose), bx = bin % placer->bx, by = bin / placer->bx;
+  double area = 0;
+  for(int y = by - 1; y <= by + 1; y++){
+    for(int x = bx - 1; x <= bx + 1; x++){
+      if(x < 0 || y < 0 || x >= placer->bx || y >= placer->by){
+        continue;
+      }
+      for(int other = chain->bin_head[y * placer->bx + x]; other >= 0; other = chain->bin_next[other]){
+        if(other != part && other != skip && placer->parts[other].side == placer->parts[part].side){
+          struct Box other_box = part_box(placer, &chain->pose[other], other);
+          area += box_overlap(&box, &other_box);
+        }
+      }
+    }
+  }
+  return area;
+}
+
+// A footprint whose centre is in the bin the point falls in, -1 if none
+static int part_at(struct Place_Chain *chain, float x, float y, int part){
+  struct Place_Pose point = {x, y, 0, 1, 0};
+  int count = 0, found = -1;
+  for(int other = chain->bin_head[bin_of(chain->placer, &point)]; other >= 0; other = chain->bin_next[other]){
+    if(other != part && !chain->placer->parts[other].locked && next_random(&chain->random) % ++count == 0){
+      found = other;
+    }
+  }
+  return found;
+}
+
+// Annealing
+
+// Tries one move, keeping it if the Metropolis rule says so
+static int try_move(struct Place_Chain *chain, float range, double temperature){
+  const struct Placer *placer = chain->placer;
+  double weight = chain->weight;
+  int part = placer->movable[next_random(&chain->random) % placer->movable_count], other = -1;
+  struct Place_Pose before = chain->pose[part], after = before, other_before, other_after;
+  double choice = random_unit(&chain->random);
+  if(choice < PLACE_TURN_RATE){
+    after = make_pose(before.x, before.y, fmodf(before.angle + 90, 360));
+  }else{
+    float x = before.x + (float)((2 * random_unit(&chain->random) - 1) * range), y = before.y + (float)((2 * random_unit(&chain->random) - 1) * range);
+    other = choice < PLACE_TURN_RATE + PLACE_SWAP_RATE ? part_at(chain, x, y, part) : -1;
+    if(other >= 0){
+      other_before = chain->pose[other];
+      after = make_pose(other_before.x, other_before.y, before.angle);
+      other_after = make_pose(before.x, before.y, other_before.angle);
+    }else{
+      after = make_pose(x, y, before.angle);
+    }
+  }
+  struct Box box = part_box(placer, &after, part);
+  float excess = edge_excess(placer, &after, part), other_excess = 0;
+  if(!inside_region(placer, &box) || (excess > 0 && excess > chain->excess[part])){
+    return FALSE;
+  }
+  if(other >= 0){
+    struct Box other_box = part_box(placer, &other_after, other);
+    other_excess = edge_excess(placer, &other_after, other);
+    if(!inside_region(placer, &other_box) || (other_excess > 0 && other_excess > chain->excess[other])){
+      return FALSE;
+    }
+  }
+  chain->moves++;
+  double outside = excess - chain->excess[part] + (other >= 0 ? other_excess - chain->excess[other] : 0);
+
+  double overlap = -part_overlap(chain, part, &before, other);
+  if(other >= 0){
+    overlap -= part_overlap(chain, other, &other_before, part);
+    struct Box box_1 = part_box(placer, &before, part), box_2 = part_box(placer, &other_before, other);
+    overlap -= placer->parts[part].side == placer->parts[other].side ? box_overlap(&box_1, &box_2) : 0;
+  }
+  // Overlap at the new poses is counted with the moved parts in place
+  bin_remove(chain, part);
+  chain->pose[part] = after;
+  bin_insert(chain, part);
+  if(other >= 0){
+    bin_remove(chain, other);
+    chain->pose[other] = other_after;
+    bin_insert(chain, other);
+  }
+  overlap += part_overlap(chain, part, &after, other);
+  if(other >= 0){
+    overlap += part_overlap(chain, other, &other_after, part);
+    struct Box box_1 = part_box(placer, &after, part), box_2 = part_box(placer, &other_after, other);
+    overlap += placer->parts[part].side == placer->parts[other].side ? box_overlap(&box_1, &box_2) : 0;
+  }
+
+  if(++chain->stamp == 0){
+    memset(chain->net_stamp, 0, placer->net_count * sizeof(uint32_t));
+    chain->stamp = 1;
+  }
+  chain->touched_count = 0;
+  touch_nets(chain, part, &before, &after);
+  if(other >= 0){
+    touch_nets(chain, other, &other_before, &other_after);
+  }
+  double wirelength = touched_delta(chain), delta = wirelength + weight * (overlap + outside);
+
+  if(delta <= 0 || (temperature > 0 && random_unit(&chain->random) < exp(-delta / temperature))){
+    for(int i = 0; i < chain->touched_count; i++){
+      chain->net_box[chain->touched[i]] = chain->new_box[chain->touched[i]];
+    }
+    chain->excess[part] = excess;
+    if(other >= 0){
+      chain->excess[other] = other_excess;
+    }
+    chain->wirelength += wirelength;
+    chain->overlap += overlap;
+    chain->outside += outside;
+    chain->cost += delta;
+    chain->accepted++;
+    return TRUE;
+  }
+  bin_remove(chain, part);
+  chain->pose[part] = before;
+  bin_insert(chain, part);
+  if(other >= 0){
+    bin_remove(chain, other);
+    chain->pose[other] = other_before;
+    bin_insert(chain, other);
+  }
+  return FALSE;
+}
+
+// Wirelength, overlap and how far parts are off the board from scratch,
+// the running sums drift
+static void chain_totals(struct Place_Chain *chain){
+  const struct Placer *placer = chain->placer;
+  chain->wirelength = 0;
+  for(int net = 0; net < placer->net_count; net++){
+    chain->net_box[net] = net_box(chain, net);
+    chain->wirelength += box_length(&chain->net_box[net]);
+  }
+  chain->overlap = 0;
+  chain->outside = 0;
+  for(int part = 0; part < placer->part_count; part++){
+    chain->overlap += part_overlap(chain, part, &chain->pose[part], -1) / 2;
+    chain->excess[part] = edge_excess(placer, &chain->pose[part], part);
+    chain->outside += chain->excess[part];
+  }
+  chain->cost = chain->wirelength + chain->weight * (chain->overlap + chain->outside);
+}
+
+static void chain_init(struct Place_Chain *chain, const struct Placer *placer, uint64_t seed){
+  memset(chain, 0, sizeof(struct Place_Chain));
+  chain->placer = placer;
+  chain->random = seed ? seed : 1;
+  chain->weight = placer->options.overlap_weight;
+  chain->pose = malloc((placer->part_count ? placer->part_count : 1) * sizeof(struct Place_Pose));
+  chain->net_box = malloc((placer->net_count ? placer->net_count : 1) * sizeof(struct Box));
+  chain->new_box = malloc((placer->net_count ? placer->net_count : 1) * sizeof(struct Box));
+  chain->net_stamp = calloc(placer->net_count ? placer->net_count : 1, sizeof(uint32_t));
+  chain->touched = malloc((placer->pin_count ? placer->pin_count : 1) * sizeof(int));
+  chain->bin_head = malloc(placer->bx * placer->by * sizeof(int));
+  chain->bin_next = malloc((placer->part_count ? placer->part_count : 1) * sizeof(int));
+  chain->bin_prev = malloc((placer->part_count ? placer->part_count : 1) * sizeof(int));
+  chain->part_bin = malloc((placer->part_count ? placer->part_count : 1) * sizeof(int));
+  chain->excess = malloc((placer->part_count ? placer->part_count : 1) * sizeof(float));
+  for(int i = 0; i < placer->bx * placer->by; i++){
+    chain->bin_head[i] = -1;
+  }
+  for(int part = 0; part < placer->part_count; part++){
+    struct at at = placer->parts[part].footprint->at;
+    chain->pose[part] = make_pose(at.x, at.y, at.angle);
+    bin_insert(chain, part);
+  }
+  chain_totals(chain);
+}
+
+static void chain_free(struct Place_Chain *chain){
+  free(chain->pose);
+  free(chain->net_box);
+  free(chain->new_box);
+  free(chain->net_stamp);
+  free(chain->touched);
+  free(chain->bin_head);
+  free(chain->bin_next);
+  free(chain->bin_prev);
+  free(chain->part_bin);
+  free(chain->excess);
+}
+
+// The schedule adapts to how many moves get taken: the start is hot enough
+// to take most, the range shrinks towards an acceptance of
+// PLACE_TARGET_RATE and cooling is slow while the rate is in the middle
+static void anneal(struct Place_Chain *chain){
+  const struct Placer *placer = chain->placer;
+  int moves = (int)(placer->options.effort * PLACE_MOVES * pow(placer->movable_count, 4.0 / 3.0));
+  moves = moves < 1 ? 1 : moves;
+  float range = fmaxf(placer->region.max_x - placer->region.min_x, placer->region.max_y - placer->region.min_y);
+  float range_min = placer->bin / 4;
+
+  // Start from the spread of random moves, all taken
+  double sum = 0, sum2 = 0;
+  int samples = placer->movable_count < 64 ? 64 : placer->movable_count;
+  for(int i = 0; i < samples; i++){
+    double cost = chain->cost;
+    try_move(chain, range, INFINITY);
+    sum += chain->cost - cost;
+    sum2 += (chain->cost - cost) * (chain->cost - cost);
+  }
+  double temperature = 20 * sqrt(fmax(0, sum2 / samples - (sum / samples) * (sum / samples)));
+  chain_totals(chain);
+
+  double stop = placer->net_count ? 0.005 * chain->cost / placer->net_count : 0;
+  while(chain->temperatures < PLACE_TEMPERATURES && temperature > stop){
+    uint64_t accepted = chain->accepted;
+    for(int i = 0; i < moves; i++){
+      try_move(chain, range, temperature);
+    }
+    double rate = (double)(chain->accepted - accepted) / moves;
+    temperature *= rate > 0.96 ? 0.5 : (rate > 0.8 ? 0.9 : (rate > 0.15 ? 0.95 : 0.8));
+    range = fmaxf(range_min, fminf(range * (float)(1 - PLACE_TARGET_RATE + rate), placer->region.max_x - placer->region.min_x));
+    // Overlap gets dearer as it cools so the end has none
+    chain->weight *= PLACE_WEIGHT_GROWTH;
+    if(++chain->temperatures % PLACE_FULL_REBUILD == 0){
+      chain_totals(chain);
+    }else{
+      chain->cost = chain->wirelength + chain->weight * (chain->overlap + chain->outside);
+    }
+  }
+  // A cold pass keeps only what helps
+  for(int i = 0; i < moves; i++){
+    try_move(chain, range_min, 0);
+  }
+  chain_totals(chain);
+}
+
+struct Place_Worker {
+  const struct Placer *placer;
+  struct Place_Chain *chains;
+  int chain_count, *next;
+};
+
+static void *place_worker(void *arg){
+  struct Place_Worker *worker = arg;
+  pcb = worker->placer->board;
+  while(TRUE){
+    int i = __atomic_fetch_add(worker->next, 1, __ATOMIC_RELAXED);
+    if(i >= worker->chain_count){
+      break;
+    }
+    anneal(&worker->chains[i]);
+  }
+  return NULL;
+}
+
+// Setup
+
+static int build_placer(struct Placer *placer){
+  int part_count = 0, pin_count = 0, max_ordinal = 0;
+  for(struct Footprint *footprint = pcb->footprints; footprint; footprint = footprint->next, part_count++){
+    for(struct Pad *pad = footprint->pads; pad; pad = pad->next){
+      pin_count += pad->net && pad->net->ordinal > 0;
+      max_ordinal = pad->net && pad->net->ordinal > max_ordinal ? pad->net->ordinal : max_ordinal;
+    }
+  }
+  if(part_count == 0){
+    return ERROR;
+  }
+  if(pcb->bodies == NULL){
+    footprint_bodies_init();
+  }
+  placer->parts = calloc(part_count, sizeof(struct Place_Part));
+  placer->movable = malloc(part_count * sizeof(int));
+  placer->pins = malloc((pin_count ? pin_count : 1) * sizeof(struct Place_Pin));
+  int *pins_on = calloc(max_ordinal + 1, sizeof(int));
+  for(struct Footprint *footprint = pcb->footprints; footprint; footprint = footprint->next){
+    for(struct Pad *pad = footprint->pads; pad; pad = pad->next){
+      pins_on[pad->net ? pad->net->ordinal : 0]++;
+    }
+  }
+  // Nets numbered densely, one pin nets and the huge ones that are planes
+  // in all but name left out
+  int *dense = malloc((max_ordinal + 1) * sizeof(int));
+  placer->region = empty_box();
+  for(int ordinal = 0; ordinal <= max_ordinal; ordinal++){
+    dense[ordinal] = ordinal > 0 && pins_on[ordinal] >= 2 && pins_on[ordinal] <= PLACE_NET_MAX ? placer->net_count++ : -1;
+  }
+  float largest = 0;
+  for(struct Footprint *footprint = pcb->footprints; footprint; footprint = footprint->next){
+    struct Place_Part *part = &placer->parts[placer->part_count];
+    part->footprint = footprint;
+    part->locked = footprint->locked || cuts_board(footprint);
+    part->side = footprint->layer && strcmp(footprint->layer->canonical_name.chars, "B.Cu") == 0;
+    part->box = footprint->body->box;
+    part->box.min_x -= placer->options.spacing / 2, part->box.min_y -= placer->options.spacing / 2;
+    part->box.max_x += placer->options.spacing / 2, part->box.max_y += placer->options.spacing / 2;
+    largest = fmaxf(largest, hypotf(fmaxf(-part->box.min_x, part->box.max_x), fmaxf(-part->box.min_y, part->box.max_y)));
+    part->pin_start = placer->pin_count;
+    for(struct Pad *pad = footprint->pads; pad; pad = pad->next){
+      if(pad->net && pad->net->ordinal > 0 && dense[pad->net->ordinal] >= 0){
+        placer->pins[placer->pin_count++] = (struct Place_Pin){placer->part_count, dense[pad->net->ordinal], {pad->at.x, pad->at.y}};
+      }
+    }
+    part->pin_count = placer->pin_count - part->pin_start;
+    if(!part->locked){
+      placer->movable[placer->movable_count++] = placer->part_count;
+    }
+    struct Box box = footprint_box(footprint);
+    placer->region.min_x = fminf(placer->region.min_x, box.min_x - placer->options.spacing / 2);
+    placer->region.min_y = fminf(placer->region.min_y, box.min_y - placer->options.spacing / 2);
+    placer->region.max_x = fmaxf(placer->region.max_x, box.max_x + placer->options.spacing / 2);
+    placer->region.max_y = fmaxf(placer->region.max_y, box.max_y + placer->options.spacing / 2);
+    placer->part_count++;
+  }
+  if(pcb->outline == NULL){
+    board_outline_init(0);
+  }
+  if(pcb->outline->rings){
+    placer->outline = pcb->outline;
+    placer->region.min_x = fminf(placer->region.min_x, pcb->outline->box.min_x);
+    placer->region.min_y = fminf(placer->region.min_y, pcb->outline->box.min_y);
+    placer->region.max_x = fmaxf(placer->region.max_x, pcb->outline->box.max_x);
+    placer->region.max_y = fmaxf(placer->region.max_y, pcb->outline->box.max_y);
+  }
+  placer->net_start = calloc(placer->net_count + 1, sizeof(int));
+  placer->net_pins = malloc((placer->pin_count ? placer->pin_count : 1) * sizeof(int));
+  for(int i = 0; i < placer->pin_count; i++){
+    placer->net_start[placer->pins[i].net + 1]++;
+  }
+  for(int net = 0; net < placer->net_count; net++){
+    placer->net_start[net + 1] += placer->net_start[net];
+  }
+  int *fill = malloc((placer->net_count ? placer->net_count : 1) * sizeof(int));
+  memcpy(fill, placer->net_start, placer->net_count * sizeof(int));
+  for(int i = 0; i < placer->pin_count; i++){
+    placer->net_pins[fill[placer->pins[i].net]++] = i;
+  }
+  // Footprints that touch have origins no further apart than twice the
+  // furthest corner from any origin
+  placer->bin = fmaxf(2 * largest, 0.1f);
+  placer->bx = (int)ceilf((placer->region.max_x - placer->region.min_x) / placer->bin);
+  placer->by = (int)ceilf((placer->region.max_y - placer->region.min_y) / placer->bin);
+  placer->bx = placer->bx < 1 ? 1 : placer->bx;
+  placer->by = placer->by < 1 ? 1 : placer->by;
+  free(fill);
+  free(dense);
+  free(pins_on);
+  return SUCCESS;
+}
+
+// Moves the board's footprints to the chain's poses, pad angles are
+// absolute so they turn with their footprint
+static void apply_chain(const struct Place_Chain *chain){
+  const struct Placer *placer = chain->placer;
+  for(int i = 0; i < placer->part_count; i++){
+    struct Footprint *footprint = placer->parts[i].footprint;
+    const struct Place_Pose *pose = &chain->pose[i];
+    if(pose->x == footprint->at.x && pose->y == footprint->at.y && pose->angle == footprint->at.angle){
+      continue;
+    }
+    for(struct Pad *pad = footprint->pads; pad; pad = pad->next){
+      pad->at.angle = fmodf(pad->at.angle + pose->angle - footprint->at.angle + 360, 360);
+    }
+    footprint->at.x = pose->x;
+    footprint->at.y = pose->y;
+    footprint->at.angle = pose->angle;
+    footprint->index.set = SECTION_MODIFIED;
+    net_metrics_footprint(pcb->metrics, footprint);
+  }
+}
+
+// Anneals the placement of every footprint not locked and moves them on
+// the board. Zero options take the defaults: effort 1, 0.25 mm spacing, an
+// overlap weight of 10 per mm^2, one chain per thread and threads <= 0
+// uses every core. Returns the number of footprints moved, stats can be
+// NULL.
+int place_board(const struct Place_Options *options, struct Place_Stats *stats){
+  struct Place_Stats local_stats;
+  struct Placer placer;
+  memset(&placer, 0, sizeof(placer));
+  stats = stats ? stats : &local_stats;
+  memset(stats, 0, sizeof(struct Place_Stats));
+  placer.board = pcb;
+  placer.options = *options;
+  placer.options.effort = options->effort > 0 ? options->effort : 1;
+  placer.options.spacing = options->spacing > 0 ? options->spacing : PLACE_SPACING;
+  placer.options.overlap_weight = options->overlap_weight > 0 ? options->overlap_weight : PLACE_OVERLAP_WEIGHT;
+  placer.options.threads = options->threads > 0 ? options->threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+  placer.options.chains = options->chains > 0 ? options->chains : placer.options.threads;
+  placer.options.seed = options->seed ? options->seed : 0x9E3779B97F4A7C15ull;
+  if(build_placer(&placer) == ERROR){
+    return 0;
+  }
+  int chain_count = placer.options.chains, threads = placer.options.threads < chain_count ? placer.options.threads : chain_count;
+  struct Place_Chain *chains = malloc(chain_count * sizeof(struct Place_Chain));
+  for(int i = 0; i < chain_count; i++){
+    chain_init(&chains[i], &placer, placer.options.seed + 0x9E3779B97F4A7C15ull * (i + 1));
+  }
+  stats->footprints = placer.part_count;
+  stats->movable = placer.movable_count;
+  stats->nets = placer.net_count;
+  stats->chains = chain_count;
+  stats->wirelength_before = chains[0].wirelength;
+  stats->overlap_before = chains[0].overlap;
+  double outside_before = chains[0].outside;
+
+  int moved = 0;
+  if(placer.movable_count > 0){
+    int next = 0;
+    struct Place_Worker worker = {&placer, chains, chain_count, &next};
+    pthread_t *thread = malloc(threads * sizeof(pthread_t));
+    for(int i = 0; i < threads; i++){
+      pthread_create(&thread[i], NULL, place_worker, &worker);
+    }
+    for(int i = 0; i < threads; i++){
+      pthread_join(thread[i], NULL);
+    }
+    free(thread);
+    // Chains are compared at the dearest overlap any of them ended on,
+    // being off the board costs the same
+    int best = 0;
+    double weight = 0;
+    for(int i = 0; i < chain_count; i++){
+      stats->moves += chains[i].moves;
+      stats->accepted += chains[i].accepted;
+      stats->temperatures += chains[i].temperatures;
+      weight = fmax(weight, chains[i].weight);
+    }
+    for(int i = 0; i < chain_count; i++){
+      best = chains[i].wirelength + weight * (chains[i].overlap + chains[i].outside) < chains[best].wirelength + weight * (chains[best].overlap + chains[best].outside) ? i : best;
+    }
+    // Only worth it if the chain beat the start
+    if(chains[best].wirelength + weight * (chains[best].overlap + chains[best].outside) < stats->wirelength_before + weight * (stats->overlap_before + outside_before)){
+      for(int i = 0; i < placer.part_count; i++){
+        struct at at = placer.parts[i].footprint->at;
+        moved += chains[best].pose[i].x != at.x || chains[best].pose[i].y != at.y || chains[best].pose[i].angle != at.angle;
+      }
+      apply_chain(&chains[best]);
+      stats->wirelength = chains[best].wirelength;
+      stats->overlap = chains[best].overlap;
+    }else{
+      stats->wirelength = stats->wirelength_before;
+      stats->overlap = stats->overlap_before;
+    }
+  }
+  if(moved){
+    // The spatial index no longer covers the board. Footprints carrying
+    // edges never move, so the outline still does
+    spatial_index_free(pcb->spatial);
+    pcb->spatial = NULL;
+  }
+
+  for(int i = 0; i < chain_count; i++){
+    chain_free(&chains[i]);
+  }
+  free(chains);
+  free(placer.parts);
+  free(placer.movable);
+  free(placer.pins);
+  free(placer.net_start);
+  free(placer.net_pins);
+  return moved;
+}
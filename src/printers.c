@@ -1,5 +1,11 @@
 #include "solver.h"
 
+// Only good until the next call, each printf below uses one
+static const char *uuid_text(struct Uuid uuid){
+  static _Thread_local char text[40];
+  return uuid_string(uuid, text);
+}
+
 void print_layer(){
   printf("(ORDINAL: %d; CANONICAL_NAME: \"%s\"; TYPE: %d; USER_NAME: \"%s\")\n", pcb->footprints->layer->ordinal, pcb->footprints->layer->canonical_name.chars, pcb->footprints->layer->type, pcb->footprints->layer->user_name.chars);
 }
@@ -8,7 +14,7 @@ void print_footprints(struct Footprint *footprint){
   while(footprint){
     printf("(footprint \"%s\"\n", footprint->library_link.chars);
     printf("(layer %s)\n", footprint->layer->canonical_name.chars);
-    printf("(uuid \"%s\")\n", footprint->uuid.chars);
+    printf("(uuid \"%s\")\n", uuid_text(footprint->uuid));
     printf("(at %f %f %f)\n", footprint->at.x, footprint->at.y, footprint->at.angle);
     printf("(descr \"%s\")\n", footprint->description.chars);
     //print_footprint_properties(footprint->properties);
@@ -32,7 +38,7 @@ void print_footprint_properties(struct Footprint_Property *property){
     printf("(property %s %s\n", property->property->key.chars, property->property->val.chars);
     printf("(at %f %f %f)\n", property->at.x, property->at.y, property->at.angle);
     printf("(layer %s)\n", property->layer ? property->layer->canonical_name.chars : (char *)"NULL");
-    printf("(uuid %s)\n", property->uuid.chars);
+    printf("(uuid %s)\n", uuid_text(property->uuid));
     printf(")\n");
     property = property->next;
   }
@@ -44,7 +50,7 @@ void print_line(struct Line *line){
     printf("(start %f %f)\n", line->start.x, line->start.y);
     printf("(end %f %f)\n", line->end.x, line->end.y);
     printf("(layer %s)\n", line->layer ? line->layer->canonical_name.chars : (char *)"NULL");
-    printf("(uuid %s)\n)\n", line->uuid.chars);
+    printf("(uuid %s)\n)\n", uuid_text(line->uuid));
     line = line->next;
   }
 }
@@ -61,7 +67,7 @@ void print_pad(struct Pad *pad){
     }
     printf(")\n");
     printf("(net %d \"%s\")\n", pad->net->ordinal, pad->net->name.chars);
-    printf("(uuid \"%s\")\n)\n", pad->uuid.chars);
+    printf("(uuid \"%s\")\n)\n", uuid_text(pad->uuid));
     pad = pad->next;
   }
 }
@@ -112,7 +118,7 @@ void print_tracks(struct Track *track){
       printf("(unknown\n");
       break;
     }
-    printf("(uuid %s)\n", track->uuid.chars);
+    printf("(uuid %s)\n", uuid_text(track->uuid));
     track = track->next;
   }
 }
@@ -0,0 +1,236 @@
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "solver.h"
+
+#ifdef PROFILE
+
+// Parser profile
+// Every parsing thread gets its own counters the first time it records,
+// linked onto a global list with a compare and swap so recording never
+// takes a lock. Slots are registered once by name while the token table is
+// built. Self time is a node's time less its profiled children, total
+// includes them and handler is the time spent in the keyword's handler.
+//
+// SOLVER_TRACE=<file> also keeps a Chrome trace event per node down to
+// SOLVER_TRACE_DEPTH levels (3 by default, kicad_pcb is level 1), open it
+// in chrome://tracing or ui.perfetto.dev.
+
+#define PROFILE_DEPTH 64
+#define PROFILE_TRACE_EVENTS (1 << 20)
+
+struct Profile_Counter {
+  uint64_t calls, bytes, self, handler, total;
+};
+
+struct Trace_Event {
+  int slot;
+  uint64_t start, duration, bytes;
+};
+
+struct Profile_Thread {
+  int id;
+  struct Profile_Counter counters[PROFILE_SLOTS];
+  struct Trace_Event *events;
+  uint32_t event_count, event_capacity;
+  uint64_t dropped;
+  struct Profile_Thread *next;
+};
+
+static const char *slot_names[PROFILE_SLOTS];
+static int slot_count = 0;
+static struct Profile_Thread *threads = NULL;
+static int thread_count = 0;
+static const char *trace_path = NULL;
+static int trace_depth = 3;
+static uint64_t base_clock;
+static struct timespec base_time;
+static pthread_mutex_t register_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static _Thread_local struct Profile_Thread *profile_thread = NULL;
+static _Thread_local uint64_t children[PROFILE_DEPTH];
+static _Thread_local int depth = 0;
+
+static inline uint64_t profile_clock(){
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return (uint64_t)time.tv_sec * 1000000000ull + time.tv_nsec;
+#endif
+}
+
+uint64_t profile_now(){
+  return profile_clock();
+}
+
+// Returns the slot of name, registering it the first time, the name must
+// outlive the profile
+int profile_register(const char *name){
+  int slot;
+  pthread_mutex_lock(&register_lock);
+  if(slot_count == 0){
+    base_clock = profile_clock();
+    clock_gettime(CLOCK_MONOTONIC, &base_time);
+    trace_path = getenv("SOLVER_TRACE");
+    if(getenv("SOLVER_TRACE_DEPTH")){
+      trace_depth = atoi(getenv("SOLVER_TRACE_DEPTH"));
+    }
+  }
+  for(slot = 0; slot < slot_count && strcmp(slot_names[slot], name) != 0; slot++);
+  if(slot == slot_count){
+    if(slot_count == PROFILE_SLOTS){
+      // Everything past the table shares the last slot
+      slot = PROFILE_SLOTS - 1;
+    }else{
+      slot_names[slot_count++] = name;
+    }
+  }
+  pthread_mutex_unlock(&register_lock);
+  return slot;
+}
+
+static struct Profile_Thread *thread_counters(){
+  if(profile_thread == NULL){
+    struct Profile_Thread *thread = calloc(1, sizeof(struct Profile_Thread));
+    thread->id = __atomic_add_fetch(&thread_count, 1, __ATOMIC_RELAXED);
+    thread->next = __atomic_load_n(&threads, __ATOMIC_RELAXED);
+    while(!__atomic_compare_exchange_n(&threads, &thread->next, thread, TRUE, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    profile_thread = thread;
+  }
+  return profile_thread;
+}
+
+// Starts a node, returns the clock to hand back to profile_leave
+uint64_t profile_enter(){
+  if(depth + 1 < PROFILE_DEPTH){
+    children[depth + 1] = 0;
+  }
+  depth++;
+  return profile_clock();
+}
+
+void profile_leave(int slot, uint64_t start, uint64_t bytes, uint64_t handler){
+  uint64_t end = profile_clock(), total = end - start;
+  struct Profile_Thread *thread = thread_counters();
+  struct Profile_Counter *counter = &thread->counters[slot];
+  uint64_t nested = depth < PROFILE_DEPTH ? children[depth] : 0;
+  counter->calls++;
+  counter->bytes += bytes;
+  counter->self += total - nested;
+  counter->handler += handler;
+  counter->total += total;
+  if(trace_path && depth <= trace_depth){
+    if(thread->event_count == thread->event_capacity && thread->event_capacity < PROFILE_TRACE_EVENTS){
+      thread->event_capacity = thread->event_capacity ? thread->event_capacity * 2 : 4096;
+      thread->events = realloc(thread->events, thread->event_capacity * sizeof(struct Trace_Event));
+    }
+    if(thread->event_count < thread->event_capacity){
+      thread->events[thread->event_count++] = (struct Trace_Event){slot, start, total, bytes};
+    }else{
+      thread->dropped++;
+    }
+  }
+  depth--;
+  if(depth >= 0 && depth < PROFILE_DEPTH){
+    children[depth] += total;
+  }
+}
+
+// Clock ticks per nanosecond since the first slot was registered
+static double ticks_per_ns(){
+  struct timespec time;
+  uint64_t now = profile_clock();
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  double ns = (time.tv_sec - base_time.tv_sec) * 1e9 + (time.tv_nsec - base_time.tv_nsec);
+  return ns > 0 && now > base_clock ? (now - base_clock) / ns : 1;
+}
+
+static const struct Profile_Counter *sort_counters;
+
+static int compare_self(const void *_1, const void *_2){
+  uint64_t a_1 = sort_counters[*(const int *)_1].self, a_2 = sort_counters[*(const int *)_2].self;
+  return (a_1 < a_2) - (a_1 > a_2);
+}
+
+static void write_trace(double scale){
+  FILE *file = fopen(trace_path, "w");
+  if(file == NULL){
+    perror(trace_path);
+    return;
+  }
+  int first = TRUE;
+  fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  for(struct Profile_Thread *thread = threads; thread; thread = thread->next){
+    for(uint32_t i = 0; i < thread->event_count; i++){
+      struct Trace_Event *event = &thread->events[i];
+      fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"bytes\":%llu}}", first ? "" : ",\n",
+        slot_names[event->slot], thread->id, (event->start - base_clock) / scale / 1e3, event->duration / scale / 1e3, (unsigned long long)event->bytes);
+      first = FALSE;
+    }
+    if(thread->dropped){
+      fprintf(stderr, "Trace dropped %llu events on thread %d\n", (unsigned long long)thread->dropped, thread->id);
+    }
+  }
+  fprintf(file, "\n]}\n");
+  fclose(file);
+  fprintf(stderr, "Trace written to %s\n", trace_path);
+}
+
+// Prints the flat profile summed over every thread to stderr, writes the
+// trace if one was asked for and starts the counters again. Only call while
+// nothing is parsing.
+void profile_dump(){
+  struct Profile_Counter sum[PROFILE_SLOTS];
+  int order[PROFILE_SLOTS];
+  uint64_t self_total = 0;
+  if(slot_count == 0){
+    return;
+  }
+  memset(sum, 0, sizeof(sum));
+  for(struct Profile_Thread *thread = threads; thread; thread = thread->next){
+    for(int i = 0; i < slot_count; i++){
+      sum[i].calls += thread->counters[i].calls;
+      sum[i].bytes += thread->counters[i].bytes;
+      sum[i].self += thread->counters[i].self;
+      sum[i].handler += thread->counters[i].handler;
+      sum[i].total += thread->counters[i].total;
+    }
+  }
+  for(int i = 0; i < slot_count; i++){
+    order[i] = i;
+    self_total += sum[i].self;
+  }
+  sort_counters = sum;
+  qsort(order, slot_count, sizeof(int), compare_self);
+
+  double scale = ticks_per_ns();
+  fprintf(stderr, "Flat profile, %d threads, %.2f ticks/ns\n", thread_count, scale);
+  fprintf(stderr, "%7s %10s %10s %12s %10s %10s %10s %10s  %s\n", "self%", "self ms", "calls", "bytes", "handler ms", "total ms", "ns/call", "MB/s", "name");
+  for(int i = 0; i < slot_count; i++){
+    struct Profile_Counter *counter = &sum[order[i]];
+    if(counter->calls == 0){
+      continue;
+    }
+    double self_ms = counter->self / scale / 1e6, total_ms = counter->total / scale / 1e6;
+    fprintf(stderr, "%6.2f%% %10.3f %10llu %12llu %10.3f %10.3f %10.1f %10.1f  %s\n", self_total ? 100.0 * counter->self / self_total : 0, self_ms,
+      (unsigned long long)counter->calls, (unsigned long long)counter->bytes, counter->handler / scale / 1e6, total_ms,
+      counter->total / scale / counter->calls, total_ms > 0 ? counter->bytes / 1e3 / total_ms : 0, slot_names[order[i]]);
+  }
+
+  if(trace_path){
+    write_trace(scale);
+  }
+  for(struct Profile_Thread *thread = threads; thread; thread = thread->next){
+    memset(thread->counters, 0, sizeof(thread->counters));
+    thread->event_count = 0;
+    thread->dropped = 0;
+  }
+}
+
+#endif
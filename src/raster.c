@@ -0,0 +1,590 @@
+#include <stdio.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "solver.h"
+
+// Copper rasteriser
+// Every track, arc, via, pad and zone fill on the layer becomes a polygon,
+// turned so they all wind the same way, and the layer is the non-zero
+// union of their edges. Edges are bucketed into bands one tile high and the
+// worker threads take a band each, sweeping it with an active edge list.
+// A band only touches its own tiles, tiles nothing covers are never
+// allocated. Depth 1 samples pixel centres, depth 8 takes RASTER_SAMPLES
+// scanlines per row with exact horizontal coverage.
+
+#define RASTER_SAMPLES 4
+#define RASTER_ARC_POINTS 64
+// Chord error for arcs in pixels
+#define RASTER_ARC_ERROR 0.25f
+// Blank border around the copper in mm
+#define RASTER_MARGIN 0.5f
+
+struct Raster_Edge {
+  float x, slope, top, bottom;
+  int winding;
+};
+
+struct Edge_List {
+  struct Raster_Edge *edges;
+  uint32_t count, capacity;
+};
+
+struct Raster_Context {
+  struct Raster *raster;
+  struct Edge_List edges;
+  uint32_t *band_start, *band_edges;
+  int next;
+};
+
+struct Crossing {
+  float x;
+  int winding;
+};
+
+static void add_polygon(struct Edge_List *list, const struct Raster *raster, const struct Point *points, int count){
+  double area = 0;
+  for(int i = 0; i < count; i++){
+    const struct Point *p_1 = &points[i], *p_2 = &points[(i + 1) % count];
+    area += (double)p_1->x * p_2->y - (double)p_2->x * p_1->y;
+  }
+  int turn = area < 0 ? -1 : 1;
+  for(int i = 0; i < count; i++){
+    const struct Point *p_1 = &points[i], *p_2 = &points[(i + 1) % count];
+    float x_1 = (p_1->x - raster->box.min_x) * raster->scale, y_1 = (p_1->y - raster->box.min_y) * raster->scale;
+    float x_2 = (p_2->x - raster->box.min_x) * raster->scale, y_2 = (p_2->y - raster->box.min_y) * raster->scale;
+    if(y_1 == y_2){
+      continue;
+    }
+    if(list->count == list->capacity){
+      list->capacity = list->capacity ? list->capacity * 2 : 4096;
+      list->edges = realloc(list->edges, list->capacity * sizeof(struct Raster_Edge));
+    }
+    struct Raster_Edge *edge = &list->edges[list->count++];
+    int down = y_2 > y_1;
+    edge->top = down ? y_1 : y_2;
+    edge->bottom = down ? y_2 : y_1;
+    edge->x = down ? x_1 : x_2;
+    edge->slope = (x_2 - x_1) / (y_2 - y_1);
+    edge->winding = down ? turn : -turn;
+  }
+}
+
+static void add_capsule(struct Edge_List *list, const struct Raster *raster, struct Point start, struct Point end, float width){
+  struct Point outline[PAD_OUTLINE_MAX];
+  add_polygon(list, raster, outline, capsule_outline(start, end, width / 2, outline));
+}
+
+static void collect_edges(struct Edge_List *list, const struct Raster *raster, struct Layer *layer){
+  struct Point points[RASTER_ARC_POINTS];
+  for(struct Zone *zone = pcb->zones; zone; zone = zone->next){
+    for(struct Polygon *polygon = &zone->filled_polygon; polygon; polygon = polygon->next){
+      int count = polygon->point_index ? polygon->point_index : polygon->point_count;
+      if(polygon->points && count >= 3 && (polygon->layer ? polygon->layer : zone->layer) == layer){
+        add_polygon(list, raster, polygon->points, count);
+      }
+    }
+  }
+  for(struct Track *track = pcb->tracks; track; track = track->next){
+    if(track->type == TRACK_TYPE_SEG && track->track.segment.layer == layer){
+      add_capsule(list, raster, track->track.segment.start, track->track.segment.end, track->track.segment.width);
+    }else if(track->type == TRACK_TYPE_ARC && track->track.arc.layer == layer){
+      struct Arc *arc = &track->track.arc;
+      int count = arc_points(arc->start, arc->mid, arc->end, RASTER_ARC_ERROR / raster->scale, points, RASTER_ARC_POINTS);
+      for(int i = 1; i < count; i++){
+        add_capsule(list, raster, points[i - 1], points[i], arc->width);
+      }
+    }else if(track->type == TRACK_TYPE_VIA && via_on_layer(&track->track.via, layer)){
+      struct Point at = {track->track.via.at.x, track->track.via.at.y};
+      add_capsule(list, raster, at, at, track->track.via.size);
+    }
+  }
+  for(struct Footprint *footprint = pcb->footprints; footprint; footprint = footprint->next){
+    for(struct Pad *pad = footprint->pads; pad; pad = pad->next){
+      if(pad_on_layer(pad, layer)){
+        add_polygon(list, raster, points, pad_outline(footprint, pad, 0, points));
+      }
+    }
+  }
+}
+
+static void extend_box(struct Box *box, struct Point point, float radius){
+  box->min_x = fminf(box->min_x, point.x - radius);
+  box->min_y = fminf(box->min_y, point.y - radius);
+  box->max_x = fmaxf(box->max_x, point.x + radius);
+  box->max_y = fmaxf(box->max_y, point.y + radius);
+}
+
+// Bounds of the copper on every layer, so every layer of a board lines up
+struct Box copper_box(){
+  struct Box box = {INFINITY, INFINITY, -INFINITY, -INFINITY};
+  struct Point outline[PAD_OUTLINE_MAX];
+  for(struct Zone *zone = pcb->zones; zone; zone = zone->next){
+    for(struct Polygon *polygon = &zone->filled_polygon; polygon; polygon = polygon->next){
+      int count = polygon->point_index ? polygon->point_index : polygon->point_count;
+      for(int i = 0; polygon->points && i < count; i++){
+        extend_box(&box, polygon->points[i], 0);
+      }
+    }
+  }
+  for(struct Track *track = pcb->tracks; track; track = track->next){
+    if(track->type == TRACK_TYPE_VIA){
+      extend_box(&box, (struct Point){track->track.via.at.x, track->track.via.at.y}, track->track.via.size / 2);
+    }else if(track->type == TRACK_TYPE_SEG){
+      extend_box(&box, track->track.segment.start, track->track.segment.width / 2);
+      extend_box(&box, track->track.segment.end, track->track.segment.width / 2);
+    }else if(track->type == TRACK_TYPE_ARC){
+      // The mid point does not bound the whole arc, the radius does
+      struct Point center;
+      float radius = track->track.arc.width / 2;
+      if(arc_center(track->track.arc.start, track->track.arc.mid, track->track.arc.end, &center)){
+        radius += hypotf(track->track.arc.start.x - center.x, track->track.arc.start.y - center.y);
+        extend_box(&box, center, radius);
+      }else{
+        extend_box(&box, track->track.arc.start, radius);
+        extend_box(&box, track->track.arc.end, radius);
+      }
+    }
+  }
+  for(struct Footprint *footprint = pcb->footprints; footprint; footprint = footprint->next){
+    for(struct Pad *pad = footprint->pads; pad; pad = pad->next){
+      int count = pad_outline(footprint, pad, 0, outline);
+      for(int i = 0; i < count; i++){
+        extend_box(&box, outline[i], 0);
+      }
+    }
+  }
+  return box;
+}
+
+// Adds value to row[from..to), spans never overlap in one scanline so the
+// sum stays within 16 bits
+static void span_add(uint16_t *row, int from, int to, uint16_t value){
+  int x = from;
+#if defined(__SSE2__)
+  __m128i add = _mm_set1_epi16(value);
+  for(; x + 8 <= to; x += 8){
+    __m128i pixels = _mm_loadu_si128((__m128i *)&row[x]);
+    _mm_storeu_si128((__m128i *)&row[x], _mm_add_epi16(pixels, add));
+  }
+#endif
+  for(; x < to; x++){
+    row[x] += value;
+  }
+}
+
+static void span_coverage(uint16_t *row, int width, float from, float to){
+  const float full = 256 / RASTER_SAMPLES;
+  from = fmaxf(from, 0);
+  to = fminf(to, width);
+  if(to <= from){
+    return;
+  }
+  int first = (int)from, last = (int)to;
+  if(first == last){
+    row[first] += (uint16_t)((to - from) * full + 0.5f);
+    return;
+  }
+  row[first] += (uint16_t)((first + 1 - from) * full + 0.5f);
+  span_add(row, first + 1, last, (uint16_t)full);
+  if(last < width){
+    row[last] += (uint16_t)((to - last) * full + 0.5f);
+  }
+}
+
+// Sets the bits of pixels whose centres lie in [from, to)
+static void span_bits(uint8_t *row, int width, float from, float to){
+  int first = (int)ceilf(from - 0.5f), last = (int)ceilf(to - 0.5f);
+  first = first < 0 ? 0 : first;
+  last = last > width ? width : last;
+  if(first >= last){
+    return;
+  }
+  int first_byte = first >> 3, last_byte = (last - 1) >> 3;
+  uint8_t head = 0xFF >> (first & 7), tail = 0xFF << (7 - ((last - 1) & 7));
+  if(first_byte == last_byte){
+    row[first_byte] |= head & tail;
+    return;
+  }
+  row[first_byte] |= head;
+  memset(&row[first_byte + 1], 0xFF, last_byte - first_byte - 1);
+  row[last_byte] |= tail;
+}
+
+static int compare_crossing(const void *_1, const void *_2){
+  float x_1 = ((const struct Crossing *)_1)->x, x_2 = ((const struct Crossing *)_2)->x;
+  return (x_1 > x_2) - (x_1 < x_2);
+}
+
+static void sort_crossings(struct Crossing *crossings, int count){
+  if(count > 32){
+    qsort(crossings, count, sizeof(struct Crossing), compare_crossing);
+    return;
+  }
+  for(int i = 1; i < count; i++){
+    struct Crossing crossing = crossings[i];
+    int j = i - 1;
+    for(; j >= 0 && crossings[j].x > crossing.x; j--){
+      crossings[j + 1] = crossings[j];
+    }
+    crossings[j + 1] = crossing;
+  }
+}
+
+static int compare_top(const void *_1, const void *_2){
+  float t_1 = ((const struct Raster_Edge *)_1)->top, t_2 = ((const struct Raster_Edge *)_2)->top;
+  return (t_1 > t_2) - (t_1 < t_2);
+}
+
+// Copies one finished pixel row into the band's tiles, allocating the ones
+// it is the first to touch
+static void store_row(struct Raster *raster, int y, const uint8_t *row, int dirty_from, int dirty_to){
+  int band = y / RASTER_TILE, line = y % RASTER_TILE;
+  int bytes = raster->depth == 1 ? RASTER_TILE / 8 : RASTER_TILE;
+  int tile_from = dirty_from / RASTER_TILE, tile_to = (dirty_to - 1) / RASTER_TILE;
+  for(int column = tile_from; column <= tile_to && dirty_from < dirty_to; column++){
+    uint8_t **tile = &raster->tiles[band * raster->columns + column];
+    if(*tile == NULL){
+      *tile = calloc(RASTER_TILE, bytes);
+    }
+    memcpy(*tile + line * bytes, row + column * bytes, bytes);
+  }
+}
+
+static void raster_band(struct Raster_Context *context, int band){
+  struct Raster *raster = context->raster;
+  uint32_t *edges = &context->band_edges[context->band_start[band]];
+  uint32_t count = context->band_start[band + 1] - context->band_start[band];
+  int samples = raster->depth == 1 ? 1 : RASTER_SAMPLES;
+  int padded = raster->columns * RASTER_TILE;
+  uint32_t *active = malloc((count ? count : 1) * sizeof(uint32_t)), active_count = 0, next = 0;
+  struct Crossing *crossings = malloc((count ? count : 1) * sizeof(struct Crossing));
+  uint16_t *coverage = raster->depth == 8 ? calloc(padded, sizeof(uint16_t)) : NULL;
+  uint8_t *row = calloc(raster->depth == 1 ? padded / 8 : padded, 1);
+
+  int top = band * RASTER_TILE, bottom = top + RASTER_TILE < raster->height ? top + RASTER_TILE : raster->height;
+  for(int y = top; y < bottom; y++){
+    int dirty_from = padded, dirty_to = 0;
+    for(int sample = 0; sample < samples; sample++){
+      float scan = y + (sample + 0.5f) / samples;
+      while(next < count && context->edges.edges[edges[next]].top <= scan){
+        active[active_count++] = edges[next++];
+      }
+      int crossing_count = 0;
+      uint32_t kept = 0;
+      for(uint32_t i = 0; i < active_count; i++){
+        const struct Raster_Edge *edge = &context->edges.edges[active[i]];
+        if(edge->bottom <= scan){
+          continue;
+        }
+        active[kept++] = active[i];
+        if(edge->top <= scan){
+          crossings[crossing_count++] = (struct Crossing){edge->x + (scan - edge->top) * edge->slope, edge->winding};
+        }
+      }
+      active_count = kept;
+      sort_crossings(crossings, crossing_count);
+      int winding = 0;
+      float start = 0;
+      for(int i = 0; i < crossing_count; i++){
+        if(winding == 0){
+          start = crossings[i].x;
+        }
+        winding += crossings[i].winding;
+        if(winding == 0 && crossings[i].x > start){
+          if(coverage){
+            span_coverage(coverage, raster->width, start, crossings[i].x);
+          }else{
+            span_bits(row, raster->width, start, crossings[i].x);
+          }
+          int from = (int)fmaxf(start, 0), to = (int)fminf(ceilf(crossings[i].x) + 1, raster->width);
+          dirty_from = from < dirty_from ? from : dirty_from;
+          dirty_to = to > dirty_to ? to : dirty_to;
+        }
+      }
+    }
+    if(dirty_from >= dirty_to){
+      continue;
+    }
+    if(coverage){
+      for(int x = dirty_from; x < dirty_to; x++){
+        row[x] = coverage[x] > 255 ? 255 : coverage[x];
+        coverage[x] = 0;
+      }
+    }
+    // Widen to whole tiles so the copy never picks up another row's pixels
+    dirty_from -= dirty_from % RASTER_TILE;
+    dirty_to += (RASTER_TILE - dirty_to % RASTER_TILE) % RASTER_TILE;
+    store_row(raster, y, row, dirty_from, dirty_to);
+    memset(row + (raster->depth == 1 ? dirty_from / 8 : dirty_from), 0, raster->depth == 1 ? (dirty_to - dirty_from) / 8 : dirty_to - dirty_from);
+  }
+  free(active);
+  free(crossings);
+  free(coverage);
+  free(row);
+}
+
+static void *raster_worker(void *arg){
+  struct Raster_Context *context = arg;
+  while(1){
+    int band = __atomic_fetch_add(&context->next, 1, __ATOMIC_RELAXED);
+    if(band >= context->raster->rows){
+      break;
+    }
+    raster_band(context, band);
+  }
+  return NULL;
+}
+
+// Sets up the raster of layer over box, or the copper of the whole board
+// when box is NULL, and buckets the layer's edges into its bands, nothing
+// is drawn yet. Returns ERROR when the layer is not copper or nothing fits.
+static int raster_prepare(struct Raster_Context *context, struct Layer *layer, float dpi, int depth, const struct Box *box){
+  memset(context, 0, sizeof(struct Raster_Context));
+  if(!is_copper(layer) || dpi <= 0 || (depth != 1 && depth != 8)){
+    printf("Can't rasterise %s at %g dpi and depth %d\n", layer ? layer->canonical_name.chars : "(null)", dpi, depth);
+    return ERROR;
+  }
+  struct Raster *raster = calloc(1, sizeof(struct Raster));
+  raster->depth = depth;
+  raster->scale = dpi / 25.4f;
+  if(box){
+    raster->box = *box;
+  }else{
+    raster->box = copper_box();
+    raster->box.min_x -= RASTER_MARGIN, raster->box.min_y -= RASTER_MARGIN;
+    raster->box.max_x += RASTER_MARGIN, raster->box.max_y += RASTER_MARGIN;
+  }
+  if(!(raster->box.max_x > raster->box.min_x && raster->box.max_y > raster->box.min_y)){
+    printf("Nothing to rasterise\n");
+    free(raster);
+    return ERROR;
+  }
+  raster->width = (int)ceilf((raster->box.max_x - raster->box.min_x) * raster->scale);
+  raster->height = (int)ceilf((raster->box.max_y - raster->box.min_y) * raster->scale);
+  raster->columns = (raster->width + RASTER_TILE - 1) / RASTER_TILE;
+  raster->rows = (raster->height + RASTER_TILE - 1) / RASTER_TILE;
+  raster->tiles = calloc((size_t)raster->columns * raster->rows, sizeof(uint8_t *));
+  context->raster = raster;
+
+  collect_edges(&context->edges, raster, layer);
+  if(context->edges.count > 0){
+    qsort(context->edges.edges, context->edges.count, sizeof(struct Raster_Edge), compare_top);
+  }
+
+  // Bucket every edge into each band it crosses, counting first, the bands
+  // keep the edges sorted by top
+  context->band_start = calloc(raster->rows + 1, sizeof(uint32_t));
+  for(uint32_t i = 0; i < context->edges.count; i++){
+    struct Raster_Edge *edge = &context->edges.edges[i];
+    int first = (int)fmaxf(edge->top / RASTER_TILE, 0), last = (int)fminf(edge->bottom / RASTER_TILE, raster->rows - 1);
+    for(int band = first; band <= last; band++){
+      context->band_start[band + 1]++;
+    }
+  }
+  for(int band = 0; band < raster->rows; band++){
+    context->band_start[band + 1] += context->band_start[band];
+  }
+  uint32_t *fill = malloc((raster->rows ? raster->rows : 1) * sizeof(uint32_t));
+  memcpy(fill, context->band_start, raster->rows * sizeof(uint32_t));
+  context->band_edges = malloc((context->band_start[raster->rows] ? context->band_start[raster->rows] : 1) * sizeof(uint32_t));
+  for(uint32_t i = 0; i < context->edges.count; i++){
+    struct Raster_Edge *edge = &context->edges.edges[i];
+    int first = (int)fmaxf(edge->top / RASTER_TILE, 0), last = (int)fminf(edge->bottom / RASTER_TILE, raster->rows - 1);
+    for(int band = first; band <= last; band++){
+      context->band_edges[fill[band]++] = i;
+    }
+  }
+  free(fill);
+  return SUCCESS;
+}
+
+// Frees the edges, the raster stays
+static void raster_release(struct Raster_Context *context){
+  free(context->edges.edges);
+  free(context->band_start);
+  free(context->band_edges);
+}
+
+// threads <= 0 uses every core, never more than there are bands
+static void run_workers(void *(*worker)(void *), void *arg, int threads, int rows){
+  if(threads <= 0){
+    threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  threads = threads > rows ? rows : threads;
+  pthread_t *workers = malloc((threads ? threads : 1) * sizeof(pthread_t));
+  for(int i = 0; i < threads; i++){
+    pthread_create(&workers[i], NULL, worker, arg);
+  }
+  for(int i = 0; i < threads; i++){
+    pthread_join(workers[i], NULL);
+  }
+  free(workers);
+}
+
+// Rasterises the copper of layer at dpi into 1 or 8 bit tiles covering box,
+// or the copper of the whole board when box is NULL. threads <= 0 uses
+// every core. Returns NULL when the layer is not copper or nothing fits.
+struct Raster *rasterise_layer(struct Layer *layer, float dpi, int depth, const struct Box *box, int threads){
+  struct Raster_Context context;
+  if(raster_prepare(&context, layer, dpi, depth, box) == ERROR){
+    return NULL;
+  }
+  run_workers(raster_worker, &context, threads, context.raster->rows);
+  raster_release(&context);
+  return context.raster;
+}
+
+void raster_free(struct Raster *raster){
+  if(raster == NULL){
+    return;
+  }
+  for(int i = 0; i < raster->columns * raster->rows; i++){
+    free(raster->tiles[i]);
+  }
+  free(raster->tiles);
+  free(raster);
+}
+
+// Coverage of one pixel, 0 to 255 at either depth
+uint8_t raster_pixel(const struct Raster *raster, int x, int y){
+  if(x < 0 || y < 0 || x >= raster->width || y >= raster->height){
+    return 0;
+  }
+  const uint8_t *tile = raster->tiles[(y / RASTER_TILE) * raster->columns + x / RASTER_TILE];
+  if(tile == NULL){
+    return 0;
+  }
+  x %= RASTER_TILE, y %= RASTER_TILE;
+  if(raster->depth == 1){
+    return tile[y * (RASTER_TILE / 8) + x / 8] & (0x80 >> (x & 7)) ? 255 : 0;
+  }
+  return tile[y * RASTER_TILE + x];
+}
+
+// Writes depth 1 as a binary PBM with copper black, depth 8 as a binary
+// PGM with copper white
+int raster_write(const struct Raster *raster, const char *path){
+  FILE *file = fopen(path, "wb");
+  if(file == NULL){
+    perror(path);
+    return ERROR;
+  }
+  int bytes = raster->depth == 1 ? RASTER_TILE / 8 : RASTER_TILE;
+  int row_bytes = raster->depth == 1 ? (raster->width + 7) / 8 : raster->width;
+  uint8_t *row = malloc((size_t)raster->columns * bytes);
+  static const uint8_t blank[RASTER_TILE];
+  if(raster->depth == 1){
+    fprintf(file, "P4\n%d %d\n", raster->width, raster->height);
+  }else{
+    fprintf(file, "P5\n%d %d\n255\n", raster->width, raster->height);
+  }
+  for(int y = 0; y < raster->height; y++){
+    for(int column = 0; column < raster->columns; column++){
+      const uint8_t *tile = raster->tiles[(y / RASTER_TILE) * raster->columns + column];
+      memcpy(row + column * bytes, tile ? tile + (y % RASTER_TILE) * bytes : blank, bytes);
+    }
+    fwrite(row, 1, row_bytes, file);
+  }
+  free(row);
+  if(fclose(file) != 0){
+    perror(path);
+    return ERROR;
+  }
+  return SUCCESS;
+}
+
+// XORs tiles first to last of other into raster, freeing other's as it
+// goes and dropping tiles that come out blank. Returns the set pixels left.
+static uint64_t xor_tiles(struct Raster *raster, struct Raster *other, int first, int last){
+  uint64_t pixels = 0;
+  for(int i = first; i < last; i++){
+    uint64_t *tile = (uint64_t *)raster->tiles[i], *with = other ? (uint64_t *)other->tiles[i] : NULL;
+    if(tile == NULL && with){
+      raster->tiles[i] = (uint8_t *)with;
+      other->tiles[i] = NULL;
+      tile = with;
+      with = NULL;
+    }
+    if(tile == NULL){
+      continue;
+    }
+    uint64_t set = 0;
+    for(int word = 0; word < RASTER_TILE * RASTER_TILE / 64; word++){
+      tile[word] ^= with ? with[word] : 0;
+      set += __builtin_popcountll(tile[word]);
+    }
+    if(with){
+      free(with);
+      other->tiles[i] = NULL;
+    }
+    if(set == 0){
+      free(tile);
+      raster->tiles[i] = NULL;
+    }
+    pixels += set;
+  }
+  return pixels;
+}
+
+struct Xor_Context {
+  struct Raster_Context sides[2];
+  int count, next;
+  uint64_t pixels;
+};
+
+// Draws a band of every side and XORs it into the first straight away
+static void *xor_worker(void *arg){
+  struct Xor_Context *context = arg;
+  struct Raster *raster = context->sides[0].raster, *other = context->count > 1 ? context->sides[1].raster : NULL;
+  uint64_t pixels = 0;
+  while(1){
+    int band = __atomic_fetch_add(&context->next, 1, __ATOMIC_RELAXED);
+    if(band >= raster->rows){
+      break;
+    }
+    for(int i = 0; i < context->count; i++){
+      raster_band(&context->sides[i], band);
+    }
+    pixels += xor_tiles(raster, other, band * raster->columns, (band + 1) * raster->columns);
+  }
+  __atomic_fetch_add(&context->pixels, pixels, __ATOMIC_RELAXED);
+  return NULL;
+}
+
+// The XOR of layer_1 on board_1 and layer_2 on board_2 at depth 1 over
+// box. Both are drawn a band at a time and each band is XORed as soon as
+// both sides have it, so only tiles that differ are ever kept whole.
+// Either layer may be NULL for one missing from its board. pixels gets the
+// number set. Returns NULL when neither side could be rasterised.
+struct Raster *raster_xor_layers(struct Board *board_1, struct Layer *layer_1, struct Board *board_2, struct Layer *layer_2, float dpi, const struct Box *box, int threads, uint64_t *pixels){
+  struct Board *saved = pcb;
+  struct Board *boards[2] = {board_1, board_2};
+  struct Layer *layers[2] = {layer_1, layer_2};
+  struct Xor_Context context;
+  memset(&context, 0, sizeof(context));
+  for(int i = 0; i < 2; i++){
+    pcb = boards[i];
+    if(layers[i] && raster_prepare(&context.sides[context.count], layers[i], dpi, 1, box) == SUCCESS){
+      context.count++;
+    }
+  }
+  pcb = saved;
+  *pixels = 0;
+  if(context.count == 0){
+    return NULL;
+  }
+  run_workers(xor_worker, &context, threads, context.sides[0].raster->rows);
+  for(int i = 0; i < context.count; i++){
+    raster_release(&context.sides[i]);
+  }
+  if(context.count > 1){
+    raster_free(context.sides[1].raster);
+  }
+  *pixels = context.pixels;
+  return context.sides[0].raster;
+}
@@ -0,0 +1,1270 @@
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "solver.h"
+
+// Maze router
+// Routes the connections the ratsnest still needs on a grid over the
+// board's signal layers, a via joins every layer at a cell. Copper already
+// on the board is marked into the grid grown by the clearance and half a
+// track, so a track centred on an open cell keeps its clearance, and into a
+// second map grown by half a via for where vias may go. Cells a net's own
+// copper covers stay open to that net, cells two nets' copper cover are
+// closed to both. The grid covers the board outline, and cells off the
+// board or as near its edge as they would be to other copper are closed to
+// every net.
+//
+// A net is grown from one group of connected copper: A* searches from
+// everything joined so far to the nearest group still apart, until the net
+// is whole. Congestion is negotiated the PathFinder way: nets may share
+// cells at a price that rises every pass, and cells that stay shared gather
+// history that keeps them dear. Each pass rips up and reroutes only the
+// nets on a shared cell, until no cell is shared, the passes run out or
+// ROUTE_STALL passes in a row fail to bring the overuse below its best.
+// A net searches inside its window, the box round its terminals plus a
+// margin, so nets whose windows do not overlap are routed in parallel,
+// batched greedily on a coarse grid of regions.
+//
+// Nets still sharing after the last pass are then ripped up one at a time
+// until none is, and rerouted in turn with every cell another net holds
+// closed, so what goes into the board never overlaps. Connections they
+// cannot make that way are left unrouted.
+
+#define ROUTE_LAYERS_MAX 32
+#define ROUTE_BOX_MARGIN 2.0f
+#define ROUTE_MARGIN 8
+#define ROUTE_REGION 16
+#define ROUTE_BATCH_TRIES 64
+#define ROUTE_ITERATIONS 100
+#define ROUTE_STALL 8
+#define ROUTE_VIA_COST 10.0f
+#define ROUTE_WRONG_WAY 1.5f
+#define ROUTE_PRESENT 0.5f
+#define ROUTE_PRESENT_GROWTH 1.3f
+#define ROUTE_HISTORY 1.0f
+#define ROUTE_BLOCKED -1
+
+#define SHAPE_CAPSULE 1
+#define SHAPE_POLYGON 2
+#define SHAPE_ZONE 3
+
+// Copper of one item, a via or a point is a capsule with start == end
+struct Route_Shape {
+  int kind, net;
+  uint64_t layers;
+  struct Point start, end;
+  float radius;
+  struct Point outline[PAD_OUTLINE_MAX];
+  int count;
+  struct Zone *zone;
+  struct Box box;
+  struct Point anchor;
+};
+
+// A cell a connection may end on and the copper point it stubs to
+struct Route_Terminal {
+  int32_t node;
+  int group;
+  struct Point anchor;
+};
+
+// path holds one run of nodes per connection, from the group joined to the
+// copper it reached, each closed by -1 - group
+struct Route_Net {
+  int ordinal;
+  struct Net *net;
+  struct Route_Terminal *terminals;
+  int terminal_count, group_count, connections;
+  int x0, y0, x1, y1;
+  int32_t *path;
+  int path_count, path_capacity;
+  int32_t *usage;
+  int usage_count, usage_capacity;
+  int routed, widened;
+};
+
+struct Route_Heap {
+  float *key;
+  int32_t *node;
+  int count, capacity;
+};
+
+// One per worker, stamps save clearing the per node arrays every search
+struct Route_Search {
+  float *cost;
+  int32_t *parent, *target_group;
+  uint32_t *seen, *target, stamp;
+  struct Route_Heap heap;
+  int32_t *tree;
+  int tree_count, tree_capacity;
+  char *joined;
+  int joined_capacity;
+};
+
+struct Router {
+  struct Board *board;
+  struct Route_Options options;
+  struct Box box;
+  float pitch;
+  int nx, ny, layer_count;
+  struct Layer *layers[ROUTE_LAYERS_MAX];
+  struct Layer *top, *bottom;
+  int32_t *owner, *via_owner;
+  uint16_t *occupancy;
+  float *history, present;
+  int strict;
+  struct Route_Net *nets;
+  int net_count;
+  int *order, *batch_start, *batch_next, batch_count;
+  pthread_barrier_t barrier;
+};
+
+struct Route_Worker {
+  struct Router *router;
+  struct Route_Search search;
+};
+
+// Geometry
+
+static float segment_distance(struct Point point, struct Point start, struct Point end){
+  float dx = end.x - start.x, dy = end.y - start.y, length2 = dx * dx + dy * dy;
+  float t = length2 > 0 ? ((point.x - start.x) * dx + (point.y - start.y) * dy) / length2 : 0;
+  t = t < 0 ? 0 : (t > 1 ? 1 : t);
+  return hypotf(point.x - start.x - t * dx, point.y - start.y - t * dy);
+}
+
+// 0 inside the convex outline, else the distance to its nearest edge
+static float outline_distance(const struct Point *outline, int count, struct Point point){
+  float best = INFINITY, sign = 0;
+  int inside = TRUE;
+  for(int i = 0; i < count; i++){
+    struct Point from = outline[i], to = outline[(i + 1) % count];
+    float cross = (to.x - from.x) * (point.y - from.y) - (to.y - from.y) * (point.x - from.x);
+    if(cross != 0){
+      if(sign == 0){
+        sign = cross;
+      }else if((cross > 0) != (sign > 0)){
+        inside = FALSE;
+      }
+    }
+    best = fminf(best, segment_distance(point, from, to));
+  }
+  return inside ? 0 : best;
+}
+
+static float zone_distance(struct Zone *zone, struct Point point){
+  if(rings_contain_point(zone->rings, point)){
+    return 0;
+  }
+  float best = INFINITY;
+  for(struct Ring *ring = zone->rings; ring; ring = ring->next){
+    best = fminf(best, ring_point_distance(ring, point));
+  }
+  return best;
+}
+
+// How far the point is from the shape's copper, 0 on it
+static float shape_distance(const struct Route_Shape *shape, struct Point point){
+  switch(shape->kind){
+    case SHAPE_POLYGON:
+      return outline_distance(shape->outline, shape->count, point);
+    case SHAPE_ZONE:
+      return zone_distance(shape->zone, point);
+  }
+  return fmaxf(0, segment_distance(point, shape->start, shape->end) - shape->radius);
+}
+
+static int boxes_touch(const struct Box *_1, const struct Box *_2){
+  return _1->min_x <= _2->max_x + 1e-4f && _2->min_x <= _1->max_x + 1e-4f && _1->min_y <= _2->max_y + 1e-4f && _2->min_y <= _1->max_y + 1e-4f;
+}
+
+// Whether one shape's copper reaches the other's, pads and zones are
+// tested at their vertices and capsules at their ends, which is where
+// routed copper meets
+static int shapes_touch(const struct Route_Shape *_1, const struct Route_Shape *_2){
+  if(!(_1->layers & _2->layers) || !boxes_touch(&_1->box, &_2->box)){
+    return FALSE;
+  }
+  if(_1->kind != SHAPE_CAPSULE && _2->kind == SHAPE_CAPSULE){
+    const struct Route_Shape *swap = _1;
+    _1 = _2;
+    _2 = swap;
+  }
+  if(_1->kind == SHAPE_CAPSULE){
+    if(shape_distance(_2, _1->start) <= _1->radius + 1e-4f || shape_distance(_2, _1->end) <= _1->radius + 1e-4f){
+      return TRUE;
+    }
+    return _2->kind == SHAPE_CAPSULE && (shape_distance(_1, _2->start) <= _2->radius + 1e-4f || shape_distance(_1, _2->end) <= _2->radius + 1e-4f);
+  }
+  for(int i = 0; _1->kind == SHAPE_POLYGON && i < _1->count; i++){
+    if(shape_distance(_2, _1->outline[i]) == 0){
+      return TRUE;
+    }
+  }
+  for(int i = 0; _2->kind == SHAPE_POLYGON && i < _2->count; i++){
+    if(shape_distance(_1, _2->outline[i]) == 0){
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+static void capsule_shape(struct Route_Shape *shape, struct Point start, struct Point end, float radius){
+  shape->kind = SHAPE_CAPSULE;
+  shape->start = start;
+  shape->end = end;
+  shape->radius = radius;
+  shape->anchor = start;
+  shape->box = (struct Box){fminf(start.x, end.x) - radius, fminf(start.y, end.y) - radius, fmaxf(start.x, end.x) + radius, fmaxf(start.y, end.y) + radius};
+}
+
+static struct Route_Shape *add_shape(struct Route_Shape **shapes, int *count, int *capacity, struct Net *net, uint64_t layers){
+  if(*count == *capacity){
+    *capacity = *capacity ? *capacity * 2 : 1024;
+    *shapes = realloc(*shapes, *capacity * sizeof(struct Route_Shape));
+  }
+  struct Route_Shape *shape = &(*shapes)[(*count)++];
+  memset(shape, 0, sizeof(struct Route_Shape));
+  shape->net = net ? net->ordinal : 0;
+  shape->layers = layers;
+  return shape;
+}
+
+// Every copper item as shapes, arcs become a run of capsules
+static int collect_shapes(struct Route_Shape **shapes){
+  int count = 0, capacity = 0;
+  struct Point points[64];
+  *shapes = NULL;
+  for(struct Footprint *footprint = pcb->footprints; footprint; footprint = footprint->next){
+    for(struct Pad *pad = footprint->pads; pad; pad = pad->next){
+      uint64_t layers = 0;
+      for(int i = 0; i < pad->layer_count; i++){
+        layers |= is_copper(pad->layers[i]) ? layer_mask(pad->layers[i]) : 0;
+      }
+      if(layers == 0){
+        continue;
+      }
+      struct Route_Shape *shape = add_shape(shapes, &count, &capacity, pad->net, layers);
+      shape->kind = SHAPE_POLYGON;
+      shape->count = pad_outline(footprint, pad, 0, shape->outline);
+      shape->anchor = pad_position(footprint, pad);
+      shape->box = (struct Box){INFINITY, INFINITY, -INFINITY, -INFINITY};
+      for(int i = 0; i < shape->count; i++){
+        shape->box.min_x = fminf(shape->box.min_x, shape->outline[i].x);
+        shape->box.min_y = fminf(shape->box.min_y, shape->outline[i].y);
+        shape->box.max_x = fmaxf(shape->box.max_x, shape->outline[i].x);
+        shape->box.max_y = fmaxf(shape->box.max_y, shape->outline[i].y);
+      }
+    }
+  }
+  for(struct Track *track = pcb->tracks; track; track = track->next){
+    if(track->type == TRACK_TYPE_SEG){
+      struct Segment *segment = &track->track.segment;
+      capsule_shape(add_shape(shapes, &count, &capacity, segment->net, layer_mask(segment->layer)), segment->start, segment->end, segment->width / 2);
+    }else if(track->type == TRACK_TYPE_ARC){
+      struct Arc *arc = &track->track.arc;
+      int points_count = arc_points(arc->start, arc->mid, arc->end, 0.01, points, 64);
+      for(int i = 0; i + 1 < points_count; i++){
+        capsule_shape(add_shape(shapes, &count, &capacity, arc->net, layer_mask(arc->layer)), points[i], points[i + 1], arc->width / 2);
+      }
+    }else if(track->type == TRACK_TYPE_VIA){
+      struct Via *via = &track->track.via;
+      uint64_t layers = 0;
+      for(struct Layer *layer = pcb->layers.layer; layer; layer = layer->next){
+        layers |= is_copper(layer) && via_on_layer(via, layer) ? layer_mask(layer) : 0;
+      }
+      struct Point at = {via->at.x, via->at.y};
+      capsule_shape(add_shape(shapes, &count, &capacity, via->net, layers), at, at, via->size / 2);
+    }
+  }
+  for(struct Zone *zone = pcb->zones; zone; zone = zone->next){
+    if(zone->layer == NULL || (zone->rings == NULL && zone_rings_init(zone) == ERROR)){
+      continue;
+    }
+    struct Route_Shape *shape = add_shape(shapes, &count, &capacity, zone->net, layer_mask(zone->layer));
+    shape->kind = SHAPE_ZONE;
+    shape->zone = zone;
+    shape->box = zone->rings->box;
+    for(struct Ring *ring = zone->rings->next; ring; ring = ring->next){
+      shape->box.min_x = fminf(shape->box.min_x, ring->box.min_x);
+      shape->box.min_y = fminf(shape->box.min_y, ring->box.min_y);
+      shape->box.max_x = fmaxf(shape->box.max_x, ring->box.max_x);
+      shape->box.max_y = fmaxf(shape->box.max_y, ring->box.max_y);
+    }
+  }
+  return count;
+}
+
+// Grid
+
+static int cell_x(const struct Router *router, float x){
+  int cell = (int)floorf((x - router->box.min_x) / router->pitch);
+  return cell < 0 ? 0 : (cell >= router->nx ? router->nx - 1 : cell);
+}
+
+static int cell_y(const struct Router *router, float y){
+  int cell = (int)floorf((y - router->box.min_y) / router->pitch);
+  return cell < 0 ? 0 : (cell >= router->ny ? router->ny - 1 : cell);
+}
+
+static struct Point cell_centre(const struct Router *router, int32_t node){
+  int32_t cell = node % (router->nx * router->ny);
+  return (struct Point){router->box.min_x + (cell % router->nx + 0.5f) * router->pitch, router->box.min_y + (cell / router->nx + 0.5f) * router->pitch};
+}
+
+static void mark(int32_t *slot, int net){
+  if(net == 0){
+    *slot = ROUTE_BLOCKED;
+  }else if(*slot == 0){
+    *slot = net;
+  }else if(*slot != net){
+    *slot = ROUTE_BLOCKED;
+  }
+}
+
+static int open_to(int32_t owner, int net){
+  return owner == 0 || owner == net;
+}
+
+// Marks the cells the shape's copper closes to other nets' tracks on the
+// routing layers and to other nets' vias on any
+static void mark_shape(struct Router *router, const struct Route_Shape *shape){
+  float track = router->options.clearance + router->options.width / 2, via = router->options.clearance + router->options.via_size / 2;
+  float reach = fmaxf(track, via);
+  int cells = router->nx * router->ny;
+  int x0 = cell_x(router, shape->box.min_x - reach), x1 = cell_x(router, shape->box.max_x + reach);
+  int y0 = cell_y(router, shape->box.min_y - reach), y1 = cell_y(router, shape->box.max_y + reach);
+  for(int y = y0; y <= y1; y++){
+    for(int x = x0; x <= x1; x++){
+      int32_t cell = y * router->nx + x;
+      float distance = shape_distance(shape, cell_centre(router, cell));
+      // Zones are refilled round new vias, they only close cells to tracks
+      if(distance < via && shape->kind != SHAPE_ZONE){
+        mark(&router->via_owner[cell], shape->net);
+      }
+      for(int layer = 0; distance < track && layer < router->layer_count; layer++){
+        if(shape->layers & layer_mask(router->layers[layer])){
+          mark(&router->owner[layer * cells + cell], shape->net);
+        }
+      }
+    }
+  }
+}
+
+// Closes the cells off the board, and those the board edge closes the way
+// mark_shape does for other copper
+static void mark_outline(struct Router *router, const struct Board_Outline *outline){
+  float track = router->options.clearance + router->options.width / 2, via = router->options.clearance + router->options.via_size / 2;
+  float reach = fmaxf(track, via);
+  int cells = router->nx * router->ny;
+  struct Point *centres = malloc(router->nx * sizeof(struct Point));
+  uint8_t *inside = malloc(router->nx);
+  for(int y = 0; y < router->ny; y++){
+    for(int x = 0; x < router->nx; x++){
+      centres[x] = cell_centre(router, y * router->nx + x);
+    }
+    board_contains_points(outline, centres, router->nx, inside);
+    for(int x = 0; x < router->nx; x++){
+      if(!inside[x]){
+        mark(&router->via_owner[y * router->nx + x], 0);
+        for(int layer = 0; layer < router->layer_count; layer++){
+          mark(&router->owner[layer * cells + y * router->nx + x], 0);
+        }
+      }
+    }
+  }
+  free(centres);
+  free(inside);
+  for(const struct Ring *ring = outline->rings; ring; ring = ring->next){
+    for(int i = 0; i < ring->count; i++){
+      // Rings repeat their first point after the last
+      struct Point start = {ring->x[i], ring->y[i]}, end = {ring->x[i + 1], ring->y[i + 1]};
+      int x0 = cell_x(router, fminf(start.x, end.x) - reach), x1 = cell_x(router, fmaxf(start.x, end.x) + reach);
+      int y0 = cell_y(router, fminf(start.y, end.y) - reach), y1 = cell_y(router, fmaxf(start.y, end.y) + reach);
+      for(int y = y0; y <= y1; y++){
+        for(int x = x0; x <= x1; x++){
+          int32_t cell = y * router->nx + x;
+          float distance = segment_distance(cell_centre(router, cell), start, end);
+          if(distance < via){
+            mark(&router->via_owner[cell], 0);
+          }
+          for(int layer = 0; distance < track && layer < router->layer_count; layer++){
+            mark(&router->owner[layer * cells + cell], 0);
+          }
+        }
+      }
+    }
+  }
+}
+
+// Nets
+
+static int find_root(int *parent, int i){
+  while(parent[i] != i){
+    parent[i] = parent[parent[i]];
+    i = parent[i];
+  }
+  return i;
+}
+
+static void add_terminal(struct Route_Net *net, int *capacity, int32_t node, int group, struct Point anchor){
+  if(net->terminal_count == *capacity){
+    *capacity = *capacity ? *capacity * 2 : 16;
+    net->terminals = realloc(net->terminals, *capacity * sizeof(struct Route_Terminal));
+  }
+  net->terminals[net->terminal_count++] = (struct Route_Terminal){node, group, anchor};
+}
+
+// Whether the stub from the pad's centre to the cell leaves the pad only
+// over cells open to the net
+static int stub_clear(const struct Router *router, const struct Route_Shape *shape, const int32_t *owner, int32_t cell, int net){
+  struct Point to = cell_centre(router, cell);
+  float length = hypotf(to.x - shape->anchor.x, to.y - shape->anchor.y);
+  int steps = (int)ceilf(2 * length / router->pitch);
+  for(int i = 1; i < steps; i++){
+    struct Point point = {shape->anchor.x + (to.x - shape->anchor.x) * i / steps, shape->anchor.y + (to.y - shape->anchor.y) * i / steps};
+    if(shape_distance(shape, point) > 0 && !open_to(owner[cell_y(router, point.y) * router->nx + cell_x(router, point.x)], net)){
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+// Cells a route may end on for the shape, pads give the open cells under
+// them or failing that the nearest open cell, one their centre reaches
+// without crossing closed cells if there is one
+static void shape_terminals(struct Router *router, struct Route_Net *net, int *capacity, const struct Route_Shape *shape, int group){
+  int cells = router->nx * router->ny, before = net->terminal_count;
+  for(int layer = 0; layer < router->layer_count; layer++){
+    if(!(shape->layers & layer_mask(router->layers[layer]))){
+      continue;
+    }
+    int32_t *owner = &router->owner[layer * cells];
+    if(shape->kind == SHAPE_CAPSULE){
+      struct Point ends[2] = {shape->start, shape->end};
+      for(int i = 0; i < 2; i++){
+        int32_t cell = cell_y(router, ends[i].y) * router->nx + cell_x(router, ends[i].x);
+        if(open_to(owner[cell], net->ordinal)){
+          add_terminal(net, capacity, layer * cells + cell, group, ends[i]);
+        }
+      }
+    }else if(shape->kind == SHAPE_POLYGON){
+      for(int y = cell_y(router, shape->box.min_y); y <= cell_y(router, shape->box.max_y); y++){
+        for(int x = cell_x(router, shape->box.min_x); x <= cell_x(router, shape->box.max_x); x++){
+          int32_t cell = y * router->nx + x;
+          if(open_to(owner[cell], net->ordinal) && shape_distance(shape, cell_centre(router, cell)) == 0){
+            add_terminal(net, capacity, layer * cells + cell, group, shape->anchor);
+          }
+        }
+      }
+    }
+  }
+  if(shape->kind != SHAPE_POLYGON || net->terminal_count > before){
+    return;
+  }
+  int cx = cell_x(router, shape->anchor.x), cy = cell_y(router, shape->anchor.y);
+  for(int layer = 0; layer < router->layer_count; layer++){
+    float best = INFINITY;
+    int32_t found = -1;
+    for(int y = cy - 2; (shape->layers & layer_mask(router->layers[layer])) && y <= cy + 2; y++){
+      for(int x = cx - 2; x <= cx + 2; x++){
+        if(x < 0 || y < 0 || x >= router->nx || y >= router->ny || !open_to(router->owner[layer * cells + y * router->nx + x], net->ordinal)){
+          continue;
+        }
+        // A stub crossing closed cells is the last resort
+        struct Point centre = cell_centre(router, y * router->nx + x);
+        float distance = hypotf(centre.x - shape->anchor.x, centre.y - shape->anchor.y);
+        distance += stub_clear(router, shape, &router->owner[layer * cells], y * router->nx + x, net->ordinal) ? 0 : 1e3f;
+        if(distance < best){
+          best = distance;
+          found = layer * cells + y * router->nx + x;
+        }
+      }
+    }
+    if(found >= 0){
+      add_terminal(net, capacity, found, group, shape->anchor);
+    }
+  }
+}
+
+// Groups the net's copper by contact, groups with a pad need joining
+static void build_net(struct Router *router, struct Route_Net *net, struct Route_Shape *shapes, int *members, int count){
+  int *parent = malloc(count * sizeof(int)), *group = malloc(count * sizeof(int)), *pads = calloc(count, sizeof(int));
+  int capacity = 0, groups = 0;
+  for(int i = 0; i < count; i++){
+    parent[i] = i;
+  }
+  for(int i = 0; i < count; i++){
+    for(int j = i + 1; j < count; j++){
+      if(shapes_touch(&shapes[members[i]], &shapes[members[j]])){
+        parent[find_root(parent, i)] = find_root(parent, j);
+      }
+    }
+  }
+  for(int i = 0; i < count; i++){
+    group[i] = -1;
+    pads[find_root(parent, i)] += shapes[members[i]].kind == SHAPE_POLYGON;
+  }
+  for(int i = 0; i < count; i++){
+    net->connections += find_root(parent, i) == i && pads[i] > 0;
+  }
+  net->connections = net->connections > 0 ? net->connections - 1 : 0;
+  for(int i = 0; net->connections && i < count; i++){
+    int root = find_root(parent, i);
+    if(pads[root] == 0 || shapes[members[i]].kind == SHAPE_ZONE){
+      continue;
+    }
+    if(group[root] < 0){
+      group[root] = groups++;
+    }
+    shape_terminals(router, net, &capacity, &shapes[members[i]], group[root]);
+  }
+  // Renumber to the groups that got a terminal
+  int *renumber = malloc((groups ? groups : 1) * sizeof(int));
+  for(int i = 0; i < groups; i++){
+    renumber[i] = -1;
+  }
+  for(int i = 0; i < net->terminal_count; i++){
+    int *slot = &renumber[net->terminals[i].group];
+    *slot = *slot < 0 ? net->group_count++ : *slot;
+    net->terminals[i].group = *slot;
+  }
+  net->x0 = router->nx, net->y0 = router->ny, net->x1 = -1, net->y1 = -1;
+  for(int i = 0; i < net->terminal_count; i++){
+    int32_t cell = net->terminals[i].node % (router->nx * router->ny);
+    int x = cell % router->nx, y = cell / router->nx;
+    net->x0 = x < net->x0 ? x : net->x0;
+    net->x1 = x > net->x1 ? x : net->x1;
+    net->y0 = y < net->y0 ? y : net->y0;
+    net->y1 = y > net->y1 ? y : net->y1;
+  }
+  int margin_x = ROUTE_MARGIN + (net->x1 - net->x0) / 4, margin_y = ROUTE_MARGIN + (net->y1 - net->y0) / 4;
+  net->x0 = net->x0 - margin_x < 0 ? 0 : net->x0 - margin_x;
+  net->y0 = net->y0 - margin_y < 0 ? 0 : net->y0 - margin_y;
+  net->x1 = net->x1 + margin_x >= router->nx ? router->nx - 1 : net->x1 + margin_x;
+  net->y1 = net->y1 + margin_y >= router->ny ? router->ny - 1 : net->y1 + margin_y;
+  free(renumber);
+  free(parent);
+  free(group);
+  free(pads);
+}
+
+static int build_nets(struct Router *router){
+  struct Route_Shape *shapes;
+  int shape_count = collect_shapes(&shapes), max_ordinal = 0;
+  for(struct Net *net = pcb->nets; net; net = net->next){
+    max_ordinal = net->ordinal > max_ordinal ? net->ordinal : max_ordinal;
+  }
+  for(int i = 0; i < shape_count; i++){
+    mark_shape(router, &shapes[i]);
+    max_ordinal = shapes[i].net > max_ordinal ? shapes[i].net : max_ordinal;
+  }
+  // Shapes bucketed by net
+  int *start = calloc(max_ordinal + 2, sizeof(int)), *members = malloc((size_t)(shape_count > 0 ? shape_count : 1) * sizeof(int));
+  for(int i = 0; i < shape_count; i++){
+    start[shapes[i].net + 1]++;
+  }
+  for(int i = 0; i <= max_ordinal; i++){
+    start[i + 1] += start[i];
+  }
+  int *fill = malloc((max_ordinal + 1) * sizeof(int));
+  memcpy(fill, start, (max_ordinal + 1) * sizeof(int));
+  for(int i = 0; i < shape_count; i++){
+    members[fill[shapes[i].net]++] = i;
+  }
+  router->nets = calloc(max_ordinal + 1, sizeof(struct Route_Net));
+  for(struct Net *net = pcb->nets; net; net = net->next){
+    if(net->ordinal <= 0 || start[net->ordinal + 1] - start[net->ordinal] < 2){
+      continue;
+    }
+    struct Route_Net *route = &router->nets[router->net_count];
+    route->ordinal = net->ordinal;
+    route->net = net;
+    build_net(router, route, shapes, &members[start[net->ordinal]], start[net->ordinal + 1] - start[net->ordinal]);
+    if(route->connections){
+      router->net_count++;
+    }else{
+      free(route->terminals);
+      memset(route, 0, sizeof(struct Route_Net));
+    }
+  }
+  free(fill);
+  free(start);
+  free(members);
+  free(shapes);
+  return router->net_count;
+}
+
+// Search
+
+static void heap_push(struct Route_Heap *heap, float key, int32_t node){
+  if(heap->count == heap->capacity){
+    heap->capacity = heap->capacity ? heap->capacity * 2 : 1024;
+    heap->key = realloc(heap->key, heap->capacity * sizeof(float));
+    heap->node = realloc(heap->node, heap->capacity * sizeof(int32_t));
+  }
+  int i = heap->count++;
+  while(i > 0 && heap->key[(i - 1) / 2] > key){
+    heap->key[i] = heap->key[(i - 1) / 2];
+    heap->node[i] = heap->node[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  heap->key[i] = key;
+  heap->node[i] = node;
+}
+
+static int32_t heap_pop(struct Route_Heap *heap, float *key){
+  int32_t top = heap->node[0];
+  *key = heap->key[0];
+  float last_key = heap->key[--heap->count];
+  int32_t last = heap->node[heap->count];
+  int i = 0;
+  while(2 * i + 1 < heap->count){
+    int child = 2 * i + 1;
+    child += child + 1 < heap->count && heap->key[child + 1] < heap->key[child];
+    if(heap->key[child] >= last_key){
+      break;
+    }
+    heap->key[i] = heap->key[child];
+    heap->node[i] = heap->node[child];
+    i = child;
+  }
+  heap->key[i] = last_key;
+  heap->node[i] = last;
+  return top;
+}
+
+// Strict routing closes every cell another net holds
+static float node_cost(const struct Router *router, int32_t node, int net){
+  if(!open_to(router->owner[node], net) || (router->strict && router->occupancy[node])){
+    return INFINITY;
+  }
+  return (1 + router->history[node]) * (1 + router->present * router->occupancy[node]);
+}
+
+// A via takes the dearest price of the cells it crowds on every layer
+static float via_cost(const struct Router *router, int32_t cell, int net){
+  int cells = router->nx * router->ny;
+  float worst = 1;
+  if(!open_to(router->via_owner[cell], net)){
+    return INFINITY;
+  }
+  for(int layer = 0; layer < router->layer_count; layer++){
+    if(!open_to(router->owner[layer * cells + cell], net)){
+      return INFINITY;
+    }
+    for(int dy = -1; dy <= 1; dy++){
+      for(int dx = -1; dx <= 1; dx++){
+        int32_t node = layer * cells + cell + dy * router->nx + dx;
+        if(router->strict && router->occupancy[node]){
+          return INFINITY;
+        }
+        worst = fmaxf(worst, (1 + router->history[node]) * (1 + router->present * router->occupancy[node]));
+      }
+    }
+  }
+  return ROUTE_VIA_COST * worst;
+}
+
+static void push_node(int32_t **nodes, int *count, int *capacity, int32_t node){
+  if(*count == *capacity){
+    *capacity = *capacity ? *capacity * 2 : 256;
+    *nodes = realloc(*nodes, *capacity * sizeof(int32_t));
+  }
+  (*nodes)[(*count)++] = node;
+}
+
+static void join_group(struct Route_Search *search, const struct Route_Net *net, int group){
+  search->joined[group] = TRUE;
+  for(int i = 0; i < net->terminal_count; i++){
+    if(net->terminals[i].group == group){
+      push_node(&search->tree, &search->tree_count, &search->tree_capacity, net->terminals[i].node);
+    }
+  }
+}
+
+// A* from the joined copper to any terminal of a group still apart,
+// returns the node reached or -1
+static int32_t search_path(const struct Router *router, const struct Route_Net *net, struct Route_Search *search){
+  int cells = router->nx * router->ny;
+  if(++search->stamp == 0){
+    memset(search->seen, 0, (size_t)cells * router->layer_count * sizeof(uint32_t));
+    memset(search->target, 0, (size_t)cells * router->layer_count * sizeof(uint32_t));
+    search->stamp = 1;
+  }
+  uint32_t stamp = search->stamp;
+  int tx0 = router->nx, ty0 = router->ny, tx1 = -1, ty1 = -1;
+  for(int i = 0; i < net->terminal_count; i++){
+    const struct Route_Terminal *terminal = &net->terminals[i];
+    if(search->joined[terminal->group]){
+      continue;
+    }
+    search->target[terminal->node] = stamp;
+    search->target_group[terminal->node] = terminal->group;
+    int32_t cell = terminal->node % cells;
+    int x = cell % router->nx, y = cell / router->nx;
+    tx0 = x < tx0 ? x : tx0;
+    tx1 = x > tx1 ? x : tx1;
+    ty0 = y < ty0 ? y : ty0;
+    ty1 = y > ty1 ? y : ty1;
+  }
+  struct Route_Heap *heap = &search->heap;
+  heap->count = 0;
+  for(int i = 0; i < search->tree_count; i++){
+    int32_t node = search->tree[i];
+    if(router->strict && router->occupancy[node]){
+      continue;
+    }
+    if(search->seen[node] != stamp){
+      search->seen[node] = stamp;
+      search->cost[node] = 0;
+      search->parent[node] = -1;
+      heap_push(heap, 0, node);
+    }
+  }
+  while(heap->count){
+    float key;
+    int32_t node = heap_pop(heap, &key);
+    int32_t cell = node % cells;
+    int layer = node / cells, x = cell % router->nx, y = cell / router->nx;
+    float cost = search->cost[node];
+    int h = (x < tx0 ? tx0 - x : (x > tx1 ? x - tx1 : 0)) + (y < ty0 ? ty0 - y : (y > ty1 ? y - ty1 : 0));
+    if(key > cost + h + 1e-3f){
+      continue;
+    }
+    if(search->target[node] == stamp){
+      return node;
+    }
+    // Even layers run horizontally, odd ones vertically
+    int32_t next[4 + ROUTE_LAYERS_MAX];
+    float step[4 + ROUTE_LAYERS_MAX];
+    int count = 0;
+    float along = layer % 2 ? ROUTE_WRONG_WAY : 1, across = layer % 2 ? 1 : ROUTE_WRONG_WAY;
+    if(x > net->x0){
+      next[count] = node - 1, step[count++] = along;
+    }
+    if(x < net->x1){
+      next[count] = node + 1, step[count++] = along;
+    }
+    if(y > net->y0){
+      next[count] = node - router->nx, step[count++] = across;
+    }
+    if(y < net->y1){
+      next[count] = node + router->nx, step[count++] = across;
+    }
+    for(int i = 0; i < count; i++){
+      step[i] *= node_cost(router, next[i], net->ordinal);
+    }
+    // Vias keep their halo inside the window
+    if(router->layer_count > 1 && x > net->x0 && x < net->x1 && y > net->y0 && y < net->y1){
+      float via = via_cost(router, cell, net->ordinal);
+      for(int other = 0; via < INFINITY && other < router->layer_count; other++){
+        if(other != layer){
+          next[count] = other * cells + cell, step[count++] = via;
+        }
+      }
+    }
+    for(int i = 0; i < count; i++){
+      if(step[i] == INFINITY){
+        continue;
+      }
+      float reached = cost + step[i];
+      int32_t to = next[i];
+      if(search->seen[to] != stamp || reached < search->cost[to]){
+        int32_t to_cell = to % cells;
+        int to_x = to_cell % router->nx, to_y = to_cell / router->nx;
+        int to_h = (to_x < tx0 ? tx0 - to_x : (to_x > tx1 ? to_x - tx1 : 0)) + (to_y < ty0 ? ty0 - to_y : (to_y > ty1 ? to_y - ty1 : 0));
+        search->seen[to] = stamp;
+        search->cost[to] = reached;
+        search->parent[to] = node;
+        heap_push(heap, reached + to_h, to);
+      }
+    }
+  }
+  return -1;
+}
+
+static int compare_node(const void *_1, const void *_2){
+  int32_t node_1 = *(const int32_t *)_1, node_2 = *(const int32_t *)_2;
+  return node_1 < node_2 ? -1 : node_1 > node_2;
+}
+
+// Cells the net's path takes, vias take their halo on every layer
+static void net_usage(const struct Router *router, struct Route_Net *net){
+  int cells = router->nx * router->ny;
+  net->usage_count = 0;
+  for(int i = 0; i < net->path_count; i++){
+    int32_t node = net->path[i];
+    if(node < 0){
+      continue;
+    }
+    push_node(&net->usage, &net->usage_count, &net->usage_capacity, node);
+    int32_t previous = i > 0 ? net->path[i - 1] : -1;
+    if(previous >= 0 && previous % cells == node % cells){
+      for(int layer = 0; layer < router->layer_count; layer++){
+        for(int dy = -1; dy <= 1; dy++){
+          for(int dx = -1; dx <= 1; dx++){
+            push_node(&net->usage, &net->usage_count, &net->usage_capacity, layer * cells + node % cells + dy * router->nx + dx);
+          }
+        }
+      }
+    }
+  }
+  // Sort and drop repeats so a net counts once per cell
+  int32_t *usage = net->usage;
+  if(net->usage_count > 0){
+    qsort(usage, net->usage_count, sizeof(int32_t), compare_node);
+  }
+  int unique = 0;
+  for(int i = 0; i < net->usage_count; i++){
+    if(unique == 0 || usage[unique - 1] != usage[i]){
+      usage[unique++] = usage[i];
+    }
+  }
+  net->usage_count = unique;
+}
+
+static void route_net(struct Router *router, struct Route_Net *net, struct Route_Search *search){
+  for(int i = 0; i < net->usage_count; i++){
+    router->occupancy[net->usage[i]]--;
+  }
+  net->path_count = 0;
+  net->usage_count = 0;
+  net->routed = 0;
+  if(net->group_count > search->joined_capacity){
+    search->joined_capacity = net->group_count;
+    search->joined = realloc(search->joined, search->joined_capacity);
+  }
+  memset(search->joined, 0, net->group_count);
+  search->tree_count = 0;
+  if(net->group_count > 0){
+    join_group(search, net, 0);
+  }
+  for(int connection = 1; connection < net->group_count; connection++){
+    int32_t end = search_path(router, net, search);
+    if(end < 0){
+      break;
+    }
+    int group = search->target_group[end];
+    for(int32_t node = end; node >= 0; node = search->parent[node]){
+      push_node(&net->path, &net->path_count, &net->path_capacity, node);
+      push_node(&search->tree, &search->tree_count, &search->tree_capacity, node);
+    }
+    push_node(&net->path, &net->path_count, &net->path_capacity, -1 - group);
+    join_group(search, net, group);
+    net->routed++;
+  }
+  net_usage(router, net);
+  for(int i = 0; i < net->usage_count; i++){
+    router->occupancy[net->usage[i]]++;
+  }
+}
+
+static void *route_worker(void *arg){
+  struct Route_Worker *worker = arg;
+  struct Router *router = worker->router;
+  pcb = router->board;
+  for(int batch = 0; batch < router->batch_count; batch++){
+    int size = router->batch_start[batch + 1] - router->batch_start[batch];
+    while(TRUE){
+      int i = __atomic_fetch_add(&router->batch_next[batch], 1, __ATOMIC_RELAXED);
+      if(i >= size){
+        break;
+      }
+      route_net(router, &router->nets[router->order[router->batch_start[batch] + i]], &worker->search);
+    }
+    pthread_barrier_wait(&router->barrier);
+  }
+  return NULL;
+}
+
+struct Route_Order {
+  int area, net;
+};
+
+static int compare_order(const void *_1, const void *_2){
+  const struct Route_Order *order_1 = _1, *order_2 = _2;
+  return order_1->area != order_2->area ? (order_1->area < order_2->area ? -1 : 1) : order_1->net - order_2->net;
+}
+
+// Packs the nets to route into batches whose windows share no region,
+// order ends up grouped by batch
+static void make_batches(struct Router *router, int *pending, int count){
+  int rx = (router->nx + ROUTE_REGION - 1) / ROUTE_REGION, ry = (router->ny + ROUTE_REGION - 1) / ROUTE_REGION;
+  // Small windows first, they pack into the early batches
+  struct Route_Order *sorted = malloc((count ? count : 1) * sizeof(struct Route_Order));
+  for(int i = 0; i < count; i++){
+    struct Route_Net *net = &router->nets[pending[i]];
+    sorted[i] = (struct Route_Order){(net->x1 - net->x0 + 1) * (net->y1 - net->y0 + 1), pending[i]};
+  }
+  qsort(sorted, count, sizeof(struct Route_Order), compare_order);
+  for(int i = 0; i < count; i++){
+    pending[i] = sorted[i].net;
+  }
+  free(sorted);
+  int *batch = malloc((count ? count : 1) * sizeof(int)), batches = 0;
+  uint8_t **regions = calloc(count ? count : 1, sizeof(uint8_t *));
+  for(int i = 0; i < count; i++){
+    struct Route_Net *net = &router->nets[pending[i]];
+    int x0 = net->x0 / ROUTE_REGION, x1 = net->x1 / ROUTE_REGION, y0 = net->y0 / ROUTE_REGION, y1 = net->y1 / ROUTE_REGION;
+    int chosen = -1;
+    for(int b = batches > ROUTE_BATCH_TRIES ? batches - ROUTE_BATCH_TRIES : 0; b < batches && chosen < 0; b++){
+      int free_window = TRUE;
+      for(int y = y0; y <= y1 && free_window; y++){
+        for(int x = x0; x <= x1 && free_window; x++){
+          free_window = !regions[b][y * rx + x];
+        }
+      }
+      chosen = free_window ? b : -1;
+    }
+    if(chosen < 0){
+      chosen = batches++;
+      regions[chosen] = calloc(rx * ry, 1);
+    }
+    for(int y = y0; y <= y1; y++){
+      memset(&regions[chosen][y * rx + x0], 1, x1 - x0 + 1);
+    }
+    batch[i] = chosen;
+  }
+  router->batch_count = batches;
+  router->batch_start = realloc(router->batch_start, (batches + 1) * sizeof(int));
+  router->batch_next = realloc(router->batch_next, (batches ? batches : 1) * sizeof(int));
+  memset(router->batch_start, 0, (batches + 1) * sizeof(int));
+  memset(router->batch_next, 0, (batches ? batches : 1) * sizeof(int));
+  for(int i = 0; i < count; i++){
+    router->batch_start[batch[i] + 1]++;
+  }
+  for(int b = 0; b < batches; b++){
+    router->batch_start[b + 1] += router->batch_start[b];
+    free(regions[b]);
+  }
+  int *fill = calloc(batches ? batches : 1, sizeof(int));
+  for(int i = 0; i < count; i++){
+    router->order[router->batch_start[batch[i]] + fill[batch[i]]++] = pending[i];
+  }
+  free(fill);
+  free(regions);
+  free(batch);
+}
+
+static int net_shared(const struct Router *router, const struct Route_Net *net){
+  for(int i = 0; i < net->usage_count; i++){
+    if(router->occupancy[net->usage[i]] > 1){
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+// Writing
+
+static uint64_t next_uuid(uint64_t *state){
+  // splitmix64
+  uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+static struct Track *new_track(int type, uint64_t *state){
+  struct Track *track = calloc(1, sizeof(struct Track));
+  track->index.set = SECTION_MODIFIED;
+  track->type = type;
+  track->uuid.high = (next_uuid(state) & ~0xF000ull) | 0x4000ull;
+  track->uuid.low = (next_uuid(state) & 0x3FFFFFFFFFFFFFFFull) | 0x8000000000000000ull;
+  if(pcb->tracks){
+    pcb->tracks->prev = track;
+  }
+  track->next = pcb->tracks;
+  pcb->tracks = track;
+  return track;
+}
+
+static void put_segment(struct Router *router, struct Route_Net *net, struct Route_Stats *stats, uint64_t *state, struct Point start, struct Point end, int layer){
+  if(hypotf(end.x - start.x, end.y - start.y) < 1e-4f){
+    return;
+  }
+  struct Track *track = new_track(TRACK_TYPE_SEG, state);
+  struct Segment *segment = &track->track.segment;
+  segment->start = start;
+  segment->end = end;
+  segment->width = router->options.width;
+  segment->layer = router->layers[layer];
+  segment->net = net->net;
+  net_metrics_track(pcb->metrics, track, 1);
+  stats->segments++;
+  stats->length += hypotf(end.x - start.x, end.y - start.y);
+}
+
+static void put_via(struct Router *router, struct Route_Net *net, struct Route_Stats *stats, uint64_t *state, struct Point at){
+  struct Track *track = new_track(TRACK_TYPE_VIA, state);
+  struct Via *via = &track->track.via;
+  via->at = (struct at){at.x, at.y, 0};
+  via->size = router->options.via_size;
+  via->drill.diameter = router->options.via_drill;
+  via->layer_count = 2;
+  via->layers = malloc(2 * sizeof(struct Layer *));
+  via->layers[0] = router->top;
+  via->layers[1] = router->bottom;
+  via->net = net->net;
+  net_metrics_track(pcb->metrics, track, 1);
+  stats->vias++;
+}
+
+// The anchor of a terminal of group at node, or of any other group when
+// other is set
+static const struct Route_Terminal *find_terminal(const struct Route_Net *net, int32_t node, int group, int other){
+  for(int i = 0; i < net->terminal_count; i++){
+    if(net->terminals[i].node == node && (other ? net->terminals[i].group != group : net->terminals[i].group == group)){
+      return &net->terminals[i];
+    }
+  }
+  return NULL;
+}
+
+// Straight runs become one segment each, layer changes a via
+static void put_route(struct Router *router, struct Route_Net *net, struct Route_Stats *stats, uint64_t *state){
+  int cells = router->nx * router->ny;
+  for(int first = 0, last = 0; first < net->path_count; first = last + 1){
+    for(last = first; net->path[last] >= 0; last++);
+    int group = -1 - net->path[last];
+    const int32_t *nodes = &net->path[first];
+    int count = last - first;
+    const struct Route_Terminal *from = find_terminal(net, nodes[0], group, FALSE), *to = find_terminal(net, nodes[count - 1], group, TRUE);
+    if(from){
+      put_segment(router, net, stats, state, from->anchor, cell_centre(router, nodes[0]), nodes[0] / cells);
+    }
+    int run = 0;
+    for(int i = 1; i <= count; i++){
+      int turn = i < count && nodes[i] - nodes[i - 1] != nodes[run + 1] - nodes[run];
+      int via = i < count && nodes[i] % cells == nodes[i - 1] % cells;
+      if(i == count || turn || via){
+        put_segment(router, net, stats, state, cell_centre(router, nodes[run]), cell_centre(router, nodes[i - 1]), nodes[run] / cells);
+        run = i - 1;
+      }
+      if(via){
+        // A hop through several layers at one cell is still one via
+        if(i < 2 || nodes[i - 1] % cells != nodes[i - 2] % cells){
+          put_via(router, net, stats, state, cell_centre(router, nodes[i]));
+        }
+        run = i;
+      }
+    }
+    if(to){
+      put_segment(router, net, stats, state, cell_centre(router, nodes[count - 1]), to->anchor, nodes[count - 1] / cells);
+    }
+  }
+}
+
+static int compare_ordinal(const void *_1, const void *_2){
+  return (*(struct Layer *const *)_1)->ordinal - (*(struct Layer *const *)_2)->ordinal;
+}
+
+// Routes every connection the board's copper leaves open and adds the
+// tracks to the board. Zero options take the defaults: a grid of width
+// plus clearance, 0.15 mm tracks and clearance, 0.6/0.3 mm vias and
+// at most ROUTE_ITERATIONS passes, threads <= 0 uses every core. Returns
+// the number of connections routed, stats can be NULL.
+int route_board(const struct Route_Options *options, struct Route_Stats *stats){
+  struct Route_Stats local_stats;
+  struct Router router;
+  memset(&router, 0, sizeof(router));
+  stats = stats ? stats : &local_stats;
+  memset(stats, 0, sizeof(struct Route_Stats));
+  router.board = pcb;
+  router.options = *options;
+  router.options.width = options->width > 0 ? options->width : 0.15f;
+  router.options.clearance = options->clearance > 0 ? options->clearance : 0.15f;
+  router.options.via_size = options->via_size > 0 ? options->via_size : 0.6f;
+  router.options.via_drill = options->via_drill > 0 ? options->via_drill : 0.3f;
+  router.options.iterations = options->iterations > 0 ? options->iterations : ROUTE_ITERATIONS;
+  router.options.threads = options->threads > 0 ? options->threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+  router.pitch = options->grid > 0 ? options->grid : router.options.width + router.options.clearance;
+
+  struct Layer *copper[ROUTE_LAYERS_MAX];
+  int copper_count = 0;
+  for(struct Layer *layer = pcb->layers.layer; layer && copper_count < ROUTE_LAYERS_MAX; layer = layer->next){
+    if(is_copper(layer)){
+      copper[copper_count++] = layer;
+    }
+  }
+  qsort(copper, copper_count, sizeof(struct Layer *), compare_ordinal);
+  for(int i = 0; i < copper_count; i++){
+    if(copper[i]->type != LAYER_TYPE_POWER){
+      router.layers[router.layer_count++] = copper[i];
+    }
+  }
+  router.box = copper_box();
+  if(router.layer_count == 0 || !(router.box.max_x >= router.box.min_x)){
+    return 0;
+  }
+  router.top = copper[0];
+  router.bottom = copper[copper_count - 1];
+  if(pcb->outline == NULL){
+    board_outline_init(0);
+  }
+  const struct Board_Outline *outline = pcb->outline->rings ? pcb->outline : NULL;
+  if(outline){
+    router.box.min_x = fminf(router.box.min_x, outline->box.min_x), router.box.min_y = fminf(router.box.min_y, outline->box.min_y);
+    router.box.max_x = fmaxf(router.box.max_x, outline->box.max_x), router.box.max_y = fmaxf(router.box.max_y, outline->box.max_y);
+  }else{
+    // Without an outline the grid runs a margin past the copper
+    router.box.min_x -= ROUTE_BOX_MARGIN, router.box.min_y -= ROUTE_BOX_MARGIN;
+    router.box.max_x += ROUTE_BOX_MARGIN, router.box.max_y += ROUTE_BOX_MARGIN;
+  }
+  router.nx = (int)ceilf((router.box.max_x - router.box.min_x) / router.pitch);
+  router.ny = (int)ceilf((router.box.max_y - router.box.min_y) / router.pitch);
+  size_t cells = (size_t)router.nx * router.ny, nodes = cells * router.layer_count;
+  router.owner = calloc(nodes, sizeof(int32_t));
+  router.via_owner = calloc(cells, sizeof(int32_t));
+  router.occupancy = calloc(nodes, sizeof(uint16_t));
+  router.history = calloc(nodes, sizeof(float));
+  router.present = ROUTE_PRESENT;
+  if(outline){
+    mark_outline(&router, outline);
+  }
+  build_nets(&router);
+
+  int threads = router.options.threads;
+  struct Route_Worker *workers = calloc(threads, sizeof(struct Route_Worker));
+  for(int i = 0; i < threads; i++){
+    struct Route_Search *search = &workers[i].search;
+    workers[i].router = &router;
+    search->cost = malloc(nodes * sizeof(float));
+    search->parent = malloc(nodes * sizeof(int32_t));
+    search->target_group = malloc(nodes * sizeof(int32_t));
+    search->seen = calloc(nodes, sizeof(uint32_t));
+    search->target = calloc(nodes, sizeof(uint32_t));
+  }
+  router.order = malloc((router.net_count ? router.net_count : 1) * sizeof(int));
+  int *pending = malloc((router.net_count ? router.net_count : 1) * sizeof(int)), pending_count = 0;
+  for(int i = 0; i < router.net_count; i++){
+    pending[pending_count++] = i;
+  }
+  pthread_t *thread = malloc(threads * sizeof(pthread_t));
+  uint64_t best = UINT64_MAX;
+  int stalled = 0;
+  while(pending_count && stalled < ROUTE_STALL && stats->iterations < (uint32_t)router.options.iterations){
+    stats->iterations++;
+    make_batches(&router, pending, pending_count);
+    pthread_barrier_init(&router.barrier, NULL, threads);
+    for(int i = 0; i < threads; i++){
+      pthread_create(&thread[i], NULL, route_worker, &workers[i]);
+    }
+    for(int i = 0; i < threads; i++){
+      pthread_join(thread[i], NULL);
+    }
+    pthread_barrier_destroy(&router.barrier);
+
+    uint64_t overuse = 0;
+    for(size_t node = 0; node < nodes; node++){
+      int over = router.occupancy[node] > 1 ? router.occupancy[node] - 1 : 0;
+      router.history[node] += ROUTE_HISTORY * over;
+      overuse += over;
+    }
+    stalled = overuse < best ? 0 : stalled + 1;
+    best = overuse < best ? overuse : best;
+    router.present *= ROUTE_PRESENT_GROWTH;
+    pending_count = 0;
+    for(int i = 0; i < router.net_count; i++){
+      struct Route_Net *net = &router.nets[i];
+      int failed = net->routed < net->group_count - 1;
+      if(failed && !net->widened){
+        // Try once more over the whole board
+        net->widened = TRUE;
+        net->x0 = 0, net->y0 = 0, net->x1 = router.nx - 1, net->y1 = router.ny - 1;
+      }else{
+        failed = FALSE;
+      }
+      if(failed || net_shared(&router, net)){
+        pending[pending_count++] = i;
+      }
+    }
+  }
+
+  // Rip up the nets on the most shared cells first until none shares a
+  // cell, then reroute them one by one around everything kept
+  struct Route_Order *shared = malloc((router.net_count > 0 ? router.net_count : 1) * sizeof(struct Route_Order));
+  int shared_count = 0;
+  for(int i = 0; i < router.net_count; i++){
+    struct Route_Net *net = &router.nets[i];
+    int cells_shared = 0;
+    for(int j = 0; j < net->usage_count; j++){
+      cells_shared += router.occupancy[net->usage[j]] > 1;
+    }
+    if(cells_shared){
+      shared[shared_count++] = (struct Route_Order){-cells_shared, i};
+    }
+  }
+  qsort(shared, shared_count, sizeof(struct Route_Order), compare_order);
+  pending_count = 0;
+  for(int i = 0; i < shared_count; i++){
+    struct Route_Net *net = &router.nets[shared[i].net];
+    if(net_shared(&router, net)){
+      for(int j = 0; j < net->usage_count; j++){
+        router.occupancy[net->usage[j]]--;
+      }
+      net->usage_count = 0;
+      pending[pending_count++] = shared[i].net;
+    }
+  }
+  free(shared);
+  router.strict = TRUE;
+  for(int i = 0; i < pending_count; i++){
+    struct Route_Net *net = &router.nets[pending[i]];
+    route_net(&router, net, &workers[0].search);
+    stats->shared += net->routed < net->group_count - 1;
+  }
+
+  uint64_t state = 0x2545F4914F6CDD1Dull;
+  for(struct Track *track = pcb->tracks; track; track = track->next, state++);
+  for(int i = 0; i < router.net_count; i++){
+    struct Route_Net *net = &router.nets[i];
+    if(net->routed){
+      stats->routed += net->routed;
+      put_route(&router, net, stats, &state);
+    }
+  }
+  for(int i = 0; i < router.net_count; i++){
+    stats->nets++;
+    stats->connections += router.nets[i].connections;
+  }
+  if(stats->segments || stats->vias){
+    // Derived data no longer covers the board
+    spatial_index_free(pcb->spatial);
+    pcb->spatial = NULL;
+    uuid_index_free(pcb->uuids);
+    pcb->uuids = NULL;
+  }
+
+  for(int i = 0; i < threads; i++){
+    struct Route_Search *search = &workers[i].search;
+    free(search->cost);
+    free(search->parent);
+    free(search->target_group);
+    free(search->seen);
+    free(search->target);
+    free(search->heap.key);
+    free(search->heap.node);
+    free(search->tree);
+    free(search->joined);
+  }
+  for(int i = 0; i < router.net_count; i++){
+    free(router.nets[i].terminals);
+    free(router.nets[i].path);
+    free(router.nets[i].usage);
+  }
+  free(thread);
+  free(workers);
+  free(pending);
+  free(router.order);
+  free(router.batch_start);
+  free(router.batch_next);
+  free(router.nets);
+  free(router.owner);
+  free(router.via_owner);
+  free(router.occupancy);
+  free(router.history);
+  return stats->routed;
+}
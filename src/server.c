@@ -0,0 +1,610 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#ifdef __linux__
+
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+
+#include "libsolver.h"
+
+// Board server
+// Parsed boards stay resident in an LRU cache keyed by path and mtime and
+// are queried over a Unix socket with a line protocol. One epoll set is
+// shared by a pool of threads, every descriptor is armed EPOLLONESHOT so a
+// connection is only ever handled by one thread at a time.
+//
+// Solver --serve <socket> [--threads N] [--cache N]
+//
+// Requests are one line, paths can't hold spaces:
+//   PING
+//   STATS <board>
+//   NET <board> <net name>
+//   PADS <board> <reference>
+//   REGION <board> <layer|*> <min x> <min y> <max x> <max y>
+// Replies are "OK <n>" followed by n lines, or "ERR <message>".
+
+#define SERVER_LINE_MAX 4096
+#define SERVER_EVENTS 64
+
+struct Net_Entry {
+  const char *name;
+  int ordinal;
+  uint32_t pads, tracks;
+};
+
+struct Footprint_Entry {
+  const char *reference;
+  struct Footprint *footprint;
+};
+
+struct Cache_Entry {
+  char *path;
+  time_t mtime;
+  long mtime_ns;
+  int users, loading, stale;
+  struct Board *board;
+  // Sorted by name for the lookups
+  struct Net_Entry *nets;
+  int net_count;
+  struct Footprint_Entry *footprints;
+  int footprint_count;
+  uint32_t pads, tracks, vias, zones;
+  struct Cache_Entry *prev, *next;
+};
+
+// Most recently used first
+struct Cache {
+  pthread_mutex_t lock;
+  pthread_cond_t loaded;
+  struct Cache_Entry *head, *tail;
+  int count, capacity;
+};
+
+struct Connection {
+  int fd, listener;
+  char in[SERVER_LINE_MAX];
+  int in_length;
+  char *out;
+  size_t out_length, out_sent, out_capacity;
+};
+
+struct Server {
+  int epoll_fd;
+  struct Cache cache;
+  struct Connection listener;
+};
+
+static volatile sig_atomic_t server_stop = 0;
+
+static void server_signal(int signal){
+  server_stop = 1;
+}
+
+// Cache
+static int compare_net_entry(const void *_1, const void *_2){
+  return strcmp(((const struct Net_Entry *)_1)->name, ((const struct Net_Entry *)_2)->name);
+}
+
+static int compare_footprint_entry(const void *_1, const void *_2){
+  return strcmp(((const struct Footprint_Entry *)_1)->reference, ((const struct Footprint_Entry *)_2)->reference);
+}
+
+// Lookup tables built once per load so queries don't walk the board
+static void index_entry(struct Cache_Entry *entry){
+  struct Board *board = entry->board;
+  int count = 0, max_ordinal = 0;
+  for(struct Net *net = solver_next_net(board, NULL); net; net = solver_next_net(board, net)){
+    count++;
+    max_ordinal = solver_net_ordinal(net) > max_ordinal ? solver_net_ordinal(net) : max_ordinal;
+  }
+  // Counted by ordinal first, the table is sorted by name afterwards
+  struct Net_Entry **by_ordinal = calloc(max_ordinal + 1, sizeof(struct Net_Entry *));
+  entry->nets = calloc(count ? count : 1, sizeof(struct Net_Entry));
+  for(struct Net *net = solver_next_net(board, NULL); net; net = solver_next_net(board, net)){
+    struct Net_Entry *net_entry = &entry->nets[entry->net_count++];
+    net_entry->name = solver_net_name(net, NULL) ? solver_net_name(net, NULL) : "";
+    net_entry->ordinal = solver_net_ordinal(net);
+    if(net_entry->ordinal >= 0){
+      by_ordinal[net_entry->ordinal] = net_entry;
+    }
+  }
+
+  count = 0;
+  for(struct Footprint *footprint = solver_next_footprint(board, NULL); footprint; footprint = solver_next_footprint(board, footprint)){
+    count++;
+  }
+  entry->footprints = calloc(count ? count : 1, sizeof(struct Footprint_Entry));
+  for(struct Footprint *footprint = solver_next_footprint(board, NULL); footprint; footprint = solver_next_footprint(board, footprint)){
+    const char *reference = solver_footprint_reference(footprint, NULL);
+    for(struct Pad *pad = solver_next_pad(footprint, NULL); pad; pad = solver_next_pad(footprint, pad)){
+      int ordinal = solver_net_ordinal(solver_pad_net(pad));
+      struct Net_Entry *net_entry = ordinal > 0 && ordinal <= max_ordinal ? by_ordinal[ordinal] : NULL;
+      entry->pads++;
+      if(net_entry){
+        net_entry->pads++;
+      }
+    }
+    if(reference){
+      entry->footprints[entry->footprint_count].reference = reference;
+      entry->footprints[entry->footprint_count++].footprint = footprint;
+    }
+  }
+  for(struct Track *track = solver_next_track(board, NULL); track; track = solver_next_track(board, track)){
+    int ordinal = solver_net_ordinal(solver_track_net(track));
+    struct Net_Entry *net_entry = ordinal > 0 && ordinal <= max_ordinal ? by_ordinal[ordinal] : NULL;
+    entry->tracks += solver_track_type(track) != SOLVER_TRACK_VIA;
+    entry->vias += solver_track_type(track) == SOLVER_TRACK_VIA;
+    if(net_entry){
+      net_entry->tracks++;
+    }
+  }
+  for(struct Zone *zone = solver_next_zone(board, NULL); zone; zone = solver_next_zone(board, zone)){
+    entry->zones++;
+  }
+  free(by_ordinal);
+  qsort(entry->nets, entry->net_count, sizeof(struct Net_Entry), compare_net_entry);
+  qsort(entry->footprints, entry->footprint_count, sizeof(struct Footprint_Entry), compare_footprint_entry);
+  solver_prepare(board);
+}
+
+static void free_entry(struct Cache_Entry *entry){
+  solver_close(entry->board);
+  free(entry->nets);
+  free(entry->footprints);
+  free(entry->path);
+  free(entry);
+}
+
+static void cache_unlink(struct Cache *cache, struct Cache_Entry *entry){
+  if(entry->prev){
+    entry->prev->next = entry->next;
+  }else{
+    cache->head = entry->next;
+  }
+  if(entry->next){
+    entry->next->prev = entry->prev;
+  }else{
+    cache->tail = entry->prev;
+  }
+  entry->prev = entry->next = NULL;
+  cache->count--;
+}
+
+static void cache_push_front(struct Cache *cache, struct Cache_Entry *entry){
+  entry->prev = NULL;
+  entry->next = cache->head;
+  if(cache->head){
+    cache->head->prev = entry;
+  }else{
+    cache->tail = entry;
+  }
+  cache->head = entry;
+  cache->count++;
+}
+
+// Entries still in use are only marked, the last user frees them
+static void cache_evict(struct Cache *cache){
+  struct Cache_Entry *entry = cache->tail;
+  while(cache->count > cache->capacity && entry){
+    struct Cache_Entry *prev = entry->prev;
+    if(!entry->loading){
+      cache_unlink(cache, entry);
+      entry->stale = 1;
+      if(entry->users == 0){
+        free_entry(entry);
+      }
+    }
+    entry = prev;
+  }
+}
+
+static void cache_release(struct Cache *cache, struct Cache_Entry *entry){
+  pthread_mutex_lock(&cache->lock);
+  if(--entry->users == 0 && entry->stale){
+    free_entry(entry);
+  }
+  pthread_mutex_unlock(&cache->lock);
+}
+
+// Returns the entry with a reference held, loading or reloading the board
+// when the file is new or its mtime changed
+static struct Cache_Entry *cache_acquire(struct Cache *cache, const char *path){
+  struct stat info;
+  if(stat(path, &info) != 0){
+    return NULL;
+  }
+  pthread_mutex_lock(&cache->lock);
+  while(1){
+    struct Cache_Entry *entry = cache->head;
+    while(entry && strcmp(entry->path, path) != 0){
+      entry = entry->next;
+    }
+    if(entry && entry->loading){
+      pthread_cond_wait(&cache->loaded, &cache->lock);
+      continue;
+    }
+    if(entry && entry->mtime == info.st_mtim.tv_sec && entry->mtime_ns == info.st_mtim.tv_nsec){
+      if(entry != cache->head){
+        cache_unlink(cache, entry);
+        cache_push_front(cache, entry);
+      }
+      entry->users++;
+      pthread_mutex_unlock(&cache->lock);
+      return entry;
+    }
+    if(entry){
+      cache_unlink(cache, entry);
+      entry->stale = 1;
+      if(entry->users == 0){
+        free_entry(entry);
+      }
+    }
+    break;
+  }
+
+  // Parse outside the lock, other requests for the path wait on loaded
+  struct Cache_Entry *entry = calloc(1, sizeof(struct Cache_Entry));
+  entry->path = malloc(strlen(path) + 1);
+  strcpy(entry->path, path);
+  entry->mtime = info.st_mtim.tv_sec;
+  entry->mtime_ns = info.st_mtim.tv_nsec;
+  entry->loading = 1;
+  entry->users = 1;
+  cache_push_front(cache, entry);
+  pthread_mutex_unlock(&cache->lock);
+
+  entry->board = solver_open(path);
+  if(entry->board){
+    index_entry(entry);
+  }
+
+  pthread_mutex_lock(&cache->lock);
+  entry->loading = 0;
+  if(entry->board == NULL){
+    cache_unlink(cache, entry);
+    free_entry(entry);
+    entry = NULL;
+  }
+  cache_evict(cache);
+  pthread_cond_broadcast(&cache->loaded);
+  pthread_mutex_unlock(&cache->lock);
+  return entry;
+}
+
+// Replies
+static void reply(struct Connection *connection, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+static void reply(struct Connection *connection, const char *format, ...){
+  va_list args;
+  while(1){
+    size_t space = connection->out_capacity - connection->out_length;
+    va_start(args, format);
+    int length = vsnprintf(connection->out + connection->out_length, space, format, args);
+    va_end(args);
+    if(length < 0){
+      return;
+    }
+    if((size_t)length < space){
+      connection->out_length += length;
+      return;
+    }
+    connection->out_capacity = connection->out_capacity * 2 + length + 1;
+    connection->out = realloc(connection->out, connection->out_capacity);
+  }
+}
+
+// Replies with a line count are written after their lines, the header is
+// reserved up front and the body is moved up once the count is known
+#define REPLY_HEADER 16
+
+static size_t reply_begin(struct Connection *connection){
+  size_t header = connection->out_length;
+  reply(connection, "%*s", REPLY_HEADER, "");
+  return header;
+}
+
+static void reply_end(struct Connection *connection, size_t header, int lines){
+  char count[REPLY_HEADER + 1];
+  int length = snprintf(count, sizeof(count), "OK %d\n", lines);
+  char *body = connection->out + header + REPLY_HEADER;
+  size_t body_length = connection->out_length - header - REPLY_HEADER;
+  memmove(connection->out + header + length, body, body_length);
+  memcpy(connection->out + header, count, length);
+  connection->out_length = header + length + body_length;
+}
+
+struct Region {
+  struct Connection *connection;
+  int lines;
+};
+
+static const char *net_name(struct Net *net){
+  const char *name = net ? solver_net_name(net, NULL) : NULL;
+  return name && name[0] ? name : "-";
+}
+
+static int region_item(int kind, void *item, struct Footprint *footprint, void *context){
+  struct Region *region = context;
+  if(kind == SOLVER_ITEM_TRACK){
+    struct Track *track = item;
+    const char *layer = solver_track_layer(track, NULL);
+    float x0, y0, x1, y1;
+    solver_track_points(track, &x0, &y0, &x1, &y1);
+    reply(region->connection, "%s %s %.4f %.4f %.4f %.4f %.4f %s\n", solver_track_type(track) == SOLVER_TRACK_VIA ? "via" : (solver_track_type(track) == SOLVER_TRACK_ARC ? "arc" : "segment"),
+      layer ? layer : "-", x0, y0, x1, y1, solver_track_width(track), net_name(solver_track_net(track)));
+  }else{
+    struct Pad *pad = item;
+    const char *reference = solver_footprint_reference(footprint, NULL);
+    float x, y;
+    solver_pad_position(footprint, pad, &x, &y);
+    reply(region->connection, "pad %s %s %.4f %.4f %s\n", reference ? reference : "-", solver_pad_number(pad, NULL), x, y, net_name(solver_pad_net(pad)));
+  }
+  region->lines++;
+  return 1;
+}
+
+static void handle_request(struct Server *server, struct Connection *connection, char *line){
+  char *save = NULL;
+  char *command = strtok_r(line, " \t", &save);
+  if(command == NULL){
+    return;
+  }
+  if(strcmp(command, "PING") == 0){
+    reply(connection, "OK 0\n");
+    return;
+  }
+  char *path = strtok_r(NULL, " \t", &save);
+  if(path == NULL){
+    reply(connection, "ERR missing board\n");
+    return;
+  }
+  struct Cache_Entry *entry = cache_acquire(&server->cache, path);
+  if(entry == NULL){
+    reply(connection, "ERR can't open %s\n", path);
+    return;
+  }
+
+  if(strcmp(command, "STATS") == 0){
+    reply(connection, "OK 1\nnets %d footprints %d pads %u tracks %u vias %u zones %u\n", entry->net_count, entry->footprint_count, entry->pads, entry->tracks, entry->vias, entry->zones);
+  }else if(strcmp(command, "NET") == 0){
+    struct Net_Entry key = {save && *save ? save : "", 0, 0, 0};
+    struct Net_Entry *net = bsearch(&key, entry->nets, entry->net_count, sizeof(struct Net_Entry), compare_net_entry);
+    if(net){
+      reply(connection, "OK 1\nnet %d %s pads %u tracks %u\n", net->ordinal, net->name, net->pads, net->tracks);
+    }else{
+      reply(connection, "ERR no net %s\n", key.name);
+    }
+  }else if(strcmp(command, "PADS") == 0){
+    struct Footprint_Entry key = {strtok_r(NULL, " \t", &save), NULL};
+    struct Footprint_Entry *found = key.reference ? bsearch(&key, entry->footprints, entry->footprint_count, sizeof(struct Footprint_Entry), compare_footprint_entry) : NULL;
+    if(found){
+      size_t header = reply_begin(connection);
+      int lines = 0;
+      for(struct Pad *pad = solver_next_pad(found->footprint, NULL); pad; pad = solver_next_pad(found->footprint, pad)){
+        float x, y;
+        solver_pad_position(found->footprint, pad, &x, &y);
+        reply(connection, "pad %s %.4f %.4f %s\n", solver_pad_number(pad, NULL), x, y, net_name(solver_pad_net(pad)));
+        lines++;
+      }
+      reply_end(connection, header, lines);
+    }else{
+      reply(connection, "ERR no footprint %s\n", key.reference ? key.reference : "");
+    }
+  }else if(strcmp(command, "REGION") == 0){
+    char *layer = strtok_r(NULL, " \t", &save);
+    float box[4];
+    int count = 0;
+    for(char *value; count < 4 && (value = strtok_r(NULL, " \t", &save)); count++){
+      box[count] = strtof(value, NULL);
+    }
+    if(layer == NULL || count < 4){
+      reply(connection, "ERR usage REGION <board> <layer|*> <min x> <min y> <max x> <max y>\n");
+    }else{
+      struct Region region = {connection, 0};
+      size_t header = reply_begin(connection);
+      if(solver_query(entry->board, box[0], box[1], box[2], box[3], strcmp(layer, "*") == 0 ? NULL : layer, region_item, &region) < 0){
+        connection->out_length = header;
+        reply(connection, "ERR no layer %s\n", layer);
+      }else{
+        reply_end(connection, header, region.lines);
+      }
+    }
+  }else{
+    reply(connection, "ERR unknown command %s\n", command);
+  }
+  cache_release(&server->cache, entry);
+}
+
+// Connections
+static void close_connection(struct Connection *connection){
+  close(connection->fd);
+  free(connection->out);
+  free(connection);
+}
+
+static int arm(struct Server *server, struct Connection *connection, uint32_t events){
+  struct epoll_event event = {events | EPOLLONESHOT | EPOLLRDHUP, {.ptr = connection}};
+  return epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, connection->fd, &event);
+}
+
+static void accept_connections(struct Server *server){
+  while(1){
+    int fd = accept4(server->listener.fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if(fd < 0){
+      break;
+    }
+    struct Connection *connection = calloc(1, sizeof(struct Connection));
+    connection->fd = fd;
+    struct epoll_event event = {EPOLLIN | EPOLLONESHOT | EPOLLRDHUP, {.ptr = connection}};
+    if(epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0){
+      close_connection(connection);
+    }
+  }
+  arm(server, &server->listener, EPOLLIN);
+}
+
+// Returns FALSE once the connection is closed
+static int flush_connection(struct Connection *connection){
+  while(connection->out_sent < connection->out_length){
+    ssize_t sent = send(connection->fd, connection->out + connection->out_sent, connection->out_length - connection->out_sent, MSG_NOSIGNAL);
+    if(sent < 0){
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    connection->out_sent += sent;
+  }
+  connection->out_sent = connection->out_length = 0;
+  return 1;
+}
+
+static void serve_connection(struct Server *server, struct Connection *connection, uint32_t events){
+  int open = !(events & (EPOLLERR | EPOLLHUP));
+  while(open && connection->out_length == 0){
+    ssize_t length = recv(connection->fd, connection->in + connection->in_length, sizeof(connection->in) - connection->in_length, 0);
+    if(length == 0 || (length < 0 && errno != EAGAIN && errno != EWOULDBLOCK)){
+      open = 0;
+      break;
+    }
+    if(length < 0){
+      break;
+    }
+    connection->in_length += length;
+    // Answer every complete line, keep the partial one for later
+    char *start = connection->in, *end;
+    while((end = memchr(start, '\n', connection->in + connection->in_length - start))){
+      *end = '\0';
+      if(end > start && end[-1] == '\r'){
+        end[-1] = '\0';
+      }
+      handle_request(server, connection, start);
+      start = end + 1;
+    }
+    connection->in_length -= start - connection->in;
+    memmove(connection->in, start, connection->in_length);
+    if(connection->in_length == sizeof(connection->in)){
+      reply(connection, "ERR line too long\n");
+      connection->in_length = 0;
+    }
+    open = flush_connection(connection);
+  }
+  if(open && connection->out_length){
+    open = flush_connection(connection);
+  }
+  if(!open){
+    close_connection(connection);
+  }else{
+    arm(server, connection, connection->out_length ? EPOLLOUT : EPOLLIN);
+  }
+}
+
+static void *server_worker(void *arg){
+  struct Server *server = arg;
+  struct epoll_event events[SERVER_EVENTS];
+  while(!server_stop){
+    int count = epoll_wait(server->epoll_fd, events, SERVER_EVENTS, 200);
+    for(int i = 0; i < count; i++){
+      struct Connection *connection = events[i].data.ptr;
+      if(connection->listener){
+        accept_connections(server);
+      }else{
+        serve_connection(server, connection, events[i].events);
+      }
+    }
+  }
+  return NULL;
+}
+
+// argv holds the socket path and options after --serve
+int run_server(int argc, char **argv){
+  struct Server server;
+  struct sockaddr_un address;
+  int threads = 0;
+  memset(&server, 0, sizeof(struct Server));
+  server.cache.capacity = 16;
+  if(argc < 1){
+    printf("No socket specified\n");
+    return -1;
+  }
+  for(int i = 1; i + 1 < argc; i += 2){
+    if(strcmp(argv[i], "--threads") == 0){
+      threads = atoi(argv[i + 1]);
+    }else if(strcmp(argv[i], "--cache") == 0){
+      server.cache.capacity = atoi(argv[i + 1]) > 0 ? atoi(argv[i + 1]) : 1;
+    }
+  }
+  if(threads <= 0){
+    threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  if(strlen(argv[0]) >= sizeof(address.sun_path)){
+    printf("Socket path too long\n");
+    return -1;
+  }
+
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, argv[0]);
+  unlink(argv[0]);
+  server.listener.listener = 1;
+  server.listener.fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if(server.listener.fd < 0 || bind(server.listener.fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(server.listener.fd, SOMAXCONN) != 0){
+    perror("Error opening socket");
+    if(server.listener.fd >= 0){
+      close(server.listener.fd);
+    }
+    return -1;
+  }
+  server.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  struct epoll_event event = {EPOLLIN | EPOLLONESHOT, {.ptr = &server.listener}};
+  epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.listener.fd, &event);
+  pthread_mutex_init(&server.cache.lock, NULL);
+  pthread_cond_init(&server.cache.loaded, NULL);
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = server_signal;
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+
+  printf("Serving %s with %d threads\n", argv[0], threads);
+  fflush(stdout);
+  pthread_t *workers = malloc(threads * sizeof(pthread_t));
+  for(int i = 0; i < threads; i++){
+    pthread_create(&workers[i], NULL, server_worker, &server);
+  }
+  for(int i = 0; i < threads; i++){
+    pthread_join(workers[i], NULL);
+  }
+  free(workers);
+
+  // Connections still open are dropped with the process
+  close(server.epoll_fd);
+  close(server.listener.fd);
+  unlink(argv[0]);
+  while(server.cache.head){
+    struct Cache_Entry *entry = server.cache.head;
+    cache_unlink(&server.cache, entry);
+    free_entry(entry);
+  }
+  pthread_mutex_destroy(&server.cache.lock);
+  pthread_cond_destroy(&server.cache.loaded);
+  return 0;
+}
+
+#else
+
+int run_server(int argc, char **argv){
+  printf("The board server needs Linux\n");
+  return -1;
+}
+
+#endif
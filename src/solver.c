@@ -1,130 +1,350 @@
-#include "solver.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
-struct Board *pcb;
+#include "libsolver.h"
+
+// Batch
+int run_batch(int argc, char **argv);
+
+// Server
+int run_server(int argc, char **argv);
+int run_load(int argc, char **argv);
 
 int main(int argc, char **argv){
   //pcb = malloc(sizeof(struct Board));
   printf("Got Here\n");
-  pcb = calloc(1, sizeof(struct Board));
-  printf("Got Here1\n");
   if (argc < 2){
     printf("No file specified\n");
     return EXIT_FAILURE;
   }
-  token_table_init();
-  open_pcb(argv[1]);
-  
-  //print_footprints(pcb->footprints);
-  //print_tracks(pcb->tracks);
-  print_zone(pcb->zones);
-  free_pcb();
-
-  return EXIT_SUCCESS;
-}
-
-
-void free_pcb(){
-  //a();
-  struct Layer *layer = pcb->layers.layer;
-  struct Net *net = pcb->nets;
-  struct Footprint *footprint = pcb->footprints;
-  struct Track *track = pcb->tracks;
-  struct Zone *zone = pcb->zones;
-  
-  //a();
-  free(pcb->header.version.chars);
-  free(pcb->header.generator.chars);
-  free(pcb->header.generator_version.chars);
-  free(pcb->page.paper.chars);
-  while(layer){
-    struct Layer *temp = layer;
-    layer = layer->next;
-    free(temp->canonical_name.chars);
-    free(temp->user_name.chars);
-    free(temp->material.chars);
-    free(temp->stackup_type.chars);
-    free(temp);
-  }
-  //a();
-  while(net){
-    struct Net *temp = net;
-    net = net->next;
-    free(temp->name.chars);
-    free(temp);
-  }
-  //a();
-  while(footprint){
-    struct Footprint *temp = footprint;
-    footprint = footprint->next;
-      if(temp->properties){
-        struct Footprint_Property *property = temp->properties;
-        struct Footprint_Property *temp_property;
-        while(property){ 
-          temp_property = property;
-          property = property->next;
-          free(temp_property->uuid.chars);
-          free(temp_property->property->key.chars);
-          free(temp_property->property->val.chars);
-          free(temp_property->property);
-          free(temp_property);
-        }
+  if(strcmp(argv[1], "--batch") == 0){
+    int status = run_batch(argc - 2, argv + 2);
+    solver_cleanup();
+    return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  if(strcmp(argv[1], "--serve") == 0 || strcmp(argv[1], "--load") == 0){
+    int status = argv[1][2] == 's' ? run_server(argc - 2, argv + 2) : run_load(argc - 2, argv + 2);
+    solver_cleanup();
+    return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  if(strcmp(argv[1], "--write") == 0){
+    if(argc < 4){
+      printf("Usage --write <board> <out>\n");
+      return EXIT_FAILURE;
+    }
+    struct Board *board = solver_open(argv[2]);
+    int status = board ? solver_save(board, argv[3]) : -1;
+    solver_close(board);
+    solver_cleanup();
+    return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  if(strcmp(argv[1], "--gerber") == 0){
+    // --gerber <board> <dir> [threads]
+    if(argc < 4){
+      printf("Usage --gerber <board> <dir> [threads]\n");
+      return EXIT_FAILURE;
+    }
+    struct Board *board = solver_open(argv[2]);
+    int count = board ? solver_export_gerbers(board, argv[3], argc > 4 ? atoi(argv[4]) : 0) : -1;
+    if(count >= 0){
+      printf("Wrote %d layers\n", count);
+    }
+    solver_close(board);
+    solver_cleanup();
+    return count >= 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  if(strcmp(argv[1], "--drill") == 0){
+    // --drill <board> <dir> [threads]
+    if(argc < 4){
+      printf("Usage --drill <board> <dir> [threads]\n");
+      return EXIT_FAILURE;
+    }
+    struct Board *board = solver_open(argv[2]);
+    double seed = 0, travel = 0;
+    int count = board ? solver_export_drills(board, argv[3], argc > 4 ? atoi(argv[4]) : 0, &seed, &travel) : -1;
+    if(count >= 0){
+      printf("Wrote %d holes, travel %.1f mm from %.1f mm\n", count, travel, seed);
+    }
+    solver_close(board);
+    solver_cleanup();
+    return count >= 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  if(strcmp(argv[1], "--raster") == 0){
+    // --raster <board> <layer> <out> [dpi] [depth] [threads]
+    if(argc < 5){
+      printf("Usage --raster <board> <layer> <out> [dpi] [depth] [threads]\n");
+      return EXIT_FAILURE;
+    }
+    struct Board *board = solver_open(argv[2]);
+    struct Raster *raster = board ? solver_rasterise(board, argv[3], argc > 5 ? atof(argv[5]) : 600, argc > 6 ? atoi(argv[6]) : 1, argc > 7 ? atoi(argv[7]) : 0) : NULL;
+    int status = raster ? solver_raster_write(raster, argv[4]) : -1;
+    if(status == 0){
+      int width, height;
+      solver_raster_size(raster, &width, &height);
+      printf("Wrote %d x %d pixels\n", width, height);
+    }
+    solver_raster_free(raster);
+    solver_close(board);
+    solver_cleanup();
+    return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  if(strcmp(argv[1], "--diff") == 0){
+    // --diff <before> <after> [dir] [dpi] [threads]
+    if(argc < 4){
+      printf("Usage --diff <before> <after> [dir] [dpi] [threads]\n");
+      return EXIT_FAILURE;
+    }
+    int changes = solver_diff(argv[2], argv[3], argc > 4 ? argv[4] : NULL, argc > 5 ? atof(argv[5]) : 600, argc > 6 ? atoi(argv[6]) : 0);
+    printf("%d changes\n", changes);
+    solver_cleanup();
+    return changes >= 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  if(strcmp(argv[1], "--route") == 0){
+    // --route <board> <out> [grid] [threads]
+    if(argc < 4){
+      printf("Usage --route <board> <out> [grid] [threads]\n");
+      return EXIT_FAILURE;
+    }
+    struct Board *board = solver_open(argv[2]);
+    int connections = 0;
+    int routed = board ? solver_route(board, argc > 4 ? atof(argv[4]) : 0, 0, 0, argc > 5 ? atoi(argv[5]) : 0, &connections) : -1;
+    int status = routed >= 0 ? solver_save(board, argv[3]) : -1;
+    if(status == 0){
+      printf("Routed %d of %d connections\n", routed, connections);
+    }
+    solver_close(board);
+    solver_cleanup();
+    return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  if(strcmp(argv[1], "--place") == 0){
+    // --place <board> <out> [effort] [threads]
+    if(argc < 4){
+      printf("Usage --place <board> <out> [effort] [threads]\n");
+      return EXIT_FAILURE;
+    }
+    struct Board *board = solver_open(argv[2]);
+    double wirelength[2] = {0, 0};
+    int moved = board ? solver_place(board, argc > 4 ? atof(argv[4]) : 0, argc > 5 ? atoi(argv[5]) : 0, 0, wirelength) : -1;
+    int status = moved >= 0 ? solver_save(board, argv[3]) : -1;
+    if(status == 0){
+      printf("Moved %d footprints, wirelength %.1f mm to %.1f mm\n", moved, wirelength[0], wirelength[1]);
+    }
+    solver_close(board);
+    solver_cleanup();
+    return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  if(strcmp(argv[1], "--nets") == 0){
+    // --nets <board> [sort] [threads]
+    if(argc < 3){
+      printf("Usage --nets <board> [name|length|hpwl|vias|ratio] [threads]\n");
+      return EXIT_FAILURE;
+    }
+    struct Board *board = solver_open(argv[2]);
+    int count = board ? solver_net_report(board, NULL, argc > 3 ? argv[3] : NULL, argc > 4 ? atoi(argv[4]) : 0) : -1;
+    solver_close(board);
+    solver_cleanup();
+    return count >= 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  if(strcmp(argv[1], "--pairs") == 0){
+    // --pairs <board> [patterns] [max_skew] [threads]
+    if(argc < 3){
+      printf("Usage --pairs <board> [patterns] [max_skew] [threads]\n");
+      return EXIT_FAILURE;
+    }
+    struct Board *board = solver_open(argv[2]);
+    const char *patterns = argc > 3 && strcmp(argv[3], "-") != 0 ? argv[3] : NULL;
+    int violations = board ? solver_check_pairs(board, patterns, 0, argc > 4 ? atof(argv[4]) : 0, argc > 5 ? atoi(argv[5]) : 0, NULL) : -1;
+    solver_close(board);
+    solver_cleanup();
+    return violations == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  if(strcmp(argv[1], "--impedance") == 0){
+    // --impedance <board> [closed|field] [tolerance] [threads]
+    if(argc < 3){
+      printf("Usage --impedance <board> [closed|field] [tolerance] [threads]\n");
+      return EXIT_FAILURE;
+    }
+    struct Board *board = solver_open(argv[2]);
+    int field = argc > 3 && strcmp(argv[3], "field") == 0;
+    int steps = board ? solver_impedance_report(board, field, argc > 4 ? atof(argv[4]) : 0, argc > 5 ? atoi(argv[5]) : 0, NULL) : -1;
+    solver_close(board);
+    solver_cleanup();
+    return steps >= 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  if(strcmp(argv[1], "--crosstalk") == 0){
+    // --crosstalk <board> [max_spacing] [rise_ns] [top] [threads]
+    if(argc < 3){
+      printf("Usage --crosstalk <board> [max_spacing] [rise_ns] [top] [threads]\n");
+      return EXIT_FAILURE;
+    }
+    struct Board *board = solver_open(argv[2]);
+    int victims = board ? solver_check_crosstalk(board, argc > 3 ? atof(argv[3]) : 0, argc > 4 ? atof(argv[4]) : 0, argc > 5 ? atoi(argv[5]) : 0,
+      argc > 6 ? atoi(argv[6]) : 0, NULL, NULL) : -1;
+    solver_close(board);
+    solver_cleanup();
+    return victims >= 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  if(strcmp(argv[1], "--outline") == 0){
+    // --outline <board> [max_error] [x,y]...
+    if(argc < 3){
+      printf("Usage --outline <board> [max_error] [x,y]...\n");
+      return EXIT_FAILURE;
+    }
+    struct Board *board = solver_open(argv[2]);
+    double area = 0;
+    float box[4];
+    int cutouts = 0, open_chains = 0;
+    int rings = board ? solver_board_outline(board, argc > 3 ? atof(argv[3]) : 0, &area, box, &cutouts, &open_chains) : 0;
+    if(board){
+      printf("%d rings, %d cutouts, %d open chains, %.4f mm^2, box %.4f %.4f %.4f %.4f\n", rings, cutouts, open_chains, area, box[0], box[1], box[2], box[3]);
+    }
+    for(int i = 4; board && i < argc; i++){
+      float x, y;
+      if(sscanf(argv[i], "%f,%f", &x, &y) == 2){
+        printf("%.4f %.4f %s\n", x, y, solver_board_contains(board, x, y) ? "inside" : "outside");
       }
-      //a();
-      if(temp->fp_lines){
-        struct Line  *line = temp->fp_lines;
-        struct Line  *temp_line;
-        while(line){
-          temp_line = line;
-          line = line->next;
-          free(temp_line->uuid.chars);
-          free(temp_line);
+    }
+    solver_close(board);
+    solver_cleanup();
+    return rings > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  if(strcmp(argv[1], "--courtyard") == 0){
+    // --courtyard <board> [clearance] [edge_clearance] [threads]
+    if(argc < 3){
+      printf("Usage --courtyard <board> [clearance] [edge_clearance] [threads]\n");
+      return EXIT_FAILURE;
+    }
+    struct Board *board = solver_open(argv[2]);
+    int violations = board ? solver_check_courtyards(board, argc > 3 ? atof(argv[3]) : 0, argc > 4 ? atof(argv[4]) : 0, argc > 5 ? atoi(argv[5]) : 0, NULL) : -1;
+    solver_close(board);
+    solver_cleanup();
+    return violations == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  if(strcmp(argv[1], "--irdrop") == 0){
+    // --irdrop <board> <net> <volts> <REF.PAD[=amps]>... [--cell mm] [--map prefix] [--threads n]
+    if(argc < 6){
+      printf("Usage --irdrop <board> <net> <volts> <REF.PAD[=amps]>... [--cell mm] [--map prefix] [--threads n]\n");
+      return EXIT_FAILURE;
+    }
+    const char **pads = malloc(argc * sizeof(char *));
+    float *currents = malloc(argc * sizeof(float)), cell = 0;
+    int count = 0, threads = 0;
+    const char *map = NULL;
+    for(int i = 5; i < argc; i++){
+      if(strcmp(argv[i], "--cell") == 0 && i + 1 < argc){
+        cell = atof(argv[++i]);
+      }else if(strcmp(argv[i], "--map") == 0 && i + 1 < argc){
+        map = argv[++i];
+      }else if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc){
+        threads = atoi(argv[++i]);
+      }else{
+        char *equals = strchr(argv[i], '=');
+        currents[count] = equals ? atof(equals + 1) : 0;
+        if(equals){
+          *equals = '\0';
         }
+        pads[count++] = argv[i];
       }
-      //a();
-      if(temp->pads){
-        struct Pad *pad = temp->pads;
-        struct Pad * temp_pad;
-        while(pad){
-          temp_pad = pad;
-          //printf("Pad: %p\n", pad);
-          pad = pad->next;
-          free(temp_pad->num.chars);
-          free(temp_pad->uuid.chars);
-          free(temp_pad->layers);
-          free(temp_pad);
-        }
+    }
+    struct Board *board = solver_open(argv[2]);
+    int status = board ? solver_ir_drop(board, argv[3], atof(argv[4]), pads, currents, count, cell, threads, map, NULL, NULL) : -1;
+    free(pads);
+    free(currents);
+    solver_close(board);
+    solver_cleanup();
+    return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  if(strcmp(argv[1], "--thermal") == 0){
+    // --thermal <board> [--cell mm] [--ambient C] [--property name] [--map prefix] [--threads n]
+    if(argc < 3){
+      printf("Usage --thermal <board> [--cell mm] [--ambient C] [--property name] [--map prefix] [--threads n]\n");
+      return EXIT_FAILURE;
+    }
+    float cell = 0, ambient = 0;
+    int threads = 0;
+    const char *property = NULL, *map = NULL;
+    for(int i = 3; i + 1 < argc; i++){
+      if(strcmp(argv[i], "--cell") == 0){
+        cell = atof(argv[++i]);
+      }else if(strcmp(argv[i], "--ambient") == 0){
+        ambient = atof(argv[++i]);
+      }else if(strcmp(argv[i], "--property") == 0){
+        property = argv[++i];
+      }else if(strcmp(argv[i], "--map") == 0){
+        map = argv[++i];
+      }else if(strcmp(argv[i], "--threads") == 0){
+        threads = atoi(argv[++i]);
       }
-      if(temp->model){
-        free(temp->model->model.chars);
-        free(temp->model);
+    }
+    struct Board *board = solver_open(argv[2]);
+    int status = board ? solver_thermal(board, cell, ambient, property, threads, map, NULL, NULL) : -1;
+    solver_close(board);
+    solver_cleanup();
+    return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  if(strcmp(argv[1], "--uuid") == 0){
+    // --uuid <board> <uuid>...
+    static const char *kinds[] = {"none", "footprint", "property", "line", "pad", "track", "zone"};
+    if(argc < 4){
+      printf("Usage --uuid <board> <uuid>...\n");
+      return EXIT_FAILURE;
+    }
+    struct Board *board = solver_open(argv[2]);
+    for(int i = 3; board && i < argc; i++){
+      int kind;
+      struct Footprint *footprint;
+      void *item = solver_find_uuid(board, argv[i], &kind, &footprint);
+      printf("%s %s", argv[i], kinds[kind]);
+      if(footprint){
+        printf(" in %s", solver_footprint_reference(footprint, NULL));
       }
-    free(temp->attr.chars);
-    free(temp->description.chars);
-    free(temp->library_link.chars);
-    free(temp->path.chars);
-    free(temp->uuid.chars);
-    free(temp);
-  }
-  while(track){
-    struct Track *temp = track;
-    track = track->next;
-    if(temp->type == TRACK_TYPE_ARC){
-      free(temp->uuid.chars);
-    }else if(temp->type == TRACK_TYPE_SEG){
-      free(temp->uuid.chars);
-    }else if(temp->type == TRACK_TYPE_VIA){
-      free(temp->uuid.chars);
-      free(temp->track.via.layers);
-    }
-    free(temp);
-  }
-  while(zone){
-    struct Zone *temp = zone;
-    zone = zone->next;
-    free(temp->uuid.chars);
-    free(temp->polygon.points);
-    free(temp->filled_polygon.points);
-    free(temp);
-  }
-  free(pcb);
-}
\ No newline at end of file
+      printf("%s\n", item ? "" : " not found");
+    }
+    solver_close(board);
+    solver_cleanup();
+    return board ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  if(strcmp(argv[1], "--fill") == 0){
+    // --fill <board> [out], out gets the board with the new fills
+    if(argc < 3){
+      printf("No file specified\n");
+      return EXIT_FAILURE;
+    }
+    struct Board *board = solver_open(argv[2]);
+    if(board == NULL){
+      solver_cleanup();
+      return EXIT_FAILURE;
+    }
+    int zones = solver_fill_zones(board, 0.01, 0);
+    printf("Filled %d zones\n", zones);
+    for(struct Zone *zone = solver_next_zone(board, NULL); zone; zone = solver_next_zone(board, zone)){
+      int points;
+      char uuid[SOLVER_UUID_SIZE];
+      int polygons = solver_zone_filled(zone, &points);
+      printf("Zone %s: %d polygons, %d points\n", solver_zone_uuid(zone, uuid), polygons, points);
+    }
+    if(argc > 3 && solver_save(board, argv[3]) != 0){
+      solver_close(board);
+      solver_cleanup();
+      return EXIT_FAILURE;
+    }
+    solver_close(board);
+    solver_cleanup();
+    return EXIT_SUCCESS;
+  }
+  struct Board *board = solver_open(argv[1]);
+  if(board == NULL){
+    solver_cleanup();
+    return EXIT_FAILURE;
+  }
+  printf("Got Here1\n");
+
+  //print_footprints(pcb->footprints);
+  //print_tracks(pcb->tracks);
+  solver_print(board);
+  solver_close(board);
+  solver_cleanup();
+
+  return EXIT_SUCCESS;
+}
@@ -33,6 +33,8 @@
 #define SECTION_UNSET 0
 #define SECTION_SET 1
 #define SECTION_CLOSED 2
+// Changed since parsing, the writer emits it from the model
+#define SECTION_MODIFIED 3
 
 #define LAYER_TYPE_JUMPER 1
 #define LAYER_TYPE_MIXED 2
@@ -65,12 +67,31 @@
 #define NO_CONNECT 0
 #define THERMAL_RELIEF 1
 #define SOLID_FILL 2
+#define THRU_HOLE_ONLY 3
+
+#define HATCH_NONE 0
+#define HATCH_EDGE 1
+#define HATCH_FULL 2
+
+#define ITEM_TRACK 1
+#define ITEM_PAD 2
+
+// Most points pad_outline and capsule_outline write
+#define PAD_OUTLINE_MAX 20
 
 typedef struct {
     char *chars;
     uint64_t length;
 } String;
 
+// 128 bit uuid, all zero when an item has none
+// text is the uuid as the file wrote it when that was not the canonical
+// form, interned, NULL otherwise
+struct Uuid {
+  uint64_t high, low;
+  const char *text;
+};
+
 
 struct Section_Index{
   int set;
@@ -118,6 +139,8 @@ struct Property{
 struct Stackup{
   struct Section_Index index;
   String finish;
+  // Entry being parsed
+  struct Layer *layer;
 };
 
 struct Setup {
@@ -158,7 +181,8 @@ struct Footprint {
   struct Section_Index index;
   String library_link;
   struct Layer *layer;
-  String uuid, description;
+  struct Uuid uuid;
+  String description;
   struct at at;
   // Properties properties; // I think text properties are needed to be treated different
   struct Footprint_Property{
@@ -166,20 +190,27 @@ struct Footprint {
     struct Property *property;
     struct at at;
     struct Layer *layer;
-    String uuid; 
+    struct Uuid uuid;
     struct Footprint_Property *next, *prev;
   } *properties;
   String path, sheetname, sheetfile, attr;
   struct Text *fp_texts;
   struct Line *fp_lines;
+  // Rects, circles, arcs and polys stay with each instance
   struct Rect *fp_rects;
-  struct Circule *fp_circles;
-  struct Arc *fp_arcs;
+  struct Circle *fp_circles;
+  struct Footprint_Arc *fp_arcs;
   struct Polygon *fp_poly;
   struct Curve *fp_curve;
   struct Pad *pads;
   struct Footprint *prev, *next;
   struct Model *model;
+  // fp_lines, model and the pads' layers belong to body, the uuids of
+  // fp_lines are this instance's in list order
+  struct Footprint_Body *body;
+  struct Uuid *line_uuids;
+  // Set by a bare locked after the library link or (locked yes)
+  int locked;
 };
 
 struct Point {
@@ -203,19 +234,30 @@ struct Line {
     float width;
     String type;
   } stroke;
-  String uuid;
+  struct Uuid uuid;
   struct Line *prev, *next;
 };
 
+// Oval drills are diameter wide in x and width in y, offset is in the
+// pad's frame
+struct Drill{
+  struct Section_Index index;
+  int oval;
+  float diameter, width;
+  struct Point offset;
+};
+
 struct Pad {
   struct Section_Index index;
   String num;
   int type, shape, function, layer_count;
   struct at at;
   struct Size size;
+  struct Drill drill;
+  float roundrect_rratio;
   struct Layer **layers;
   struct Net *net;
-  String uuid;
+  struct Uuid uuid;
   struct Pad *next, *prev;
 };
 
@@ -247,8 +289,30 @@ struct File_Buffer {
   uint64_t index;
 };
 
+#define DRAWING_LINE 1
+#define DRAWING_ARC 2
+#define DRAWING_CIRCLE 3
+#define DRAWING_RECT 4
+#define DRAWING_POLY 5
+
+// A gr_line, gr_arc, gr_circle, gr_rect or gr_poly of the board. Circles
+// keep their centre in start and a point on the circle in end, rects two
+// opposite corners, polys their points.
+struct Drawing {
+  struct Section_Index index;
+  int type;
+  struct Point start, mid, end;
+  struct Point *points;
+  int point_count, point_index;
+  struct Layer *layer;
+  float width;
+  struct Uuid uuid;
+  struct Drawing *prev, *next;
+};
+
 struct Graphic {
   struct Section_Index index;
+  struct Drawing *drawings;
   struct Text *gr_text;
   struct Text_Box *gr_text_box;
   struct Rect *gr_rect;
@@ -262,14 +326,14 @@ struct Text{
   struct Section_Index index;
   struct Point pos;
   struct Layer *layer;
-  String uuid;
+  struct Uuid uuid;
 };
 
 struct Text_Box{
   struct Section_Index index;
   struct Point pos;
   struct Layer *layer;
-  String uuid;
+  struct Uuid uuid;
 };
 
 struct Rect{
@@ -278,17 +342,28 @@ struct Rect{
   struct Layer *layer;
   float width;
   int fill;
-  String uuid;
-  struct Graphical_Rect *next, *prev;
+  struct Uuid uuid;
+  struct Rect *next, *prev;
 };
 
 struct Circle{
   struct Section_Index index;
-  struct Point center, end;                                 
+  struct Point center, end;
   struct Layer *layer;
   float width;
   int fill;
-  String uuid;
+  struct Uuid uuid;
+  struct Circle *next, *prev;
+};
+
+// Track arcs are struct Arc
+struct Footprint_Arc{
+  struct Section_Index index;
+  struct Point start, mid, end;
+  struct Layer *layer;
+  float width;
+  struct Uuid uuid;
+  struct Footprint_Arc *next, *prev;
 };
 
 /*  Duplicate struct except track arcs has a net pointer
@@ -297,7 +372,7 @@ struct Arc{
   struct Point start, mid, end;
   struct Layer *layer;
   float width;
-  String uuid;
+  struct Uuid uuid;
 };
 */
 
@@ -308,7 +383,8 @@ struct Polygon{
   float width;
   int fill;
   int point_count, point_index;
-  String uuid;
+  struct Uuid uuid;
+  struct Polygon *next, *prev;
 };
 
 struct Curve{
@@ -316,14 +392,7 @@ struct Curve{
   struct Point **points;
   struct Layer *layer;
   float width;
-  String uuid;
-};
-
-struct Drill{
-  struct Section_Index index;
-  int oval;
-  float diameter, width;
-  struct Point offset;
+  struct Uuid uuid;
 };
 
 struct Images{
@@ -369,7 +438,7 @@ struct Track{
     struct Arc arc;
     struct Via via;
   } track;
-  String uuid;
+  struct Uuid uuid;
   struct Track *prev, *next;
 };
 
@@ -387,17 +456,296 @@ struct Zone {
   struct Section_Index index;
   struct Net *net;
   struct Layer *layer;
-  String uuid;
+  struct Uuid uuid;
   uint32_t priority;
   int hatch_style, connect_pads, fill;
   float min_thickness, hatch_pitch;
+  float clearance, thermal_gap, thermal_bridge_width;
   struct Polygon polygon, filled_polygon;
+  struct Ring *rings;
   struct Zone *next, *prev;
 };
 
-extern struct Board {
+struct Box {
+  float min_x, min_y, max_x, max_y;
+};
+
+// Geometry shared by every footprint placed from the same library body,
+// box is the extent of pads and lines in the footprint's frame
+struct Footprint_Body {
+  String library_link;
+  uint64_t hash;
+  uint32_t instances, pad_count, line_count;
+  struct Line *lines;
+  struct Model *model;
+  struct Layer ***pad_layers;
+  struct Box box;
+  struct Footprint_Body *next;
+};
+
+// Edges are culled in blocks of RING_BLOCK, one bounding box per block
+#define RING_BLOCK 8
+
+// Structure of arrays copy of a polygon for the batch kernels
+// x/y hold count + 1 points so edge i is (x[i], y[i]) -> (x[i+1], y[i+1])
+struct Ring {
+  int count, block_count;
+  float *x, *y, *slope;
+  struct Box box;
+  struct Box *blocks;
+  struct Ring *next;
+};
+
+// Copper item as seen by the spatial index, layers is a mask of layer ordinals
+struct Item {
+  int kind;
+  struct Box box;
+  uint64_t layers;
+  struct Net *net;
+  struct Track *track;
+  struct Pad *pad;
+  struct Footprint *footprint;
+};
+
+// Uniform grid of item indices, cell_start has nx * ny + 1 entries
+struct Spatial_Index {
+  struct Box box;
+  float cell;
+  int nx, ny;
+  uint32_t count;
+  struct Item *items;
+  uint32_t *cell_start, *cell_items;
+};
+
+// Coverage bitmap in tiles of RASTER_TILE pixels square, tiles nothing
+// covers stay NULL. Depth 1 packs 8 pixels a byte, most significant first,
+// depth 8 holds 0-255 coverage. scale is pixels per mm from box's corner.
+#define RASTER_TILE 256
+struct Raster {
+  int width, height, depth, columns, rows;
+  float scale;
+  struct Box box;
+  uint8_t **tiles;
+};
+
+#define UUID_FOOTPRINT 1
+#define UUID_PROPERTY 2
+#define UUID_LINE 3
+#define UUID_PAD 4
+#define UUID_TRACK 5
+#define UUID_ZONE 6
+
+// item points at the struct named by kind, footprint is the item's own
+// footprint, NULL for tracks and zones
+struct Uuid_Entry {
+  struct Uuid uuid;
+  int kind;
+  void *item;
+  struct Footprint *footprint;
+};
+
+// Open addressing, kind 0 marks an empty slot
+struct Uuid_Index {
+  struct Uuid_Entry *entries;
+  uint32_t capacity, count;
+};
+
+// Every parsed string of a board, see intern.c
+struct Intern_Table;
+
+// Rules for route_board, fields left 0 take the defaults
+struct Route_Options {
+  float grid, width, clearance, via_size, via_drill;
+  int iterations, threads;
+};
+
+// shared counts nets that still overlapped another after the last pass
+// and could not be rerouted whole around the rest
+struct Route_Stats {
+  uint32_t nets, connections, routed, shared, segments, vias, iterations;
+  double length;
+};
+
+// Settings for place_board, fields left 0 take the defaults. effort scales
+// the moves tried per temperature, chains run independently, one per thread
+struct Place_Options {
+  float effort, spacing, overlap_weight;
+  int chains, threads;
+  uint64_t seed;
+};
+
+// Wirelength is the half perimeter sum over nets, overlap the area in mm^2
+// of footprint boxes that cover each other on one side
+struct Place_Stats {
+  uint32_t footprints, movable, nets, chains, temperatures;
+  uint64_t moves, accepted;
+  double wirelength_before, wirelength, overlap_before, overlap;
+};
+
+// Per net totals net_metrics keeps, lengths in mm. layer_length follows
+// the board's copper layers in stackup order, see net_metrics_layer.
+#define NET_METRIC_LAYERS 32
+struct Net_Metric {
+  struct Net *net;
+  uint32_t segments, arcs, vias, pads;
+  double length, hpwl;
+  double layer_length[NET_METRIC_LAYERS];
+};
+
+// Keys for net_metrics_report
+#define NET_SORT_NAME 0
+#define NET_SORT_LENGTH 1
+#define NET_SORT_HPWL 2
+#define NET_SORT_VIAS 3
+#define NET_SORT_RATIO 4
+
+// Settings for check_pairs, fields left 0 take the defaults. max_gap is the
+// edge to edge distance up to which a pair counts as coupled, patterns a
+// file of extra suffix pairs and length groups
+struct Pair_Options {
+  float max_gap, step, max_skew;
+  int threads;
+  const char *patterns;
+};
+
+struct Pair_Stats {
+  uint32_t pairs, groups, grouped, violations;
+};
+
+// Settings for check_impedance, fields left 0 take the defaults. field
+// adds the finite difference solver, tolerance is the relative step in
+// impedance between joined tracks that counts as a discontinuity
+struct Impedance_Options {
+  float tolerance;
+  int field, threads;
+};
+
+// sections counts every cross section cached on the board, new_sections
+// those this run added, solved those the field solver ran on
+struct Impedance_Stats {
+  uint32_t tracks, sections, new_sections, solved, nets, discontinuities;
+};
+
+// Copper layer of the board top to bottom, below is the dielectric down
+// to the next in mm and epsilon_r its permittivity. Reference layers are
+// power planes or carry a zone.
+#define STACK_MAX_LAYERS 64
+#define STACK_COPPER 0.035f
+#define STACK_BOARD 1.6f
+#define STACK_EPSILON_R 4.5f
+struct Stack_Layer {
+  struct Layer *layer;
+  float thickness, below, epsilon_r;
+  int reference;
+};
+
+// Symmetric system with one node per used cell of an nx by ny grid on each
+// layer. Rows of CSR hold the off diagonal conductances, the matrix their
+// negatives. Fixed rows, when fixed is set, have no entries, nothing refers
+// to them and they solve to 0.
+struct Grid_System {
+  int n, nx, ny, layers;
+  int *row, *column;
+  double *value, *diagonal, *b;
+  int *x_cell, *y_cell, *layer;
+  uint8_t *fixed;
+};
+
+// A pad by footprint reference and number, current in A drawn from the
+// net, 0 for a source held at the supply
+struct IR_Terminal {
+  const char *reference, *pad;
+  float current;
+};
+
+// Settings for ir_drop, cell is the mesh pitch in mm, 0.1 when 0. map is
+// a path prefix for one PGM drop map per layer, NULL for none.
+struct IR_Options {
+  const char *net;
+  const struct IR_Terminal *terminals;
+  int terminal_count;
+  float voltage, cell;
+  int threads;
+  const char *map;
+};
+
+// Drops in V, densities in A/mm^2. islands counts nodes no source reaches,
+// unconnected the sinks among them.
+struct IR_Stats {
+  uint32_t nodes, edges, iterations, islands, unconnected;
+  double residual, max_drop, max_density;
+};
+
+// Settings for thermal_solve, fields left 0 take the defaults. cell is the
+// grid pitch in mm, 0.5 when 0, ambient in C, 25 when 0, and convection
+// the heat loss from each face of the board in W/m^2K, 10 when 0.
+// property names the footprint property holding its power, "Power" when
+// NULL. map is a path prefix for one PGM temperature map per layer.
+struct Thermal_Options {
+  float cell, ambient, convection;
+  const char *property;
+  int threads;
+  const char *map;
+};
+
+// power in W from footprints dissipating, max_temperature in C
+struct Thermal_Stats {
+  uint32_t nodes, layers, footprints, iterations;
+  double residual, power, max_temperature;
+};
+
+// Settings for check_crosstalk, fields left 0 take the defaults. Segments
+// couple within max_spacing mm edge to edge and angle degrees of parallel,
+// rise_time is the aggressors' edge in ns and net pairs coupled over less
+// than min_length mm are dropped. top limits the aggressors listed per net.
+struct Crosstalk_Options {
+  float max_spacing, angle, rise_time, min_length;
+  int top, threads;
+};
+
+// pieces are coupled segment overlaps, couplings the victim and aggressor
+// net pairs they add up to. Crosstalk is a fraction of the aggressor swing.
+struct Crosstalk_Stats {
+  uint32_t segments, pieces, couplings, victims;
+  uint64_t candidates;
+  double worst_next, worst_fext;
+};
+
+// Settings for check_courtyards, fields left 0 take the defaults.
+// Courtyards on one side closer than clearance mm are violations, as are
+// those off the board outline or within edge_clearance mm of its edge.
+struct Courtyard_Options {
+  float clearance, edge_clearance;
+  int threads;
+};
+
+// missing counts footprints checked with their body box for want of
+// courtyard lines, area is the total overlap in mm^2, edge counts the
+// violations at the board edge
+struct Courtyard_Stats {
+  uint32_t footprints, missing, overlaps, violations, edge;
+  uint64_t candidates;
+  double area;
+};
+
+// Closed rings of Edge.Cuts, see outline.c. area is the board's in mm^2
+// less its cutouts, box the extent of the board rings.
+struct Board_Outline {
+  struct Ring *rings;
+  int ring_count, cutouts, open_chains;
+  float max_error;
+  double area;
+  struct Box box;
+};
+
+struct Net_Metrics;
+struct Impedance_Cache;
+
+// Every thread works on its own board, libsolver.c points it at a handle
+extern _Thread_local struct Board {
   // Buffer
   struct File_Buffer file_buffer;
+  String source;
   int opens;
 
   // Kicad PCB
@@ -417,18 +765,196 @@ extern struct Board {
   struct Track *tracks;
   struct Zone *zones;
   struct Groups groups;
+  struct Footprint_Body *bodies;
+
+  // Derived data
+  struct Spatial_Index *spatial;
+  struct Uuid_Index *uuids;
+  struct Net_Metrics *metrics;
+  struct Impedance_Cache *impedance;
+  struct Board_Outline *outline;
+
+  // Owns every String the parser produced
+  struct Intern_Table *strings;
 } *pcb;
 
+// Item counts for generate_board, pads are per footprint and
+// fill_points per zone. With local set pads only share nets with the
+// neighbouring footprints, as the router bench wants.
+struct Generator {
+  uint32_t footprints, pads, segments, vias, nets, zones, fill_points;
+  uint64_t seed;
+  int local;
+};
+
+#ifdef BENCH
+// Inclusive parse time of one class of top level item
+struct Parse_Timing {
+  char name[32];
+  uint64_t count;
+  double seconds;
+};
+#endif
+
+#ifdef PROFILE
+// Keywords, helpers and the unknown bucket, past it slots are shared
+#define PROFILE_SLOTS 96
+#endif
+
 // Solver
 void free_pcb();  
 
 // Parser
 int open_pcb(const char *path);
+int open_pcb_buffer(const char *buffer, uint64_t length);
 void token_table_init();
+void token_table_free();
+#ifdef BENCH
+int parse_timings(struct Parse_Timing **timings);
+void parse_timings_reset();
+#endif
+
+#ifdef PROFILE
+// Profile
+int profile_register(const char *name);
+uint64_t profile_now();
+uint64_t profile_enter();
+void profile_leave(int slot, uint64_t start, uint64_t bytes, uint64_t handler);
+void profile_dump();
+#endif
 
 // Utils
 int string_compare(String _1, String _2);
 
+// Intern
+struct Intern_Table *intern_table_create();
+void intern_table_free(struct Intern_Table *table);
+String intern(struct Intern_Table *table, const char *chars, uint64_t length);
+void intern_stats(struct Intern_Table *table, uint32_t *count, uint64_t *bytes);
+
+// UUIDs
+struct Uuid uuid_parse(const char *text, uint64_t length);
+int uuid_format(struct Uuid uuid, char *out);
+const char *uuid_string(struct Uuid uuid, char *out);
+int uuid_is_nil(struct Uuid uuid);
+int uuid_equal(struct Uuid _1, struct Uuid _2);
+uint64_t uuid_hash(struct Uuid uuid);
+int uuid_index_init();
+void uuid_index_free(struct Uuid_Index *index);
+const struct Uuid_Entry *uuid_find(const struct Uuid_Index *index, struct Uuid uuid);
+
+// Footprint bodies
+int footprint_bodies_init();
+void footprint_bodies_free(struct Footprint_Body *bodies);
+struct Box footprint_box(struct Footprint *footprint);
+
+// Geometry
+struct Ring *ring_create(struct Polygon *polygon);
+void ring_free(struct Ring *ring);
+int zone_rings_init(struct Zone *zone);
+void ring_contains_points(const struct Ring *ring, const struct Point *points, int count, uint8_t *inside);
+int ring_contains_point(const struct Ring *ring, struct Point point);
+void ring_points_distance(const struct Ring *ring, const struct Point *points, int count, float *distance);
+float ring_point_distance(const struct Ring *ring, struct Point point);
+void ring_segments_distance(const struct Ring *ring, const struct Point *starts, const struct Point *ends, int count, float *distance);
+float ring_segment_distance(const struct Ring *ring, struct Point start, struct Point end);
+void ring_segments_overlap(const struct Ring *ring, const struct Point *starts, const struct Point *ends, const float *widths, int count, uint8_t *overlap);
+int rings_contain_point(const struct Ring *rings, struct Point point);
+int rings_overlap_segment(const struct Ring *rings, struct Point start, struct Point end, float width);
+struct Point rotate_point(struct Point point, float angle);
+struct Point pad_position(struct Footprint *footprint, struct Pad *pad);
+int pad_outline(struct Footprint *footprint, struct Pad *pad, float inflate, struct Point *out);
+int capsule_outline(struct Point start, struct Point end, float radius, struct Point *out);
+int arc_center(struct Point start, struct Point mid, struct Point end, struct Point *center);
+int arc_points(struct Point start, struct Point mid, struct Point end, float max_error, struct Point *out, int max);
+double arc_length(struct Point start, struct Point mid, struct Point end);
+int is_copper(struct Layer *layer);
+int pad_on_layer(struct Pad *pad, struct Layer *layer);
+int via_on_layer(struct Via *via, struct Layer *layer);
+struct Layer *track_layer(struct Track *track);
+struct Net *track_net(struct Track *track);
+int copper_stack(struct Stack_Layer *stack, int max);
+
+// Spatial index
+int spatial_index_init();
+void spatial_index_free(struct Spatial_Index *index);
+int spatial_query(const struct Spatial_Index *index, struct Box box, uint64_t layers, int (*callback)(struct Item *item, void *context), void *context);
+uint64_t layer_mask(struct Layer *layer);
+
+// Zone fill
+int fill_zones(float resolution, int threads);
+
+// Writer
+int write_pcb(const char *path);
+int format_float(char *out, float value);
+int format_int(char *out, int64_t value);
+
+// Gerber
+int export_gerbers(const char *dir, int threads);
+
+// Drill
+int export_drills(const char *dir, int threads, double *seed, double *travel);
+
+// Raster
+struct Box copper_box();
+struct Raster *rasterise_layer(struct Layer *layer, float dpi, int depth, const struct Box *box, int threads);
+void raster_free(struct Raster *raster);
+uint8_t raster_pixel(const struct Raster *raster, int x, int y);
+int raster_write(const struct Raster *raster, const char *path);
+struct Raster *raster_xor_layers(struct Board *board_1, struct Layer *layer_1, struct Board *board_2, struct Layer *layer_2, float dpi, const struct Box *box, int threads, uint64_t *pixels);
+
+// Diff
+int diff_boards(struct Board *before, struct Board *after, const char *dir, float dpi, int threads);
+
+// Net metrics
+struct Net_Metrics *net_metrics_build(int threads);
+void net_metrics_free(struct Net_Metrics *metrics);
+void net_metrics_track(struct Net_Metrics *metrics, const struct Track *track, int sign);
+void net_metrics_footprint(struct Net_Metrics *metrics, struct Footprint *footprint);
+const struct Net_Metric *net_metric(const struct Net_Metrics *metrics, int ordinal);
+struct Layer *net_metrics_layer(const struct Net_Metrics *metrics, int slot);
+int net_metrics_report(FILE *file, const struct Net_Metrics *metrics, int sort);
+
+// Pairs
+int check_pairs(const struct Pair_Options *options, FILE *report, struct Pair_Stats *stats);
+
+// Impedance
+float track_impedance(struct Track *track, int field);
+int check_impedance(const struct Impedance_Options *options, FILE *report, struct Impedance_Stats *stats);
+void impedance_cache_free(struct Impedance_Cache *cache);
+
+// Multigrid
+int grid_solve(const struct Grid_System *system, double *x, double tolerance, int threads, double *residual);
+
+// IR drop
+int ir_drop(const struct IR_Options *options, FILE *report, struct IR_Stats *stats);
+
+// Thermal
+int thermal_solve(const struct Thermal_Options *options, FILE *report, struct Thermal_Stats *stats);
+
+// Crosstalk
+int check_crosstalk(const struct Crosstalk_Options *options, FILE *report, struct Crosstalk_Stats *stats);
+
+// Courtyards
+int check_courtyards(const struct Courtyard_Options *options, FILE *report, struct Courtyard_Stats *stats);
+
+// Outline
+int board_outline_init(float max_error);
+int footprint_chains(struct Footprint *footprint, const char *name, float max_error, struct Point **points, int **sizes);
+void board_outline_free(struct Board_Outline *outline);
+int board_contains_point(const struct Board_Outline *outline, struct Point point);
+void board_contains_points(const struct Board_Outline *outline, const struct Point *points, int count, uint8_t *inside);
+float board_edge_distance(const struct Board_Outline *outline, struct Point start, struct Point end);
+
+// Router
+int route_board(const struct Route_Options *options, struct Route_Stats *stats);
+
+// Placer
+int place_board(const struct Place_Options *options, struct Place_Stats *stats);
+
+// Generator
+uint64_t generate_board(FILE *file, const struct Generator *generator);
+
 // Printers
 void print_layer();
 void print_footprints(struct Footprint *footprint);
@@ -0,0 +1,196 @@
+#include <math.h>
+
+#include "solver.h"
+
+// Uniform grid over every copper item on the board
+// Items are stored once and referenced from each cell their box touches.
+
+#define MAX_CELLS 1024
+
+static int cell_x(const struct Spatial_Index *index, float x){
+  int cell = (int)((x - index->box.min_x) / index->cell);
+  return cell < 0 ? 0 : (cell >= index->nx ? index->nx - 1 : cell);
+}
+
+static int cell_y(const struct Spatial_Index *index, float y){
+  int cell = (int)((y - index->box.min_y) / index->cell);
+  return cell < 0 ? 0 : (cell >= index->ny ? index->ny - 1 : cell);
+}
+
+uint64_t layer_mask(struct Layer *layer){
+  return layer ? 1ull << (layer->ordinal & 63) : 0;
+}
+
+static void box_points(struct Box *box, struct Point *points, int count, float grow){
+  box->min_x = box->max_x = points[0].x;
+  box->min_y = box->max_y = points[0].y;
+  for(int i = 1; i < count; i++){
+    box->min_x = fminf(box->min_x, points[i].x);
+    box->max_x = fmaxf(box->max_x, points[i].x);
+    box->min_y = fminf(box->min_y, points[i].y);
+    box->max_y = fmaxf(box->max_y, points[i].y);
+  }
+  box->min_x -= grow, box->min_y -= grow;
+  box->max_x += grow, box->max_y += grow;
+}
+
+static int track_item(struct Track *track, struct Item *item){
+  struct Point points[64];
+  item->kind = ITEM_TRACK;
+  item->track = track;
+  item->net = track_net(track);
+  switch(track->type){
+    case TRACK_TYPE_SEG:
+      points[0] = track->track.segment.start;
+      points[1] = track->track.segment.end;
+      box_points(&item->box, points, 2, track->track.segment.width / 2);
+      item->layers = layer_mask(track->track.segment.layer);
+      break;
+    case TRACK_TYPE_ARC:{
+      int count = arc_points(track->track.arc.start, track->track.arc.mid, track->track.arc.end, 0.001, points, 64);
+      box_points(&item->box, points, count, track->track.arc.width / 2);
+      item->layers = layer_mask(track->track.arc.layer);
+      break;
+    }
+    case TRACK_TYPE_VIA:
+      points[0].x = track->track.via.at.x;
+      points[0].y = track->track.via.at.y;
+      box_points(&item->box, points, 1, track->track.via.size / 2);
+      item->layers = 0;
+      for(struct Layer *layer = pcb->layers.layer; layer; layer = layer->next){
+        if(via_on_layer(&track->track.via, layer)){
+          item->layers |= layer_mask(layer);
+        }
+      }
+      break;
+    default:
+      return ERROR;
+  }
+  return SUCCESS;
+}
+
+static void pad_item(struct Footprint *footprint, struct Pad *pad, struct Item *item){
+  struct Point points[PAD_OUTLINE_MAX];
+  int count = pad_outline(footprint, pad, 0, points);
+  item->kind = ITEM_PAD;
+  item->pad = pad;
+  item->footprint = footprint;
+  item->net = pad->net;
+  box_points(&item->box, points, count, 0);
+  item->layers = 0;
+  for(int i = 0; i < pad->layer_count; i++){
+    if(is_copper(pad->layers[i])){
+      item->layers |= layer_mask(pad->layers[i]);
+    }
+  }
+}
+
+int spatial_index_init(){
+  uint32_t count = 0;
+  for(struct Track *track = pcb->tracks; track; track = track->next){
+    count++;
+  }
+  for(struct Footprint *footprint = pcb->footprints; footprint; footprint = footprint->next){
+    for(struct Pad *pad = footprint->pads; pad; pad = pad->next){
+      count++;
+    }
+  }
+  spatial_index_free(pcb->spatial);
+  struct Spatial_Index *index = calloc(1, sizeof(struct Spatial_Index));
+  index->items = calloc(count ? count : 1, sizeof(struct Item));
+  for(struct Track *track = pcb->tracks; track; track = track->next){
+    if(track_item(track, &index->items[index->count]) == SUCCESS){
+      index->count++;
+    }
+  }
+  for(struct Footprint *footprint = pcb->footprints; footprint; footprint = footprint->next){
+    for(struct Pad *pad = footprint->pads; pad; pad = pad->next){
+      pad_item(footprint, pad, &index->items[index->count++]);
+    }
+  }
+
+  // Roughly two items per cell
+  if(index->count){
+    index->box = index->items[0].box;
+  }
+  for(uint32_t i = 1; i < index->count; i++){
+    struct Box *box = &index->items[i].box;
+    index->box.min_x = fminf(index->box.min_x, box->min_x);
+    index->box.min_y = fminf(index->box.min_y, box->min_y);
+    index->box.max_x = fmaxf(index->box.max_x, box->max_x);
+    index->box.max_y = fmaxf(index->box.max_y, box->max_y);
+  }
+  float width = fmaxf(index->box.max_x - index->box.min_x, 1e-3f);
+  float height = fmaxf(index->box.max_y - index->box.min_y, 1e-3f);
+  index->cell = sqrtf(width * height * 2 / (index->count ? index->count : 1));
+  index->cell = fmaxf(index->cell, fmaxf(width, height) / MAX_CELLS);
+  index->nx = (int)(width / index->cell) + 1;
+  index->ny = (int)(height / index->cell) + 1;
+
+  uint32_t cells = index->nx * index->ny;
+  index->cell_start = calloc(cells + 1, sizeof(uint32_t));
+  for(uint32_t i = 0; i < index->count; i++){
+    struct Box *box = &index->items[i].box;
+    for(int y = cell_y(index, box->min_y); y <= cell_y(index, box->max_y); y++){
+      for(int x = cell_x(index, box->min_x); x <= cell_x(index, box->max_x); x++){
+        index->cell_start[y * index->nx + x + 1]++;
+      }
+    }
+  }
+  for(uint32_t cell = 0; cell < cells; cell++){
+    index->cell_start[cell + 1] += index->cell_start[cell];
+  }
+  index->cell_items = malloc((index->cell_start[cells] ? index->cell_start[cells] : 1) * sizeof(uint32_t));
+  uint32_t *fill = malloc(cells * sizeof(uint32_t));
+  memcpy(fill, index->cell_start, cells * sizeof(uint32_t));
+  for(uint32_t i = 0; i < index->count; i++){
+    struct Box *box = &index->items[i].box;
+    for(int y = cell_y(index, box->min_y); y <= cell_y(index, box->max_y); y++){
+      for(int x = cell_x(index, box->min_x); x <= cell_x(index, box->max_x); x++){
+        index->cell_items[fill[y * index->nx + x]++] = i;
+      }
+    }
+  }
+  free(fill);
+  pcb->spatial = index;
+  return SUCCESS;
+}
+
+void spatial_index_free(struct Spatial_Index *index){
+  if(index){
+    free(index->items);
+    free(index->cell_start);
+    free(index->cell_items);
+    free(index);
+  }
+}
+
+// Calls back once for every item on one of the layers whose box touches box,
+// stops early when the callback returns FALSE
+int spatial_query(const struct Spatial_Index *index, struct Box box, uint64_t layers, int (*callback)(struct Item *item, void *context), void *context){
+  if(index == NULL || index->count == 0 || box.max_x < index->box.min_x || box.min_x > index->box.max_x || box.max_y < index->box.min_y || box.min_y > index->box.max_y){
+    return SUCCESS;
+  }
+  int x0 = cell_x(index, box.min_x), x1 = cell_x(index, box.max_x);
+  int y0 = cell_y(index, box.min_y), y1 = cell_y(index, box.max_y);
+  for(int y = y0; y <= y1; y++){
+    for(int x = x0; x <= x1; x++){
+      uint32_t cell = y * index->nx + x;
+      for(uint32_t i = index->cell_start[cell]; i < index->cell_start[cell + 1]; i++){
+        struct Item *item = &index->items[index->cell_items[i]];
+        if(!(item->layers & layers) || item->box.max_x < box.min_x || item->box.min_x > box.max_x || item->box.max_y < box.min_y || item->box.min_y > box.max_y){
+          continue;
+        }
+        // Report an item only from the first cell shared by it and the query
+        int first_x = cell_x(index, item->box.min_x), first_y = cell_y(index, item->box.min_y);
+        if(x != (first_x > x0 ? first_x : x0) || y != (first_y > y0 ? first_y : y0)){
+          continue;
+        }
+        if(callback(item, context) == FALSE){
+          return SUCCESS;
+        }
+      }
+    }
+  }
+  return SUCCESS;
+}
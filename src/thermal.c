@@ -0,0 +1,493 @@
+#include <stdio.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "solver.h"
+
+// Thermal
+// Steady state temperature of the board. Each copper layer is a sheet of
+// square cells whose in-plane conductance mixes copper, by its rasterised
+// coverage, with the FR4 half way to the copper either side. Neighbouring
+// sheets are joined through the dielectric between them in the stackup,
+// and vias and plated holes add their barrels to that. The outer sheets
+// lose heat to the air by convection. A footprint dissipates the power in
+// its property, spread over the cells under its pads on its own side.
+// Nodes are numbered tile by tile with all the layers of a tile together,
+// so the neighbours a row reaches are close by in memory, and the
+// multigrid solver finds the rise above ambient.
+
+#define THERMAL_CELL 0.5f
+#define THERMAL_AMBIENT 25.0f
+// W/m^2K, still air
+#define THERMAL_CONVECTION 10.0f
+#define THERMAL_PROPERTY "Power"
+// W/mm K
+#define THERMAL_K_COPPER 0.385
+#define THERMAL_K_FR4 0.0003
+#define THERMAL_K_FR4_PLANE 0.0008
+#define THERMAL_PLATING 0.025f
+#define THERMAL_MARGIN 1.0f
+#define THERMAL_TOLERANCE 1e-8
+#define THERMAL_TILE 16
+#define THERMAL_MAX_LAYERS 64
+#define THERMAL_MAX_CELLS (1 << 26)
+#define THERMAL_PATH 4096
+
+// below is the dielectric down to the next sheet, mm
+struct Thermal_Layer {
+  struct Layer *layer;
+  float thickness, below;
+  struct Raster *raster;
+};
+
+struct Thermal_Grid {
+  struct Thermal_Layer layers[THERMAL_MAX_LAYERS];
+  int layer_count;
+  struct Box box;
+  float cell;
+  int nx, ny;
+  // Node of each cell, layer by layer
+  int *node;
+  // Lateral conductance of each cell as a square, and the vertical one
+  // from each cell to the layer below, W/K
+  double *sheet, *vertical;
+};
+
+static void grow_box(struct Box *box, struct Point point){
+  box->min_x = fminf(box->min_x, point.x);
+  box->min_y = fminf(box->min_y, point.y);
+  box->max_x = fmaxf(box->max_x, point.x);
+  box->max_y = fmaxf(box->max_y, point.y);
+}
+
+static int sheet_of(const struct Thermal_Grid *grid, const struct Layer *layer){
+  for(int i = 0; i < grid->layer_count; i++){
+    if(grid->layers[i].layer == layer){
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Barrel of a via or plated hole added to the vertical conductance of its
+// cell from the first sheet it reaches to the last
+static void add_barrel(struct Thermal_Grid *grid, struct Point at, float drill, const int *layers, int count){
+  int i = (int)floorf((at.x - grid->box.min_x) / grid->cell), j = (int)floorf((at.y - grid->box.min_y) / grid->cell);
+  if(count < 2 || i < 0 || j < 0 || i >= grid->nx || j >= grid->ny){
+    return;
+  }
+  double r = drill / 2, area = M_PI * ((r + THERMAL_PLATING) * (r + THERMAL_PLATING) - r * r);
+  size_t cells = (size_t)grid->nx * grid->ny;
+  for(int l = layers[0]; l < layers[count - 1]; l++){
+    grid->vertical[l * cells + (size_t)j * grid->nx + i] += THERMAL_K_COPPER * area / grid->layers[l].below;
+  }
+}
+
+static void grid_free(struct Thermal_Grid *grid){
+  for(int l = 0; l < grid->layer_count; l++){
+    raster_free(grid->layers[l].raster);
+  }
+  free(grid->node);
+  free(grid->sheet);
+  free(grid->vertical);
+}
+
+static int build_grid(struct Thermal_Grid *grid, float cell, int threads){
+  struct Stack_Layer stack[THERMAL_MAX_LAYERS];
+  grid->layer_count = copper_stack(stack, THERMAL_MAX_LAYERS);
+  for(int l = 0; l < grid->layer_count; l++){
+    grid->layers[l] = (struct Thermal_Layer){stack[l].layer, stack[l].thickness, stack[l].below, NULL};
+  }
+  if(grid->layer_count == 0){
+    printf("Thermal: the board has no copper layers\n");
+    return ERROR;
+  }
+  struct Box box = copper_box();
+  if(!(box.max_x > box.min_x && box.max_y > box.min_y)){
+    printf("Thermal: the board has no copper\n");
+    return ERROR;
+  }
+  grid->cell = cell;
+  grid->box = (struct Box){box.min_x - THERMAL_MARGIN, box.min_y - THERMAL_MARGIN, box.max_x + THERMAL_MARGIN, box.max_y + THERMAL_MARGIN};
+  double cells_x = ceil((grid->box.max_x - grid->box.min_x) / cell), cells_y = ceil((grid->box.max_y - grid->box.min_y) / cell);
+  if(cells_x * cells_y * grid->layer_count > THERMAL_MAX_CELLS){
+    printf("Thermal: %.0f x %.0f cells on %d layers is too many, use a larger cell\n", cells_x, cells_y, grid->layer_count);
+    return ERROR;
+  }
+  for(int l = 0; l < grid->layer_count; l++){
+    grid->layers[l].raster = rasterise_layer(grid->layers[l].layer, 25.4f / cell, 8, &grid->box, threads);
+    if(grid->layers[l].raster == NULL){
+      return ERROR;
+    }
+  }
+  grid->nx = grid->layers[0].raster->width;
+  grid->ny = grid->layers[0].raster->height;
+  size_t cells = (size_t)grid->nx * grid->ny;
+
+  grid->sheet = malloc(cells * grid->layer_count * sizeof(double));
+  grid->vertical = calloc(cells * grid->layer_count, sizeof(double));
+  for(int l = 0; l < grid->layer_count; l++){
+    struct Thermal_Layer *layer = &grid->layers[l];
+    float fr4 = (layer->below + (l > 0 ? grid->layers[l - 1].below : 0)) / 2;
+    double vertical = layer->below > 0 ? THERMAL_K_FR4 * cell * cell / layer->below : 0;
+    for(int j = 0; j < grid->ny; j++){
+      for(int i = 0; i < grid->nx; i++){
+        size_t c = l * cells + (size_t)j * grid->nx + i;
+        double coverage = raster_pixel(layer->raster, i, j) / 255.0;
+        grid->sheet[c] = THERMAL_K_COPPER * layer->thickness * coverage + THERMAL_K_FR4_PLANE * (layer->thickness * (1 - coverage) + fr4);
+        grid->vertical[c] = vertical;
+      }
+    }
+  }
+
+  int spans[THERMAL_MAX_LAYERS];
+  for(struct Track *track = pcb->tracks; track; track = track->next){
+    if(track->type != TRACK_TYPE_VIA){
+      continue;
+    }
+    int count = 0;
+    for(int l = 0; l < grid->layer_count; l++){
+      if(via_on_layer(&track->track.via, grid->layers[l].layer)){
+        spans[count++] = l;
+      }
+    }
+    add_barrel(grid, (struct Point){track->track.via.at.x, track->track.via.at.y}, track->track.via.drill.diameter, spans, count);
+  }
+  for(struct Footprint *footprint = pcb->footprints; footprint; footprint = footprint->next){
+    for(struct Pad *pad = footprint->pads; pad; pad = pad->next){
+      if(pad->drill.diameter <= 0){
+        continue;
+      }
+      int count = 0;
+      for(int l = 0; l < grid->layer_count; l++){
+        if(pad_on_layer(pad, grid->layers[l].layer)){
+          spans[count++] = l;
+        }
+      }
+      add_barrel(grid, pad_position(footprint, pad), pad->drill.diameter, spans, count);
+    }
+  }
+
+  // Tile by tile, every layer of a tile before the next
+  grid->node = malloc(cells * grid->layer_count * sizeof(int));
+  int n = 0;
+  for(int tile_y = 0; tile_y < grid->ny; tile_y += THERMAL_TILE){
+    for(int tile_x = 0; tile_x < grid->nx; tile_x += THERMAL_TILE){
+      for(int l = 0; l < grid->layer_count; l++){
+        for(int j = tile_y; j < tile_y + THERMAL_TILE && j < grid->ny; j++){
+          for(int i = tile_x; i < tile_x + THERMAL_TILE && i < grid->nx; i++){
+            grid->node[l * cells + (size_t)j * grid->nx + i] = n++;
+          }
+        }
+      }
+    }
+  }
+  return SUCCESS;
+}
+
+// Series conductance of two half cells
+static double between(double a, double b){
+  return a + b > 0 ? 2 * a * b / (a + b) : 0;
+}
+
+// Rows in node order, each with its lateral neighbours and the sheets
+// above and below. The outer sheets lose heat to ambient through their
+// diagonal.
+static void build_system(struct Grid_System *system, const struct Thermal_Grid *grid, double convection){
+  size_t cells = (size_t)grid->nx * grid->ny;
+  int n = (int)(cells * grid->layer_count);
+  system->n = n;
+  system->nx = grid->nx;
+  system->ny = grid->ny;
+  system->layers = grid->layer_count;
+  system->row = malloc((n + 1) * sizeof(int));
+  system->column = malloc((n ? n : 1) * 6 * sizeof(int));
+  system->value = malloc((n ? n : 1) * 6 * sizeof(double));
+  system->diagonal = malloc((n ? n : 1) * sizeof(double));
+  system->b = calloc(n ? n : 1, sizeof(double));
+  system->x_cell = malloc((n ? n : 1) * sizeof(int));
+  system->y_cell = malloc((n ? n : 1) * sizeof(int));
+  system->layer = malloc((n ? n : 1) * sizeof(int));
+  for(int l = 0; l < grid->layer_count; l++){
+    for(int j = 0; j < grid->ny; j++){
+      for(int i = 0; i < grid->nx; i++){
+        int node = grid->node[l * cells + (size_t)j * grid->nx + i];
+        system->x_cell[node] = i;
+        system->y_cell[node] = j;
+        system->layer[node] = l;
+      }
+    }
+  }
+  double air = convection * grid->cell * grid->cell;
+  int count = 0;
+  for(int node = 0; node < n; node++){
+    int i = system->x_cell[node], j = system->y_cell[node], l = system->layer[node];
+    size_t c = l * cells + (size_t)j * grid->nx + i;
+    size_t neighbours[6];
+    double conductances[6];
+    int k = 0;
+    if(i > 0){
+      neighbours[k] = c - 1;
+      conductances[k++] = between(grid->sheet[c], grid->sheet[c - 1]);
+    }
+    if(i + 1 < grid->nx){
+      neighbours[k] = c + 1;
+      conductances[k++] = between(grid->sheet[c], grid->sheet[c + 1]);
+    }
+    if(j > 0){
+      neighbours[k] = c - grid->nx;
+      conductances[k++] = between(grid->sheet[c], grid->sheet[c - grid->nx]);
+    }
+    if(j + 1 < grid->ny){
+      neighbours[k] = c + grid->nx;
+      conductances[k++] = between(grid->sheet[c], grid->sheet[c + grid->nx]);
+    }
+    if(l > 0){
+      neighbours[k] = c - cells;
+      conductances[k++] = grid->vertical[c - cells];
+    }
+    if(l + 1 < grid->layer_count){
+      neighbours[k] = c + cells;
+      conductances[k++] = grid->vertical[c];
+    }
+    system->row[node] = count;
+    double diagonal = (l == 0 ? air : 0) + (l == grid->layer_count - 1 ? air : 0);
+    for(int m = 0; m < k; m++){
+      system->column[count] = grid->node[neighbours[m]];
+      system->value[count++] = conductances[m];
+      diagonal += conductances[m];
+    }
+    system->diagonal[node] = diagonal > 0 ? diagonal : 1;
+  }
+  system->row[n] = count;
+}
+
+static void system_free(struct Grid_System *system){
+  free(system->row);
+  free(system->column);
+  free(system->value);
+  free(system->diagonal);
+  free(system->b);
+  free(system->x_cell);
+  free(system->y_cell);
+  free(system->layer);
+}
+
+// Report
+
+static const char *footprint_property(const struct Footprint *footprint, const char *key){
+  for(struct Footprint_Property *property = footprint->properties; property; property = property->next){
+    if(property->property && property->property->key.chars && strcmp(property->property->key.chars, key) == 0){
+      return property->property->val.chars;
+    }
+  }
+  return NULL;
+}
+
+// Watts from text like "0.5", "0.5W" or "250mW", negative when it is not
+// a number
+static double parse_power(const char *text){
+  char *end;
+  double power = strtod(text, &end);
+  if(end == text){
+    return -1;
+  }
+  while(*end == ' '){
+    end++;
+  }
+  if(*end == 'm'){
+    power *= 1e-3;
+  }else if(*end == 'u'){
+    power *= 1e-6;
+  }
+  return power;
+}
+
+// Cells under the footprint's pads on sheet, or under its box when no
+// pad reaches the sheet. Returns how many went in cells.
+static int footprint_cells(const struct Thermal_Grid *grid, struct Footprint *footprint, int sheet, int **cells){
+  int count = 0, capacity = 0;
+  struct Point outline[PAD_OUTLINE_MAX];
+  for(struct Pad *pad = footprint->pads; pad; pad = pad->next){
+    if(!pad_on_layer(pad, grid->layers[sheet].layer)){
+      continue;
+    }
+    struct Box box = {INFINITY, INFINITY, -INFINITY, -INFINITY};
+    int points = pad_outline(footprint, pad, 0, outline);
+    for(int p = 0; p < points; p++){
+      grow_box(&box, outline[p]);
+    }
+    if(points == 0){
+      grow_box(&box, pad_position(footprint, pad));
+    }
+    // At least the cell under the centre of the pad
+    int first_x = (int)floorf((box.min_x - grid->box.min_x) / grid->cell), last_x = (int)floorf((box.max_x - grid->box.min_x) / grid->cell);
+    int first_y = (int)floorf((box.min_y - grid->box.min_y) / grid->cell), last_y = (int)floorf((box.max_y - grid->box.min_y) / grid->cell);
+    for(int j = first_y < 0 ? 0 : first_y; j <= last_y && j < grid->ny; j++){
+      for(int i = first_x < 0 ? 0 : first_x; i <= last_x && i < grid->nx; i++){
+        if(count == capacity){
+          capacity = capacity ? capacity * 2 : 16;
+          *cells = realloc(*cells, capacity * sizeof(int));
+        }
+        (*cells)[count++] = j * grid->nx + i;
+      }
+    }
+  }
+  if(count == 0){
+    struct Box box = footprint_box(footprint);
+    struct Point centre = {(box.min_x + box.max_x) / 2, (box.min_y + box.max_y) / 2};
+    int i = (int)floorf((centre.x - grid->box.min_x) / grid->cell), j = (int)floorf((centre.y - grid->box.min_y) / grid->cell);
+    if(i >= 0 && j >= 0 && i < grid->nx && j < grid->ny){
+      *cells = realloc(*cells, sizeof(int));
+      (*cells)[count++] = j * grid->nx + i;
+    }
+  }
+  return count;
+}
+
+struct Thermal_Source {
+  struct Footprint *footprint;
+  double power, hottest;
+};
+
+static int compare_hottest(const void *_1, const void *_2){
+  double hottest_1 = ((const struct Thermal_Source *)_1)->hottest, hottest_2 = ((const struct Thermal_Source *)_2)->hottest;
+  return hottest_1 > hottest_2 ? -1 : hottest_1 < hottest_2;
+}
+
+// Temperature map of one layer as a grey PGM, black at ambient and white
+// at the hottest point of the board
+static int write_map(const struct Thermal_Grid *grid, int layer, const double *rise, double max_rise, const char *prefix){
+  char path[THERMAL_PATH];
+  snprintf(path, sizeof(path), "%s-%s.pgm", prefix, grid->layers[layer].layer->canonical_name.chars);
+  FILE *file = fopen(path, "wb");
+  if(file == NULL){
+    perror(path);
+    return ERROR;
+  }
+  fprintf(file, "P5\n%d %d\n255\n", grid->nx, grid->ny);
+  uint8_t *row = malloc(grid->nx);
+  size_t cells = (size_t)grid->nx * grid->ny;
+  for(int j = 0; j < grid->ny; j++){
+    for(int i = 0; i < grid->nx; i++){
+      double value = rise[grid->node[layer * cells + (size_t)j * grid->nx + i]];
+      row[i] = (uint8_t)lround(max_rise > 0 ? 255 * fmin(fmax(value / max_rise, 0), 1) : 0);
+    }
+    fwrite(row, 1, grid->nx, file);
+  }
+  free(row);
+  if(fclose(file) != 0){
+    perror(path);
+    return ERROR;
+  }
+  return SUCCESS;
+}
+
+// Steady state temperatures with the footprints dissipating the power in
+// their options->property. Writes each layer's hottest and mean and each
+// dissipating footprint's temperature to report, and a temperature map
+// per layer when options->map names a prefix. Returns ERROR when the board
+// has no copper or the grid is too large.
+int thermal_solve(const struct Thermal_Options *options, FILE *report, struct Thermal_Stats *stats){
+  struct Thermal_Stats local_stats;
+  stats = stats ? stats : &local_stats;
+  memset(stats, 0, sizeof(struct Thermal_Stats));
+  int threads = options->threads > 0 ? options->threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+  threads = threads < 1 ? 1 : threads;
+  float cell = options->cell > 0 ? options->cell : THERMAL_CELL;
+  float ambient = options->ambient != 0 ? options->ambient : THERMAL_AMBIENT;
+  double convection = (options->convection > 0 ? options->convection : THERMAL_CONVECTION) * 1e-6;
+  const char *key = options->property ? options->property : THERMAL_PROPERTY;
+
+  struct Thermal_Grid grid;
+  memset(&grid, 0, sizeof(grid));
+  if(build_grid(&grid, cell, threads) == ERROR){
+    grid_free(&grid);
+    return ERROR;
+  }
+  struct Grid_System system;
+  memset(&system, 0, sizeof(system));
+  build_system(&system, &grid, convection);
+  int n = system.n;
+  size_t cells = (size_t)grid.nx * grid.ny;
+
+  // Power into the cells under each dissipating footprint
+  struct Thermal_Source *sources = NULL;
+  int source_count = 0, *footprint_cell = NULL;
+  for(struct Footprint *footprint = pcb->footprints; footprint; footprint = footprint->next){
+    const char *text = footprint_property(footprint, key);
+    if(text == NULL){
+      continue;
+    }
+    const char *reference = footprint_property(footprint, "Reference");
+    double power = parse_power(text);
+    if(power < 0){
+      printf("Thermal: %s %s \"%s\" is not a power\n", reference ? reference : "footprint", key, text);
+      continue;
+    }
+    int sheet = sheet_of(&grid, footprint->layer);
+    sheet = sheet < 0 ? 0 : sheet;
+    int count = footprint_cells(&grid, footprint, sheet, &footprint_cell);
+    for(int k = 0; k < count; k++){
+      system.b[grid.node[sheet * cells + footprint_cell[k]]] += power / count;
+    }
+    if(count && power > 0){
+      sources = realloc(sources, (source_count + 1) * sizeof(struct Thermal_Source));
+      sources[source_count++] = (struct Thermal_Source){footprint, power, 0};
+      stats->power += power;
+    }
+  }
+
+  double *rise = calloc(n ? n : 1, sizeof(double)), residual;
+  int iterations = grid_solve(&system, rise, THERMAL_TOLERANCE, threads, &residual);
+  stats->nodes = n;
+  stats->layers = grid.layer_count;
+  stats->footprints = source_count;
+  stats->iterations = iterations;
+  stats->residual = residual;
+  for(int i = 0; i < n; i++){
+    stats->max_temperature = fmax(stats->max_temperature, rise[i]);
+  }
+  double max_rise = stats->max_temperature;
+  stats->max_temperature += ambient;
+
+  fprintf(report, "%d nodes on %d layers, cell %.4f mm, %.4f W from %d footprints, ambient %.1f C\n", n, grid.layer_count, cell, stats->power, source_count, ambient);
+  fprintf(report, "%d iterations, residual %.3g%s\n", iterations, residual, residual > THERMAL_TOLERANCE ? " not converged" : "");
+  for(int l = 0; l < grid.layer_count; l++){
+    double hottest = 0, mean = 0;
+    for(size_t c = 0; c < cells; c++){
+      double value = rise[grid.node[l * cells + c]];
+      hottest = fmax(hottest, value);
+      mean += value / cells;
+    }
+    fprintf(report, "layer %-8s hottest %8.2f C, mean %8.2f C\n", grid.layers[l].layer->canonical_name.chars, ambient + hottest, ambient + mean);
+  }
+  for(int s = 0; s < source_count; s++){
+    int sheet = sheet_of(&grid, sources[s].footprint->layer);
+    sheet = sheet < 0 ? 0 : sheet;
+    int count = footprint_cells(&grid, sources[s].footprint, sheet, &footprint_cell);
+    for(int k = 0; k < count; k++){
+      sources[s].hottest = fmax(sources[s].hottest, rise[grid.node[sheet * cells + footprint_cell[k]]]);
+    }
+  }
+  if(source_count > 0){
+    qsort(sources, source_count, sizeof(struct Thermal_Source), compare_hottest);
+  }
+  for(int s = 0; s < source_count; s++){
+    const char *reference = footprint_property(sources[s].footprint, "Reference");
+    fprintf(report, "  %-12s %8.4f W %8.2f C\n", reference ? reference : "?", sources[s].power, ambient + sources[s].hottest);
+  }
+
+  int status = SUCCESS;
+  for(int l = 0; options->map && l < grid.layer_count; l++){
+    if(write_map(&grid, l, rise, max_rise, options->map) == ERROR){
+      status = ERROR;
+    }
+  }
+  free(sources);
+  free(footprint_cell);
+  free(rise);
+  system_free(&system);
+  grid_free(&grid);
+  return status;
+}
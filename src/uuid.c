@@ -0,0 +1,178 @@
+#include "solver.h"
+
+// UUIDs
+// KiCad writes uuids as 36 character 8-4-4-4-12 lower case hex, they are
+// kept as two 64 bit halves inline in the item. Anything else found in a
+// uuid (older or hand written files) is hashed into the 128 bits instead,
+// so it still looks up consistently, and the parser keeps its text so it
+// is written back as it was.
+//
+// The index is derived data like the spatial index, built on first use
+// from every footprint, property, line, pad, track and zone with a uuid.
+
+static int hex_digit(char c){
+  if(c >= '0' && c <= '9'){
+    return c - '0';
+  }
+  if(c >= 'a' && c <= 'f'){
+    return c - 'a' + 10;
+  }
+  if(c >= 'A' && c <= 'F'){
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+struct Uuid uuid_parse(const char *text, uint64_t length){
+  struct Uuid uuid = {0, 0};
+  int digits = 0;
+  if(length == 36){
+    for(uint64_t i = 0; i < length; i++){
+      int digit = hex_digit(text[i]);
+      if(i == 8 || i == 13 || i == 18 || i == 23){
+        if(text[i] != '-'){
+          break;
+        }
+      }else if(digit < 0){
+        break;
+      }else{
+        if(digits < 16){
+          uuid.high = uuid.high << 4 | digit;
+        }else{
+          uuid.low = uuid.low << 4 | digit;
+        }
+        digits++;
+      }
+    }
+  }
+  if(digits == 32 && !uuid_is_nil(uuid)){
+    return uuid;
+  }
+  // Two FNV-1a passes from different offsets fill the halves
+  uuid.high = 0xcbf29ce484222325ull;
+  uuid.low = 0x84222325cbf29ce4ull;
+  for(uint64_t i = 0; i < length; i++){
+    uuid.high = (uuid.high ^ (uint8_t)text[i]) * 0x100000001b3ull;
+    uuid.low = (uuid.low ^ (uint8_t)text[i]) * 0x100000001b3ull;
+  }
+  return uuid;
+}
+
+// Writes the 36 characters and a NUL, returns 36
+int uuid_format(struct Uuid uuid, char *out){
+  static const char digits[] = "0123456789abcdef";
+  int length = 0;
+  for(int i = 0; i < 32; i++){
+    uint64_t half = i < 16 ? uuid.high : uuid.low;
+    if(i == 8 || i == 12 || i == 16 || i == 20){
+      out[length++] = '-';
+    }
+    out[length++] = digits[(half >> (60 - 4 * (i % 16))) & 15];
+  }
+  out[length] = '\0';
+  return length;
+}
+
+// The text the uuid was read from when it was not canonical, otherwise
+// the canonical form written into out, which holds 37 characters
+const char *uuid_string(struct Uuid uuid, char *out){
+  if(uuid.text){
+    return uuid.text;
+  }
+  uuid_format(uuid, out);
+  return out;
+}
+
+int uuid_is_nil(struct Uuid uuid){
+  return uuid.high == 0 && uuid.low == 0;
+}
+
+int uuid_equal(struct Uuid _1, struct Uuid _2){
+  return _1.high == _2.high && _1.low == _2.low;
+}
+
+uint64_t uuid_hash(struct Uuid uuid){
+  uint64_t hash = (uuid.high ^ (uuid.low * 0x9E3779B97F4A7C15ull)) * 0xBF58476D1CE4E5B9ull;
+  return hash ^ (hash >> 31);
+}
+
+static void uuid_insert(struct Uuid_Index *index, struct Uuid uuid, int kind, void *item, struct Footprint *footprint){
+  if(uuid_is_nil(uuid)){
+    return;
+  }
+  uint32_t slot = (uint32_t)uuid_hash(uuid) & (index->capacity - 1);
+  while(index->entries[slot].kind){
+    if(uuid_equal(index->entries[slot].uuid, uuid)){
+      // Duplicates keep the first item, KiCad repeats uuids across boards
+      // pasted together
+      return;
+    }
+    slot = (slot + 1) & (index->capacity - 1);
+  }
+  index->entries[slot] = (struct Uuid_Entry){uuid, kind, item, footprint};
+  index->count++;
+}
+
+int uuid_index_init(){
+  struct Uuid_Index *index = calloc(1, sizeof(struct Uuid_Index));
+  uint32_t count = 0;
+  for(struct Footprint *footprint = pcb->footprints; footprint; footprint = footprint->next){
+    count++;
+    for(struct Footprint_Property *property = footprint->properties; property; property = property->next, count++);
+    for(struct Line *line = footprint->fp_lines; line; line = line->next, count++);
+    for(struct Pad *pad = footprint->pads; pad; pad = pad->next, count++);
+  }
+  for(struct Track *track = pcb->tracks; track; track = track->next, count++);
+  for(struct Zone *zone = pcb->zones; zone; zone = zone->next, count++);
+  // At most half full
+  index->capacity = 16;
+  while(index->capacity < count * 2){
+    index->capacity *= 2;
+  }
+  index->entries = calloc(index->capacity, sizeof(struct Uuid_Entry));
+
+  for(struct Footprint *footprint = pcb->footprints; footprint; footprint = footprint->next){
+    uuid_insert(index, footprint->uuid, UUID_FOOTPRINT, footprint, footprint);
+    for(struct Footprint_Property *property = footprint->properties; property; property = property->next){
+      uuid_insert(index, property->uuid, UUID_PROPERTY, property, footprint);
+    }
+    // Lines are shared between instances, their uuids are not
+    uint32_t i = 0;
+    for(struct Line *line = footprint->fp_lines; line; line = line->next, i++){
+      uuid_insert(index, footprint->line_uuids[i], UUID_LINE, line, footprint);
+    }
+    for(struct Pad *pad = footprint->pads; pad; pad = pad->next){
+      uuid_insert(index, pad->uuid, UUID_PAD, pad, footprint);
+    }
+  }
+  for(struct Track *track = pcb->tracks; track; track = track->next){
+    uuid_insert(index, track->uuid, UUID_TRACK, track, NULL);
+  }
+  for(struct Zone *zone = pcb->zones; zone; zone = zone->next){
+    uuid_insert(index, zone->uuid, UUID_ZONE, zone, NULL);
+  }
+  uuid_index_free(pcb->uuids);
+  pcb->uuids = index;
+  return SUCCESS;
+}
+
+void uuid_index_free(struct Uuid_Index *index){
+  if(index){
+    free(index->entries);
+    free(index);
+  }
+}
+
+// NULL when no item has the uuid
+const struct Uuid_Entry *uuid_find(const struct Uuid_Index *index, struct Uuid uuid){
+  if(uuid_is_nil(uuid)){
+    return NULL;
+  }
+  uint32_t slot = (uint32_t)uuid_hash(uuid) & (index->capacity - 1);
+  for(; index->entries[slot].kind; slot = (slot + 1) & (index->capacity - 1)){
+    if(uuid_equal(index->entries[slot].uuid, uuid)){
+      return &index->entries[slot];
+    }
+  }
+  return NULL;
+}
@@ -0,0 +1,850 @@
+#include <stdio.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/uio.h>
+
+#include "solver.h"
+
+// Board writer
+// The output is a list of iovecs. Whatever the model did not change is a
+// span of the source the board was parsed from, so an untouched board is one
+// writev of the original bytes. Items marked SECTION_MODIFIED are spliced,
+// the children the model owns are generated and the rest is copied. Items
+// without a span are new and go before the board's closing parenthesis,
+// footprints, tracks and zones missing from the model are left out.
+// Generated text goes into chunks that never move so iovecs point straight
+// into them.
+
+#define WRITER_CHUNK (1 << 20)
+#ifdef IOV_MAX
+#define WRITER_IOV IOV_MAX
+#else
+#define WRITER_IOV 1024
+#endif
+
+#define CHILD_KEEP 0
+#define CHILD_REPLACED 1
+#define CHILD_DROPPED 2
+
+#define WRITE_FOOTPRINT 1
+#define WRITE_TRACK 2
+#define WRITE_ZONE 3
+
+struct Writer_Chunk {
+  char *chars;
+  uint64_t length, capacity;
+  struct Writer_Chunk *next;
+};
+
+struct Writer {
+  const char *source;
+  struct iovec *iov;
+  int iov_count, iov_capacity;
+  struct Writer_Chunk *chunk;
+};
+
+// A direct child of a list being spliced, gap is where the whitespace in
+// front of it starts and indent where its line's indentation starts. At
+// the end of the list start is the closing parenthesis and closing is set.
+struct Child {
+  uint64_t gap, indent, start, end;
+  int closing;
+};
+
+struct Writer_Item {
+  uint64_t start;
+  int kind;
+  void *item;
+};
+
+struct Board_Items {
+  struct Writer_Item *items;
+  int count;
+};
+
+struct Zone_Fill_State {
+  struct Zone *zone;
+  int written;
+};
+
+typedef int (*Child_Field)(struct Writer *writer, const struct Child *child, void *context);
+
+static void emit(struct Writer *writer, const char *chars, uint64_t length){
+  if(length == 0){
+    return;
+  }
+  if(writer->iov_count){
+    struct iovec *last = &writer->iov[writer->iov_count - 1];
+    if((const char *)last->iov_base + last->iov_len == chars){
+      last->iov_len += length;
+      return;
+    }
+  }
+  if(writer->iov_count == writer->iov_capacity){
+    writer->iov_capacity = writer->iov_capacity ? writer->iov_capacity * 2 : 256;
+    writer->iov = realloc(writer->iov, writer->iov_capacity * sizeof(struct iovec));
+  }
+  writer->iov[writer->iov_count].iov_base = (char *)chars;
+  writer->iov[writer->iov_count++].iov_len = length;
+}
+
+// Copies [start, end) of the source
+static void copy_source(struct Writer *writer, uint64_t start, uint64_t end){
+  if(end > start){
+    emit(writer, writer->source + start, end - start);
+  }
+}
+
+static char *reserve(struct Writer *writer, uint64_t length){
+  struct Writer_Chunk *chunk = writer->chunk;
+  if(chunk == NULL || chunk->capacity - chunk->length < length){
+    chunk = malloc(sizeof(struct Writer_Chunk));
+    chunk->capacity = length > WRITER_CHUNK ? length : WRITER_CHUNK;
+    chunk->chars = malloc(chunk->capacity);
+    chunk->length = 0;
+    chunk->next = writer->chunk;
+    writer->chunk = chunk;
+  }
+  return chunk->chars + chunk->length;
+}
+
+static void commit(struct Writer *writer, char *chars, uint64_t length){
+  writer->chunk->length += length;
+  emit(writer, chars, length);
+}
+
+static void put(struct Writer *writer, const char *text, uint64_t length){
+  char *chars = reserve(writer, length);
+  memcpy(chars, text, length);
+  commit(writer, chars, length);
+}
+
+static void put_text(struct Writer *writer, const char *text){
+  put(writer, text, strlen(text));
+}
+
+static void put_float(struct Writer *writer, float value){
+  char *chars = reserve(writer, 48);
+  commit(writer, chars, format_float(chars, value));
+}
+
+static void put_int(struct Writer *writer, int64_t value){
+  char *chars = reserve(writer, 24);
+  commit(writer, chars, format_int(chars, value));
+}
+
+// The parser keeps quoted strings as they were written, escapes included
+static void put_string(struct Writer *writer, const String *string){
+  put_text(writer, "\"");
+  if(string->chars){
+    put_text(writer, string->chars);
+  }
+  put_text(writer, "\"");
+}
+
+static void put_layer(struct Writer *writer, const struct Layer *layer){
+  if(layer){
+    put_string(writer, &layer->canonical_name);
+  }else{
+    put_text(writer, "\"\"");
+  }
+}
+
+// Newline, the child's indentation from the source and depth more tabs
+static void put_line(struct Writer *writer, const struct Child *child, int depth){
+  // Copied into the chunk so a run of lines stays one iovec
+  put_text(writer, "\n");
+  put(writer, writer->source + child->indent, child->start - child->indent);
+  for(int i = 0; i < depth; i++){
+    put_text(writer, "\t");
+  }
+}
+
+static void put_point(struct Writer *writer, const char *keyword, struct Point point){
+  put_text(writer, "(");
+  put_text(writer, keyword);
+  put_text(writer, " ");
+  put_float(writer, point.x);
+  put_text(writer, " ");
+  put_float(writer, point.y);
+  put_text(writer, ")");
+}
+
+static void put_at(struct Writer *writer, struct at at){
+  put_text(writer, "(at ");
+  put_float(writer, at.x);
+  put_text(writer, " ");
+  put_float(writer, at.y);
+  if(at.angle != 0){
+    put_text(writer, " ");
+    put_float(writer, at.angle);
+  }
+  put_text(writer, ")");
+}
+
+static void put_value(struct Writer *writer, const char *keyword, float value){
+  put_text(writer, "(");
+  put_text(writer, keyword);
+  put_text(writer, " ");
+  put_float(writer, value);
+  put_text(writer, ")");
+}
+
+static void put_net(struct Writer *writer, const struct Net *net, int with_name){
+  put_text(writer, "(net ");
+  put_int(writer, net ? net->ordinal : 0);
+  if(with_name){
+    put_text(writer, " ");
+    if(net){
+      put_string(writer, &net->name);
+    }else{
+      put_text(writer, "\"\"");
+    }
+  }
+  put_text(writer, ")");
+}
+
+static void put_layers(struct Writer *writer, struct Layer **layers, int count){
+  put_text(writer, "(layers");
+  for(int i = 0; i < count; i++){
+    if(layers[i]){
+      put_text(writer, " ");
+      put_layer(writer, layers[i]);
+    }
+  }
+  put_text(writer, ")");
+}
+
+static void put_uuid(struct Writer *writer, const struct Child *child, int depth, struct Uuid uuid){
+  char text[40];
+  if(!uuid_is_nil(uuid)){
+    put_line(writer, child, depth);
+    put_text(writer, "(uuid \"");
+    put_text(writer, uuid_string(uuid, text));
+    put_text(writer, "\")");
+  }
+}
+
+static int polygon_count(const struct Polygon *polygon){
+  return polygon->point_index ? polygon->point_index : polygon->point_count;
+}
+
+static void put_pts(struct Writer *writer, const struct Child *child, int depth, const struct Polygon *polygon){
+  int count = polygon_count(polygon);
+  put_text(writer, "(pts");
+  for(int i = 0; i < count; i++){
+    if(i % 4 == 0){
+      put_line(writer, child, depth + 1);
+    }else{
+      put_text(writer, " ");
+    }
+    put_point(writer, "xy", polygon->points[i]);
+  }
+  put_line(writer, child, depth);
+  put_text(writer, ")");
+}
+
+static void put_filled_polygons(struct Writer *writer, const struct Child *child, int depth, const struct Zone *zone){
+  int first = TRUE;
+  for(const struct Polygon *polygon = &zone->filled_polygon; polygon; polygon = polygon->next){
+    if(polygon->points == NULL || polygon_count(polygon) == 0){
+      continue;
+    }
+    if(!first){
+      put_line(writer, child, depth);
+    }
+    first = FALSE;
+    put_text(writer, "(filled_polygon");
+    put_line(writer, child, depth + 1);
+    put_text(writer, "(layer ");
+    put_layer(writer, polygon->layer ? polygon->layer : zone->layer);
+    put_text(writer, ")");
+    put_line(writer, child, depth + 1);
+    put_pts(writer, child, depth + 1, polygon);
+    put_line(writer, child, depth);
+    put_text(writer, ")");
+  }
+}
+
+// Source scanning, quoted strings may hold parentheses
+
+static int is_blank(char c){
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static uint64_t skip_quote(const char *source, uint64_t index, uint64_t end){
+  for(index++; index < end && source[index] != '\"'; index++){
+    if(source[index] == '\\'){
+      index++;
+    }
+  }
+  return index;
+}
+
+// Matching parenthesis of the list opening at start
+static uint64_t list_end(const char *source, uint64_t start, uint64_t end){
+  int opens = 0;
+  for(uint64_t index = start; index <= end; index++){
+    if(source[index] == '\"'){
+      index = skip_quote(source, index, end);
+    }else if(source[index] == '('){
+      opens++;
+    }else if(source[index] == ')' && --opens == 0){
+      return index;
+    }
+  }
+  return end;
+}
+
+// Next child opening at or after index, end when the list closes first
+static uint64_t next_child(const char *source, uint64_t index, uint64_t end){
+  for(; index < end; index++){
+    if(source[index] == '\"'){
+      index = skip_quote(source, index, end);
+    }else if(source[index] == '(' || source[index] == ')'){
+      return source[index] == '(' ? index : end;
+    }
+  }
+  return end;
+}
+
+static int keyword_is(const char *source, uint64_t start, const char *keyword){
+  uint64_t length = strlen(keyword);
+  if(strncmp(source + start + 1, keyword, length) != 0){
+    return FALSE;
+  }
+  char next = source[start + 1 + length];
+  return is_blank(next) || next == '(' || next == ')';
+}
+
+// Copies the list at [start, end] handing each direct child to field, which
+// keeps it, writes a replacement after the whitespace in front of it or
+// drops it together with that whitespace
+static void splice(struct Writer *writer, uint64_t start, uint64_t end, Child_Field field, void *context){
+  const char *source = writer->source;
+  uint64_t cursor = start, index = start + 1, indent = start, indent_end = start;
+  struct Child child;
+  while(1){
+    child.start = next_child(source, index, end);
+    child.closing = child.start >= end;
+    child.end = child.closing ? end : list_end(source, child.start, end);
+    child.gap = child.start;
+    while(child.gap > cursor && is_blank(source[child.gap - 1])){
+      child.gap--;
+    }
+    copy_source(writer, cursor, child.gap);
+    cursor = child.gap;
+    if(child.closing){
+      // Anything added at the end lines up with the last child
+      child.indent = indent;
+      child.start = indent_end;
+      field(writer, &child, context);
+      break;
+    }
+    for(child.indent = child.start; child.indent > child.gap && source[child.indent - 1] != '\n'; child.indent--);
+    indent = child.indent;
+    indent_end = child.start;
+    if(field(writer, &child, context) != CHILD_KEEP){
+      cursor = child.end + 1;
+    }
+    index = child.end + 1;
+  }
+  copy_source(writer, cursor, end + 1);
+}
+
+// Writes the whitespace in front of a child before its replacement
+static void replace_child(struct Writer *writer, const struct Child *child){
+  copy_source(writer, child->gap, child->start);
+}
+
+static int track_field(struct Writer *writer, const struct Child *child, void *context){
+  struct Track *track = context;
+  const char *source = writer->source;
+  if(child->closing){
+    return CHILD_KEEP;
+  }
+  replace_child(writer, child);
+  if(track->type == TRACK_TYPE_VIA){
+    struct Via *via = &track->track.via;
+    if(keyword_is(source, child->start, "at")){
+      put_point(writer, "at", (struct Point){via->at.x, via->at.y});
+    }else if(keyword_is(source, child->start, "size")){
+      put_value(writer, "size", via->size);
+    }else if(keyword_is(source, child->start, "layers") && via->layer_count){
+      put_layers(writer, via->layers, via->layer_count);
+    }else if(keyword_is(source, child->start, "net")){
+      put_net(writer, via->net, FALSE);
+    }else{
+      copy_source(writer, child->start, child->end + 1);
+    }
+  }else{
+    struct Segment *segment = &track->track.segment;
+    struct Arc *arc = &track->track.arc;
+    int is_arc = track->type == TRACK_TYPE_ARC;
+    if(keyword_is(source, child->start, "start")){
+      put_point(writer, "start", is_arc ? arc->start : segment->start);
+    }else if(keyword_is(source, child->start, "end")){
+      put_point(writer, "end", is_arc ? arc->end : segment->end);
+    }else if(is_arc && keyword_is(source, child->start, "mid")){
+      put_point(writer, "mid", arc->mid);
+    }else if(keyword_is(source, child->start, "width")){
+      put_value(writer, "width", is_arc ? arc->width : segment->width);
+    }else if(keyword_is(source, child->start, "layer")){
+      put_text(writer, "(layer ");
+      put_layer(writer, is_arc ? arc->layer : segment->layer);
+      put_text(writer, ")");
+    }else if(keyword_is(source, child->start, "net")){
+      put_net(writer, is_arc ? arc->net : segment->net, FALSE);
+    }else{
+      copy_source(writer, child->start, child->end + 1);
+    }
+  }
+  return CHILD_REPLACED;
+}
+
+static int pad_field(struct Writer *writer, const struct Child *child, void *context){
+  struct Pad *pad = context;
+  if(child->closing){
+    return CHILD_KEEP;
+  }
+  if(keyword_is(writer->source, child->start, "at")){
+    replace_child(writer, child);
+    put_at(writer, pad->at);
+    return CHILD_REPLACED;
+  }
+  if(keyword_is(writer->source, child->start, "net") && pad->net){
+    replace_child(writer, child);
+    put_net(writer, pad->net, TRUE);
+    return CHILD_REPLACED;
+  }
+  return CHILD_KEEP;
+}
+
+static int footprint_field(struct Writer *writer, const struct Child *child, void *context){
+  struct Footprint *footprint = context;
+  if(child->closing){
+    return CHILD_KEEP;
+  }
+  if(keyword_is(writer->source, child->start, "at")){
+    replace_child(writer, child);
+    put_at(writer, footprint->at);
+    return CHILD_REPLACED;
+  }
+  if(keyword_is(writer->source, child->start, "pad")){
+    for(struct Pad *pad = footprint->pads; pad; pad = pad->next){
+      if(pad->index.section_start == child->start){
+        replace_child(writer, child);
+        splice(writer, child->start, child->end, pad_field, pad);
+        return CHILD_REPLACED;
+      }
+    }
+  }
+  return CHILD_KEEP;
+}
+
+static int zone_field(struct Writer *writer, const struct Child *child, void *context){
+  struct Zone_Fill_State *state = context;
+  int has_fill = state->zone->filled_polygon.points != NULL;
+  if(child->closing){
+    if(!state->written && has_fill){
+      put_line(writer, child, 0);
+      put_filled_polygons(writer, child, 0, state->zone);
+    }
+    return CHILD_KEEP;
+  }
+  if(keyword_is(writer->source, child->start, "filled_polygon") || keyword_is(writer->source, child->start, "fill_segments")){
+    if(state->written || !has_fill){
+      return CHILD_DROPPED;
+    }
+    replace_child(writer, child);
+    put_filled_polygons(writer, child, 0, state->zone);
+    state->written = TRUE;
+    return CHILD_REPLACED;
+  }
+  return CHILD_KEEP;
+}
+
+// Items created since parsing, written whole from the model
+
+static void put_track(struct Writer *writer, const struct Child *child, struct Track *track){
+  if(track->type == TRACK_TYPE_VIA){
+    struct Via *via = &track->track.via;
+    put_text(writer, "(via");
+    put_line(writer, child, 1);
+    put_point(writer, "at", (struct Point){via->at.x, via->at.y});
+    put_line(writer, child, 1);
+    put_value(writer, "size", via->size);
+    put_line(writer, child, 1);
+    put_value(writer, "drill", via->drill.diameter);
+    put_line(writer, child, 1);
+    put_layers(writer, via->layers, via->layer_count);
+    put_line(writer, child, 1);
+    put_net(writer, via->net, FALSE);
+  }else{
+    int is_arc = track->type == TRACK_TYPE_ARC;
+    struct Segment *segment = &track->track.segment;
+    struct Arc *arc = &track->track.arc;
+    put_text(writer, is_arc ? "(arc" : "(segment");
+    put_line(writer, child, 1);
+    put_point(writer, "start", is_arc ? arc->start : segment->start);
+    if(is_arc){
+      put_line(writer, child, 1);
+      put_point(writer, "mid", arc->mid);
+    }
+    put_line(writer, child, 1);
+    put_point(writer, "end", is_arc ? arc->end : segment->end);
+    put_line(writer, child, 1);
+    put_value(writer, "width", is_arc ? arc->width : segment->width);
+    put_line(writer, child, 1);
+    put_text(writer, "(layer ");
+    put_layer(writer, is_arc ? arc->layer : segment->layer);
+    put_text(writer, ")");
+    put_line(writer, child, 1);
+    put_net(writer, is_arc ? arc->net : segment->net, FALSE);
+  }
+  put_uuid(writer, child, 1, track->uuid);
+  put_line(writer, child, 0);
+  put_text(writer, ")");
+}
+
+static void put_zone(struct Writer *writer, const struct Child *child, struct Zone *zone){
+  static const char *hatch[] = {"none", "edge", "full"};
+  static const char *connect[] = {" no", "", " yes", " thru_hole_only"};
+  put_text(writer, "(zone");
+  put_line(writer, child, 1);
+  put_net(writer, zone->net, FALSE);
+  put_line(writer, child, 1);
+  put_text(writer, "(net_name ");
+  if(zone->net){
+    put_string(writer, &zone->net->name);
+  }else{
+    put_text(writer, "\"\"");
+  }
+  put_text(writer, ")");
+  put_line(writer, child, 1);
+  put_text(writer, "(layer ");
+  put_layer(writer, zone->layer);
+  put_text(writer, ")");
+  put_uuid(writer, child, 1, zone->uuid);
+  put_line(writer, child, 1);
+  put_text(writer, "(hatch ");
+  put_text(writer, hatch[zone->hatch_style >= HATCH_NONE && zone->hatch_style <= HATCH_FULL ? zone->hatch_style : HATCH_EDGE]);
+  put_text(writer, " ");
+  put_float(writer, zone->hatch_pitch);
+  put_text(writer, ")");
+  if(zone->priority){
+    put_line(writer, child, 1);
+    put_text(writer, "(priority ");
+    put_int(writer, zone->priority);
+    put_text(writer, ")");
+  }
+  put_line(writer, child, 1);
+  put_text(writer, "(connect_pads");
+  put_text(writer, connect[zone->connect_pads >= NO_CONNECT && zone->connect_pads <= THRU_HOLE_ONLY ? zone->connect_pads : THERMAL_RELIEF]);
+  put_line(writer, child, 2);
+  put_value(writer, "clearance", zone->clearance);
+  put_line(writer, child, 1);
+  put_text(writer, ")");
+  put_line(writer, child, 1);
+  put_value(writer, "min_thickness", zone->min_thickness);
+  put_line(writer, child, 1);
+  put_text(writer, "(fill yes");
+  put_line(writer, child, 2);
+  put_value(writer, "thermal_gap", zone->thermal_gap);
+  put_line(writer, child, 2);
+  put_value(writer, "thermal_bridge_width", zone->thermal_bridge_width);
+  put_line(writer, child, 1);
+  put_text(writer, ")");
+  if(zone->polygon.points){
+    put_line(writer, child, 1);
+    put_text(writer, "(polygon");
+    put_line(writer, child, 2);
+    put_pts(writer, child, 2, &zone->polygon);
+    put_line(writer, child, 1);
+    put_text(writer, ")");
+  }
+  if(zone->filled_polygon.points){
+    put_line(writer, child, 1);
+    put_filled_polygons(writer, child, 1, zone);
+  }
+  put_line(writer, child, 0);
+  put_text(writer, ")");
+}
+
+static void put_footprint(struct Writer *writer, const struct Child *child, struct Footprint *footprint){
+  static const char *types[] = {"smd", "thru_hole", "smd", "connect", "np_thru_hole"};
+  static const char *shapes[] = {"rect", "circle", "rect", "oval", "trapezoid", "roundrect", "custom"};
+  put_text(writer, "(footprint ");
+  put_string(writer, &footprint->library_link);
+  put_line(writer, child, 1);
+  put_text(writer, "(layer ");
+  put_layer(writer, footprint->layer);
+  put_text(writer, ")");
+  put_uuid(writer, child, 1, footprint->uuid);
+  put_line(writer, child, 1);
+  put_at(writer, footprint->at);
+  // Pads are pushed, walk from the tail to keep their order
+  struct Pad *pad = footprint->pads;
+  while(pad && pad->next){
+    pad = pad->next;
+  }
+  for(; pad; pad = pad->prev){
+    put_line(writer, child, 1);
+    put_text(writer, "(pad ");
+    put_string(writer, &pad->num);
+    put_text(writer, " ");
+    put_text(writer, types[pad->type >= THRU_HOLE && pad->type <= NP_THRU_HOLE ? pad->type : SMD]);
+    put_text(writer, " ");
+    put_text(writer, shapes[pad->shape >= CIRCLE && pad->shape <= CUSTOM ? pad->shape : RECT]);
+    put_line(writer, child, 2);
+    put_at(writer, pad->at);
+    put_line(writer, child, 2);
+    put_point(writer, "size", (struct Point){pad->size.width, pad->size.height});
+    put_line(writer, child, 2);
+    put_layers(writer, pad->layers, pad->layer_count);
+    if(pad->shape == ROUNDRECT){
+      put_line(writer, child, 2);
+      put_value(writer, "roundrect_rratio", pad->roundrect_rratio);
+    }
+    if(pad->net){
+      put_line(writer, child, 2);
+      put_net(writer, pad->net, TRUE);
+    }
+    put_uuid(writer, child, 2, pad->uuid);
+    put_line(writer, child, 1);
+    put_text(writer, ")");
+  }
+  put_line(writer, child, 0);
+  put_text(writer, ")");
+}
+
+static int compare_items(const void *_1, const void *_2){
+  uint64_t a_1 = ((const struct Writer_Item *)_1)->start, a_2 = ((const struct Writer_Item *)_2)->start;
+  return (a_1 > a_2) - (a_1 < a_2);
+}
+
+static void put_item(struct Writer *writer, const struct Child *child, int kind, void *item){
+  struct Zone_Fill_State state = {item, FALSE};
+  replace_child(writer, child);
+  if(kind == WRITE_FOOTPRINT){
+    splice(writer, child->start, child->end, footprint_field, item);
+  }else if(kind == WRITE_TRACK){
+    splice(writer, child->start, child->end, track_field, item);
+  }else{
+    splice(writer, child->start, child->end, zone_field, &state);
+  }
+}
+
+// Items added since parsing have no span, lists are pushed so walking from
+// the tail writes them in the order they were added
+static void put_new_items(struct Writer *writer, const struct Child *child){
+  struct Footprint *footprint = pcb->footprints;
+  struct Track *track = pcb->tracks;
+  struct Zone *zone = pcb->zones;
+  for(; footprint && footprint->next; footprint = footprint->next);
+  for(; track && track->next; track = track->next);
+  for(; zone && zone->next; zone = zone->next);
+  for(; footprint; footprint = footprint->prev){
+    if(footprint->index.section_end == 0 && footprint->index.set == SECTION_MODIFIED){
+      put_line(writer, child, 0);
+      put_footprint(writer, child, footprint);
+    }
+  }
+  for(; track; track = track->prev){
+    if(track->index.section_end == 0 && track->index.set == SECTION_MODIFIED){
+      put_line(writer, child, 0);
+      put_track(writer, child, track);
+    }
+  }
+  for(; zone; zone = zone->prev){
+    if(zone->index.section_end == 0 && zone->index.set == SECTION_MODIFIED){
+      put_line(writer, child, 0);
+      put_zone(writer, child, zone);
+    }
+  }
+}
+
+static int board_field(struct Writer *writer, const struct Child *child, void *context){
+  struct Board_Items *board = context;
+  static const char *keywords[] = {"footprint", "segment", "via", "arc", "zone"};
+  static const int kinds[] = {WRITE_FOOTPRINT, WRITE_TRACK, WRITE_TRACK, WRITE_TRACK, WRITE_ZONE};
+  if(child->closing){
+    put_new_items(writer, child);
+    return CHILD_KEEP;
+  }
+  for(int i = 0; i < 5; i++){
+    if(!keyword_is(writer->source, child->start, keywords[i])){
+      continue;
+    }
+    struct Writer_Item key = {child->start, 0, NULL};
+    struct Writer_Item *found = bsearch(&key, board->items, board->count, sizeof(struct Writer_Item), compare_items);
+    if(found == NULL || found->kind != kinds[i]){
+      return CHILD_DROPPED;
+    }
+    // The index is the first member of every item
+    if(((struct Section_Index *)found->item)->set != SECTION_MODIFIED){
+      return CHILD_KEEP;
+    }
+    put_item(writer, child, found->kind, found->item);
+    return CHILD_REPLACED;
+  }
+  return CHILD_KEEP;
+}
+
+// Footprints, tracks and zones that came from the source, by position
+static struct Board_Items collect_items(){
+  struct Board_Items board = {NULL, 0};
+  int count = 0;
+  for(struct Footprint *footprint = pcb->footprints; footprint; footprint = footprint->next, count++);
+  for(struct Track *track = pcb->tracks; track; track = track->next, count++);
+  for(struct Zone *zone = pcb->zones; zone; zone = zone->next, count++);
+  board.items = calloc(count ? count : 1, sizeof(struct Writer_Item));
+  for(struct Footprint *footprint = pcb->footprints; footprint; footprint = footprint->next){
+    if(footprint->index.section_end){
+      board.items[board.count++] = (struct Writer_Item){footprint->index.section_start, WRITE_FOOTPRINT, footprint};
+    }
+  }
+  for(struct Track *track = pcb->tracks; track; track = track->next){
+    if(track->index.section_end){
+      board.items[board.count++] = (struct Writer_Item){track->index.section_start, WRITE_TRACK, track};
+    }
+  }
+  for(struct Zone *zone = pcb->zones; zone; zone = zone->next){
+    if(zone->index.section_end){
+      board.items[board.count++] = (struct Writer_Item){zone->index.section_start, WRITE_ZONE, zone};
+    }
+  }
+  qsort(board.items, board.count, sizeof(struct Writer_Item), compare_items);
+  return board;
+}
+
+static int write_all(int fd, struct iovec *iov, int count){
+  while(count > 0){
+    ssize_t written = writev(fd, iov, count > WRITER_IOV ? WRITER_IOV : count);
+    if(written < 0){
+      return ERROR;
+    }
+    while(count > 0 && (size_t)written >= iov->iov_len){
+      written -= iov->iov_len;
+      iov++;
+      count--;
+    }
+    if(count > 0){
+      iov->iov_base = (char *)iov->iov_base + written;
+      iov->iov_len -= written;
+    }
+  }
+  return SUCCESS;
+}
+
+// Writes the board to path through a temporary file next to it, so a
+// failed write leaves any old file in place
+int write_pcb(const char *path){
+  struct Writer writer = {pcb->source.chars, NULL, 0, 0, NULL};
+  uint64_t start = pcb->kicad_pcb.section_start, end = pcb->kicad_pcb.section_end;
+  int status = ERROR;
+  if(writer.source == NULL || end == 0){
+    printf("Board has no source to write from\n");
+    return ERROR;
+  }
+  struct Board_Items board = collect_items();
+  copy_source(&writer, 0, start);
+  splice(&writer, start, end, board_field, &board);
+  copy_source(&writer, end + 1, pcb->source.length);
+
+  char temp_path[4096];
+  snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+  int fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if(fd < 0){
+    perror(temp_path);
+  }else{
+    status = write_all(fd, writer.iov, writer.iov_count);
+    if(close(fd) != 0 || status == ERROR){
+      perror(temp_path);
+      remove(temp_path);
+      status = ERROR;
+    }else if(rename(temp_path, path) != 0){
+      perror(path);
+      remove(temp_path);
+      status = ERROR;
+    }
+  }
+
+  while(writer.chunk){
+    struct Writer_Chunk *chunk = writer.chunk;
+    writer.chunk = chunk->next;
+    free(chunk->chars);
+    free(chunk);
+  }
+  free(writer.iov);
+  free(board.items);
+  return status;
+}
+
+// Number formatting
+
+static int put_digits(char *out, uint64_t value, int minimum){
+  char digits[24];
+  int count = 0;
+  do{
+    digits[count++] = '0' + value % 10;
+    value /= 10;
+  }while(value || count < minimum);
+  for(int i = 0; i < count; i++){
+    out[i] = digits[count - 1 - i];
+  }
+  return count;
+}
+
+int format_int(char *out, int64_t value){
+  int length = 0;
+  if(value < 0){
+    out[length++] = '-';
+    return length + put_digits(out + length, -(uint64_t)value, 1);
+  }
+  return put_digits(out, value, 1);
+}
+
+// Shortest fixed point decimal that reads back as the same float, KiCad
+// takes no exponents. Exact from 1e-6 up, smaller values keep what fits in
+// 18 places. Returns the length, out needs room for 48 characters.
+int format_float(char *out, float value){
+  static const double powers[] = {1, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18};
+  double magnitude = fabs((double)value);
+  int length = 0, places = 0;
+  uint64_t scaled = 0;
+  if(isnan(value) || isinf(value)){
+    out[0] = '0';
+    return 1;
+  }
+  if(magnitude >= 1e18){
+    scaled = (uint64_t)1e18;
+  }else{
+    for(int i = 0; i <= 18 && magnitude * powers[i] < 1e18; i++){
+      places = i;
+      scaled = (uint64_t)llround(magnitude * powers[i]);
+      if((float)(scaled / powers[i]) == (float)magnitude){
+        break;
+      }
+    }
+  }
+  if(scaled == 0){
+    out[0] = '0';
+    return 1;
+  }
+  if(value < 0){
+    out[length++] = '-';
+  }
+  uint64_t whole = scaled / (uint64_t)powers[places], fraction = scaled % (uint64_t)powers[places];
+  for(; places && fraction % 10 == 0; places--){
+    fraction /= 10;
+  }
+  length += put_digits(out + length, whole, 1);
+  if(places){
+    out[length++] = '.';
+    length += put_digits(out + length, fraction, places);
+  }
+  return length;
+}
@@ -0,0 +1,211 @@
+// Fixture boards in tests/ checked through libsolver, run from the
+// repository root with make test. Each check prints where it failed and
+// the run exits non zero when any did.
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/libsolver.h"
+
+#define REPORT "bld/tests/report.txt"
+
+static int checks, failures;
+
+#define CHECK(condition) check(condition, #condition, __FILE__, __LINE__)
+#define NEAR(value, expected, tolerance) check(fabs((double)(value) - (expected)) <= (tolerance), #value " near " #expected, __FILE__, __LINE__)
+
+static void check(int passed, const char *text, const char *file, int line){
+  checks++;
+  if(!passed){
+    failures++;
+    printf("%s:%d: failed %s\n", file, line, text);
+  }
+}
+
+static struct Board *open_fixture(const char *path){
+  struct Board *board = solver_open(path);
+  check(board != NULL, path, __FILE__, __LINE__);
+  return board;
+}
+
+// The courtyard report row for a pair either way round, state is overlap
+// or gap. Returns 1 when found.
+static int courtyard_row(const char *ref_1, const char *ref_2, char *state, float *gap, double *area){
+  FILE *report = fopen(REPORT, "r");
+  char line[256], name_1[64], name_2[64], side[16];
+  int found = 0;
+  while(report && !found && fgets(line, sizeof(line), report)){
+    *area = 0;
+    if(sscanf(line, "%63s %63s %15s %15s %f mm area %lf", name_1, name_2, side, state, gap, area) < 5){
+      continue;
+    }
+    found = (strcmp(name_1, ref_1) == 0 && strcmp(name_2, ref_2) == 0) || (strcmp(name_1, ref_2) == 0 && strcmp(name_2, ref_1) == 0);
+  }
+  if(report){
+    fclose(report);
+  }
+  return found;
+}
+
+// Two 4x2 fp_rect parts sharing 1x1.5 mm, an L shaped fp_poly with a part
+// in its notch 2 mm clear, another L with a part 0.1 mm off its inner
+// corner and one inside its arm, and an fp_circle crossed by 0.1 mm
+static void test_courtyards(void){
+  struct Board *board = open_fixture("tests/courtyard.kicad_pcb");
+  if(board == NULL){
+    return;
+  }
+  CHECK(solver_check_courtyards(board, 0.25, 0, 2, REPORT) == 4);
+  char state[16];
+  float gap;
+  double area;
+  CHECK(courtyard_row("U1", "U2", state, &gap, &area) && strcmp(state, "overlap") == 0);
+  NEAR(gap, 1.0, 1e-4);
+  NEAR(area, 1.5, 1e-4);
+  CHECK(!courtyard_row("U3", "U4", state, &gap, &area));
+  CHECK(courtyard_row("U5", "U6", state, &gap, &area) && strcmp(state, "gap") == 0);
+  NEAR(gap, 0.1, 1e-4);
+  CHECK(courtyard_row("U5", "U7", state, &gap, &area) && strcmp(state, "overlap") == 0);
+  NEAR(gap, 0.5, 1e-4);
+  NEAR(area, 1.0, 1e-4);
+  // The circle's chords cut the exact 0.0587 mm^2 segment a little short
+  CHECK(courtyard_row("U8", "U9", state, &gap, &area) && strcmp(state, "overlap") == 0);
+  NEAR(area, 0.0587, 0.01);
+  solver_close(board);
+}
+
+// A 40x30 board with a gr_poly cutout that is a 10x10 square and a half
+// disc of radius 5 from an arc in its pts, a footprint fp_circle hole of
+// radius 2 and a 4x2 fp_rect slot on a footprint turned 90 degrees
+static void test_outline(void){
+  struct Board *board = open_fixture("tests/outline.kicad_pcb");
+  if(board == NULL){
+    return;
+  }
+  double area;
+  float box[4];
+  int cutouts, open_chains;
+  CHECK(solver_board_outline(board, 0, &area, box, &cutouts, &open_chains) == 4);
+  CHECK(cutouts == 3 && open_chains == 0);
+  // Chords keep the holes a little under 1200 - 100 - 12.5 pi - 4 pi - 8
+  NEAR(area, 1040.1637, 0.2);
+  CHECK(solver_board_contains(board, 5, 5));
+  CHECK(!solver_board_contains(board, 24, 15));
+  CHECK(!solver_board_contains(board, 32, 22));
+  CHECK(!solver_board_contains(board, 8, 26.5));
+  CHECK(solver_board_contains(board, 9.5, 25));
+  CHECK(!solver_board_contains(board, 41, 15));
+  solver_close(board);
+}
+
+// A 0.35 mm trace on F.Cu over 0.2 mm of epsilon_r 4.2 to a B.Cu plane,
+// 35 um copper. Hammerstad and Jensen with the thickness correction give
+// 52.43 ohm, the field solver should land within a few percent of it.
+static void test_impedance(void){
+  struct Board *board = open_fixture("tests/microstrip.kicad_pcb");
+  if(board == NULL){
+    return;
+  }
+  struct Track *track = solver_next_track(board, NULL);
+  CHECK(track != NULL);
+  if(track){
+    double closed = solver_track_impedance(board, track, 0), field = solver_track_impedance(board, track, 1);
+    NEAR(closed, 52.43, 0.01);
+    NEAR(field / closed, 1.0, 0.05);
+  }
+  solver_close(board);
+}
+
+// The first report row listing aggressor under a victim, next and fext in
+// percent. Returns 1 when found.
+static int crosstalk_row(const char *aggressor, float *spacing, float *next, float *fext){
+  FILE *report = fopen(REPORT, "r");
+  char line[256], name[64];
+  float length;
+  int found = 0;
+  while(report && !found && fgets(line, sizeof(line), report)){
+    found = line[0] == ' ' && sscanf(line, "%63s %f mm at %f mm next %f%% fext %f%%", name, &length, spacing, next, fext) == 5 && strcmp(name, aggressor) == 0;
+  }
+  if(report){
+    fclose(report);
+  }
+  return found;
+}
+
+// Striplines on In1.Cu 0.2 mm from planes either side, A and B 0.2 mm
+// apart centre to centre, C and D 0.4 mm, so D/H is 1 and 2 and k is 0.5
+// and 0.2. Coupled 50 mm at 0.1 ns rise time the near end saturates at
+// k / 2 and a stripline has no far end crosstalk.
+static void test_crosstalk(void){
+  struct Board *board = open_fixture("tests/crosstalk.kicad_pcb");
+  if(board == NULL){
+    return;
+  }
+  double worst = 0;
+  CHECK(solver_check_crosstalk(board, 0.5, 0.1, 0, 2, REPORT, &worst) == 4);
+  NEAR(worst, 0.25, 1e-4);
+  float spacing, next, fext;
+  CHECK(crosstalk_row("B", &spacing, &next, &fext));
+  NEAR(spacing, 0.1, 1e-4);
+  NEAR(next, 25.0, 0.01);
+  NEAR(fext, 0, 0.01);
+  CHECK(crosstalk_row("D", &spacing, &next, &fext));
+  NEAR(next, 10.0, 0.01);
+  NEAR(fext, 0, 0.01);
+  solver_close(board);
+}
+
+// 60 vias, hole i at 10 + (37i mod 60) / 2, 10 + (23i mod 17) / 2 with
+// a 0.3 mm drill when i is even and 0.4 mm when odd. Each tool in PTH.drl
+// must visit its holes once each, in an order no longer than the seed.
+static void test_drills(void){
+  struct Board *board = open_fixture("tests/drill.kicad_pcb");
+  if(board == NULL){
+    return;
+  }
+  double seed = 0, travel = 0;
+  CHECK(solver_export_drills(board, "bld/tests", 2, &seed, &travel) == 60);
+  CHECK(travel > 0 && travel <= seed);
+  int visits[60] = {0}, tool = 0, hits = 0, misplaced = 0;
+  FILE *file = fopen("bld/tests/PTH.drl", "r");
+  char line[128];
+  while(file && fgets(line, sizeof(line), file)){
+    float x, y;
+    if(line[0] == 'T' && strchr(line, 'C') == NULL){
+      tool = atoi(line + 1);
+    }else if(sscanf(line, "X%fY%f", &x, &y) == 2){
+      hits++;
+      int found = -1;
+      for(int i = 0; i < 60 && found < 0; i++){
+        found = fabsf(x - (10 + (i * 37 % 60) * 0.5f)) < 1e-3f && fabsf(-y - (10 + (i * 23 % 17) * 0.5f)) < 1e-3f ? i : -1;
+      }
+      // T1 is the 0.3 mm tool
+      if(found < 0 || (found % 2) != (tool == 2)){
+        misplaced++;
+      }else{
+        visits[found]++;
+      }
+    }
+  }
+  if(file){
+    fclose(file);
+  }
+  CHECK(hits == 60 && misplaced == 0);
+  int once = 0;
+  for(int i = 0; i < 60; i++){
+    once += visits[i] == 1;
+  }
+  CHECK(once == 60);
+  solver_close(board);
+}
+
+int main(int argc, char **argv){
+  test_drills();
+  test_impedance();
+  test_crosstalk();
+  test_outline();
+  test_courtyards();
+  solver_cleanup();
+  printf("%d checks, %d failed\n", checks, failures);
+  return failures != 0;
+}